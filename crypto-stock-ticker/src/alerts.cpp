@@ -0,0 +1,219 @@
+#include "alerts.h"
+#include "json_fixed.h"
+#include <LittleFS.h>
+
+AlertStats alertStats;
+
+static AlertRule rules[MAX_ALERT_RULES];
+static int ruleCount = 0;
+
+// First rule per asset slot, so an update only touches that asset's rules
+static int16_t ruleHeads[MAX_ASSETS];
+
+struct AlertQueue {
+  AlertEvent events[ALERT_QUEUE_SIZE];
+  uint8_t head;
+  uint8_t count;
+};
+
+static AlertQueue displayQueue;
+static AlertQueue notifyQueue;
+static uint32_t tickAccumUs = 0;
+
+static bool queuePush(AlertQueue &queue, const AlertEvent &event) {
+  if(queue.count >= ALERT_QUEUE_SIZE) return false;
+  queue.events[(queue.head + queue.count) % ALERT_QUEUE_SIZE] = event;
+  queue.count++;
+  return true;
+}
+
+static bool queuePop(AlertQueue &queue, AlertEvent &event) {
+  if(queue.count == 0) return false;
+  event = queue.events[queue.head];
+  queue.head = (queue.head + 1) % ALERT_QUEUE_SIZE;
+  queue.count--;
+  return true;
+}
+
+static int addRule(int slot, AlertType type, Fixed threshold, Fixed hysteresis,
+                   uint32_t windowSec, uint32_t cooldownSec) {
+  if(ruleCount >= MAX_ALERT_RULES) return -1;
+  AlertRule &rule = rules[ruleCount];
+  memset(&rule, 0, sizeof(rule));
+  rule.slot = slot;
+  rule.type = type;
+  rule.threshold = threshold;
+  rule.hysteresis = hysteresis;
+  rule.windowSec = windowSec;
+  rule.cooldownMs = cooldownSec * 1000UL;
+
+  // Prepend to the asset's list
+  rule.next = ruleHeads[slot];
+  ruleHeads[slot] = ruleCount;
+  return ruleCount++;
+}
+
+int alertsLoad(const char *path) {
+  ruleCount = 0;
+  for(int i = 0; i < MAX_ASSETS; i++) ruleHeads[i] = -1;
+
+  File file = LittleFS.open(path, "r");
+  if(!file) return 0;
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  if(error) {
+    Serial.printf("[Alerts] %s parse error: %s\n", path, error.c_str());
+    return 0;
+  }
+
+  for(JsonObjectConst def : doc["rules"].as<JsonArrayConst>()) {
+    const char *id = def["asset"] | "";
+    int slot = registryFind(id);
+    if(slot < 0) {
+      Serial.printf("[Alerts] Unknown asset '%s'\n", id);
+      continue;
+    }
+
+    Fixed hysteresis = jsonFixed(def["hysteresis"], Fixed::fromRaw(0));
+    uint32_t cooldown = def["cooldown"] | ALERT_DEFAULT_COOLDOWN_SEC;
+    int added;
+    if(!def["above"].isNull()) {
+      added = addRule(slot, ALERT_ABOVE, jsonFixed(def["above"], Fixed::fromRaw(0)), hysteresis, 0, cooldown);
+    } else if(!def["below"].isNull()) {
+      added = addRule(slot, ALERT_BELOW, jsonFixed(def["below"], Fixed::fromRaw(0)), hysteresis, 0, cooldown);
+    } else if(!def["move"].isNull()) {
+      Fixed move = jsonFixed(def["move"], Fixed::fromRaw(0));
+      if(move.isNegative()) move = -move;
+      added = addRule(slot, ALERT_MOVE, move, hysteresis, def["window"] | 900, cooldown);
+    } else {
+      Serial.printf("[Alerts] Rule for '%s' has no above/below/move\n", id);
+      continue;
+    }
+    if(added < 0) {
+      Serial.println("[Alerts] Rule table full");
+      break;
+    }
+  }
+
+  return ruleCount;
+}
+
+// Percent move from the newest sample at least windowSec old; false if the
+// history doesn't reach back that far yet.
+static bool percentMove(const Asset &asset, uint32_t windowSec, Fixed &move) {
+  const PriceHistory &history = registryHistory(asset);
+  int count = history.filled ? HISTORY_SIZE : history.index;
+  if(count < 2) return false;
+
+  int newest = (history.index + HISTORY_SIZE - 1) % HISTORY_SIZE;
+  if(history.times[newest] < windowSec) return false;  // clock not synced yet
+  uint32_t cutoff = history.times[newest] - windowSec;
+  for(int i = 1; i < count; i++) {
+    int idx = (newest + HISTORY_SIZE - i) % HISTORY_SIZE;
+    if(history.times[idx] <= cutoff) {
+      move = fixedPercentChange(history.prices[idx], asset.price);
+      return true;
+    }
+  }
+  return false;
+}
+
+void alertsBeginTick() {
+  tickAccumUs = 0;
+}
+
+void alertsEndTick() {
+  uint32_t elapsed = tickAccumUs;
+  alertStats.tickUs = elapsed;
+  if(elapsed > alertStats.maxTickUs) alertStats.maxTickUs = elapsed;
+  if(elapsed > ALERT_EVAL_BUDGET_US) {
+    alertStats.overBudgetTicks++;
+    Serial.printf("[Alerts] Tick took %lu us (budget %d us)\n", (unsigned long)elapsed, ALERT_EVAL_BUDGET_US);
+  }
+}
+
+void alertsEvaluate(int slot, unsigned long nowMs) {
+  if(slot < 0 || slot >= MAX_ASSETS || ruleCount == 0) return;
+  unsigned long start = micros();
+  const Asset &asset = assets[slot];
+
+  for(int16_t i = ruleHeads[slot]; i >= 0; i = rules[i].next) {
+    AlertRule &rule = rules[i];
+    alertStats.evaluations++;
+
+    // triggered: condition holds now; rearm: far enough back past the threshold
+    bool triggered;
+    bool rearm;
+    Fixed value = rule.threshold;
+    if(rule.type == ALERT_ABOVE) {
+      triggered = asset.price >= rule.threshold;
+      rearm = asset.price < rule.threshold - rule.hysteresis;
+    } else if(rule.type == ALERT_BELOW) {
+      triggered = asset.price <= rule.threshold;
+      rearm = asset.price > rule.threshold + rule.hysteresis;
+    } else {
+      Fixed move;
+      if(!percentMove(asset, rule.windowSec, move)) continue;
+      Fixed magnitude = move.isNegative() ? -move : move;
+      triggered = magnitude >= rule.threshold;
+      rearm = magnitude < rule.threshold - rule.hysteresis;
+      value = move;
+    }
+
+    // A condition that already holds at boot is not a crossing
+    if(!rule.primed) {
+      rule.primed = true;
+      rule.armed = !triggered;
+      continue;
+    }
+
+    if(!triggered) {
+      if(rearm) rule.armed = true;
+      continue;
+    }
+
+    bool coolingDown = rule.hasFired && nowMs - rule.lastFired < rule.cooldownMs;
+    if(!rule.armed || coolingDown) {
+      if(rule.armed) alertStats.suppressed++;
+      continue;
+    }
+
+    rule.armed = false;
+    rule.hasFired = true;
+    rule.lastFired = nowMs;
+    alertStats.fired++;
+
+    AlertEvent event;
+    event.price = asset.price;
+    event.value = value;
+    event.windowSec = rule.windowSec;
+    event.firedAt = nowMs;
+    event.slot = slot;
+    event.type = rule.type;
+    if(!queuePush(displayQueue, event)) alertStats.dropped++;
+    if(!queuePush(notifyQueue, event)) alertStats.dropped++;
+  }
+
+  tickAccumUs += micros() - start;
+}
+
+bool alertsPopDisplay(AlertEvent &event) {
+  return queuePop(displayQueue, event);
+}
+
+bool alertsPopNotify(AlertEvent &event) {
+  return queuePop(notifyQueue, event);
+}
+
+size_t alertsDescribe(const AlertEvent &event, char *buf, size_t len) {
+  char value[24];
+  const char *symbol = assets[event.slot].symbol;
+  if(event.type == ALERT_MOVE) {
+    fixedFormat(value, sizeof(value), event.value, 1, true);
+    return snprintf(buf, len, "%s %s%% in %lum", symbol, value, (unsigned long)(event.windowSec / 60));
+  }
+  fixedFormat(value, sizeof(value), event.value, event.value >= Fixed::fromInt(100) ? 0 : 2);
+  return snprintf(buf, len, "%s %s %s", symbol, event.type == ALERT_ABOVE ? ">" : "<", value);
+}
@@ -0,0 +1,85 @@
+#ifndef ALERTS_H
+#define ALERTS_H
+
+#include "asset_registry.h"
+
+// Price alert rules, evaluated for an asset every time its price updates.
+//
+// /alerts.json:
+//   {"rules": [
+//     {"asset": "bitcoin", "above": 100000, "hysteresis": 500, "cooldown": 600},
+//     {"asset": "bitcoin", "below": 90000},
+//     {"asset": "TSLA", "move": 3, "window": 900, "hysteresis": 0.5}
+//   ]}
+//
+// "asset" is the watchlist id. "move" is a percent change over "window"
+// seconds, in either direction. A rule fires once, then stays disarmed until
+// the price moves back past the threshold by "hysteresis", and never fires
+// again within "cooldown" seconds.
+
+#define MAX_ALERT_RULES 256
+#define ALERT_QUEUE_SIZE 8
+#define ALERTS_PATH "/alerts.json"
+#define ALERT_DEFAULT_COOLDOWN_SEC 300
+#define ALERT_EVAL_BUDGET_US 2000         // per fetch tick, across all rules
+
+enum AlertType : uint8_t {
+  ALERT_ABOVE,
+  ALERT_BELOW,
+  ALERT_MOVE
+};
+
+struct AlertRule {
+  Fixed threshold;          // price for ABOVE/BELOW, percent for MOVE
+  Fixed hysteresis;
+  uint32_t windowSec;       // MOVE lookback
+  uint32_t cooldownMs;
+  unsigned long lastFired;
+  int16_t next;             // next rule for the same asset, -1 at the end
+  uint8_t slot;             // asset registry slot
+  AlertType type;
+  bool armed;
+  bool primed;              // false until the first evaluation sets the armed state
+  bool hasFired;
+};
+
+struct AlertEvent {
+  Fixed price;
+  Fixed value;              // threshold, or the percent move for ALERT_MOVE
+  uint32_t windowSec;
+  unsigned long firedAt;
+  uint8_t slot;
+  AlertType type;
+};
+
+struct AlertStats {
+  uint32_t evaluations;     // rule evaluations since boot
+  uint32_t fired;
+  uint32_t suppressed;      // triggered while armed but cooling down
+  uint32_t dropped;         // events lost to a full queue
+  uint32_t tickUs;          // evaluation time in the last tick
+  uint32_t maxTickUs;
+  uint32_t overBudgetTicks;
+};
+
+extern AlertStats alertStats;
+
+// Load rules from LittleFS (call after the registry is loaded). Returns the rule count.
+int alertsLoad(const char *path);
+
+// Bracket the price updates of one fetch; evaluation time is summed per tick
+// and checked against ALERT_EVAL_BUDGET_US
+void alertsBeginTick();
+void alertsEndTick();
+
+// Evaluate the rules of one asset after its price changed
+void alertsEvaluate(int slot, unsigned long nowMs);
+
+// Fired events, consumed separately by the display and the notifier
+bool alertsPopDisplay(AlertEvent &event);
+bool alertsPopNotify(AlertEvent &event);
+
+// Human-readable description, e.g. "BTC > 100000" or "TSLA +3.2% in 15m"
+size_t alertsDescribe(const AlertEvent &event, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,80 @@
+#include "alloc_check.h"
+
+AllocCheckStats allocCheckStats;
+
+#ifdef ALLOC_CHECK
+
+extern "C" {
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+}
+
+// One slot per task currently inside a scope. The malloc hook only compares
+// task handles, so it needs no lock.
+struct Watch {
+  volatile TaskHandle_t task;
+  volatile uint32_t count;
+  void *volatile firstCaller;
+};
+
+static Watch watches[ALLOC_CHECK_TASKS];
+
+static inline void countAllocation(void *caller) {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  for(int i = 0; i < ALLOC_CHECK_TASKS; i++) {
+    if(watches[i].task != task) continue;
+    if(watches[i].count++ == 0) watches[i].firstCaller = caller;
+    return;
+  }
+}
+
+extern "C" void *__wrap_malloc(size_t size) {
+  countAllocation(__builtin_return_address(0));
+  return __real_malloc(size);
+}
+
+extern "C" void *__wrap_calloc(size_t count, size_t size) {
+  countAllocation(__builtin_return_address(0));
+  return __real_calloc(count, size);
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size) {
+  countAllocation(__builtin_return_address(0));
+  return __real_realloc(ptr, size);
+}
+
+AllocScope::AllocScope(AllocSite &site) : site(site), slot(-1) {
+  if(site.runs++ < ALLOC_CHECK_WARMUP) return;
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  // A nested scope is already covered by the outer one
+  for(int i = 0; i < ALLOC_CHECK_TASKS; i++) {
+    if(watches[i].task == task) return;
+  }
+  for(int i = 0; i < ALLOC_CHECK_TASKS; i++) {
+    // Tasks on both cores may claim a slot at the same time
+    if(__sync_bool_compare_and_swap((void **)&watches[i].task, nullptr, task)) {
+      watches[i].count = 0;
+      watches[i].firstCaller = nullptr;
+      slot = i;
+      return;
+    }
+  }
+}
+
+AllocScope::~AllocScope() {
+  if(slot < 0) return;
+  Watch &watch = watches[slot];
+  uint32_t count = watch.count;
+  void *caller = watch.firstCaller;
+  watch.task = nullptr;
+
+  allocCheckStats.scopes++;
+  if(count == 0) return;
+  allocCheckStats.failures++;
+  allocCheckStats.allocations += count;
+  Serial.printf("[Alloc] FAIL %s: %lu allocations, first from %p\n",
+                site.name, (unsigned long)count, caller);
+}
+
+#endif
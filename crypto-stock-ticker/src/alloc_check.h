@@ -0,0 +1,66 @@
+#ifndef ALLOC_CHECK_H
+#define ALLOC_CHECK_H
+
+#include <Arduino.h>
+
+// Heap allocation check for the render path. Drawing runs every frame for
+// weeks, so it must not touch the heap at all: formatting goes into stack
+// buffers, never String or printf's temporary buffer.
+//
+// Built with -D ALLOC_CHECK and malloc/calloc/realloc wrapped by the linker
+// (the "alloc-check" environment in platformio.ini), every malloc made by a
+// task inside an AllocScope is counted. A scope that allocates after its
+// first ALLOC_CHECK_WARMUP runs logs
+//   [Alloc] FAIL drawAsset: 2 allocations, first from 0x400d5a1c
+// (decode the address with addr2line). Without ALLOC_CHECK both classes are
+// empty and compile away.
+//
+//   void drawAsset(Asset &asset) {
+//     static AllocSite site("drawAsset");
+//     AllocScope check(site);
+//     ...
+
+#define ALLOC_CHECK_WARMUP 2          // runs allowed to do one-time lazy allocations
+#define ALLOC_CHECK_TASKS 2           // tasks that can be inside a scope at once
+
+struct AllocCheckStats {
+  uint32_t scopes;                    // checked runs (after warmup)
+  uint32_t failures;                  // checked runs that allocated
+  uint32_t allocations;               // allocations made in those runs
+};
+
+extern AllocCheckStats allocCheckStats;
+
+#ifdef ALLOC_CHECK
+
+struct AllocSite {
+  const char *name;
+  uint32_t runs;
+
+  explicit AllocSite(const char *name) : name(name), runs(0) {}
+};
+
+class AllocScope {
+ public:
+  explicit AllocScope(AllocSite &site);
+  ~AllocScope();
+
+ private:
+  AllocSite &site;
+  int slot;
+};
+
+#else
+
+struct AllocSite {
+  explicit AllocSite(const char *) {}
+};
+
+class AllocScope {
+ public:
+  explicit AllocScope(AllocSite &) {}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef ASSET_H
+#define ASSET_H
+
+#include <Arduino.h>
+#include "fixed_point.h"
+#include "indicators.h"
+
+// Price history for the sparkline, indicators and move alerts. One ring per
+// registry slot, kept in assetHistory[] beside assets[] (see asset_registry.h).
+#define HISTORY_SIZE 30
+struct PriceHistory {
+  Fixed prices[HISTORY_SIZE];
+  uint32_t times[HISTORY_SIZE];  // epoch seconds of each sample
+  int index;
+  bool filled;
+};
+
+static_assert(INDICATOR_WINDOW == HISTORY_SIZE, "indicator window tracks the history ring");
+
+// Encoder state for the asset's on-flash history log (see history_log.h)
+#define HISTORY_LOG_PENDING_BYTES 64
+struct HistoryLogState {
+  uint32_t lastTime;       // timestamp of the last encoded sample
+  int32_t lastDelta;       // last timestamp delta, for delta-of-delta
+  int64_t lastValue;       // last encoded price (raw Fixed)
+  uint32_t fileBytes;      // bytes currently in the log file
+  uint8_t pending[HISTORY_LOG_PENDING_BYTES];  // encoded samples not yet on flash
+  uint8_t pendingLen;
+  uint8_t pendingCount;
+  bool needsCompaction;    // file has a torn tail or outgrew its budget
+};
+
+#define ASSET_ID_LEN 48
+#define ASSET_SYMBOL_LEN 12
+#define ASSET_NAME_LEN 24
+
+enum AssetKind : uint8_t {
+  ASSET_CRYPTO,
+  ASSET_STOCK
+};
+
+// Enhanced price data structure
+struct Asset {
+  char id[ASSET_ID_LEN];          // CoinGecko coin id, or the ticker for stocks
+  char symbol[ASSET_SYMBOL_LEN];
+  char name[ASSET_NAME_LEN];
+  AssetKind kind;
+  Fixed price;
+  Fixed change24h;     // percent
+  Fixed volume24h;
+  Fixed marketCap;
+  Fixed high24h;
+  Fixed low24h;
+  bool dataValid;
+  unsigned long lastUpdate;
+  IndicatorState indicators;
+  HistoryLogState log;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "asset_registry.h"
+#include "hash.h"
+#include <ArduinoJson.h>
+#include <LittleFS.h>
+
+Asset assets[MAX_ASSETS];
+int assetCount = 0;
+PriceHistory assetHistory[MAX_ASSETS];
+
+uint8_t cryptoSlots[MAX_ASSETS];
+uint8_t stockSlots[MAX_ASSETS];
+int cryptoCount = 0;
+int stockCount = 0;
+
+// Slot per bucket, -1 when empty. Linear probing; load factor stays <= 0.5.
+static int16_t assetIndex[ASSET_INDEX_SIZE];
+static SemaphoreHandle_t assetMutex = nullptr;
+
+void registryClear() {
+  if(assetMutex == nullptr) assetMutex = xSemaphoreCreateMutex();
+  assetCount = 0;
+  cryptoCount = 0;
+  stockCount = 0;
+  for(int i = 0; i < ASSET_INDEX_SIZE; i++) assetIndex[i] = -1;
+}
+
+int registryFind(const char *id) {
+  if(id == nullptr) return -1;
+  uint32_t bucket = fnv1a32(id) & (ASSET_INDEX_SIZE - 1);
+  for(int probe = 0; probe < ASSET_INDEX_SIZE; probe++) {
+    int16_t slot = assetIndex[bucket];
+    if(slot < 0) return -1;
+    if(strcmp(assets[slot].id, id) == 0) return slot;
+    bucket = (bucket + 1) & (ASSET_INDEX_SIZE - 1);
+  }
+  return -1;
+}
+
+int registryAdd(AssetKind kind, const char *id, const char *symbol, const char *name) {
+  if(assetCount >= MAX_ASSETS || id == nullptr || *id == '\0') return -1;
+  // A truncated id would never match the ids in the price responses
+  if(strlen(id) >= ASSET_ID_LEN) return -1;
+  if(registryFind(id) >= 0) return -1;
+
+  int slot = assetCount++;
+  Asset &asset = assets[slot];
+  memset(&asset, 0, sizeof(asset));
+  memset(&assetHistory[slot], 0, sizeof(PriceHistory));
+  strlcpy(asset.id, id, sizeof(asset.id));
+  strlcpy(asset.symbol, symbol ? symbol : id, sizeof(asset.symbol));
+  strlcpy(asset.name, name ? name : "", sizeof(asset.name));
+  asset.kind = kind;
+
+  if(kind == ASSET_CRYPTO) cryptoSlots[cryptoCount++] = slot;
+  else stockSlots[stockCount++] = slot;
+
+  uint32_t bucket = fnv1a32(asset.id) & (ASSET_INDEX_SIZE - 1);
+  while(assetIndex[bucket] >= 0) {
+    bucket = (bucket + 1) & (ASSET_INDEX_SIZE - 1);
+  }
+  assetIndex[bucket] = slot;
+
+  return slot;
+}
+
+static void addFromWatchlist(AssetKind kind, const char *id, const char *symbol, const char *name) {
+  const char *label = kind == ASSET_CRYPTO ? "crypto" : "stock";
+  if(id != nullptr && strlen(id) >= ASSET_ID_LEN) {
+    Serial.printf("[Watchlist] Skipped %s '%.20s...': id longer than %d chars\n", label, id, ASSET_ID_LEN - 1);
+  } else if(registryAdd(kind, id, symbol, name) < 0) {
+    Serial.printf("[Watchlist] Skipped %s '%s'\n", label, id ? id : "?");
+  }
+}
+
+bool registryLoad(const char *path) {
+  registryClear();
+
+  File file = LittleFS.open(path, "r");
+  if(!file) return false;
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  if(error) {
+    Serial.printf("[Watchlist] %s parse error: %s\n", path, error.c_str());
+    return false;
+  }
+
+  for(JsonObjectConst coin : doc["crypto"].as<JsonArrayConst>()) {
+    addFromWatchlist(ASSET_CRYPTO, coin["id"], coin["symbol"], coin["name"]);
+  }
+  for(JsonObjectConst stock : doc["stocks"].as<JsonArrayConst>()) {
+    addFromWatchlist(ASSET_STOCK, stock["symbol"], stock["symbol"], stock["name"]);
+  }
+
+  return assetCount > 0;
+}
+
+void registryLoadDefaults(const WatchlistEntry *entries, int count) {
+  registryClear();
+  for(int i = 0; i < count; i++) {
+    registryAdd(entries[i].kind, entries[i].id, entries[i].symbol, entries[i].name);
+  }
+}
+
+size_t registryCryptoIds(char *buf, size_t len, int page, int pageSize) {
+  if(len == 0) return 0;
+  buf[0] = '\0';
+
+  size_t used = 0;
+  int first = page * pageSize;
+  int last = min(first + pageSize, cryptoCount);
+  for(int i = first; i < last; i++) {
+    const char *id = assets[cryptoSlots[i]].id;
+    size_t needed = strlen(id) + (i > first ? 1 : 0);
+    if(used + needed >= len) break;
+    if(i > first) buf[used++] = ',';
+    strcpy(buf + used, id);
+    used += strlen(id);
+  }
+  return used;
+}
+
+void registryLock() {
+  xSemaphoreTake(assetMutex, portMAX_DELAY);
+}
+
+void registryUnlock() {
+  xSemaphoreGive(assetMutex);
+}
@@ -0,0 +1,69 @@
+#ifndef ASSET_REGISTRY_H
+#define ASSET_REGISTRY_H
+
+#include "asset.h"
+
+// Fixed-capacity watchlist loaded from LittleFS, with an open-addressing hash
+// index from asset id to slot so response parsing is O(1) per coin.
+//
+// /watchlist.json:
+//   {
+//     "crypto": [ {"id": "bitcoin", "symbol": "BTC", "name": "Bitcoin"}, ... ],
+//     "stocks": [ {"symbol": "AAPL", "name": "Apple"}, ... ]
+//   }
+
+// Every slot costs an Asset (408 bytes on the ESP32), its price ring (368)
+// and a fetch job (108), all static. 40 slots keep that near 35 KB, next to
+// the 32 KB fetch body buffer and the alert table; the default watchlist
+// uses 18.
+#define MAX_ASSETS 40
+#define ASSET_INDEX_SIZE 128      // power of two, at least 2x MAX_ASSETS
+#define WATCHLIST_PATH "/watchlist.json"
+
+struct WatchlistEntry {
+  AssetKind kind;
+  const char *id;
+  const char *symbol;
+  const char *name;
+};
+
+extern Asset assets[MAX_ASSETS];
+extern int assetCount;
+
+// Price ring of each slot
+extern PriceHistory assetHistory[MAX_ASSETS];
+
+inline PriceHistory &registryHistory(const Asset &asset) {
+  return assetHistory[&asset - assets];
+}
+
+// Slots of each kind, in watchlist order (used for fetch paging)
+extern uint8_t cryptoSlots[MAX_ASSETS];
+extern uint8_t stockSlots[MAX_ASSETS];
+extern int cryptoCount;
+extern int stockCount;
+
+void registryClear();
+
+// Add an asset; returns its slot, or -1 if the registry is full, or id is a
+// duplicate or too long for ASSET_ID_LEN
+int registryAdd(AssetKind kind, const char *id, const char *symbol, const char *name);
+
+// Replace the registry with the watchlist file. Returns false (and leaves the
+// registry empty) if the file is missing or invalid.
+bool registryLoad(const char *path);
+
+void registryLoadDefaults(const WatchlistEntry *entries, int count);
+
+// Slot for an asset id, or -1
+int registryFind(const char *id);
+
+// Comma-separated CoinGecko ids for one page of the crypto watchlist
+size_t registryCryptoIds(char *buf, size_t len, int page, int pageSize);
+
+// Held while an asset's fields are written or read from another task (web
+// server), so readers never see a half-updated asset
+void registryLock();
+void registryUnlock();
+
+#endif
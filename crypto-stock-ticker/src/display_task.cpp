@@ -0,0 +1,143 @@
+#include "display_task.h"
+#include <Adafruit_SSD1306.h>
+
+DisplayStats displayStats;
+
+#define FRAME_BYTES (DISPLAY_PAGES * DISPLAY_WIDTH)
+
+static TwoWire *bus = nullptr;
+static uint8_t busAddress = 0;
+static SemaphoreHandle_t busMutex = nullptr;     // one transfer on the bus at a time
+
+static TaskHandle_t flushTaskHandle = nullptr;
+static SemaphoreHandle_t bufferMutex = nullptr;  // guards back, pendingPages and pendingInvert
+static uint8_t buffers[2][FRAME_BYTES];
+static uint8_t *back = buffers[0];               // filled by displaySubmit
+static uint8_t *front = buffers[1];              // being sent by the task
+static uint8_t pendingPages = 0;
+static int8_t pendingInvert = -1;                // -1: unchanged
+static bool inverted = false;
+
+static void sendCommands(const uint8_t *commands, size_t len) {
+  bus->beginTransmission(busAddress);
+  bus->write((uint8_t)0x00);  // Co = 0, D/C = 0: command stream
+  bus->write(commands, len);
+  bus->endTransmission();
+}
+
+// Caller holds busMutex
+static void sendPagesLocked(const uint8_t *data, int firstPage, int count) {
+  const uint8_t window[] = {
+    SSD1306_COLUMNADDR, 0, DISPLAY_WIDTH - 1,
+    SSD1306_PAGEADDR, (uint8_t)firstPage, (uint8_t)(firstPage + count - 1)
+  };
+  sendCommands(window, sizeof(window));
+
+  size_t total = (size_t)count * DISPLAY_WIDTH;
+  for(size_t offset = 0; offset < total; offset += DISPLAY_I2C_CHUNK) {
+    size_t n = total - offset < DISPLAY_I2C_CHUNK ? total - offset : DISPLAY_I2C_CHUNK;
+    bus->beginTransmission(busAddress);
+    bus->write((uint8_t)0x40);  // D/C = 1: display data
+    bus->write(data + offset, n);
+    bus->endTransmission();
+  }
+}
+
+void displaySendPages(const uint8_t *data, int firstPage, int count) {
+  xSemaphoreTake(busMutex, portMAX_DELAY);
+  sendPagesLocked(data, firstPage, count);
+  xSemaphoreGive(busMutex);
+}
+
+// Send each run of consecutive pages in mask, then the invert command if any
+static void flush(const uint8_t *frame, uint8_t mask, int8_t invert) {
+  unsigned long start = micros();
+  int page = 0;
+  while(page < DISPLAY_PAGES) {
+    if(!(mask & (1 << page))) {
+      page++;
+      continue;
+    }
+    int first = page;
+    while(page < DISPLAY_PAGES && (mask & (1 << page))) page++;
+    // Released between runs so the tape's frames can go in between
+    displaySendPages(frame + first * DISPLAY_WIDTH, first, page - first);
+  }
+  if(invert >= 0) {
+    uint8_t command = invert ? SSD1306_INVERTDISPLAY : SSD1306_NORMALDISPLAY;
+    xSemaphoreTake(busMutex, portMAX_DELAY);
+    sendCommands(&command, 1);
+    xSemaphoreGive(busMutex);
+  }
+
+  uint32_t elapsed = micros() - start;
+  displayStats.flushes++;
+  displayStats.lastFlushUs = elapsed;
+  if(elapsed > displayStats.maxFlushUs) displayStats.maxFlushUs = elapsed;
+}
+
+static void flushTask(void *param) {
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    xSemaphoreTake(bufferMutex, portMAX_DELAY);
+    uint8_t *frame = back;
+    back = front;
+    front = frame;
+    uint8_t mask = pendingPages;
+    int8_t invert = pendingInvert;
+    pendingPages = 0;
+    pendingInvert = -1;
+    xSemaphoreGive(bufferMutex);
+
+    // Pages left out of mask are stale in the new back buffer, but only
+    // pages copied in by later submits are ever sent from it
+    if(mask != 0 || invert >= 0) flush(front, mask, invert);
+  }
+}
+
+void displayTaskBegin(TwoWire &wire, uint8_t address) {
+  bus = &wire;
+  busAddress = address;
+  bus->setClock(DISPLAY_I2C_HZ);
+  busMutex = xSemaphoreCreateMutex();
+  bufferMutex = xSemaphoreCreateMutex();
+  // Core 0 with the tape task and the WiFi stack, leaving core 1 to loop()
+  xTaskCreatePinnedToCore(flushTask, "display", 2048, nullptr, 1, &flushTaskHandle, 0);
+}
+
+void displaySubmit(const uint8_t *frame, uint8_t pageMask) {
+  unsigned long start = micros();
+
+#ifdef DISPLAY_SYNC_FLUSH
+  flush(frame, pageMask, -1);
+#else
+  xSemaphoreTake(bufferMutex, portMAX_DELAY);
+  if(pendingPages & pageMask) displayStats.merged++;
+  for(int page = 0; page < DISPLAY_PAGES; page++) {
+    if(!(pageMask & (1 << page))) continue;
+    memcpy(back + page * DISPLAY_WIDTH, frame + page * DISPLAY_WIDTH, DISPLAY_WIDTH);
+  }
+  pendingPages |= pageMask;
+  xSemaphoreGive(bufferMutex);
+  xTaskNotifyGive(flushTaskHandle);
+#endif
+
+  uint32_t elapsed = micros() - start;
+  displayStats.lastSubmitUs = elapsed;
+  if(elapsed > displayStats.maxSubmitUs) displayStats.maxSubmitUs = elapsed;
+}
+
+void displaySetInverted(bool invert) {
+  if(invert == inverted) return;
+  inverted = invert;
+
+#ifdef DISPLAY_SYNC_FLUSH
+  flush(nullptr, 0, invert);
+#else
+  xSemaphoreTake(bufferMutex, portMAX_DELAY);
+  pendingInvert = invert;
+  xSemaphoreGive(bufferMutex);
+  xTaskNotifyGive(flushTaskHandle);
+#endif
+}
@@ -0,0 +1,54 @@
+#ifndef DISPLAY_TASK_H
+#define DISPLAY_TASK_H
+
+#include <Wire.h>
+
+// Display service: a task that owns the SSD1306 bus and flushes frames in
+// the background.
+//
+// display.display() used to send the whole 1 KB frame from loop(), blocking
+// fetches and parsing for ~25 ms at 400 kHz (and ~100 ms after Adafruit's
+// driver dropped the bus back to 100 kHz). Instead, loop() draws into the
+// Adafruit buffer as before and calls displaySubmit(): the changed pages are
+// copied into a back buffer and the call returns. The task swaps it with the
+// front buffer and sends the pages at DISPLAY_I2C_HZ. Frames submitted faster
+// than the bus can take them are merged, so the newest content always wins.
+//
+// The tape task sends its own pages through displaySendPages, in turn with
+// the flushes.
+//
+// Build with -D DISPLAY_SYNC_FLUSH to flush from the caller instead, for
+// comparing loop() timings.
+
+#define DISPLAY_WIDTH 128
+#define DISPLAY_PAGES 8               // 8 px rows
+#define DISPLAY_ALL_PAGES 0xFF
+#define DISPLAY_I2C_HZ 800000         // above the 400 kHz spec; fine on the Heltec's short traces
+#define DISPLAY_I2C_CHUNK 64          // data bytes per I2C transaction
+
+struct DisplayStats {
+  uint32_t flushes;
+  uint32_t merged;                    // submits that replaced a frame not yet sent
+  uint32_t lastFlushUs;               // bus time of the last flush
+  uint32_t maxFlushUs;
+  uint32_t lastSubmitUs;              // time the caller spent in displaySubmit
+  uint32_t maxSubmitUs;
+};
+
+extern DisplayStats displayStats;
+
+// Start the flush task. Call after display.begin(); from then on only this
+// module talks to the panel.
+void displayTaskBegin(TwoWire &wire, uint8_t address);
+
+// Queue the pages set in pageMask (bit n = page n) of a 128x64 frame buffer
+void displaySubmit(const uint8_t *frame, uint8_t pageMask = DISPLAY_ALL_PAGES);
+
+// Inverted video, sent with the next flush
+void displaySetInverted(bool inverted);
+
+// Send pages [firstPage, firstPage + count) of page-major data right away
+// from the calling task
+void displaySendPages(const uint8_t *data, int firstPage, int count);
+
+#endif
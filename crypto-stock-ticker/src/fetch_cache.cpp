@@ -0,0 +1,108 @@
+#include "fetch_cache.h"
+#include "hash.h"
+
+FetchStats fetchStats;
+
+static const char *CACHE_HEADERS[] = {"ETag", "Last-Modified", "Cache-Control"};
+
+void fetchCacheReset(FetchCache &cache) {
+  memset(&cache, 0, sizeof(cache));
+}
+
+bool fetchCacheIsFresh(const FetchCache &cache, unsigned long now) {
+  return cache.maxAgeMs > 0 && now - cache.fetchedAt < cache.maxAgeMs;
+}
+
+void fetchCachePrepare(FetchCache &cache, HTTPClient &http) {
+  http.collectHeaders(CACHE_HEADERS, sizeof(CACHE_HEADERS) / sizeof(CACHE_HEADERS[0]));
+  if(cache.etag[0]) http.addHeader("If-None-Match", cache.etag);
+  if(cache.lastModified[0]) http.addHeader("If-Modified-Since", cache.lastModified);
+  fetchStats.requests++;
+}
+
+// max-age in seconds from a Cache-Control value; 0 for no-cache/no-store or none
+static uint32_t parseMaxAge(const String &cacheControl) {
+  const char *value = cacheControl.c_str();
+  if(strstr(value, "no-cache") || strstr(value, "no-store")) return 0;
+  const char *maxAge = strstr(value, "max-age=");
+  // strtoul() would read "-1" as ULONG_MAX
+  if(maxAge == nullptr || !isdigit((unsigned char)maxAge[8])) return 0;
+  return strtoul(maxAge + 8, nullptr, 10);
+}
+
+void fetchCacheStore(FetchCache &cache, HTTPClient &http, int httpCode, unsigned long now) {
+  cache.fetchedAt = now;
+  // Clamped before scaling, so a max-age past ~49 days cannot wrap maxAgeMs
+  // and a merely long one cannot hold a price for hours
+  cache.maxAgeMs = min(parseMaxAge(http.header("Cache-Control")), (uint32_t)FETCH_MAX_AGE_CAP_S) * 1000UL;
+
+  if(httpCode == HTTP_CODE_NOT_MODIFIED) {
+    fetchStats.notModified++;
+    fetchStats.savedBytes += cache.bodyBytes;
+    return;
+  }
+
+  // Validators that don't fit are dropped rather than sent back truncated
+  String etag = http.header("ETag");
+  String lastModified = http.header("Last-Modified");
+  if(etag.length() < sizeof(cache.etag)) strlcpy(cache.etag, etag.c_str(), sizeof(cache.etag));
+  else cache.etag[0] = '\0';
+  if(lastModified.length() < sizeof(cache.lastModified)) strlcpy(cache.lastModified, lastModified.c_str(), sizeof(cache.lastModified));
+  else cache.lastModified[0] = '\0';
+}
+
+// Fixed-capacity sink for HTTPClient::writeToStream, which also undoes chunked encoding
+class BodyBuffer : public Stream {
+ public:
+  char data[FETCH_BODY_MAX];
+  size_t len = 0;
+  bool overflow = false;
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t *bytes, size_t n) override {
+    if(len + n > sizeof(data)) {
+      overflow = true;
+      return 0;
+    }
+    memcpy(data + len, bytes, n);
+    len += n;
+    return n;
+  }
+
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+};
+
+static BodyBuffer bodyBuffer;
+
+size_t fetchReadBody(HTTPClient &http, const char **body) {
+  bodyBuffer.len = 0;
+  bodyBuffer.overflow = false;
+  int written = http.writeToStream(&bodyBuffer);
+  if(bodyBuffer.overflow) {
+    Serial.printf("[Fetch] Body larger than %d bytes\n", FETCH_BODY_MAX);
+    return 0;
+  }
+  if(written < 0) return 0;
+  *body = bodyBuffer.data;
+  return bodyBuffer.len;
+}
+
+bool fetchCacheBodyUnchanged(FetchCache &cache, const char *body, size_t len) {
+  uint32_t hash = fnv1a32(body, len);
+  bool unchanged = cache.bodyBytes == len && cache.bodyHash == hash;
+  cache.bodyHash = hash;
+  cache.bodyBytes = len;
+  if(unchanged) {
+    fetchStats.unchangedBodies++;
+    fetchStats.unparsedBytes += len;
+  } else {
+    fetchStats.parses++;
+  }
+  return unchanged;
+}
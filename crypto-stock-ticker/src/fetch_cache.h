@@ -0,0 +1,60 @@
+#ifndef FETCH_CACHE_H
+#define FETCH_CACHE_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+
+// Per-endpoint HTTP validators, so unchanged price data costs as little as possible:
+//   - Cache-Control max-age: don't send the request at all while still fresh
+//   - ETag / Last-Modified: conditional GET, a 304 has no body to download
+//   - body hash: servers without validators still send identical bodies when
+//     nothing changed (e.g. stocks after hours); skip parsing those
+//
+// Bodies are read into one static buffer shared by all fetches instead of a
+// String that grows (and reallocates) with every response, so weeks of
+// fetching don't leave the heap fragmented.
+
+#define FETCH_BODY_MAX 32768          // a 25-coin CoinGecko page is ~25 KB
+#define FETCH_MAX_AGE_CAP_S 300       // longest Cache-Control max-age honoured, in seconds
+
+struct FetchCache {
+  char etag[48];
+  char lastModified[32];
+  uint32_t bodyHash;
+  uint32_t bodyBytes;           // size of the last full body
+  unsigned long fetchedAt;      // millis() of the last response
+  uint32_t maxAgeMs;            // from Cache-Control, 0 if not cacheable
+};
+
+struct FetchStats {
+  uint32_t requests;
+  uint32_t notModified;         // 304 responses
+  uint32_t freshSkips;          // requests not sent, max-age not yet expired
+  uint32_t unchangedBodies;     // 200 with the same body hash, parse skipped
+  uint32_t parses;
+  uint32_t savedBytes;          // body bytes not downloaded (304 / fresh)
+  uint32_t unparsedBytes;       // body bytes downloaded but not parsed
+};
+
+extern FetchStats fetchStats;
+
+// True while the last response's max-age hasn't expired
+bool fetchCacheIsFresh(const FetchCache &cache, unsigned long now);
+
+// Call after http.begin(): registers the response headers to keep and adds
+// If-None-Match / If-Modified-Since when validators are known
+void fetchCachePrepare(FetchCache &cache, HTTPClient &http);
+
+// Call after GET() returned 200 or 304: records validators and max-age
+void fetchCacheStore(FetchCache &cache, HTTPClient &http, int httpCode, unsigned long now);
+
+// Read a 200 response's body into the shared buffer. Returns its length, or 0
+// if the read failed or the body didn't fit. Valid until the next call.
+size_t fetchReadBody(HTTPClient &http, const char **body);
+
+// Hash the body; true if identical to the previous one (and counts the skip)
+bool fetchCacheBodyUnchanged(FetchCache &cache, const char *body, size_t len);
+
+void fetchCacheReset(FetchCache &cache);
+
+#endif
@@ -0,0 +1,202 @@
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+// Decimal fixed-point number: value = raw / FIXED_SCALE.
+//
+// Six decimals keep sub-cent prices exact and still cover +/-9.2 trillion,
+// enough for the largest market caps. All arithmetic and formatting here is
+// integer-only (no soft-float, no printf, no heap), and the header has no
+// Arduino dependencies so it also builds on a host compiler.
+
+#define FIXED_DECIMALS 6
+#define FIXED_SCALE 1000000LL
+
+struct Fixed {
+  int64_t raw;
+
+  static Fixed fromRaw(int64_t raw) {
+    Fixed f;
+    f.raw = raw;
+    return f;
+  }
+
+  static Fixed fromInt(int64_t units) {
+    const int64_t limit = INT64_MAX / FIXED_SCALE;
+    if(units > limit) units = limit;
+    if(units < -limit) units = -limit;
+    return fromRaw(units * FIXED_SCALE);
+  }
+
+  // Only for values that arrive as doubles (JSON); saturates instead of overflowing
+  static Fixed fromDouble(double value) {
+    double scaled = value * (double)FIXED_SCALE;
+    if(!(scaled == scaled)) return fromRaw(0);  // NaN
+    if(scaled >= 9.2e18) return fromRaw(INT64_MAX);
+    if(scaled <= -9.2e18) return fromRaw(-INT64_MAX);
+    return fromRaw(llround(scaled));
+  }
+
+  // Whole units, truncated toward zero
+  int64_t toInt() const { return raw / FIXED_SCALE; }
+  double toDouble() const { return (double)raw / (double)FIXED_SCALE; }
+
+  bool isZero() const { return raw == 0; }
+  bool isNegative() const { return raw < 0; }
+
+  Fixed operator+(Fixed o) const { return fromRaw(raw + o.raw); }
+  Fixed operator-(Fixed o) const { return fromRaw(raw - o.raw); }
+  Fixed operator-() const { return fromRaw(-raw); }
+  Fixed &operator+=(Fixed o) { raw += o.raw; return *this; }
+  Fixed &operator-=(Fixed o) { raw -= o.raw; return *this; }
+
+  bool operator==(Fixed o) const { return raw == o.raw; }
+  bool operator!=(Fixed o) const { return raw != o.raw; }
+  bool operator<(Fixed o) const { return raw < o.raw; }
+  bool operator<=(Fixed o) const { return raw <= o.raw; }
+  bool operator>(Fixed o) const { return raw > o.raw; }
+  bool operator>=(Fixed o) const { return raw >= o.raw; }
+};
+
+static inline uint64_t fixedAbs(int64_t v) {
+  return v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+}
+
+static inline int64_t fixedSigned(uint64_t magnitude, bool negative) {
+  if(magnitude > (uint64_t)INT64_MAX) magnitude = (uint64_t)INT64_MAX;
+  return negative ? -(int64_t)magnitude : (int64_t)magnitude;
+}
+
+// a * b, rounded half away from zero. Splits both operands at FIXED_SCALE so
+// no partial product overflows unless the result itself is out of range.
+static inline Fixed fixedMul(Fixed a, Fixed b) {
+  bool negative = (a.raw < 0) != (b.raw < 0);
+  uint64_t x = fixedAbs(a.raw);
+  uint64_t y = fixedAbs(b.raw);
+  uint64_t xh = x / FIXED_SCALE, xl = x % FIXED_SCALE;
+  uint64_t yh = y / FIXED_SCALE, yl = y % FIXED_SCALE;
+  uint64_t result = xh * yh * FIXED_SCALE + xh * yl + xl * yh +
+                    (xl * yl + FIXED_SCALE / 2) / FIXED_SCALE;
+  return Fixed::fromRaw(fixedSigned(result, negative));
+}
+
+// a / b, rounded half away from zero. Long division one decimal digit at a
+// time; valid while |b| stays below ~1.8 trillion units.
+static inline Fixed fixedDiv(Fixed a, Fixed b) {
+  if(b.raw == 0) return Fixed::fromRaw(0);
+  bool negative = (a.raw < 0) != (b.raw < 0);
+  uint64_t x = fixedAbs(a.raw);
+  uint64_t y = fixedAbs(b.raw);
+  uint64_t result = x / y;
+  uint64_t rem = x % y;
+  for(int i = 0; i < FIXED_DECIMALS; i++) {
+    rem *= 10;
+    result = result * 10 + rem / y;
+    rem %= y;
+  }
+  if(rem * 2 >= y) result++;
+  return Fixed::fromRaw(fixedSigned(result, negative));
+}
+
+// Scale by a small integer ratio, e.g. fixedMulDiv(x, 2, 10) for an EMA alpha
+static inline Fixed fixedMulDiv(Fixed a, int64_t num, int64_t den) {
+  if(den == 0) return Fixed::fromRaw(0);
+  bool negative = (a.raw < 0) != ((num < 0) != (den < 0));
+  uint64_t x = fixedAbs(a.raw);
+  uint64_t n = fixedAbs(num);
+  uint64_t d = fixedAbs(den);
+  uint64_t result = (x / d) * n + ((x % d) * n + d / 2) / d;
+  return Fixed::fromRaw(fixedSigned(result, negative));
+}
+
+// Percentage change from -> to (e.g. 2.5 for +2.5%)
+static inline Fixed fixedPercentChange(Fixed from, Fixed to) {
+  return fixedDiv(fixedMulDiv(to - from, 100, 1), from);
+}
+
+// Write |raw| rounded to `decimals` places into buf (no sign). Returns length.
+static inline size_t fixedFormatDigits(char *buf, size_t len, uint64_t magnitude, int decimals) {
+  if(decimals < 0) decimals = 0;
+  if(decimals > FIXED_DECIMALS) decimals = FIXED_DECIMALS;
+
+  uint64_t divisor = 1;
+  for(int i = decimals; i < FIXED_DECIMALS; i++) divisor *= 10;
+  uint64_t q = magnitude / divisor;
+  if(magnitude % divisor >= (divisor + 1) / 2 && divisor > 1) q++;
+
+  // Build right-to-left in a scratch buffer: up to 19 digits plus a point
+  char tmp[24];
+  size_t n = 0;
+  for(int i = 0; i < decimals; i++) {
+    tmp[n++] = (char)('0' + q % 10);
+    q /= 10;
+  }
+  if(decimals > 0) tmp[n++] = '.';
+  do {
+    tmp[n++] = (char)('0' + q % 10);
+    q /= 10;
+  } while(q > 0);
+
+  if(len == 0) return 0;
+  size_t out = 0;
+  while(n > 0 && out + 1 < len) buf[out++] = tmp[--n];
+  buf[out] = '\0';
+  return out;
+}
+
+// Format with a fixed number of decimals, e.g. "-12.35". Returns length.
+static inline size_t fixedFormat(char *buf, size_t len, Fixed value, int decimals, bool showPlus = false) {
+  if(len < 2) {
+    if(len == 1) buf[0] = '\0';
+    return 0;
+  }
+  size_t n = 0;
+  if(value.raw < 0) buf[n++] = '-';
+  else if(showPlus) buf[n++] = '+';
+  return n + fixedFormatDigits(buf + n, len - n, fixedAbs(value.raw), decimals);
+}
+
+// Compact magnitude with one decimal and a T/B/M/K suffix, e.g. "1.9T";
+// whole units (truncated) below one thousand. Returns length.
+static inline size_t fixedFormatCompact(char *buf, size_t len, Fixed value) {
+  static const char suffixes[] = {'T', 'B', 'M', 'K'};
+  static const uint64_t thresholds[] = {
+    1000000000000ULL * FIXED_SCALE,
+    1000000000ULL * FIXED_SCALE,
+    1000000ULL * FIXED_SCALE,
+    1000ULL * FIXED_SCALE
+  };
+
+  if(len < 2) {
+    if(len == 1) buf[0] = '\0';
+    return 0;
+  }
+
+  size_t n = 0;
+  if(value.raw < 0) buf[n++] = '-';
+  uint64_t magnitude = fixedAbs(value.raw);
+
+  for(int i = 0; i < 4; i++) {
+    // Compare against the rounded value: 999.95K prints as 1.0M, not 1000.0K.
+    // Below 1K the units are truncated, so the K threshold is exact.
+    uint64_t cutoff = thresholds[i];
+    if(i < 3) cutoff -= thresholds[i] / 20000;
+    if(magnitude >= cutoff) {
+      // Rescale so the threshold becomes one unit, keeping FIXED_DECIMALS of precision
+      uint64_t scaled = magnitude / (thresholds[i] / FIXED_SCALE);
+      n += fixedFormatDigits(buf + n, len - n, scaled, 1);
+      if(n + 1 < len) {
+        buf[n++] = suffixes[i];
+        buf[n] = '\0';
+      }
+      return n;
+    }
+  }
+
+  return n + fixedFormatDigits(buf + n, len - n, magnitude - magnitude % FIXED_SCALE, 0);
+}
+
+#endif
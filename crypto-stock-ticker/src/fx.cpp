@@ -0,0 +1,105 @@
+#include "fx.h"
+#include "fetch_cache.h"
+#include "json_fixed.h"
+#include <WiFi.h>
+
+struct CurrencyInfo {
+  const char *code;
+  char glyph;
+};
+
+static const CurrencyInfo CURRENCIES[CCY_COUNT] = {
+  {"USD", '$'},
+  {"EUR", (char)0xEE},    // CP437 epsilon, the closest glyph to a euro sign
+  {"GBP", (char)0x9C}     // CP437 pound sign
+};
+
+static Fixed rates[CCY_COUNT] = {Fixed::fromInt(1)};
+static Currency requested = CCY_USD;
+static Currency active = CCY_USD;
+static Fixed activeRate = Fixed::fromInt(1);     // precomputed multiplier for the render path
+
+static FetchCache fxCache;
+static unsigned long nextRefresh = 0;
+static bool refreshed = false;
+
+static void applyDisplay() {
+  active = rates[requested].isZero() ? CCY_USD : requested;
+  activeRate = rates[active];
+}
+
+static bool fetchRates() {
+  HTTPClient http;
+  http.setTimeout(10000);
+  http.begin(FX_API);
+  fetchCachePrepare(fxCache, http);
+  int httpCode = http.GET();
+  if(httpCode == 200 || httpCode == 304) fetchCacheStore(fxCache, http, httpCode, millis());
+
+  bool ok = httpCode == 304;
+  if(httpCode == 200) {
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, http.getStream());
+    if(!error) {
+      JsonObjectConst values = doc["rates"];
+      for(int i = CCY_USD + 1; i < CCY_COUNT; i++) {
+        Fixed rate = jsonFixed(values[CURRENCIES[i].code], Fixed::fromRaw(0));
+        if(rate > Fixed::fromRaw(0)) rates[i] = rate;
+      }
+      ok = true;
+      Serial.printf("[FX] Rates for %s\n", doc["date"] | "?");
+    } else {
+      fetchCacheReset(fxCache);
+    }
+  }
+  if(!ok) Serial.printf("[FX] HTTP error: %d\n", httpCode);
+
+  http.end();
+  return ok;
+}
+
+bool fxUpdate(unsigned long nowMs) {
+  if(refreshed && (long)(nowMs - nextRefresh) < 0) return false;
+  if(WiFi.status() != WL_CONNECTED) return false;
+
+  bool ok = fetchRates();
+  refreshed = true;
+  nextRefresh = nowMs + (ok ? FX_REFRESH_MS : FX_RETRY_MS);
+  applyDisplay();
+  return true;
+}
+
+unsigned long fxIdleMs(unsigned long nowMs) {
+  if(!refreshed || (long)(nowMs - nextRefresh) >= 0) return 0;
+  return nextRefresh - nowMs;
+}
+
+void fxSetDisplay(Currency currency) {
+  requested = currency < CCY_COUNT ? currency : CCY_USD;
+  applyDisplay();
+  if(active != requested) Serial.printf("[FX] No %s rate yet, showing USD\n", CURRENCIES[requested].code);
+}
+
+Currency fxDisplay() {
+  return active;
+}
+
+Currency fxNext(Currency currency) {
+  return (Currency)((currency + 1) % CCY_COUNT);
+}
+
+Fixed fxToDisplay(Fixed usd) {
+  return active == CCY_USD ? usd : fixedMul(usd, activeRate);
+}
+
+Fixed fxRate(Currency currency) {
+  return currency < CCY_COUNT ? rates[currency] : Fixed::fromRaw(0);
+}
+
+const char *fxCode(Currency currency) {
+  return CURRENCIES[currency < CCY_COUNT ? currency : CCY_USD].code;
+}
+
+char fxGlyph(Currency currency) {
+  return CURRENCIES[currency < CCY_COUNT ? currency : CCY_USD].glyph;
+}
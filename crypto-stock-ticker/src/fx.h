@@ -0,0 +1,46 @@
+#ifndef FX_H
+#define FX_H
+
+#include "fixed_point.h"
+
+// USD exchange rates for display. Prices are always fetched in USD; the OLED
+// converts at render time with one fixed-point multiply, so switching the
+// display currency is instant and costs no extra requests.
+//
+// Rates come from frankfurter.app (ECB reference rates, published once per
+// working day) and are refreshed every FX_REFRESH_MS.
+
+#define FX_API "https://api.frankfurter.app/latest?from=USD&to=EUR,GBP"
+#define FX_REFRESH_MS (6UL * 60 * 60 * 1000)   // rates change once a day
+#define FX_RETRY_MS (10UL * 60 * 1000)         // after a failed refresh
+
+enum Currency : uint8_t {
+  CCY_USD,
+  CCY_EUR,
+  CCY_GBP,
+  CCY_COUNT
+};
+
+// Fetch rates if due (call from loop). Returns true if a request was sent.
+bool fxUpdate(unsigned long nowMs);
+
+// Milliseconds until fxUpdate has work to do
+unsigned long fxIdleMs(unsigned long nowMs);
+
+// Select the display currency. Falls back to USD until its rate is known.
+void fxSetDisplay(Currency currency);
+Currency fxDisplay();
+Currency fxNext(Currency currency);
+
+// USD amount in the display currency
+Fixed fxToDisplay(Fixed usd);
+
+// Rate for a currency (units per USD), zero if unknown
+Fixed fxRate(Currency currency);
+
+const char *fxCode(Currency currency);
+
+// One-character symbol for the display font, with cp437(true): $, ε (for €), £
+char fxGlyph(Currency currency);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// 32-bit FNV-1a. Cheap and good enough for hash-table keys and change detection.
+#define FNV1A32_SEED 2166136261u
+
+static inline uint32_t fnv1a32(const void *data, size_t len, uint32_t hash = FNV1A32_SEED) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for(size_t i = 0; i < len; i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+static inline uint32_t fnv1a32(const char *str) {
+  uint32_t hash = FNV1A32_SEED;
+  while(*str) {
+    hash ^= (uint8_t)*str++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+#endif
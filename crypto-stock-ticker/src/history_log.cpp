@@ -0,0 +1,230 @@
+#include "history_log.h"
+#include "asset_registry.h"
+#include "hash.h"
+#include <LittleFS.h>
+
+#define HISTORY_LOG_MAGIC 0xA7        // first byte of every log file
+#define HISTORY_LOG_MAX_RECORD 15     // worst case: 5-byte + 10-byte varint
+
+static bool logAvailable = false;
+
+// Shared scratch for restore and compaction (only ever used from loop())
+static uint8_t fileBuffer[HISTORY_LOG_MAX_BYTES + HISTORY_LOG_PENDING_BYTES + 1];
+
+// Named by a hash of the registry id, which is unique where symbols are not
+// (and may hold characters a file name should not)
+static void logPath(const Asset &asset, const char *ext, char *out, size_t len) {
+  snprintf(out, len, HISTORY_LOG_DIR "/%08lx.%s", (unsigned long)fnv1a32(asset.id), ext);
+}
+
+// Logs written before the rename were named by symbol; take one over if
+// this asset has no log of its own yet
+static void adoptSymbolLog(const Asset &asset, const char *path) {
+  char legacyPath[40];
+  snprintf(legacyPath, sizeof(legacyPath), HISTORY_LOG_DIR "/%s.bin", asset.symbol);
+  if(LittleFS.exists(legacyPath)) LittleFS.rename(legacyPath, path);
+}
+
+static uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static uint8_t putVarint(uint8_t *out, uint64_t v) {
+  uint8_t n = 0;
+  while(v >= 0x80) {
+    out[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  out[n++] = (uint8_t)v;
+  return n;
+}
+
+// Returns bytes consumed, or 0 if the buffer ends mid-varint
+static uint8_t getVarint(const uint8_t *in, size_t avail, uint64_t &v) {
+  v = 0;
+  for(uint8_t n = 0; n < avail && n < 10; n++) {
+    v |= (uint64_t)(in[n] & 0x7F) << (7 * n);
+    if(!(in[n] & 0x80)) return n + 1;
+  }
+  return 0;
+}
+
+static uint8_t encodeSample(HistoryLogState &state, uint32_t time, int64_t value, uint8_t *out) {
+  int32_t delta = (int32_t)(time - state.lastTime);
+  uint8_t n = putVarint(out, zigzag((int64_t)delta - state.lastDelta));
+  n += putVarint(out + n, zigzag(value - state.lastValue));
+  state.lastTime = time;
+  state.lastDelta = delta;
+  state.lastValue = value;
+  return n;
+}
+
+static void pushHistory(PriceHistory &history, uint32_t time, Fixed price) {
+  history.prices[history.index] = price;
+  history.times[history.index] = time;
+  history.index = (history.index + 1) % HISTORY_SIZE;
+  if(history.index == 0) history.filled = true;
+}
+
+// Rewrite the log from the in-RAM history, which always holds every sample
+// still worth keeping (including any that were only buffered).
+static void compactLog(Asset &asset) {
+  HistoryLogState &state = asset.log;
+  PriceHistory &history = registryHistory(asset);
+
+  state.lastTime = 0;
+  state.lastDelta = 0;
+  state.lastValue = 0;
+  state.pendingLen = 0;
+  state.pendingCount = 0;
+
+  int count = history.filled ? HISTORY_SIZE : history.index;
+  int start = history.filled ? history.index : 0;
+
+  size_t len = 0;
+  fileBuffer[len++] = HISTORY_LOG_MAGIC;
+  for(int i = 0; i < count; i++) {
+    int idx = (start + i) % HISTORY_SIZE;
+    len += encodeSample(state, history.times[idx], history.prices[idx].raw, fileBuffer + len);
+  }
+
+  char path[40];
+  char tmpPath[40];
+  logPath(asset, "bin", path, sizeof(path));
+  logPath(asset, "tmp", tmpPath, sizeof(tmpPath));
+
+  File f = LittleFS.open(tmpPath, "w");
+  if(!f) {
+    state.needsCompaction = true;
+    return;
+  }
+  size_t written = f.write(fileBuffer, len);
+  f.close();
+
+  // rename() replaces the old log atomically, so a power cut leaves one or the other
+  if(written != len || !LittleFS.rename(tmpPath, path)) {
+    LittleFS.remove(tmpPath);
+    state.needsCompaction = true;
+    return;
+  }
+
+  state.fileBytes = len;
+  state.needsCompaction = false;
+}
+
+bool historyLogBegin() {
+  logAvailable = LittleFS.begin(true);
+  if(!logAvailable) {
+    Serial.println("[History] LittleFS mount failed, history will not persist");
+    return false;
+  }
+  if(!LittleFS.exists(HISTORY_LOG_DIR)) {
+    LittleFS.mkdir(HISTORY_LOG_DIR);
+  }
+  return true;
+}
+
+int historyLogRestore(Asset &asset) {
+  HistoryLogState &state = asset.log;
+  memset(&state, 0, sizeof(state));
+  if(!logAvailable) return 0;
+
+  char path[40];
+  logPath(asset, "bin", path, sizeof(path));
+  if(!LittleFS.exists(path)) adoptSymbolLog(asset, path);
+  if(!LittleFS.exists(path)) return 0;
+
+  File f = LittleFS.open(path, "r");
+  if(!f) return 0;
+  size_t len = f.read(fileBuffer, sizeof(fileBuffer));
+  bool oversized = f.available() > 0;
+  f.close();
+
+  state.fileBytes = len;
+  if(len == 0 || fileBuffer[0] != HISTORY_LOG_MAGIC) {
+    state.needsCompaction = true;
+    return 0;
+  }
+
+  int restored = 0;
+  size_t pos = 1;
+  while(pos < len) {
+    uint64_t dod;
+    uint64_t dv;
+    uint8_t a = getVarint(fileBuffer + pos, len - pos, dod);
+    if(a == 0) break;
+    uint8_t b = getVarint(fileBuffer + pos + a, len - pos - a, dv);
+    if(b == 0) break;
+    pos += a + b;
+
+    int32_t delta = state.lastDelta + (int32_t)unzigzag(dod);
+    state.lastTime += delta;
+    state.lastDelta = delta;
+    state.lastValue += unzigzag(dv);
+    pushHistory(registryHistory(asset), state.lastTime, Fixed::fromRaw(state.lastValue));
+    restored++;
+  }
+
+  // A torn append (power lost mid-write) leaves a partial record at the end;
+  // appending after it would corrupt the stream, so rewrite on the next flush.
+  if(pos < len || oversized) state.needsCompaction = true;
+
+  return restored;
+}
+
+void historyLogAppend(Asset &asset, uint32_t time, Fixed price) {
+  HistoryLogState &state = asset.log;
+
+  if(state.pendingLen + HISTORY_LOG_MAX_RECORD > HISTORY_LOG_PENDING_BYTES) {
+    historyLogFlush(asset);
+  }
+  if(state.pendingLen + HISTORY_LOG_MAX_RECORD > HISTORY_LOG_PENDING_BYTES) {
+    // Flash is not accepting writes; drop the buffer and rebuild from RAM later
+    state.pendingLen = 0;
+    state.pendingCount = 0;
+    state.needsCompaction = true;
+  }
+
+  state.pendingLen += encodeSample(state, time, price.raw, state.pending + state.pendingLen);
+  state.pendingCount++;
+
+  if(state.pendingCount >= HISTORY_LOG_FLUSH_SAMPLES) {
+    historyLogFlush(asset);
+  }
+}
+
+void historyLogFlush(Asset &asset) {
+  HistoryLogState &state = asset.log;
+  if(!logAvailable) {
+    state.pendingLen = 0;
+    state.pendingCount = 0;
+    return;
+  }
+
+  if(state.needsCompaction || state.fileBytes + state.pendingLen > HISTORY_LOG_MAX_BYTES) {
+    compactLog(asset);
+    return;
+  }
+  if(state.pendingLen == 0) return;
+
+  char path[40];
+  logPath(asset, "bin", path, sizeof(path));
+  File f = LittleFS.open(path, "a");
+  if(!f) return;
+
+  if(state.fileBytes == 0) {
+    uint8_t magic = HISTORY_LOG_MAGIC;
+    state.fileBytes += f.write(&magic, 1);
+  }
+  size_t written = f.write(state.pending, state.pendingLen);
+  f.close();
+
+  state.fileBytes += written;
+  if(written != state.pendingLen) state.needsCompaction = true;
+  state.pendingLen = 0;
+  state.pendingCount = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef HISTORY_LOG_H
+#define HISTORY_LOG_H
+
+#include "asset.h"
+
+// Flash-backed price history, one append-only file per asset on LittleFS,
+// named by the FNV-1a hash of the asset id (/hist/<8 hex digits>.bin).
+//
+// Each sample is stored as two zigzag varints:
+//   - delta-of-delta of the epoch timestamp (0 for a steady fetch interval -> 1 byte)
+//   - delta of the raw Fixed price (1e-6 units), so values round-trip exactly
+// A steady ticker sample costs 3-5 bytes instead of 8.
+//
+// Samples are batched in RAM and appended in one write every
+// HISTORY_LOG_FLUSH_SAMPLES samples. Once a file outgrows HISTORY_LOG_MAX_BYTES
+// it is rewritten from the in-RAM history (write temp file, then rename).
+
+#define HISTORY_LOG_DIR "/hist"
+#define HISTORY_LOG_FLUSH_SAMPLES 5     // samples buffered before each flash append
+#define HISTORY_LOG_MAX_BYTES 1024      // compact once the file grows past this
+
+// Mount LittleFS (formatting it on first use). Returns false if unavailable.
+bool historyLogBegin();
+
+// Rebuild the asset's price ring from its log file and prime the encoder state.
+// Returns the number of samples restored.
+int historyLogRestore(Asset &asset);
+
+// Record a sample that was just added to the asset's price ring.
+void historyLogAppend(Asset &asset, uint32_t time, Fixed price);
+
+// Write any buffered samples to flash, compacting the file if needed.
+void historyLogFlush(Asset &asset);
+
+#endif
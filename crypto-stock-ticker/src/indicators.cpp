@@ -0,0 +1,133 @@
+#include "indicators.h"
+#include <string.h>
+
+static uint64_t isqrt64(uint64_t value) {
+  uint64_t result = 0;
+  uint64_t bit = 1ULL << 62;
+  while(bit > value) bit >>= 2;
+  while(bit != 0) {
+    if(value >= result + bit) {
+      value -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return result;
+}
+
+// Integer division rounded half away from zero
+static int64_t roundDiv(int64_t num, int64_t den) {
+  return num >= 0 ? (num + den / 2) / den : (num - den / 2) / den;
+}
+
+int32_t indicatorReturnPpm(Fixed from, Fixed to) {
+  if(from.raw <= 0) return 0;
+  int64_t ppm = (to.raw - from.raw) * 1000000LL / from.raw;
+  if(ppm > INT32_MAX) return INT32_MAX;
+  if(ppm < INT32_MIN) return INT32_MIN;
+  return (int32_t)ppm;
+}
+
+void indicatorsReset(IndicatorState &state) {
+  memset(&state, 0, sizeof(state));
+}
+
+static void updateRsi(IndicatorState &state, Fixed price) {
+  Fixed diff = price - state.lastPrice;
+  Fixed gain = diff.isNegative() ? Fixed::fromRaw(0) : diff;
+  Fixed loss = diff.isNegative() ? -diff : Fixed::fromRaw(0);
+
+  // samples counts prices seen before this one, i.e. this is diff number `samples`
+  if(state.samples <= RSI_PERIOD) {
+    state.avgGain += gain;
+    state.avgLoss += loss;
+    if(state.samples == RSI_PERIOD) {
+      state.avgGain = Fixed::fromRaw(roundDiv(state.avgGain.raw, RSI_PERIOD));
+      state.avgLoss = Fixed::fromRaw(roundDiv(state.avgLoss.raw, RSI_PERIOD));
+    }
+  } else {
+    state.avgGain = Fixed::fromRaw(roundDiv(state.avgGain.raw * (RSI_PERIOD - 1) + gain.raw, RSI_PERIOD));
+    state.avgLoss = Fixed::fromRaw(roundDiv(state.avgLoss.raw * (RSI_PERIOD - 1) + loss.raw, RSI_PERIOD));
+  }
+
+  if(state.samples >= RSI_PERIOD) {
+    Fixed total = state.avgGain + state.avgLoss;
+    state.rsi = total.isZero() ? Fixed::fromInt(50)
+                               : fixedDiv(fixedMulDiv(state.avgGain, 100, 1), total);
+  }
+}
+
+static void updateVolatility(IndicatorState &state, const IndicatorWindow &window, Fixed price, bool first) {
+  if(window.evicting && state.returnCount > 0) {
+    int64_t oldest = indicatorReturnPpm(window.evictedPrice, window.evictedNext);
+    state.returnSum -= oldest;
+    state.returnSqSum -= oldest * oldest;
+    state.returnCount--;
+  }
+  if(!first) {
+    int64_t latest = indicatorReturnPpm(state.lastPrice, price);
+    state.returnSum += latest;
+    state.returnSqSum += latest * latest;
+    state.returnCount++;
+  }
+
+  int64_t n = state.returnCount;
+  if(n < 2) {
+    state.volatility = Fixed::fromRaw(0);
+    return;
+  }
+  // Population std dev: sqrt(n*sum(x^2) - sum(x)^2) / n, in ppm; 1 ppm = 100 raw percent units
+  int64_t spread = n * state.returnSqSum - state.returnSum * state.returnSum;
+  if(spread < 0) spread = 0;
+  state.volatility = Fixed::fromRaw(roundDiv((int64_t)isqrt64((uint64_t)spread) * 100, n));
+}
+
+// Each sample is weighted by the volume traded since the previous one, taken
+// as the rise in the rolling 24h volume. A falling total (old trades leaving
+// the 24h window faster than new ones arrive, or a daily reset) counts as no
+// volume, as does the first sample after a gap in volume data.
+static void updateVwap(IndicatorState &state, const IndicatorWindow &window, Fixed price, Fixed volume) {
+  uint16_t &weight = state.weights[window.slot];
+  if(window.evicting) {
+    state.weightedPriceSum -= window.evictedPrice.raw * weight;
+    state.weightSum -= weight;
+  }
+
+  weight = 0;
+  if(volume > Fixed::fromRaw(0)) {
+    if(state.volumeRef.isZero()) state.volumeRef = volume;
+    Fixed traded = volume - state.lastVolume;
+    if(!state.lastVolume.isZero() && traded > Fixed::fromRaw(0)) {
+      int64_t ppm = fixedDiv(traded, state.volumeRef).raw;
+      if(ppm < 1) ppm = 1;
+      if(ppm > UINT16_MAX) ppm = UINT16_MAX;
+      weight = (uint16_t)ppm;
+    }
+  }
+  state.lastVolume = volume;
+
+  state.weightedPriceSum += price.raw * weight;
+  state.weightSum += weight;
+  state.vwap = Fixed::fromRaw(state.weightSum > 0 ? roundDiv(state.weightedPriceSum, state.weightSum) : 0);
+}
+
+void indicatorsUpdate(IndicatorState &state, const IndicatorWindow &window, Fixed price, Fixed volume) {
+  bool first = state.samples == 0;
+
+  if(first) {
+    state.emaFast = price;
+    state.emaSlow = price;
+  } else {
+    state.emaFast += fixedMulDiv(price - state.emaFast, 2, EMA_FAST_PERIOD + 1);
+    state.emaSlow += fixedMulDiv(price - state.emaSlow, 2, EMA_SLOW_PERIOD + 1);
+    updateRsi(state, price);
+  }
+
+  updateVolatility(state, window, price, first);
+  updateVwap(state, window, price, volume);
+
+  state.lastPrice = price;
+  if(state.samples < UINT16_MAX) state.samples++;
+}
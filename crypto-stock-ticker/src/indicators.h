@@ -0,0 +1,60 @@
+#ifndef INDICATORS_H
+#define INDICATORS_H
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+// Streaming technical indicators, updated in O(1) per price sample.
+//
+// The volatility and VWAP windows are the asset's sparkline ring: the caller
+// passes the sample that is about to be overwritten so it can be subtracted
+// from the running sums instead of re-summing the window. VWAP weights each
+// sample by the volume traded since the previous sample (the increase in the
+// rolling 24h volume), so it needs two samples with volume data to start.
+
+#define EMA_FAST_PERIOD 9
+#define EMA_SLOW_PERIOD 21
+#define RSI_PERIOD 14
+#define INDICATOR_WINDOW 30          // must match HISTORY_SIZE
+
+struct IndicatorState {
+  Fixed emaFast;
+  Fixed emaSlow;
+  Fixed avgGain;                     // Wilder-smoothed, seeded with a simple mean
+  Fixed avgLoss;
+  Fixed rsi;                         // 0..100
+  Fixed volatility;                  // std dev of per-sample returns, percent
+  Fixed vwap;
+  Fixed lastPrice;
+  Fixed volumeRef;                   // first non-zero 24h volume; weights are relative to it
+  Fixed lastVolume;                  // 24h volume at the previous sample (0: none)
+  int64_t returnSum;                 // per-sample returns in ppm over the window
+  int64_t returnSqSum;
+  int64_t weightedPriceSum;          // sum of price.raw * weight
+  uint32_t weightSum;
+  uint16_t weights[INDICATOR_WINDOW];  // VWAP weight per ring slot, traded volume in ppm of volumeRef
+  uint16_t samples;                  // saturates at 65535
+  uint8_t returnCount;
+};
+
+// Ring slot context for one update: the slot the new sample goes into and the
+// sample it evicts (only meaningful when the ring was already full).
+struct IndicatorWindow {
+  int slot;
+  bool evicting;
+  Fixed evictedPrice;                // oldest sample, leaving the window
+  Fixed evictedNext;                 // the sample after it (start of the oldest return)
+};
+
+void indicatorsReset(IndicatorState &state);
+
+void indicatorsUpdate(IndicatorState &state, const IndicatorWindow &window, Fixed price, Fixed volume);
+
+inline bool indicatorsEmaReady(const IndicatorState &state) { return state.samples >= EMA_SLOW_PERIOD; }
+inline bool indicatorsRsiReady(const IndicatorState &state) { return state.samples > RSI_PERIOD; }
+inline bool indicatorsVwapReady(const IndicatorState &state) { return state.weightSum > 0; }
+
+// Per-sample return in parts per million, as used for the volatility window
+int32_t indicatorReturnPpm(Fixed from, Fixed to);
+
+#endif
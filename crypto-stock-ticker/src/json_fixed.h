@@ -0,0 +1,14 @@
+#ifndef JSON_FIXED_H
+#define JSON_FIXED_H
+
+#include <ArduinoJson.h>
+#include "fixed_point.h"
+
+// JSON numbers arrive as int64 when integral (exact) or double otherwise
+inline Fixed jsonFixed(JsonVariantConst value, Fixed fallback) {
+  if(value.is<int64_t>()) return Fixed::fromInt(value.as<int64_t>());
+  if(value.is<double>()) return Fixed::fromDouble(value.as<double>());
+  return fallback;
+}
+
+#endif
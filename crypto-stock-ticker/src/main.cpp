@@ -6,6 +6,21 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <time.h>
+#include "alerts.h"
+#include "alloc_check.h"
+#include "asset.h"
+#include "asset_registry.h"
+#include "display_task.h"
+#include "fetch_cache.h"
+#include "fx.h"
+#include "history_log.h"
+#include "json_fixed.h"
+#include "portfolio.h"
+#include "power.h"
+#include "scheduler.h"
+#include "screens.h"
+#include "tape.h"
+#include "web_api.h"
 #include "secrets.h"
 
 // OLED Display configuration for Heltec WiFi Kit 32
@@ -15,6 +30,7 @@
 #define OLED_SCL 15
 #define OLED_RST 16
 #define SCREEN_ADDRESS 0x3C
+#define MODE_BUTTON 0        // PRG button: short press toggles the ticker tape, long press the currency
 
 Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RST);
 
@@ -24,70 +40,73 @@ const long GMT_OFFSET_SEC = -18000;  // EST = -5 hours, adjust for your timezone
 const int DAYLIGHT_OFFSET_SEC = 3600;  // Daylight saving (if applicable)
 
 // Update intervals
-const unsigned long PRICE_UPDATE_INTERVAL = 60000;  // 60 seconds
+const unsigned long PRICE_UPDATE_INTERVAL = 60000;  // 60 seconds for an average asset, less for volatile/on-screen ones
+const int REQUEST_BUDGET_PER_MIN = 12;             // shared by CoinGecko and Yahoo requests
+const unsigned long FETCH_STATS_INTERVAL = 300000; // log fetch counters every 5 minutes
 const unsigned long DISPLAY_ROTATION_INTERVAL = 7000; // 7 seconds per asset (more time to read)
 const unsigned long TIME_UPDATE_INTERVAL = 1000; // Update time display every second
+const unsigned long ALERT_FLASH_DURATION = 6000; // Alert screen preempts the rotation this long
+const unsigned long ALERT_FLASH_INTERVAL = 300;  // Invert toggle period while flashing
+const unsigned long LONG_PRESS_MS = 800;         // Button held this long cycles the display currency
 
-// Price history for sparkline
-#define HISTORY_SIZE 30
-struct PriceHistory {
-  float prices[HISTORY_SIZE];
-  int index;
-  bool filled;
-};
+// Wi-Fi modem sleep and CPU scaling between fetches (see src/power.h). The web
+// dashboard and alerts react up to ~300 ms later while the radio sleeps.
+const bool POWER_SAVING = false;
 
-// Enhanced price data structure
-struct Asset {
-  String symbol;
-  String name;
-  float price;
-  float change24h;
-  float volume24h;
-  float marketCap;
-  float high24h;
-  float low24h;
-  bool dataValid;
-  unsigned long lastUpdate;
-  PriceHistory history;
-};
+// Display mode at boot: false = one asset per screen, true = scrolling ticker tape
+const bool TAPE_MODE_AT_BOOT = false;
 
-// Assets to track - customize this list!
-Asset cryptoAssets[] = {
-  {"BTC", "Bitcoin", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}},
-  {"ETH", "Ethereum", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}},
-  {"SOL", "Solana", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}},
-  {"BNB", "Binance Coin", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}}
-};
+// Display currency at boot (CCY_USD, CCY_EUR or CCY_GBP). Prices are fetched in
+// USD and converted on screen with cached exchange rates.
+const Currency DISPLAY_CURRENCY_AT_BOOT = CCY_USD;
 
-Asset stockAssets[] = {
-  {"AAPL", "Apple", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}},
-  {"GOOGL", "Google", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}},
-  {"TSLA", "Tesla", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}},
-  {"MSFT", "Microsoft", 0, 0, 0, 0, 0, 0, false, 0, {{}, 0, false}}
+// Fallback watchlist when /watchlist.json is missing.
+// To customize, edit data/watchlist.json and upload it with "uploadfs".
+const WatchlistEntry DEFAULT_WATCHLIST[] = {
+  {ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin"},
+  {ASSET_CRYPTO, "ethereum", "ETH", "Ethereum"},
+  {ASSET_CRYPTO, "solana", "SOL", "Solana"},
+  {ASSET_CRYPTO, "binancecoin", "BNB", "Binance Coin"},
+  {ASSET_STOCK, "AAPL", "AAPL", "Apple"},
+  {ASSET_STOCK, "GOOGL", "GOOGL", "Google"},
+  {ASSET_STOCK, "TSLA", "TSLA", "Tesla"},
+  {ASSET_STOCK, "MSFT", "MSFT", "Microsoft"}
 };
 
-const int NUM_CRYPTO = sizeof(cryptoAssets) / sizeof(cryptoAssets[0]);
-const int NUM_STOCKS = sizeof(stockAssets) / sizeof(stockAssets[0]);
-
 int currentDisplayIndex = 0;
-bool showingCrypto = true;
 unsigned long lastDisplayRotation = 0;
-unsigned long lastPriceUpdate = 0;
+
+// Alert currently being flashed on screen
+AlertEvent activeAlert;
+bool alertShowing = false;
+unsigned long alertShownAt = 0;
+unsigned long lastFetchStatsLog = 0;
 unsigned long lastTimeUpdate = 0;
 
+bool tapeMode = TAPE_MODE_AT_BOOT;
+bool buttonWasDown = false;
+unsigned long buttonChangedAt = 0;
+unsigned long buttonPressedAt = 0;
+
 // API endpoints
 const char* CRYPTO_API = "https://api.coingecko.com/api/v3/coins/markets";
 const char* STOCK_API = "https://query1.finance.yahoo.com/v8/finance/chart/";
 
 // Forward declarations
-void updateCryptoPrices();
-void updateStockPrices();
-void drawAsset(Asset &asset, bool isCrypto);
-void addPriceToHistory(Asset &asset, float price);
-void drawSparkline(Asset &asset, int x, int y, int width, int height);
-String formatLargeNumber(float num);
-String formatVolume(float vol);
-String getTrendArrow(float change);
+bool updatePrices();
+int updateCryptoPrices(FetchJob &job);
+int updateStockPrice(FetchJob &job);
+void logFetchStats();
+void displayFocus(int &onScreen, int &upNext);
+unsigned long nextWakeMs(unsigned long now);
+void setTapeMode(bool enabled);
+void cycleCurrency();
+void sendAlertNotifications();
+uint32_t addPriceToHistory(Asset &asset, Fixed price);
+void rebuildIndicators(Asset &asset);
+void logLine(const char *format, ...);
+void logAsset(const char *tag, Asset &asset);
+void logIndicators(Asset &asset);
 
 void setup() {
   Serial.begin(115200);
@@ -97,16 +116,20 @@ void setup() {
   Serial.println("  Enhanced Crypto & Stock Ticker");
   Serial.println("========================================\n");
 
-  // Initialize I2C
+  // Initialize I2C (the display task raises the clock once the panel is set up)
   Wire.begin(OLED_SDA, OLED_SCL);
+  pinMode(MODE_BUTTON, INPUT_PULLUP);
+  attachInterrupt(digitalPinToInterrupt(MODE_BUTTON), powerWakeFromISR, CHANGE);  // wake loop() on press/release
   
   // Initialize display
   if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
     Serial.println(F("SSD1306 allocation failed"));
     for(;;);
   }
+  displayTaskBegin(Wire, SCREEN_ADDRESS);  // frames are flushed by the display task from here on
 
   display.clearDisplay();
+  display.cp437(true);  // correct code page for the currency glyphs
   display.setTextSize(1);
   display.setTextColor(SSD1306_WHITE);
   display.setCursor(0, 0);
@@ -114,21 +137,44 @@ void setup() {
   display.println(F("v2.0"));
   display.println();
   display.println(F("Connecting WiFi..."));
-  display.display();
+  displaySubmit(display.getBuffer());
+
+  // Load the watchlist and restore sparkline history saved before the last reboot
+  bool fsReady = historyLogBegin();
+  if(!fsReady || !registryLoad(WATCHLIST_PATH)) {
+    Serial.println("[Watchlist] Using built-in defaults");
+    registryLoadDefaults(DEFAULT_WATCHLIST, sizeof(DEFAULT_WATCHLIST) / sizeof(DEFAULT_WATCHLIST[0]));
+  }
+  Serial.printf("[Watchlist] %d crypto, %d stocks\n", cryptoCount, stockCount);
+
+  // Holdings stay empty (but valid) when there is no filesystem to load them from
+  portfolioClear();
+  if(fsReady) {
+    unsigned long restoreStart = micros();
+    int restored = 0;
+    for(int i = 0; i < assetCount; i++) {
+      restored += historyLogRestore(assets[i]);
+      rebuildIndicators(assets[i]);
+    }
+    Serial.printf("[History] Restored %d samples in %lu us\n", restored, micros() - restoreStart);
+
+    Serial.printf("[Alerts] %d rules loaded\n", alertsLoad(ALERTS_PATH));
+    Serial.printf("[Portfolio] %d holdings loaded\n", portfolioLoad(HOLDINGS_PATH));
+  }
 
   // Connect to WiFi
   Serial.print("Connecting to WiFi: ");
   Serial.println(WIFI_SSID);
   
-  WiFi.mode(WIFI_STA);
-  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  powerBegin(POWER_SAVING);
+  powerWifiBegin(WIFI_SSID, WIFI_PASSWORD);
 
   int attempts = 0;
   while (WiFi.status() != WL_CONNECTED && attempts < 30) {
     delay(500);
     Serial.print(".");
     display.print(".");
-    display.display();
+    displaySubmit(display.getBuffer());
     attempts++;
   }
 
@@ -144,22 +190,31 @@ void setup() {
     display.println(WiFi.localIP());
     display.println();
     display.println(F("Syncing time..."));
-    display.display();
+    displaySubmit(display.getBuffer());
     
     // Configure time
     configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
     delay(2000);
     
+    webBegin();
+    
+    // Exchange rates first, so a non-USD display currency applies from the first screen
+    fxUpdate(millis());
+    fxSetDisplay(DISPLAY_CURRENCY_AT_BOOT);
+    
     display.println(F("Fetching prices..."));
-    display.display();
+    displaySubmit(display.getBuffer());
     
-    // Initial price fetch
-    updateCryptoPrices();
-    updateStockPrices();
+    // Initial price fetch: the first few jobs, the rest follow from loop()
+    schedulerBegin(PRICE_UPDATE_INTERVAL, REQUEST_BUDGET_PER_MIN);
+    for(int i = 0; i < 5 && updatePrices(); i++);
     
     display.println(F("Ready!"));
-    display.display();
+    displaySubmit(display.getBuffer());
     delay(1000);
+    
+    tapeBegin();
+    if(tapeMode) setTapeMode(true);
   } else {
     Serial.println("\nFailed to connect to WiFi!");
     display.clearDisplay();
@@ -167,326 +222,497 @@ void setup() {
     display.println(F("WiFi Failed!"));
     display.println();
     display.println(F("Check secrets.h"));
-    display.display();
+    displaySubmit(display.getBuffer());
     for(;;);
   }
 }
 
-void updateCryptoPrices() {
-  if(WiFi.status() != WL_CONNECTED) return;
+// Asset slots the scheduler boosts: the one on screen and the one shown next
+void displayFocus(int &onScreen, int &upNext) {
+  onScreen = (currentDisplayIndex + assetCount - 1) % assetCount;
+  upNext = currentDisplayIndex % assetCount;
+}
+
+// Run the request the scheduler picks, if any is due. Returns false when idle.
+bool updatePrices() {
+  if(WiFi.status() != WL_CONNECTED || assetCount == 0) return false;
+  
+  int onScreen, upNext;
+  displayFocus(onScreen, upNext);
+  FetchJob *job = schedulerNext(millis(), time(nullptr), onScreen, upNext);
+  if(job == nullptr) return false;
+  
+  alertsBeginTick();
+  int httpCode = job->kind == JOB_CRYPTO_PAGE ? updateCryptoPrices(*job) : updateStockPrice(*job);
+  alertsEndTick();
+  schedulerDone(*job, httpCode, millis(), time(nullptr));
+  if(httpCode == 200 || httpCode == 304) powerDataReady();
+  
+  webPublishChanges();
+  if(httpCode == 200 && tapeRunning()) tapeRebuild();
+  sendAlertNotifications();
+  return true;
+}
+
+int updateCryptoPrices(FetchJob &job) {
+  int page = job.index;
+  FetchCache &cache = job.cache;
   
-  Serial.println("\n[Crypto] Fetching enhanced data...");
+  Serial.printf("\n[Crypto] Fetching page %d...\n", page + 1);
   
   HTTPClient http;
   http.setTimeout(15000);
   
   // Enhanced API call with more data
-  String url = String(CRYPTO_API) + 
-               "?vs_currency=usd" +
-               "&ids=bitcoin,ethereum,solana,binancecoin" +
-               "&order=market_cap_desc" +
-               "&sparkline=false" +
-               "&price_change_percentage=24h";
+  static char url[1400];
+  int len = snprintf(url, sizeof(url),
+                     "%s?vs_currency=usd&order=market_cap_desc&sparkline=false"
+                     "&price_change_percentage=24h&per_page=%d&ids=",
+                     CRYPTO_API, CRYPTO_PAGE_SIZE);
+  registryCryptoIds(url + len, sizeof(url) - len, page, CRYPTO_PAGE_SIZE);
   
   http.begin(url);
+  fetchCachePrepare(cache, http);
   int httpCode = http.GET();
+  if(httpCode == 200 || httpCode == 304) fetchCacheStore(cache, http, httpCode, millis());
   
-  if(httpCode == 200) {
-    String payload = http.getString();
+  if(httpCode == 304) {
+    Serial.println("[Crypto] Not modified");
+  } else if(httpCode == 200) {
+    const char *body;
+    size_t bodyLen = fetchReadBody(http, &body);
+    if(bodyLen == 0) {
+      Serial.println("[Crypto] Read error!");
+      fetchCacheReset(cache);
+      http.end();
+      return HTTPC_ERROR_STREAM_WRITE;
+    }
+    if(fetchCacheBodyUnchanged(cache, body, bodyLen)) {
+      Serial.println("[Crypto] Unchanged, parse skipped");
+      http.end();
+      return httpCode;
+    }
+    
+    // Only keep the fields we use, so a full page fits comfortably in RAM
+    JsonDocument filter;
+    JsonObject fields = filter.add<JsonObject>();
+    fields["id"] = true;
+    fields["current_price"] = true;
+    fields["price_change_percentage_24h"] = true;
+    fields["total_volume"] = true;
+    fields["market_cap"] = true;
+    fields["high_24h"] = true;
+    fields["low_24h"] = true;
     
     JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, payload);
+    DeserializationError error = deserializeJson(doc, body, bodyLen, DeserializationOption::Filter(filter));
     
     if(!error) {
       JsonArray coins = doc.as<JsonArray>();
       
       for(JsonObject coin : coins) {
-        String id = coin["id"].as<String>();
-        int assetIndex = -1;
+        int slot = registryFind(coin["id"]);
+        if(slot < 0) continue;
         
-        if(id == "bitcoin") assetIndex = 0;
-        else if(id == "ethereum") assetIndex = 1;
-        else if(id == "solana") assetIndex = 2;
-        else if(id == "binancecoin") assetIndex = 3;
+        Asset &asset = assets[slot];
+        Fixed newPrice = jsonFixed(coin["current_price"], Fixed::fromRaw(0));
+        Fixed newChange = jsonFixed(coin["price_change_percentage_24h"], Fixed::fromRaw(0));
+        if(newPrice != asset.price || newChange != asset.change24h) webMarkDirty(slot);
         
-        if(assetIndex >= 0) {
-          float newPrice = coin["current_price"];
-          cryptoAssets[assetIndex].price = newPrice;
-          cryptoAssets[assetIndex].change24h = coin["price_change_percentage_24h"];
-          cryptoAssets[assetIndex].volume24h = coin["total_volume"];
-          cryptoAssets[assetIndex].marketCap = coin["market_cap"];
-          cryptoAssets[assetIndex].high24h = coin["high_24h"];
-          cryptoAssets[assetIndex].low24h = coin["low_24h"];
-          cryptoAssets[assetIndex].dataValid = true;
-          cryptoAssets[assetIndex].lastUpdate = millis();
-          
-          // Add to price history for sparkline
-          addPriceToHistory(cryptoAssets[assetIndex], newPrice);
-          
-          Serial.printf("%s: $%.2f (%s%.2f%%) Vol: %s MCap: %s\n", 
-                        cryptoAssets[assetIndex].symbol.c_str(),
-                        cryptoAssets[assetIndex].price,
-                        cryptoAssets[assetIndex].change24h >= 0 ? "+" : "",
-                        cryptoAssets[assetIndex].change24h,
-                        formatVolume(cryptoAssets[assetIndex].volume24h).c_str(),
-                        formatLargeNumber(cryptoAssets[assetIndex].marketCap).c_str());
-        }
+        registryLock();
+        asset.price = newPrice;
+        asset.change24h = newChange;
+        asset.volume24h = jsonFixed(coin["total_volume"], Fixed::fromRaw(0));
+        asset.marketCap = jsonFixed(coin["market_cap"], Fixed::fromRaw(0));
+        asset.high24h = jsonFixed(coin["high_24h"], newPrice);
+        asset.low24h = jsonFixed(coin["low_24h"], newPrice);
+        asset.dataValid = true;
+        asset.lastUpdate = millis();
+        
+        // Add to price history for sparkline
+        uint32_t sampleTime = addPriceToHistory(asset, newPrice);
+        portfolioOnPrice(slot, asset.price, asset.change24h);
+        registryUnlock();
+        // May write flash, so not while the web server could be waiting on the lock
+        historyLogAppend(asset, sampleTime, newPrice);
+        alertsEvaluate(slot, millis());
+        
+        logAsset("Crypto", asset);
+        logIndicators(asset);
       }
       
       Serial.println("[Crypto] Update successful!");
     } else {
       Serial.println("[Crypto] JSON parse error!");
+      fetchCacheReset(cache);  // don't let a bad body be matched as "unchanged"
     }
   } else {
     Serial.printf("[Crypto] HTTP error: %d\n", httpCode);
   }
   
   http.end();
+  return httpCode;
 }
 
-void updateStockPrices() {
-  if(WiFi.status() != WL_CONNECTED) return;
+int updateStockPrice(FetchJob &job) {
+  int slot = stockSlots[job.index];
+  Asset &asset = assets[slot];
+  FetchCache &cache = job.cache;
   
-  Serial.println("\n[Stock] Fetching enhanced data...");
+  Serial.printf("\n[Stock] Fetching %s...\n", asset.symbol);
   
-  for(int i = 0; i < NUM_STOCKS; i++) {
-    HTTPClient http;
-    http.setTimeout(15000);
-    
-    String url = String(STOCK_API) + stockAssets[i].symbol + "?interval=1d&range=5d";
+  HTTPClient http;
+  http.setTimeout(15000);
+  
+  char url[128];
+  snprintf(url, sizeof(url), "%s%s?interval=1d&range=5d", STOCK_API, asset.id);
+  
+  http.begin(url);
+  http.addHeader("User-Agent", "Mozilla/5.0");
+  fetchCachePrepare(cache, http);
+  int httpCode = http.GET();
+  if(httpCode == 200 || httpCode == 304) fetchCacheStore(cache, http, httpCode, millis());
+  
+  if(httpCode == 304) {
+    Serial.printf("[Stock] %s not modified\n", asset.symbol);
+  } else if(httpCode == 200) {
+    const char *body;
+    size_t bodyLen = fetchReadBody(http, &body);
+    if(bodyLen == 0) {
+      Serial.printf("[Stock] %s read error!\n", asset.symbol);
+      fetchCacheReset(cache);
+      http.end();
+      return HTTPC_ERROR_STREAM_WRITE;
+    }
+    if(fetchCacheBodyUnchanged(cache, body, bodyLen)) {
+      Serial.printf("[Stock] %s unchanged, parse skipped\n", asset.symbol);
+      http.end();
+      return httpCode;
+    }
     
-    http.begin(url);
-    http.addHeader("User-Agent", "Mozilla/5.0");
-    int httpCode = http.GET();
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, body, bodyLen);
     
-    if(httpCode == 200) {
-      String payload = http.getString();
+    if(!error && doc["chart"]["result"][0].is<JsonObject>()) {
+      JsonObject result = doc["chart"]["result"][0];
       
-      JsonDocument doc;
-      DeserializationError error = deserializeJson(doc, payload);
-      
-      if(!error && doc["chart"]["result"][0].is<JsonObject>()) {
-        JsonObject result = doc["chart"]["result"][0];
+      if(result["meta"].is<JsonObject>()) {
+        JsonObject meta = result["meta"];
+        
+        Fixed currentPrice = jsonFixed(meta["regularMarketPrice"], Fixed::fromRaw(0));
+        Fixed previousClose = jsonFixed(meta["chartPreviousClose"], currentPrice);
+        Fixed newChange = fixedPercentChange(previousClose, currentPrice);
+        if(currentPrice != asset.price || newChange != asset.change24h) webMarkDirty(slot);
+        
+        registryLock();
+        asset.price = currentPrice;
+        asset.change24h = newChange;
+        asset.high24h = jsonFixed(meta["regularMarketDayHigh"], currentPrice);
+        asset.low24h = jsonFixed(meta["regularMarketDayLow"], currentPrice);
+        asset.volume24h = jsonFixed(meta["regularMarketVolume"], Fixed::fromRaw(0));
+        asset.marketCap = jsonFixed(meta["marketCap"], Fixed::fromRaw(0));
+        asset.dataValid = true;
+        asset.lastUpdate = millis();
         
-        if(result["meta"].is<JsonObject>()) {
-          JsonObject meta = result["meta"];
-          
-          float currentPrice = meta["regularMarketPrice"];
-          float previousClose = meta["chartPreviousClose"];
-          
-          stockAssets[i].price = currentPrice;
-          stockAssets[i].change24h = ((currentPrice - previousClose) / previousClose) * 100.0;
-          stockAssets[i].high24h = meta["regularMarketDayHigh"] | currentPrice;
-          stockAssets[i].low24h = meta["regularMarketDayLow"] | currentPrice;
-          stockAssets[i].volume24h = meta["regularMarketVolume"] | 0;
-          stockAssets[i].marketCap = meta["marketCap"] | 0;
-          stockAssets[i].dataValid = true;
-          stockAssets[i].lastUpdate = millis();
-          
-          // Add to price history
-          addPriceToHistory(stockAssets[i], currentPrice);
-          
-          Serial.printf("%s: $%.2f (%s%.2f%%) Vol: %s MCap: %s\n", 
-                        stockAssets[i].symbol.c_str(),
-                        stockAssets[i].price,
-                        stockAssets[i].change24h >= 0 ? "+" : "",
-                        stockAssets[i].change24h,
-                        formatVolume(stockAssets[i].volume24h).c_str(),
-                        formatLargeNumber(stockAssets[i].marketCap).c_str());
-        }
+        // Add to price history
+        uint32_t sampleTime = addPriceToHistory(asset, currentPrice);
+        portfolioOnPrice(slot, asset.price, asset.change24h);
+        registryUnlock();
+        historyLogAppend(asset, sampleTime, currentPrice);
+        alertsEvaluate(slot, millis());
+        
+        logAsset("Stock", asset);
+        logIndicators(asset);
       }
     } else {
-      Serial.printf("[Stock] %s HTTP error: %d\n", stockAssets[i].symbol.c_str(), httpCode);
+      Serial.printf("[Stock] %s JSON parse error!\n", asset.symbol);
+      fetchCacheReset(cache);
     }
-    
-    http.end();
-    delay(250);
+  } else {
+    Serial.printf("[Stock] %s HTTP error: %d\n", asset.symbol, httpCode);
   }
   
-  Serial.println("[Stock] Update complete!");
+  http.end();
+  return httpCode;
 }
 
-void addPriceToHistory(Asset &asset, float price) {
-  asset.history.prices[asset.history.index] = price;
-  asset.history.index = (asset.history.index + 1) % HISTORY_SIZE;
-  if(asset.history.index == 0) asset.history.filled = true;
+void logFetchStats() {
+  if(tapeRunning()) {
+    logLine("[Tape] %lu frames, blit %lu us (max %lu us), %lu late, %u px strip\n",
+            (unsigned long)tapeStats.frames, (unsigned long)tapeStats.lastBlitUs,
+            (unsigned long)tapeStats.maxBlitUs, (unsigned long)tapeStats.lateFrames,
+            tapeStats.stripWidth);
+  }
+  logLine("[Display] %lu flushes, %lu merged, flush %lu us (max %lu us), loop blocked %lu us (max %lu us)\n",
+          (unsigned long)displayStats.flushes, (unsigned long)displayStats.merged,
+          (unsigned long)displayStats.lastFlushUs, (unsigned long)displayStats.maxFlushUs,
+          (unsigned long)displayStats.lastSubmitUs, (unsigned long)displayStats.maxSubmitUs);
+  logLine("[Power] %s, awake %lu%%, ~%lu mA avg, wake-to-data %lu ms (avg %lu, max %lu), wake jitter %lu us (max %lu us)\n",
+          powerSaving() ? "saving" : "full power",
+          (unsigned long)(powerStats.awakeUs * 100 / (powerStats.awakeUs + powerStats.asleepUs + 1)),
+          (unsigned long)powerAverageMa(), (unsigned long)powerStats.lastWakeToDataMs,
+          (unsigned long)(powerStats.dataWakes ? powerStats.totalWakeToDataMs / powerStats.dataWakes : 0),
+          (unsigned long)powerStats.maxWakeToDataMs,
+          (unsigned long)powerStats.lastLateUs, (unsigned long)powerStats.maxLateUs);
+  logLine("[Sched] %lu requests, %lu budget waits, %lu rate limited, %lu skipped (market closed)\n",
+          (unsigned long)schedulerStats.requests, (unsigned long)schedulerStats.budgetWaits,
+          (unsigned long)schedulerStats.rateLimited, (unsigned long)schedulerStats.closedSkips);
+  logLine("[Fetch] %lu requests, %lu parsed, %lu not modified, %lu fresh, %lu unchanged, %lu KB saved, %lu KB unparsed\n",
+          (unsigned long)fetchStats.requests, (unsigned long)fetchStats.parses,
+          (unsigned long)fetchStats.notModified, (unsigned long)fetchStats.freshSkips,
+          (unsigned long)fetchStats.unchangedBodies,
+          (unsigned long)(fetchStats.savedBytes / 1024), (unsigned long)(fetchStats.unparsedBytes / 1024));
+  logLine("[Heap] %lu free, %lu min free, %lu largest block\n",
+          (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(),
+          (unsigned long)ESP.getMaxAllocHeap());
 }
 
-void drawSparkline(Asset &asset, int x, int y, int width, int height) {
-  if(!asset.history.filled && asset.history.index < 2) return;
-  
-  int dataPoints = asset.history.filled ? HISTORY_SIZE : asset.history.index;
-  if(dataPoints < 2) return;
+// Serial.printf() mallocs a buffer for lines over 64 characters; the lines
+// logged on every fetch are formatted on the stack instead
+void logLine(const char *format, ...) {
+  char line[192];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  Serial.print(line);
+}
+
+void logAsset(const char *tag, Asset &asset) {
+  char price[24];
+  char change[16];
+  char volume[16];
+  char marketCap[16];
+  fixedFormat(price, sizeof(price), asset.price, 2);
+  fixedFormat(change, sizeof(change), asset.change24h, 2, true);
+  formatLargeNumber(asset.volume24h, volume, sizeof(volume));
+  formatLargeNumber(asset.marketCap, marketCap, sizeof(marketCap));
+  logLine("[%s] %s: $%s (%s%%) Vol: $%s MCap: %s\n",
+          tag, asset.symbol, price, change, volume, marketCap);
+}
+
+void logIndicators(Asset &asset) {
+  IndicatorState &ind = asset.indicators;
+  char emaFast[24];
+  char emaSlow[24];
+  char rsi[12];
+  char volatility[12];
+  char vwap[24];
+  fixedFormat(emaFast, sizeof(emaFast), ind.emaFast, 2);
+  fixedFormat(emaSlow, sizeof(emaSlow), ind.emaSlow, 2);
+  fixedFormat(rsi, sizeof(rsi), ind.rsi, 1);
+  fixedFormat(volatility, sizeof(volatility), ind.volatility, 3);
+  fixedFormat(vwap, sizeof(vwap), ind.vwap, 2);
+  logLine("[Ind] %s EMA9: %s EMA21: %s RSI14: %s%s Vol: %s%% VWAP: %s\n",
+          asset.symbol, emaFast, emaSlow, rsi,
+          indicatorsRsiReady(ind) ? "" : " (warming up)",
+          volatility, indicatorsVwapReady(ind) ? vwap : "-");
+}
+
+// Updates the in-RAM ring and indicators; the caller logs the returned
+// timestamp with historyLogAppend() once it has released the registry lock
+uint32_t addPriceToHistory(Asset &asset, Fixed price) {
+  uint32_t now = (uint32_t)time(nullptr);
+  PriceHistory &history = registryHistory(asset);
   
-  // Find min and max for scaling
-  float minPrice = asset.history.prices[0];
-  float maxPrice = asset.history.prices[0];
+  // Indicators consume the sample being evicted, so update them before the ring slot is overwritten
+  IndicatorWindow window;
+  window.slot = history.index;
+  window.evicting = history.filled;
+  window.evictedPrice = history.prices[history.index];
+  window.evictedNext = history.prices[(history.index + 1) % HISTORY_SIZE];
+  indicatorsUpdate(asset.indicators, window, price, asset.volume24h);
   
-  for(int i = 0; i < dataPoints; i++) {
-    if(asset.history.prices[i] < minPrice) minPrice = asset.history.prices[i];
-    if(asset.history.prices[i] > maxPrice) maxPrice = asset.history.prices[i];
+  history.prices[history.index] = price;
+  history.times[history.index] = now;
+  history.index = (history.index + 1) % HISTORY_SIZE;
+  if(history.index == 0) history.filled = true;
+  return now;
+}
+
+// Replay restored history so indicators are warm from the first fetch (volume is not persisted)
+void rebuildIndicators(Asset &asset) {
+  const PriceHistory &history = registryHistory(asset);
+  indicatorsReset(asset.indicators);
+  int count = history.filled ? HISTORY_SIZE : history.index;
+  int start = history.filled ? history.index : 0;
+  for(int i = 0; i < count; i++) {
+    IndicatorWindow window;
+    window.slot = (start + i) % HISTORY_SIZE;
+    window.evicting = false;
+    indicatorsUpdate(asset.indicators, window, history.prices[window.slot], Fixed::fromRaw(0));
   }
-  
-  float range = maxPrice - minPrice;
-  if(range < 0.01) range = asset.price * 0.01; // Avoid division by zero
-  
-  // Draw sparkline
-  for(int i = 1; i < dataPoints && i < width; i++) {
-    int idx1 = (asset.history.index + i - 1) % HISTORY_SIZE;
-    int idx2 = (asset.history.index + i) % HISTORY_SIZE;
+}
+
+// Push fired alerts to the webhook configured in secrets.h (if any)
+void sendAlertNotifications() {
+  AlertEvent event;
+  while(alertsPopNotify(event)) {
+    char text[48];
+    alertsDescribe(event, text, sizeof(text));
+    Serial.printf("[Alerts] %s\n", text);
+
+#ifdef ALERT_WEBHOOK_URL
+    if(WiFi.status() != WL_CONNECTED) continue;
     
-    int y1 = y + height - ((asset.history.prices[idx1] - minPrice) / range * height);
-    int y2 = y + height - ((asset.history.prices[idx2] - minPrice) / range * height);
+    // Ids, symbols and the description come from config files, so let
+    // ArduinoJson escape them; the price is written as its exact decimal
+    char price[24];
+    char body[256];
+    fixedFormat(price, sizeof(price), event.price, 2);
+    JsonDocument doc;
+    doc["asset"] = assets[event.slot].id;
+    doc["symbol"] = assets[event.slot].symbol;
+    doc["price"] = serialized(price);
+    doc["alert"] = text;
+    if(measureJson(doc) >= sizeof(body)) {
+      Serial.println("[Alerts] Webhook body too long");
+      continue;
+    }
+    serializeJson(doc, body, sizeof(body));
     
-    display.drawLine(x + i - 1, y1, x + i, y2, SSD1306_WHITE);
+    HTTPClient http;
+    http.setTimeout(5000);
+    http.begin(ALERT_WEBHOOK_URL);
+    http.addHeader("Content-Type", "application/json");
+    int httpCode = http.POST((uint8_t *)body, strlen(body));
+    if(httpCode < 200 || httpCode >= 300) {
+      Serial.printf("[Alerts] Webhook error: %d\n", httpCode);
+    }
+    http.end();
+#endif
   }
 }
 
-String formatLargeNumber(float num) {
-  if(num >= 1e12) return String(num / 1e12, 1) + "T";
-  if(num >= 1e9) return String(num / 1e9, 1) + "B";
-  if(num >= 1e6) return String(num / 1e6, 1) + "M";
-  if(num >= 1e3) return String(num / 1e3, 1) + "K";
-  return String((int)num);
-}
-
-String formatVolume(float vol) {
-  return "$" + formatLargeNumber(vol);
+void setTapeMode(bool enabled) {
+  tapeMode = enabled;
+  if(enabled) {
+    tapeRebuild();
+    drawTapeFrame();
+    tapeStart();
+  } else {
+    tapeStop();
+    lastDisplayRotation = millis() - DISPLAY_ROTATION_INTERVAL;  // asset screen right away
+  }
+  Serial.printf("[Display] %s\n", enabled ? "Ticker tape" : "Asset rotation");
 }
 
-String getTrendArrow(float change) {
-  if(change > 5) return "^^";
-  if(change > 2) return "^";
-  if(change > 0) return "-";
-  if(change > -2) return "v";
-  if(change > -5) return "vv";
-  return "VV";
+// Next display currency with a known rate; redraws the current screen with it
+void cycleCurrency() {
+  Currency from = fxDisplay();
+  Currency next = fxNext(from);
+  while(next != CCY_USD && fxRate(next).isZero()) next = fxNext(next);
+  if(next == from) return;
+  
+  fxSetDisplay(next);
+  Serial.printf("[FX] Display currency %s\n", fxCode(next));
+  if(tapeMode) {
+    tapeRebuild();
+    drawTapeFrame();
+  } else {
+    lastDisplayRotation = millis() - DISPLAY_ROTATION_INTERVAL;
+    if(currentDisplayIndex > 0) currentDisplayIndex--;  // same screen again
+  }
 }
 
-void drawAsset(Asset &asset, bool isCrypto) {
-  display.clearDisplay();
+void loop() {
+  unsigned long currentMillis = millis();
   
-  // Header with type and time
-  display.setTextSize(1);
-  display.setCursor(0, 0);
-  display.print(isCrypto ? F("CRYPTO") : F("STOCK"));
+  // At most one request per pass, so the display keeps rotating between them
+  updatePrices();
   
-  // Current time
-  struct tm timeinfo;
-  if(getLocalTime(&timeinfo)) {
-    char timeStr[6];
-    strftime(timeStr, sizeof(timeStr), "%H:%M", &timeinfo);
-    display.setCursor(96, 0);
-    display.print(timeStr);
+  if(currentMillis - lastFetchStatsLog >= FETCH_STATS_INTERVAL) {
+    logFetchStats();
+    lastFetchStatsLog = currentMillis;
   }
   
-  // WiFi indicator
-  if(WiFi.status() == WL_CONNECTED) {
-    display.setCursor(75, 0);
-    int rssi = WiFi.RSSI();
-    if(rssi > -60) display.print(F("|||"));
-    else if(rssi > -75) display.print(F("|| "));
-    else display.print(F("|  "));
+  // Exchange rates on their own slow schedule (returns at once when not due)
+  fxUpdate(currentMillis);
+  
+  // PRG button (debounced, acts on release): short press toggles the ticker
+  // tape, long press cycles the display currency
+  bool buttonDown = digitalRead(MODE_BUTTON) == LOW;
+  if(buttonDown != buttonWasDown && currentMillis - buttonChangedAt >= 50) {
+    buttonWasDown = buttonDown;
+    buttonChangedAt = currentMillis;
+    if(buttonDown) {
+      buttonPressedAt = currentMillis;
+    } else if(!alertShowing) {
+      if(currentMillis - buttonPressedAt >= LONG_PRESS_MS) cycleCurrency();
+      else setTapeMode(!tapeMode);
+    }
   }
   
-  display.drawLine(0, 9, SCREEN_WIDTH, 9, SSD1306_WHITE);
+  // Fired alerts preempt the rotation with a flashing screen
+  if(!alertShowing && alertsPopDisplay(activeAlert)) {
+    if(tapeMode) tapeStop();
+    alertShowing = true;
+    alertShownAt = millis();
+    currentMillis = alertShownAt;
+    drawAlert(activeAlert);
+  }
   
-  if(asset.dataValid) {
-    // Symbol and trend arrow
-    display.setTextSize(1);
-    display.setCursor(0, 11);
-    display.print(asset.symbol);
-    display.print(" ");
-    display.print(getTrendArrow(asset.change24h));
-    
-    // Price - large
-    display.setTextSize(2);
-    display.setCursor(0, 21);
-    display.print(F("$"));
-    if(asset.price >= 1000) {
-      display.printf("%.0f", asset.price);
-    } else if(asset.price >= 100) {
-      display.printf("%.1f", asset.price);
-    } else if(asset.price >= 10) {
-      display.printf("%.2f", asset.price);
-    } else if(asset.price >= 1) {
-      display.printf("%.3f", asset.price);
+  if(alertShowing) {
+    if(currentMillis - alertShownAt >= ALERT_FLASH_DURATION) {
+      alertShowing = false;
+      displaySetInverted(false);
+      if(tapeMode) setTapeMode(true);
+      lastDisplayRotation = currentMillis - DISPLAY_ROTATION_INTERVAL;  // resume immediately
     } else {
-      display.setTextSize(1);
-      display.setCursor(6, 25);
-      display.printf("%.4f", asset.price);
+      displaySetInverted(((currentMillis - alertShownAt) / ALERT_FLASH_INTERVAL) % 2);
     }
-    
-    // 24h change
-    display.setTextSize(1);
-    display.setCursor(0, 38);
-    if(asset.change24h >= 0) {
-      display.print(F("+"));
+  } else if(tapeMode) {
+    // The tape task scrolls on its own; just keep the clock and counts around it current
+    if(currentMillis - lastTimeUpdate >= TIME_UPDATE_INTERVAL) {
+      drawTapeFrame();
+      lastTimeUpdate = currentMillis;
+    }
+  } else if(currentMillis - lastDisplayRotation >= DISPLAY_ROTATION_INTERVAL) {
+    // Rotate display through the watchlist (crypto first, then stocks), then the portfolio
+    int screens = assetCount + (portfolio.holdings > 0 ? 1 : 0);
+    if(screens > 0) {
+      currentDisplayIndex %= screens;
+      if(currentDisplayIndex < assetCount) drawAsset(assets[currentDisplayIndex]);
+      else drawPortfolio();
+      currentDisplayIndex++;
     }
-    display.print(asset.change24h, 2);
-    display.print(F("%"));
-    
-    // High/Low
-    display.setCursor(40, 38);
-    display.print(F("H:"));
-    display.print((int)asset.high24h);
-    display.setCursor(78, 38);
-    display.print(F("L:"));
-    display.print((int)asset.low24h);
-    
-    // Volume and Market Cap
-    display.setCursor(0, 47);
-    display.print(F("Vol:"));
-    display.print(formatVolume(asset.volume24h));
-    
-    display.setCursor(0, 56);
-    display.print(F("MCap:"));
-    display.print(formatLargeNumber(asset.marketCap));
-    
-    // Sparkline on the right
-    drawSparkline(asset, 70, 47, 58, 16);
     
-  } else {
-    display.setTextSize(1);
-    display.setCursor(0, 30);
-    display.print(F("Loading data..."));
+    lastDisplayRotation = currentMillis;
   }
   
-  display.display();
+  // Sleep until the next fetch, screen change or button press
+  powerWait(nextWakeMs(millis()));
 }
 
-void loop() {
-  unsigned long currentMillis = millis();
+static unsigned long untilDue(unsigned long now, unsigned long last, unsigned long interval) {
+  unsigned long elapsed = now - last;
+  return elapsed >= interval ? 0 : interval - elapsed;
+}
+
+// How long loop() can sleep before it has something to do
+unsigned long nextWakeMs(unsigned long now) {
+  unsigned long wait = POWER_MAX_SLEEP_MS;
   
-  // Update prices periodically
-  if(currentMillis - lastPriceUpdate >= PRICE_UPDATE_INTERVAL) {
-    updateCryptoPrices();
-    updateStockPrices();
-    lastPriceUpdate = currentMillis;
+  // Button still bouncing: look again once the debounce time has passed
+  if((digitalRead(MODE_BUTTON) == LOW) != buttonWasDown) {
+    wait = min(wait, untilDue(now, buttonChangedAt, 50) + 1);
   }
   
-  // Rotate display
-  if(currentMillis - lastDisplayRotation >= DISPLAY_ROTATION_INTERVAL) {
-    if(showingCrypto) {
-      drawAsset(cryptoAssets[currentDisplayIndex], true);
-      currentDisplayIndex++;
-      
-      if(currentDisplayIndex >= NUM_CRYPTO) {
-        currentDisplayIndex = 0;
-        showingCrypto = false;
-      }
-    } else {
-      drawAsset(stockAssets[currentDisplayIndex], false);
-      currentDisplayIndex++;
-      
-      if(currentDisplayIndex >= NUM_STOCKS) {
-        currentDisplayIndex = 0;
-        showingCrypto = true;
-      }
-    }
-    
-    lastDisplayRotation = currentMillis;
+  if(alertShowing) {
+    wait = min(wait, untilDue(now, alertShownAt, ALERT_FLASH_DURATION));
+    wait = min(wait, ALERT_FLASH_INTERVAL - (now - alertShownAt) % ALERT_FLASH_INTERVAL);
+  } else if(tapeMode) {
+    wait = min(wait, untilDue(now, lastTimeUpdate, TIME_UPDATE_INTERVAL));
+  } else {
+    wait = min(wait, untilDue(now, lastDisplayRotation, DISPLAY_ROTATION_INTERVAL));
   }
+  wait = min(wait, untilDue(now, lastFetchStatsLog, FETCH_STATS_INTERVAL));
   
-  delay(100);
+  if(WiFi.status() == WL_CONNECTED && assetCount > 0) {
+    int onScreen, upNext;
+    displayFocus(onScreen, upNext);
+    wait = min(wait, schedulerIdleMs(now, onScreen, upNext));
+    wait = min(wait, fxIdleMs(now));
+  }
+  return wait;
 }
@@ -0,0 +1,129 @@
+#include "portfolio.h"
+#include "json_fixed.h"
+#include <LittleFS.h>
+
+Holding holdings[MAX_HOLDINGS];
+PortfolioTotals portfolio;
+
+static int16_t holdingBySlot[MAX_ASSETS];
+static int holdingCount = 0;
+
+void portfolioClear() {
+  memset(&portfolio, 0, sizeof(portfolio));
+  holdingCount = 0;
+  for(int i = 0; i < MAX_ASSETS; i++) holdingBySlot[i] = -1;
+}
+
+int portfolioFind(int slot) {
+  if(slot < 0 || slot >= MAX_ASSETS) return -1;
+  return holdingBySlot[slot];
+}
+
+int portfolioAdd(int slot, Fixed quantity, Fixed averageCost) {
+  if(slot < 0 || slot >= MAX_ASSETS) return -1;
+  Fixed cost = fixedMul(quantity, averageCost);
+
+  int index = holdingBySlot[slot];
+  if(index < 0) {
+    if(holdingCount >= MAX_HOLDINGS) return -1;
+    index = holdingCount++;
+    Holding &holding = holdings[index];
+    memset(&holding, 0, sizeof(holding));
+    holding.slot = slot;
+    holdingBySlot[slot] = index;
+    portfolio.holdings++;
+  }
+
+  // Same asset listed twice: one position with the combined quantity and cost
+  Holding &holding = holdings[index];
+  holding.quantity += quantity;
+  holding.costBasis += cost;
+  portfolio.cost += cost;
+  if(holding.priced) portfolio.pricedCost += cost;
+  portfolio.version++;
+  return index;
+}
+
+int portfolioLoad(const char *path) {
+  portfolioClear();
+
+  File file = LittleFS.open(path, "r");
+  if(!file) return 0;
+
+  JsonDocument doc;
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  if(error) {
+    Serial.printf("[Portfolio] %s parse error: %s\n", path, error.c_str());
+    return 0;
+  }
+
+  for(JsonObjectConst def : doc["holdings"].as<JsonArrayConst>()) {
+    const char *id = def["asset"] | "";
+    int slot = registryFind(id);
+    if(slot < 0) {
+      Serial.printf("[Portfolio] Unknown asset '%s'\n", id);
+      continue;
+    }
+    Fixed quantity = jsonFixed(def["qty"], Fixed::fromRaw(0));
+    Fixed cost = jsonFixed(def["cost"], Fixed::fromRaw(0));
+    if(portfolioAdd(slot, quantity, cost) < 0) {
+      Serial.println("[Portfolio] Holdings table full");
+      break;
+    }
+  }
+
+  return holdingCount;
+}
+
+// Price at the previous close (stocks) or 24h ago (crypto), from the current
+// price and its percent change
+static Fixed previousPrice(Fixed price, Fixed change24h) {
+  Fixed base = Fixed::fromInt(100) + change24h;
+  if(base <= Fixed::fromRaw(0)) return price;
+  return fixedDiv(fixedMulDiv(price, 100, 1), base);
+}
+
+void portfolioApply(PortfolioTotals &totals, Holding &holding, Fixed price, Fixed change24h) {
+  Fixed value = fixedMul(holding.quantity, price);
+  Fixed dayChange = value - fixedMul(holding.quantity, previousPrice(price, change24h));
+
+  if(!holding.priced) {
+    holding.priced = true;
+    totals.priced++;
+    totals.pricedCost += holding.costBasis;
+  }
+
+  // Swap this holding's old contribution for the new one
+  totals.value += value - holding.value;
+  totals.dayChange += dayChange - holding.dayChange;
+  holding.value = value;
+  holding.dayChange = dayChange;
+  totals.version++;
+}
+
+void portfolioOnPrice(int slot, Fixed price, Fixed change24h) {
+  int index = portfolioFind(slot);
+  if(index < 0) return;
+  portfolioApply(portfolio, holdings[index], price, change24h);
+}
+
+Fixed portfolioTotalPnl() {
+  return portfolio.value - portfolio.pricedCost;
+}
+
+Fixed portfolioTotalPnlPercent() {
+  if(portfolio.pricedCost <= Fixed::fromRaw(0)) return Fixed::fromRaw(0);
+  return fixedDiv(fixedMulDiv(portfolioTotalPnl(), 100, 1), portfolio.pricedCost);
+}
+
+Fixed portfolioDayPercent() {
+  Fixed previous = portfolio.value - portfolio.dayChange;
+  if(previous <= Fixed::fromRaw(0)) return Fixed::fromRaw(0);
+  return fixedDiv(fixedMulDiv(portfolio.dayChange, 100, 1), previous);
+}
+
+Fixed portfolioAllocation(const Holding &holding) {
+  if(portfolio.value <= Fixed::fromRaw(0)) return Fixed::fromRaw(0);
+  return fixedDiv(fixedMulDiv(holding.value, 100, 1), portfolio.value);
+}
@@ -0,0 +1,74 @@
+#ifndef PORTFOLIO_H
+#define PORTFOLIO_H
+
+#include "asset_registry.h"
+
+// Holdings and running portfolio totals.
+//
+// /holdings.json:
+//   {"holdings": [
+//     {"asset": "bitcoin", "qty": 0.25, "cost": 42000},
+//     {"asset": "AAPL", "qty": 10, "cost": 150.5}
+//   ]}
+//
+// "asset" is the watchlist id, "cost" the average price paid per unit.
+// Totals are kept as running sums: a price update replaces that holding's
+// contribution (new minus old), so it costs O(1) whatever the portfolio size.
+// Fixed-point sums are exact, so they never drift from a full re-sum.
+
+#define MAX_HOLDINGS 32           // at most one per registry slot
+#define HOLDINGS_PATH "/holdings.json"
+
+static_assert(MAX_HOLDINGS <= MAX_ASSETS, "a holding needs its own registry slot");
+
+struct Holding {
+  Fixed quantity;
+  Fixed costBasis;          // quantity * average price paid
+  Fixed value;              // quantity * last price, as counted in the totals
+  Fixed dayChange;          // value minus its value at the previous close / 24h ago
+  uint8_t slot;             // asset registry slot
+  bool priced;              // has a price been applied yet
+};
+
+struct PortfolioTotals {
+  Fixed value;
+  Fixed dayChange;
+  Fixed cost;               // cost basis of all holdings
+  Fixed pricedCost;         // cost basis of holdings that have a price (for total P&L)
+  int holdings;
+  int priced;
+  uint32_t version;         // bumped on every change
+};
+
+extern Holding holdings[MAX_HOLDINGS];
+extern PortfolioTotals portfolio;
+
+// Empty the portfolio. Call once at boot, before anything looks up a holding.
+void portfolioClear();
+
+// Load holdings (after the registry), replacing any. Returns the number of holdings.
+int portfolioLoad(const char *path);
+
+// Holding index for an asset slot, or -1
+int portfolioFind(int slot);
+
+// Add a holding, merging with an existing one for the same asset. Returns its index or -1.
+int portfolioAdd(int slot, Fixed quantity, Fixed averageCost);
+
+// Apply an asset's new price and 24h change to its holding and the totals (O(1))
+void portfolioOnPrice(int slot, Fixed price, Fixed change24h);
+
+// Update step on an explicit holding/totals pair
+void portfolioApply(PortfolioTotals &totals, Holding &holding, Fixed price, Fixed change24h);
+
+// Unrealized P&L of priced holdings, and as a percent of their cost
+Fixed portfolioTotalPnl();
+Fixed portfolioTotalPnlPercent();
+
+// Day change as a percent of the value at the previous close
+Fixed portfolioDayPercent();
+
+// Share of the portfolio value in percent
+Fixed portfolioAllocation(const Holding &holding);
+
+#endif
@@ -0,0 +1,106 @@
+#include "power.h"
+#include <WiFi.h>
+#include <esp_wifi.h>
+#if CONFIG_PM_ENABLE
+#include <esp_pm.h>
+#endif
+
+PowerStats powerStats;
+
+static bool saving = false;
+static bool managed = false;          // the power manager scales the CPU, not us
+static TaskHandle_t loopTask = nullptr;
+static unsigned long wokeAtMs = 0;
+static unsigned long wokeAtUs = 0;
+static bool dataSinceWake = false;
+
+void powerBegin(bool enabled) {
+  saving = enabled;
+  loopTask = xTaskGetCurrentTaskHandle();  // setup() and loop() share a task
+  wokeAtMs = millis();
+  wokeAtUs = micros();
+  if(!saving) return;
+
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+  esp_pm_config_esp32_t pm = {};
+  pm.max_freq_mhz = POWER_CPU_MHZ_ACTIVE;
+  pm.min_freq_mhz = POWER_CPU_MHZ_IDLE;
+  pm.light_sleep_enable = true;
+  managed = esp_pm_configure(&pm) == ESP_OK;
+#endif
+  Serial.printf("[Power] Saving on, %s\n", managed ? "tickless idle with light sleep" : "manual CPU scaling");
+}
+
+void powerWifiBegin(const char *ssid, const char *password) {
+  WiFi.mode(WIFI_STA);
+  if(!saving) {
+    WiFi.begin(ssid, password);
+    return;
+  }
+
+  // The listen interval is only sent when associating, so it goes into the
+  // station config before connecting
+  wifi_config_t config;
+  esp_wifi_get_config(WIFI_IF_STA, &config);
+  strlcpy((char *)config.sta.ssid, ssid, sizeof(config.sta.ssid));
+  strlcpy((char *)config.sta.password, password, sizeof(config.sta.password));
+  config.sta.listen_interval = POWER_LISTEN_INTERVAL;
+  esp_wifi_set_config(WIFI_IF_STA, &config);
+  WiFi.setSleep(WIFI_PS_MAX_MODEM);
+  WiFi.begin();
+}
+
+void powerWait(unsigned long ms) {
+  if(ms > POWER_MAX_SLEEP_MS) ms = POWER_MAX_SLEEP_MS;
+  unsigned long sleptAt = micros();
+  powerStats.awakeUs += sleptAt - wokeAtUs;
+
+  bool timedOut = false;
+  if(ms > 0) {
+    if(saving && !managed) setCpuFrequencyMhz(POWER_CPU_MHZ_IDLE);
+    timedOut = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ms)) == 0;
+    if(saving && !managed) setCpuFrequencyMhz(POWER_CPU_MHZ_ACTIVE);
+  }
+
+  wokeAtUs = micros();
+  wokeAtMs = millis();
+  uint32_t slept = wokeAtUs - sleptAt;
+  powerStats.asleepUs += slept;
+  if(timedOut) {
+    // How far past its deadline loop() got the CPU back
+    uint32_t late = slept > ms * 1000 ? slept - ms * 1000 : 0;
+    powerStats.lastLateUs = late;
+    if(late > powerStats.maxLateUs) powerStats.maxLateUs = late;
+  }
+  powerStats.wakes++;
+  dataSinceWake = false;
+}
+
+void IRAM_ATTR powerWakeFromISR() {
+  if(loopTask == nullptr) return;
+  // A wake given while loop() is busy makes its next wait return at once
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(loopTask, &woken);
+  portYIELD_FROM_ISR(woken);
+}
+
+void powerDataReady() {
+  if(dataSinceWake) return;  // only the first fetch after a wake waited for the radio
+  dataSinceWake = true;
+  uint32_t latency = millis() - wokeAtMs;
+  powerStats.dataWakes++;
+  powerStats.lastWakeToDataMs = latency;
+  powerStats.totalWakeToDataMs += latency;
+  if(latency > powerStats.maxWakeToDataMs) powerStats.maxWakeToDataMs = latency;
+}
+
+uint32_t powerAverageMa() {
+  uint64_t total = powerStats.awakeUs + powerStats.asleepUs;
+  if(total == 0) return 0;
+  uint32_t idleMa = saving ? POWER_IDLE_SAVE_MA : POWER_IDLE_MA;
+  return (uint32_t)((powerStats.awakeUs * POWER_ACTIVE_MA + powerStats.asleepUs * idleMa) / total);
+}
+
+bool powerSaving() {
+  return saving;
+}
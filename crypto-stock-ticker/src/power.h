@@ -0,0 +1,65 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <Arduino.h>
+
+// Power saving between fetches.
+//
+// loop() no longer spins on delay(100): it works out when the next fetch,
+// screen change or clock tick is due and blocks until then (or until the
+// button interrupt wakes it), so the idle task gets the CPU in between.
+// With power saving on:
+//   - Wi-Fi modem sleep with a listen interval of POWER_LISTEN_INTERVAL
+//     beacons: the radio is off except to catch buffered traffic
+//   - the CPU runs at POWER_CPU_MHZ_IDLE while loop() waits and
+//     POWER_CPU_MHZ_ACTIVE while it works (fetches, TLS, parsing)
+//   - if the core was built with CONFIG_PM_ENABLE and tickless idle, the
+//     power manager does the scaling and light-sleeps through idle periods
+//
+// The average current is estimated from loop()'s awake/asleep time and the
+// rough ESP32 figures below; the OLED adds ~10 mA on top.
+
+#define POWER_CPU_MHZ_ACTIVE 240
+#define POWER_CPU_MHZ_IDLE 80
+#define POWER_LISTEN_INTERVAL 3       // beacons between wakes (~300 ms); buffered frames wait this long
+#define POWER_MAX_SLEEP_MS 1000       // upper bound on one wait, to notice a dropped connection
+
+#define POWER_ACTIVE_MA 120           // 240 MHz, radio on
+#define POWER_IDLE_MA 45              // idle at 240 MHz, default modem sleep (every beacon)
+#define POWER_IDLE_SAVE_MA 22         // idle at 80 MHz, modem sleep every POWER_LISTEN_INTERVAL beacons
+
+struct PowerStats {
+  uint64_t awakeUs;                   // loop() working
+  uint64_t asleepUs;                  // loop() blocked waiting
+  uint32_t wakes;
+  uint32_t lastLateUs;                // timed wake-up later than asked (loop jitter)
+  uint32_t maxLateUs;
+  uint32_t dataWakes;                 // wakes that brought new price data
+  uint32_t lastWakeToDataMs;          // wake until the fetched prices were applied
+  uint32_t maxWakeToDataMs;
+  uint64_t totalWakeToDataMs;
+};
+
+extern PowerStats powerStats;
+
+// Call from setup() before connecting: sets up Wi-Fi power save and frequency scaling
+void powerBegin(bool saving);
+
+// Connect to Wi-Fi with the listen interval applied (replaces WiFi.begin)
+void powerWifiBegin(const char *ssid, const char *password);
+
+// Block loop() for up to ms, or until powerWakeFromISR
+void powerWait(unsigned long ms);
+
+// Wake powerWait early, e.g. from a button interrupt
+void powerWakeFromISR();
+
+// Fetched data has been applied; records the latency since the last wake
+void powerDataReady();
+
+// Estimated average current in mA since boot
+uint32_t powerAverageMa();
+
+bool powerSaving();
+
+#endif
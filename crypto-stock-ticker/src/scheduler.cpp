@@ -0,0 +1,227 @@
+#include "scheduler.h"
+#include <limits.h>
+
+SchedulerStats schedulerStats;
+
+static FetchJob jobs[MAX_FETCH_JOBS];
+static int jobCount = 0;
+
+static unsigned long baseInterval = 60000;
+static int budget = 12;
+
+// Token bucket in thousandths of a request, holds up to one minute of budget
+static uint32_t milliTokens = 0;
+static unsigned long lastRefill = 0;
+static uint32_t refillRemainder = 0;  // ms * budget short of the next milli-token
+static unsigned long backoffUntil = 0;
+static bool backingOff = false;
+static bool waitingForBudget = false;
+
+static const time_t CLOCK_VALID_AFTER = 1600000000;  // NTP hasn't synced before this
+
+void schedulerBegin(unsigned long baseIntervalMs, int budgetPerMinute) {
+  baseInterval = baseIntervalMs;
+  budget = budgetPerMinute > 0 ? budgetPerMinute : 1;
+  milliTokens = budget * 1000;
+  lastRefill = millis();
+  refillRemainder = 0;
+  backingOff = false;
+
+  jobCount = 0;
+  int pages = (cryptoCount + CRYPTO_PAGE_SIZE - 1) / CRYPTO_PAGE_SIZE;
+  for(int page = 0; page < pages; page++) {
+    FetchJob &job = jobs[jobCount++];
+    memset(&job, 0, sizeof(job));
+    job.kind = JOB_CRYPTO_PAGE;
+    job.index = page;
+  }
+  for(int i = 0; i < stockCount; i++) {
+    FetchJob &job = jobs[jobCount++];
+    memset(&job, 0, sizeof(job));
+    job.kind = JOB_STOCK;
+    job.index = i;
+  }
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+static int32_t daysFromCivil(int year, int month, int day) {
+  year -= month <= 2;
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  int32_t yoe = year - era * 400;
+  int32_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// 0 = Sunday; 1970-01-01 was a Thursday
+static int weekdayOf(int32_t days) {
+  return (int)(((days % 7) + 11) % 7);
+}
+
+static int32_t nthSunday(int year, int month, int n) {
+  int32_t first = daysFromCivil(year, month, 1);
+  return first + (7 - weekdayOf(first)) % 7 + 7 * (n - 1);
+}
+
+bool usMarketOpen(time_t utc) {
+  struct tm t;
+  gmtime_r(&utc, &t);
+  int year = t.tm_year + 1900;
+
+  // US DST: second Sunday of March 2:00 EST to first Sunday of November 2:00 EDT
+  int64_t dstStart = (int64_t)nthSunday(year, 3, 2) * 86400 + 7 * 3600;
+  int64_t dstEnd = (int64_t)nthSunday(year, 11, 1) * 86400 + 6 * 3600;
+  int64_t local = (int64_t)utc + ((utc >= dstStart && utc < dstEnd) ? -4 : -5) * 3600;
+
+  int32_t days = (int32_t)(local / 86400);
+  int weekday = weekdayOf(days);
+  if(weekday == 0 || weekday == 6) return false;
+
+  int minutes = (int)((local - (int64_t)days * 86400) / 60);
+  return minutes >= 9 * 60 + 30 && minutes < 16 * 60;
+}
+
+static void refill(unsigned long nowMs) {
+  uint32_t capacity = budget * 1000;
+  // Elapsed ms times budget, carrying what didn't make a whole milli-token
+  uint64_t earned = (uint64_t)(nowMs - lastRefill) * budget + refillRemainder;
+  lastRefill = nowMs;
+  uint64_t added = earned / 60;
+  refillRemainder = (uint32_t)(earned % 60);
+  if(milliTokens + added >= capacity) {
+    milliTokens = capacity;
+    refillRemainder = 0;
+  } else {
+    milliTokens += added;
+  }
+}
+
+// Priority weight in percent: 100 plus boosts for volatility and visibility
+static uint32_t assetWeight(int slot, int onScreen, int upNext) {
+  // Volatility is the std dev of per-sample returns in percent; 0.25% doubles the rate
+  int64_t basisPoints = assets[slot].indicators.volatility.raw / 10000;
+  uint32_t weight = 100 + (uint32_t)(basisPoints * 4 > 300 ? 300 : basisPoints * 4);
+  if(slot == onScreen || slot == upNext) weight += 200;
+  return weight;
+}
+
+static uint32_t jobWeight(const FetchJob &job, int onScreen, int upNext) {
+  if(job.kind == JOB_STOCK) return assetWeight(stockSlots[job.index], onScreen, upNext);
+
+  // A page refreshes all its coins, so it's as urgent as its most urgent coin
+  uint32_t weight = 100;
+  int end = (job.index + 1) * CRYPTO_PAGE_SIZE;
+  if(end > cryptoCount) end = cryptoCount;
+  for(int i = job.index * CRYPTO_PAGE_SIZE; i < end; i++) {
+    uint32_t w = assetWeight(cryptoSlots[i], onScreen, upNext);
+    if(w > weight) weight = w;
+  }
+  return weight;
+}
+
+static bool clockValid(time_t utc) {
+  return utc >= CLOCK_VALID_AFTER;
+}
+
+FetchJob *schedulerNext(unsigned long nowMs, time_t nowUtc, int onScreen, int upNext) {
+  if(backingOff) {
+    if((long)(nowMs - backoffUntil) < 0) return nullptr;
+    backingOff = false;
+    lastRefill = nowMs;
+  }
+  refill(nowMs);
+
+  bool marketOpen = !clockValid(nowUtc) || usMarketOpen(nowUtc);
+  FetchJob *best = nullptr;
+  uint64_t bestScore = 0;
+
+  for(int i = 0; i < jobCount; i++) {
+    FetchJob &job = jobs[i];
+    uint64_t score;
+    if(!job.ran) {
+      score = UINT64_MAX;  // never fetched: first data beats everything
+    } else {
+      unsigned long age = nowMs - job.lastRun;
+      if(age < SCHED_MIN_INTERVAL_MS) continue;
+      // Due when age * weight reaches baseInterval * 100
+      score = (uint64_t)age * jobWeight(job, onScreen, upNext);
+      if(score < (uint64_t)baseInterval * 100) continue;
+
+      // Closed market: one refresh after the close to pick up the closing price, then nothing
+      bool closedRefreshDone = job.lastRunUtc != 0 && !usMarketOpen(job.lastRunUtc);
+      if(job.kind == JOB_STOCK && !marketOpen && closedRefreshDone) {
+        schedulerStats.closedSkips++;
+        job.lastRun = nowMs;
+        continue;
+      }
+
+      // Still within the server's max-age: treat the cached response as the refresh
+      if(fetchCacheIsFresh(job.cache, nowMs)) {
+        fetchStats.freshSkips++;
+        fetchStats.savedBytes += job.cache.bodyBytes;
+        job.lastRun = nowMs;
+        continue;
+      }
+    }
+
+    if(best == nullptr || score > bestScore) {
+      best = &job;
+      bestScore = score;
+    }
+  }
+
+  if(best == nullptr) return nullptr;
+  if(milliTokens < 1000) {
+    if(!waitingForBudget) schedulerStats.budgetWaits++;
+    waitingForBudget = true;
+    return nullptr;
+  }
+  waitingForBudget = false;
+  milliTokens -= 1000;
+  schedulerStats.requests++;
+  return best;
+}
+
+unsigned long schedulerIdleMs(unsigned long nowMs, int onScreen, int upNext) {
+  if(backingOff && (long)(nowMs - backoffUntil) < 0) return backoffUntil - nowMs;
+  if(jobCount == 0) return ULONG_MAX;
+
+  unsigned long wait = ULONG_MAX;
+  for(int i = 0; i < jobCount && wait > 0; i++) {
+    const FetchJob &job = jobs[i];
+    if(!job.ran) {
+      wait = 0;
+      break;
+    }
+    // Inverse of the due test in schedulerNext: age * weight >= baseInterval * 100
+    uint32_t weight = jobWeight(job, onScreen, upNext);
+    unsigned long dueAge = (unsigned long)(((uint64_t)baseInterval * 100 + weight - 1) / weight);
+    if(dueAge < SCHED_MIN_INTERVAL_MS) dueAge = SCHED_MIN_INTERVAL_MS;
+    unsigned long age = nowMs - job.lastRun;
+    unsigned long remaining = age >= dueAge ? 0 : dueAge - age;
+    if(remaining < wait) wait = remaining;
+  }
+
+  // The bucket may still need refilling by then
+  if(milliTokens < 1000) {
+    unsigned long refillAge = (unsigned long)(((uint64_t)(1000 - milliTokens) * 60 + budget - 1) / budget);
+    unsigned long elapsed = nowMs - lastRefill;
+    unsigned long tokenWait = elapsed >= refillAge ? 0 : refillAge - elapsed;
+    if(tokenWait > wait) wait = tokenWait;
+  }
+  return wait;
+}
+
+void schedulerDone(FetchJob &job, int httpCode, unsigned long nowMs, time_t nowUtc) {
+  job.ran = true;
+  job.lastRun = nowMs;
+  job.lastRunUtc = clockValid(nowUtc) ? nowUtc : 0;
+
+  if(httpCode == 429) {
+    schedulerStats.rateLimited++;
+    milliTokens = 0;
+    backingOff = true;
+    backoffUntil = nowMs + SCHED_RATE_LIMIT_BACKOFF_MS;
+    Serial.printf("[Sched] Rate limited, pausing %d s\n", SCHED_RATE_LIMIT_BACKOFF_MS / 1000);
+  }
+}
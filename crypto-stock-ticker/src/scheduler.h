@@ -0,0 +1,65 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <time.h>
+#include "asset_registry.h"
+#include "fetch_cache.h"
+
+// Decides which price request to send next.
+//
+// Each CoinGecko page and each Yahoo symbol is a fetch job. A job is due once
+// its age reaches the base interval scaled down by its weight: volatile
+// assets and the ones on screen refresh more often. Requests are paid for from
+// a token bucket refilled at a fixed requests-per-minute budget; when the
+// budget is short the most overdue job goes first. Stocks are only refreshed
+// while the US market is open, plus once after the close.
+
+#define CRYPTO_PAGE_SIZE 25                 // CoinGecko ids per request
+#define MAX_CRYPTO_PAGES ((MAX_ASSETS + CRYPTO_PAGE_SIZE - 1) / CRYPTO_PAGE_SIZE)
+#define MAX_FETCH_JOBS (MAX_CRYPTO_PAGES + MAX_ASSETS)
+
+#define SCHED_MIN_INTERVAL_MS 15000         // no job refreshes faster than this
+#define SCHED_RATE_LIMIT_BACKOFF_MS 60000   // pause after an HTTP 429
+
+enum FetchJobKind : uint8_t {
+  JOB_CRYPTO_PAGE,
+  JOB_STOCK
+};
+
+struct FetchJob {
+  FetchCache cache;
+  unsigned long lastRun;    // millis()
+  time_t lastRunUtc;        // wall clock of the last run, 0 if the clock wasn't set
+  uint16_t index;           // crypto page, or index into stockSlots
+  FetchJobKind kind;
+  bool ran;
+};
+
+struct SchedulerStats {
+  uint32_t requests;
+  uint32_t budgetWaits;     // a job was due but the bucket was empty
+  uint32_t rateLimited;     // HTTP 429 responses
+  uint32_t closedSkips;     // stock refreshes skipped while the market was closed
+};
+
+extern SchedulerStats schedulerStats;
+
+// Build the job table from the loaded registry
+void schedulerBegin(unsigned long baseIntervalMs, int budgetPerMinute);
+
+// Next job to run, or nullptr if nothing is due or the budget is spent.
+// onScreen / upNext are asset slots (-1 if none) that get a priority boost.
+FetchJob *schedulerNext(unsigned long nowMs, time_t nowUtc, int onScreen, int upNext);
+
+// Milliseconds until schedulerNext could return a job (0 if one is due now),
+// so the caller can sleep until then
+unsigned long schedulerIdleMs(unsigned long nowMs, int onScreen, int upNext);
+
+// Report the result of a job returned by schedulerNext
+void schedulerDone(FetchJob &job, int httpCode, unsigned long nowMs, time_t nowUtc);
+
+// NYSE/Nasdaq regular session, 9:30-16:00 New York time on weekdays.
+// Exchange holidays aren't modelled; their unchanged responses are cheap anyway.
+bool usMarketOpen(time_t utc);
+
+#endif
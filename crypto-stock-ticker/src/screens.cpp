@@ -0,0 +1,301 @@
+#include "screens.h"
+#include <WiFi.h>
+#include <time.h>
+#include "alloc_check.h"
+#include "display_task.h"
+#include "fx.h"
+#include "portfolio.h"
+#include "tape.h"
+
+static void drawSparkline(Asset &asset, int x, int y, int width, int height) {
+  const PriceHistory &history = registryHistory(asset);
+  if(!history.filled && history.index < 2) return;
+  
+  int dataPoints = history.filled ? HISTORY_SIZE : history.index;
+  if(dataPoints < 2) return;
+  
+  // Find min and max for scaling
+  int64_t minPrice = history.prices[0].raw;
+  int64_t maxPrice = history.prices[0].raw;
+  
+  for(int i = 0; i < dataPoints; i++) {
+    if(history.prices[i].raw < minPrice) minPrice = history.prices[i].raw;
+    if(history.prices[i].raw > maxPrice) maxPrice = history.prices[i].raw;
+  }
+  
+  int64_t range = maxPrice - minPrice;
+  if(range < FIXED_SCALE / 100) range = asset.price.raw / 100; // Avoid division by zero
+  if(range <= 0) range = 1;
+  
+  // Draw sparkline
+  for(int i = 1; i < dataPoints && i < width; i++) {
+    int idx1 = (history.index + i - 1) % HISTORY_SIZE;
+    int idx2 = (history.index + i) % HISTORY_SIZE;
+    
+    int y1 = y + height - (int)((history.prices[idx1].raw - minPrice) * height / range);
+    int y2 = y + height - (int)((history.prices[idx2].raw - minPrice) * height / range);
+    
+    display.drawLine(x + i - 1, y1, x + i, y2, SSD1306_WHITE);
+  }
+}
+
+void formatLargeNumber(Fixed num, char *buf, size_t len) {
+  fixedFormatCompact(buf, len, num);
+}
+
+static void formatVolume(Fixed vol, char *buf, size_t len) {
+  if(len < 2) return;
+  buf[0] = fxGlyph(fxDisplay());
+  fixedFormatCompact(buf + 1, len - 1, vol);
+}
+
+static const char *getTrendArrow(Fixed change) {
+  if(change > Fixed::fromInt(5)) return "^^";
+  if(change > Fixed::fromInt(2)) return "^";
+  if(change > Fixed::fromInt(0)) return "-";
+  if(change > Fixed::fromInt(-2)) return "v";
+  if(change > Fixed::fromInt(-5)) return "vv";
+  return "VV";
+}
+
+// Header with a label, the time and WiFi bars, above a divider at y = 9
+static void drawHeader(const char *label) {
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.print(label);
+  
+  // Current time
+  struct tm timeinfo;
+  if(getLocalTime(&timeinfo)) {
+    char timeStr[6];
+    strftime(timeStr, sizeof(timeStr), "%H:%M", &timeinfo);
+    display.setCursor(96, 0);
+    display.print(timeStr);
+  }
+  
+  // WiFi indicator
+  if(WiFi.status() == WL_CONNECTED) {
+    display.setCursor(75, 0);
+    int rssi = WiFi.RSSI();
+    if(rssi > -60) display.print(F("|||"));
+    else if(rssi > -75) display.print(F("|| "));
+    else display.print(F("|  "));
+  }
+  
+  display.drawLine(0, 9, DISPLAY_WIDTH, 9, SSD1306_WHITE);
+}
+
+void drawAsset(Asset &asset) {
+  static AllocSite site("drawAsset");
+  AllocScope check(site);
+  display.clearDisplay();
+  drawHeader(asset.kind == ASSET_CRYPTO ? "CRYPTO" : "STOCK");
+  
+  if(asset.dataValid) {
+    // Symbol and trend arrow
+    display.setTextSize(1);
+    display.setCursor(0, 11);
+    display.print(asset.symbol);
+    display.print(" ");
+    display.print(getTrendArrow(asset.change24h));
+    
+    // Indicators: EMA9/21 trend, RSI14 and volatility
+    char text[24];
+    IndicatorState &ind = asset.indicators;
+    display.setCursor(56, 11);
+    if(indicatorsEmaReady(ind)) {
+      display.print(ind.emaFast >= ind.emaSlow ? F("E+") : F("E-"));
+    }
+    if(indicatorsRsiReady(ind)) {
+      display.setCursor(72, 11);
+      display.print(F("R"));
+      fixedFormat(text, sizeof(text), ind.rsi, 0);
+      display.print(text);
+    }
+    display.setCursor(98, 11);
+    display.print(F("V"));
+    fixedFormat(text, sizeof(text), ind.volatility, 1);
+    display.print(text);
+    
+    // Price - large, in the display currency
+    Fixed price = fxToDisplay(asset.price);
+    display.setTextSize(2);
+    display.setCursor(0, 21);
+    display.print(fxGlyph(fxDisplay()));
+    if(price >= Fixed::fromInt(1000)) {
+      fixedFormat(text, sizeof(text), price, 0);
+    } else if(price >= Fixed::fromInt(100)) {
+      fixedFormat(text, sizeof(text), price, 1);
+    } else if(price >= Fixed::fromInt(10)) {
+      fixedFormat(text, sizeof(text), price, 2);
+    } else if(price >= Fixed::fromInt(1)) {
+      fixedFormat(text, sizeof(text), price, 3);
+    } else {
+      display.setTextSize(1);
+      display.setCursor(6, 25);
+      fixedFormat(text, sizeof(text), price, 4);
+    }
+    display.print(text);
+    
+    // 24h change
+    display.setTextSize(1);
+    display.setCursor(0, 38);
+    fixedFormat(text, sizeof(text), asset.change24h, 2, true);
+    display.print(text);
+    display.print(F("%"));
+    
+    // High/Low
+    display.setCursor(40, 38);
+    display.print(F("H:"));
+    fixedFormat(text, sizeof(text), fxToDisplay(asset.high24h), 0);
+    display.print(text);
+    display.setCursor(78, 38);
+    display.print(F("L:"));
+    fixedFormat(text, sizeof(text), fxToDisplay(asset.low24h), 0);
+    display.print(text);
+    
+    // Volume and Market Cap
+    display.setCursor(0, 47);
+    display.print(F("Vol:"));
+    formatVolume(fxToDisplay(asset.volume24h), text, sizeof(text));
+    display.print(text);
+    
+    display.setCursor(0, 56);
+    display.print(F("MCap:"));
+    formatLargeNumber(fxToDisplay(asset.marketCap), text, sizeof(text));
+    display.print(text);
+    
+    // Sparkline on the right
+    drawSparkline(asset, 70, 47, 58, 16);
+    
+  } else {
+    display.setTextSize(1);
+    display.setCursor(0, 30);
+    display.print(F("Loading data..."));
+  }
+  
+  displaySubmit(display.getBuffer());
+}
+
+// Whole units from 1000 up, cents below
+static size_t formatMoney(char *buf, size_t len, Fixed value, bool showPlus) {
+  Fixed magnitude = value.isNegative() ? -value : value;
+  return fixedFormat(buf, len, value, magnitude >= Fixed::fromInt(1000) ? 0 : 2, showPlus);
+}
+
+void drawPortfolio() {
+  static AllocSite site("drawPortfolio");
+  AllocScope check(site);
+  display.clearDisplay();
+  drawHeader("PORTFOLIO");
+  
+  char text[24];
+  char percent[12];
+  
+  // Total value - large
+  display.setTextSize(2);
+  display.setCursor(0, 12);
+  display.print(fxGlyph(fxDisplay()));
+  formatMoney(text, sizeof(text), fxToDisplay(portfolio.value), false);
+  display.print(text);
+  
+  // Day and total P&L
+  display.setTextSize(1);
+  display.setCursor(0, 30);
+  display.print(F("Day "));
+  formatMoney(text, sizeof(text), fxToDisplay(portfolio.dayChange), true);
+  fixedFormat(percent, sizeof(percent), portfolioDayPercent(), 1, true);
+  display.print(text);
+  display.print(F(" "));
+  display.print(percent);
+  display.print(F("%"));
+  
+  display.setCursor(0, 39);
+  display.print(F("P&L "));
+  formatMoney(text, sizeof(text), fxToDisplay(portfolioTotalPnl()), true);
+  fixedFormat(percent, sizeof(percent), portfolioTotalPnlPercent(), 1, true);
+  display.print(text);
+  display.print(F(" "));
+  display.print(percent);
+  display.print(F("%"));
+  
+  // Four largest positions by allocation
+  const int TOP = 4;
+  int top[TOP];
+  int found = 0;
+  for(int i = 0; i < portfolio.holdings; i++) {
+    if(!holdings[i].priced) continue;
+    int pos = found < TOP ? found++ : TOP;
+    while(pos > 0 && holdings[i].value > holdings[top[pos - 1]].value) {
+      if(pos < TOP) top[pos] = top[pos - 1];
+      pos--;
+    }
+    if(pos < TOP) top[pos] = i;
+  }
+  for(int i = 0; i < found; i++) {
+    const Holding &holding = holdings[top[i]];
+    fixedFormat(percent, sizeof(percent), portfolioAllocation(holding), 0);
+    snprintf(text, sizeof(text), "%s %s%%", assets[holding.slot].symbol, percent);
+    display.setCursor((i % 2) * 64, 48 + (i / 2) * 8);
+    display.print(text);
+  }
+  
+  displaySubmit(display.getBuffer());
+}
+
+// Everything around the tape. Only these pages are sent; the tape task owns the middle ones.
+void drawTapeFrame() {
+  static AllocSite site("drawTapeFrame");
+  AllocScope check(site);
+  display.clearDisplay();
+  drawHeader("TAPE");
+  
+  int up = 0;
+  int down = 0;
+  for(int i = 0; i < assetCount; i++) {
+    if(!assets[i].dataValid) continue;
+    if(assets[i].change24h.isNegative()) down++;
+    else up++;
+  }
+  
+  char text[24];
+  display.setTextSize(1);
+  snprintf(text, sizeof(text), "Up %d  Down %d", up, down);
+  display.setCursor(0, 48);
+  display.print(text);
+  snprintf(text, sizeof(text), "%d of %d shown", tapeStats.assetsShown, assetCount);
+  display.setCursor(0, 56);
+  display.print(text);
+  
+  const uint8_t tapePages = ((1 << TAPE_PAGES) - 1) << TAPE_FIRST_PAGE;
+  displaySubmit(display.getBuffer(), DISPLAY_ALL_PAGES & ~tapePages);
+}
+
+void drawAlert(const AlertEvent &event) {
+  static AllocSite site("drawAlert");
+  AllocScope check(site);
+  Asset &asset = assets[event.slot];
+  char text[48];
+  
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.print(F("!! PRICE ALERT !!"));
+  display.drawLine(0, 9, DISPLAY_WIDTH, 9, SSD1306_WHITE);
+  
+  display.setTextSize(2);
+  display.setCursor(0, 14);
+  display.print(asset.symbol);
+  
+  display.setCursor(0, 32);
+  display.print(F("$"));
+  fixedFormat(text, sizeof(text), event.price, event.price >= Fixed::fromInt(1000) ? 0 : 2);
+  display.print(text);
+  
+  display.setTextSize(1);
+  display.setCursor(0, 54);
+  alertsDescribe(event, text, sizeof(text));
+  display.print(text);
+  
+  displaySubmit(display.getBuffer());
+}
@@ -0,0 +1,29 @@
+#ifndef SCREENS_H
+#define SCREENS_H
+
+#include <Adafruit_SSD1306.h>
+#include "alerts.h"
+#include "asset_registry.h"
+
+// The screens loop() shows: one asset, the portfolio, the frame around the
+// ticker tape and a price alert. Each one draws into the display's buffer
+// and hands it to the display task with displaySubmit(); none of them
+// allocates (each is an AllocSite, see alloc_check.h).
+//
+// They draw through the Adafruit_SSD1306 interface only, so the host tests
+// can swap in the fake from test/shim and run whole frames under the
+// malloc hook.
+
+// The panel, set up in main.cpp
+extern Adafruit_SSD1306 display;
+
+void drawAsset(Asset &asset);
+void drawPortfolio();
+void drawTapeFrame();
+
+void drawAlert(const AlertEvent &event);
+
+// Compact "1.9T" form (fixedFormatCompact), also used for the serial log
+void formatLargeNumber(Fixed num, char *buf, size_t len);
+
+#endif
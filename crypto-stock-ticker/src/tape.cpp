@@ -0,0 +1,173 @@
+#include "tape.h"
+#include "alloc_check.h"
+#include "display_task.h"
+#include "fx.h"
+#include <Adafruit_GFX.h>
+#include <Adafruit_SSD1306.h>
+
+TapeStats tapeStats;
+
+static TaskHandle_t tapeTaskHandle = nullptr;
+static SemaphoreHandle_t frameMutex = nullptr;   // held while the strip is read or rebuilt
+static volatile bool running = false;
+
+// Page-major strip, TAPE_PAGES rows of TAPE_STRIP_WIDTH bytes
+static uint8_t strip[TAPE_PAGES * TAPE_STRIP_WIDTH];
+static uint16_t stripWidth = 0;
+static uint16_t scrollOffset = 0;
+
+// GFX target that writes straight into the page-major strip
+class TapeCanvas : public Adafruit_GFX {
+ public:
+  TapeCanvas(uint8_t *buffer, int16_t w, int16_t h) : Adafruit_GFX(w, h), buffer(buffer) {}
+
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if(x < 0 || y < 0 || x >= width() || y >= height()) return;
+    uint8_t &cell = buffer[(y / 8) * width() + x];
+    if(color) cell |= 1 << (y & 7);
+    else cell &= ~(1 << (y & 7));
+  }
+
+ private:
+  uint8_t *buffer;
+};
+
+static void sendFrame() {
+  static uint8_t frame[TAPE_PAGES * DISPLAY_WIDTH];
+
+  // Window of the circular strip, split in two copies where it wraps
+  for(int page = 0; page < TAPE_PAGES; page++) {
+    const uint8_t *row = strip + page * TAPE_STRIP_WIDTH;
+    uint8_t *out = frame + page * DISPLAY_WIDTH;
+    size_t first = stripWidth - scrollOffset;
+    if(first > DISPLAY_WIDTH) first = DISPLAY_WIDTH;
+    memcpy(out, row + scrollOffset, first);
+    memcpy(out + first, row, DISPLAY_WIDTH - first);
+  }
+  displaySendPages(frame, TAPE_FIRST_PAGE, TAPE_PAGES);
+}
+
+static void tapeTask(void *param) {
+  TickType_t wake = xTaskGetTickCount();
+  for(;;) {
+    if(!running) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      wake = xTaskGetTickCount();
+      continue;
+    }
+    vTaskDelayUntil(&wake, pdMS_TO_TICKS(TAPE_FRAME_MS));
+
+    xSemaphoreTake(frameMutex, portMAX_DELAY);
+    if(running && stripWidth > 0) {
+      static AllocSite site("tapeFrame");
+      AllocScope check(site);
+      unsigned long start = micros();
+      sendFrame();
+      scrollOffset = (scrollOffset + TAPE_STEP_PX) % stripWidth;
+
+      uint32_t elapsed = micros() - start;
+      tapeStats.frames++;
+      tapeStats.lastBlitUs = elapsed;
+      if(elapsed > tapeStats.maxBlitUs) tapeStats.maxBlitUs = elapsed;
+      if(elapsed > TAPE_FRAME_MS * 1000UL) tapeStats.lateFrames++;
+    }
+    xSemaphoreGive(frameMutex);
+  }
+}
+
+void tapeBegin() {
+  frameMutex = xSemaphoreCreateMutex();
+  // Core 0 next to the WiFi stack, leaving core 1 to loop() and its fetches
+  xTaskCreatePinnedToCore(tapeTask, "tape", 3072, nullptr, 1, &tapeTaskHandle, 0);
+}
+
+void tapeStart() {
+  if(running) return;
+  running = true;
+  xTaskNotifyGive(tapeTaskHandle);
+}
+
+void tapeStop() {
+  running = false;
+  // Wait out a frame that is already on the bus
+  xSemaphoreTake(frameMutex, portMAX_DELAY);
+  xSemaphoreGive(frameMutex);
+}
+
+bool tapeRunning() {
+  return running;
+}
+
+static int priceDecimals(Fixed price) {
+  if(price >= Fixed::fromInt(1000)) return 0;
+  if(price >= Fixed::fromInt(100)) return 1;
+  if(price >= Fixed::fromInt(10)) return 2;
+  if(price >= Fixed::fromInt(1)) return 3;
+  return 4;
+}
+
+// Draw one entry at x; returns its width including the gap after it, or 0 if it doesn't fit
+static int drawEntry(TapeCanvas &canvas, int x, const Asset &asset) {
+  char price[24];
+  char change[16];
+  Fixed value = fxToDisplay(asset.price);
+  price[0] = fxGlyph(fxDisplay());
+  fixedFormat(price + 1, sizeof(price) - 1, value, priceDecimals(value));
+  Fixed magnitude = asset.change24h.isNegative() ? -asset.change24h : asset.change24h;
+  size_t changeLen = fixedFormat(change, sizeof(change), magnitude, 2);
+  change[changeLen++] = '%';
+  change[changeLen] = '\0';
+
+  // Size 2 symbol and price, 8 px arrow, size 1 change, then a gap
+  int textWidth = (strlen(asset.symbol) + 1 + strlen(price)) * 12;
+  int width = textWidth + 4 + 8 + 2 + changeLen * 6 + 18;
+  if(x + width > TAPE_STRIP_WIDTH) return 0;
+
+  canvas.setTextSize(2);
+  canvas.setCursor(x, 1);
+  canvas.print(asset.symbol);
+  canvas.print(' ');
+  canvas.print(price);
+
+  int arrowX = x + textWidth + 4;
+  if(asset.change24h.isNegative()) {
+    canvas.fillTriangle(arrowX, 5, arrowX + 7, 5, arrowX + 3, 11, SSD1306_WHITE);
+  } else {
+    canvas.fillTriangle(arrowX, 11, arrowX + 7, 11, arrowX + 3, 4, SSD1306_WHITE);
+  }
+
+  canvas.setTextSize(1);
+  canvas.setCursor(arrowX + 10, 5);
+  canvas.print(change);
+  return width;
+}
+
+void tapeRebuild() {
+  static AllocSite site("tapeRebuild");
+  AllocScope check(site);
+  xSemaphoreTake(frameMutex, portMAX_DELAY);
+
+  memset(strip, 0, sizeof(strip));
+  TapeCanvas canvas(strip, TAPE_STRIP_WIDTH, TAPE_PAGES * 8);
+  canvas.setTextWrap(false);
+  canvas.cp437(true);
+  canvas.setTextColor(SSD1306_WHITE);
+
+  int x = 0;
+  int shown = 0;
+  for(int i = 0; i < assetCount; i++) {
+    if(!assets[i].dataValid) continue;
+    int width = drawEntry(canvas, x, assets[i]);
+    if(width == 0) break;
+    x += width;
+    shown++;
+  }
+
+  // A tape shorter than the screen just repeats with a blank tail
+  stripWidth = x < DISPLAY_WIDTH ? DISPLAY_WIDTH : x;
+  scrollOffset %= stripWidth;
+  tapeStats.stripWidth = stripWidth;
+  tapeStats.assetsShown = shown;
+
+  xSemaphoreGive(frameMutex);
+}
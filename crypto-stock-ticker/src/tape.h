@@ -0,0 +1,46 @@
+#ifndef TAPE_H
+#define TAPE_H
+
+#include "asset_registry.h"
+
+// Scrolling ticker tape: "BTC 67012 ^1.23%  ETH 3120 v0.80% ..." moving
+// right to left across the middle of the OLED.
+//
+// The whole tape is pre-rendered into an off-screen strip laid out like the
+// SSD1306 memory (one byte = 8 vertical pixels, page-major). Each frame a
+// dedicated task copies a 128-column window of the strip and sends only the
+// tape's pages over I2C, instead of redrawing and pushing the full 1 KB frame.
+// The SSD1306 hardware scroll can't be used: it only rotates what is already
+// on screen, so new text could never scroll in.
+
+#define TAPE_FIRST_PAGE 3             // rows 24-39
+#define TAPE_PAGES 2                  // text size 2 is 16 px tall
+#define TAPE_STRIP_WIDTH 4096         // columns; assets that don't fit are left out
+#define TAPE_FRAME_MS 33              // ~30 fps
+#define TAPE_STEP_PX 1                // columns scrolled per frame
+
+struct TapeStats {
+  uint32_t frames;
+  uint32_t lastBlitUs;                // build + I2C time of the last frame
+  uint32_t maxBlitUs;
+  uint32_t lateFrames;                // frames that took longer than TAPE_FRAME_MS
+  uint16_t stripWidth;
+  uint8_t assetsShown;
+};
+
+extern TapeStats tapeStats;
+
+// Create the tape task (idle until tapeStart). Call after displayTaskBegin.
+void tapeBegin();
+
+void tapeStart();
+
+// Stop scrolling; returns once no frame is being sent, so the caller can use the display
+void tapeStop();
+
+bool tapeRunning();
+
+// Re-render the strip from the current prices
+void tapeRebuild();
+
+#endif
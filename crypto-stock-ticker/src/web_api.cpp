@@ -0,0 +1,377 @@
+#include "web_api.h"
+#include "fx.h"
+#include "portfolio.h"
+#include <WiFi.h>
+#include <ESPAsyncWebServer.h>
+#include <LittleFS.h>
+#include <time.h>
+
+static AsyncWebServer server(80);
+static AsyncEventSource events("/api/events");
+
+// Assets changed since the last publish, one bit per slot
+static uint32_t dirtySlots[(MAX_ASSETS + 31) / 32];
+
+// Append-only writer over a fixed buffer; overflow sticks and the output is discarded
+struct JsonOut {
+  char *buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+  bool needComma;
+
+  JsonOut(char *buf, size_t cap) : buf(buf), cap(cap), len(0), overflow(false), needComma(false) {}
+
+  void raw(const char *s, size_t n) {
+    if(overflow || len + n > cap) {
+      overflow = true;
+      return;
+    }
+    memcpy(buf + len, s, n);
+    len += n;
+  }
+  void raw(const char *s) { raw(s, strlen(s)); }
+  void ch(char c) { raw(&c, 1); }
+};
+
+static void jsonString(JsonOut &out, const char *s) {
+  out.ch('"');
+  for(; *s; s++) {
+    if(*s == '"' || *s == '\\') {
+      out.ch('\\');
+      out.ch(*s);
+    } else if((uint8_t)*s < 0x20) {
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", *s);
+      out.raw(esc);
+    } else {
+      out.ch(*s);
+    }
+  }
+  out.ch('"');
+}
+
+static void jsonKey(JsonOut &out, const char *key) {
+  if(out.needComma) out.ch(',');
+  out.ch('"');
+  out.raw(key);
+  out.raw("\":");
+  out.needComma = true;
+}
+
+// Shortest exact decimal for a Fixed, e.g. 67012.5 or -0.000125
+static void jsonFixedValue(JsonOut &out, Fixed value) {
+  char tmp[28];
+  size_t n = fixedFormat(tmp, sizeof(tmp), value, FIXED_DECIMALS);
+  while(n > 0 && tmp[n - 1] == '0') n--;
+  if(n > 0 && tmp[n - 1] == '.') n--;
+  out.raw(tmp, n);
+}
+
+static void jsonUnsigned(JsonOut &out, unsigned long value) {
+  char tmp[12];
+  out.raw(tmp, snprintf(tmp, sizeof(tmp), "%lu", value));
+}
+
+static void fieldFixed(JsonOut &out, const char *key, Fixed value) {
+  jsonKey(out, key);
+  jsonFixedValue(out, value);
+}
+
+static void fieldFixedOrNull(JsonOut &out, const char *key, Fixed value, bool ready) {
+  jsonKey(out, key);
+  if(ready) jsonFixedValue(out, value);
+  else out.raw("null");
+}
+
+size_t webAssetJson(char *buf, size_t len, const Asset &asset) {
+  JsonOut out(buf, len);
+  out.ch('{');
+  jsonKey(out, "id");
+  jsonString(out, asset.id);
+  jsonKey(out, "sym");
+  jsonString(out, asset.symbol);
+  jsonKey(out, "name");
+  jsonString(out, asset.name);
+  jsonKey(out, "kind");
+  out.raw(asset.kind == ASSET_CRYPTO ? "\"crypto\"" : "\"stock\"");
+  jsonKey(out, "valid");
+  out.raw(asset.dataValid ? "true" : "false");
+  jsonKey(out, "age");
+  jsonUnsigned(out, asset.dataValid ? (millis() - asset.lastUpdate) / 1000 : 0);
+
+  fieldFixed(out, "price", asset.price);
+  fieldFixed(out, "chg", asset.change24h);
+  fieldFixed(out, "high", asset.high24h);
+  fieldFixed(out, "low", asset.low24h);
+  fieldFixed(out, "vol", asset.volume24h);
+  fieldFixed(out, "mcap", asset.marketCap);
+
+  const IndicatorState &ind = asset.indicators;
+  fieldFixedOrNull(out, "ema9", ind.emaFast, indicatorsEmaReady(ind));
+  fieldFixedOrNull(out, "ema21", ind.emaSlow, indicatorsEmaReady(ind));
+  fieldFixedOrNull(out, "rsi", ind.rsi, indicatorsRsiReady(ind));
+  fieldFixed(out, "sd", ind.volatility);
+  fieldFixedOrNull(out, "vwap", ind.vwap, indicatorsVwapReady(ind));
+
+  // Oldest first, as [time, price] pairs
+  jsonKey(out, "hist");
+  out.ch('[');
+  const PriceHistory &history = registryHistory(asset);
+  int count = history.filled ? HISTORY_SIZE : history.index;
+  int start = history.filled ? history.index : 0;
+  for(int i = 0; i < count; i++) {
+    int idx = (start + i) % HISTORY_SIZE;
+    if(i > 0) out.ch(',');
+    out.ch('[');
+    jsonUnsigned(out, history.times[idx]);
+    out.ch(',');
+    jsonFixedValue(out, history.prices[idx]);
+    out.ch(']');
+  }
+  out.raw("]}");
+
+  return out.overflow ? 0 : out.len;
+}
+
+// Renders record `stage` of a chunked JSON response into buf; 0 if it doesn't fit.
+// Stage 0 opens the document, the last stage closes it. `separate` asks for a
+// leading comma: an earlier record was written (one may have been skipped).
+typedef size_t (*StageRenderer)(int stage, int stages, bool separate, char *buf, size_t len);
+
+// Per-response state of a chunked response. A record that doesn't fit the
+// remaining response buffer is rendered here and drained over the next chunks.
+struct ChunkCursor {
+  bool inUse;
+  StageRenderer render;
+  int stage;
+  int stages;
+  bool wroteRecord;
+  size_t pendingLen;
+  size_t pendingOff;
+  char pending[WEB_ASSET_JSON_MAX + 1];
+};
+
+static ChunkCursor cursors[WEB_MAX_SNAPSHOTS];
+
+static size_t closeDocument(char *buf, size_t len) {
+  if(len < 2) return 0;
+  memcpy(buf, "]}", 2);
+  return 2;
+}
+
+static size_t renderSnapshot(int stage, int stages, bool separate, char *buf, size_t len) {
+  if(stage == 0) {
+    JsonOut out(buf, len);
+    out.raw("{\"time\":");
+    jsonUnsigned(out, (unsigned long)time(nullptr));
+    out.raw(",\"uptime\":");
+    jsonUnsigned(out, millis() / 1000);
+    // Prices stay in USD; the rates let the page show the device's display currency
+    out.raw(",\"currency\":");
+    jsonString(out, fxCode(fxDisplay()));
+    out.raw(",\"fx\":{");
+    for(int i = 0; i < CCY_COUNT; i++) {
+      Fixed rate = fxRate((Currency)i);
+      if(rate.isZero()) continue;
+      jsonKey(out, fxCode((Currency)i));
+      jsonFixedValue(out, rate);
+    }
+    out.raw("},\"assets\":[");
+    return out.overflow ? 0 : out.len;
+  }
+  if(stage == stages - 1) return closeDocument(buf, len);
+
+  size_t offset = separate ? 1 : 0;
+  if(len <= offset) return 0;
+  registryLock();
+  size_t n = webAssetJson(buf + offset, len - offset, assets[stage - 1]);
+  registryUnlock();
+  if(n == 0) return 0;
+  if(offset) buf[0] = ',';
+  return n + offset;
+}
+
+static void portfolioTotalsJson(JsonOut &out) {
+  out.ch('{');
+  fieldFixed(out, "value", portfolio.value);
+  fieldFixed(out, "day", portfolio.dayChange);
+  fieldFixed(out, "dayPct", portfolioDayPercent());
+  fieldFixed(out, "cost", portfolio.cost);
+  fieldFixed(out, "pnl", portfolioTotalPnl());
+  fieldFixed(out, "pnlPct", portfolioTotalPnlPercent());
+  jsonKey(out, "priced");
+  jsonUnsigned(out, portfolio.priced);
+  jsonKey(out, "holdings");
+  jsonUnsigned(out, portfolio.holdings);
+  out.ch('}');
+}
+
+static size_t renderPortfolio(int stage, int stages, bool separate, char *buf, size_t len) {
+  JsonOut out(buf, len);
+  registryLock();
+  if(stage == 0) {
+    out.raw("{\"totals\":");
+    portfolioTotalsJson(out);
+    out.raw(",\"holdings\":[");
+  } else if(stage == stages - 1) {
+    out.raw("]}");
+  } else {
+    const Holding &holding = holdings[stage - 1];
+    const Asset &asset = assets[holding.slot];
+    if(separate) out.ch(',');
+    out.ch('{');
+    jsonKey(out, "id");
+    jsonString(out, asset.id);
+    jsonKey(out, "sym");
+    jsonString(out, asset.symbol);
+    fieldFixed(out, "qty", holding.quantity);
+    fieldFixed(out, "cost", holding.costBasis);
+    fieldFixedOrNull(out, "value", holding.value, holding.priced);
+    fieldFixedOrNull(out, "day", holding.dayChange, holding.priced);
+    fieldFixedOrNull(out, "pnl", holding.value - holding.costBasis, holding.priced);
+    fieldFixedOrNull(out, "alloc", portfolioAllocation(holding), holding.priced);
+    out.ch('}');
+  }
+  registryUnlock();
+  return out.overflow ? 0 : out.len;
+}
+
+static size_t fillChunk(ChunkCursor &cursor, uint8_t *buffer, size_t maxLen) {
+  char *out = (char *)buffer;
+  size_t written = 0;
+
+  while(written < maxLen) {
+    if(cursor.pendingOff < cursor.pendingLen) {
+      size_t n = cursor.pendingLen - cursor.pendingOff;
+      if(n > maxLen - written) n = maxLen - written;
+      memcpy(out + written, cursor.pending + cursor.pendingOff, n);
+      cursor.pendingOff += n;
+      written += n;
+      continue;
+    }
+    if(cursor.stage >= cursor.stages) break;
+
+    // Straight into the response buffer when it fits, otherwise stage it
+    bool separate = cursor.wroteRecord;
+    size_t n = cursor.render(cursor.stage, cursor.stages, separate, out + written, maxLen - written);
+    if(n > 0) {
+      written += n;
+    } else {
+      n = cursor.render(cursor.stage, cursor.stages, separate, cursor.pending, sizeof(cursor.pending));
+      cursor.pendingLen = n;
+      cursor.pendingOff = 0;
+      if(n == 0) {
+        Serial.printf("[Web] Record %d too large, skipped\n", cursor.stage);
+      }
+    }
+    if(n > 0 && cursor.stage > 0) cursor.wroteRecord = true;
+    cursor.stage++;
+  }
+  return written;
+}
+
+static void sendChunked(AsyncWebServerRequest *request, StageRenderer render, int records) {
+  ChunkCursor *cursor = nullptr;
+  for(int i = 0; i < WEB_MAX_SNAPSHOTS; i++) {
+    if(!cursors[i].inUse) {
+      cursor = &cursors[i];
+      break;
+    }
+  }
+  if(cursor == nullptr) {
+    request->send(503, "text/plain", "Busy");
+    return;
+  }
+
+  cursor->inUse = true;
+  cursor->render = render;
+  cursor->stage = 0;
+  cursor->stages = records + 2;
+  cursor->wroteRecord = false;
+  cursor->pendingLen = 0;
+  cursor->pendingOff = 0;
+
+  AsyncWebServerResponse *response = request->beginChunkedResponse("application/json",
+    [cursor](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      return fillChunk(*cursor, buffer, maxLen);
+    });
+  response->addHeader("Cache-Control", "no-store");
+  request->onDisconnect([cursor]() { cursor->inUse = false; });
+  request->send(response);
+}
+
+void webMarkDirty(int slot) {
+  if(slot < 0 || slot >= MAX_ASSETS) return;
+  dirtySlots[slot / 32] |= 1UL << (slot % 32);
+}
+
+void webPublishChanges() {
+  static char record[WEB_ASSET_JSON_MAX];
+  static uint32_t sentPortfolioVersion = 0;
+  bool listening = events.count() > 0;
+
+  for(int word = 0; word < (MAX_ASSETS + 31) / 32; word++) {
+    uint32_t bits = dirtySlots[word];
+    dirtySlots[word] = 0;
+    while(listening && bits) {
+      int slot = word * 32 + __builtin_ctz(bits);
+      bits &= bits - 1;
+      if(slot >= assetCount) continue;
+
+      registryLock();
+      size_t n = webAssetJson(record, sizeof(record) - 1, assets[slot]);
+      registryUnlock();
+      if(n == 0) continue;
+      record[n] = '\0';
+      events.send(record, "asset", millis());
+    }
+  }
+
+  if(listening && portfolio.holdings > 0 && portfolio.version != sentPortfolioVersion) {
+    JsonOut out(record, sizeof(record) - 1);
+    registryLock();
+    portfolioTotalsJson(out);
+    sentPortfolioVersion = portfolio.version;
+    registryUnlock();
+    if(!out.overflow) {
+      record[out.len] = '\0';
+      events.send(record, "portfolio", millis());
+    }
+  }
+}
+
+void webBegin() {
+  server.on("/api/snapshot", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendChunked(request, renderSnapshot, assetCount);
+  });
+  server.on("/api/portfolio", HTTP_GET, [](AsyncWebServerRequest *request) {
+    sendChunked(request, renderPortfolio, portfolio.holdings);
+  });
+
+  events.onConnect([](AsyncEventSourceClient *client) {
+    // Ask browsers to reconnect after 5 s if the link drops
+    client->send("hello", nullptr, millis(), 5000);
+  });
+  server.addHandler(&events);
+
+  // Only the dashboard is served from flash, not the watchlist or history files
+  server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if(!LittleFS.exists(WEB_DASHBOARD_PATH)) {
+      request->send(404, "text/plain", "Dashboard missing, run uploadfs");
+      return;
+    }
+    AsyncWebServerResponse *response = request->beginResponse(LittleFS, WEB_DASHBOARD_PATH, "text/html");
+    response->addHeader("Content-Encoding", "gzip");
+    response->addHeader("Cache-Control", "max-age=3600");
+    request->send(response);
+  });
+
+  server.onNotFound([](AsyncWebServerRequest *request) {
+    request->send(404, "text/plain", "Not found");
+  });
+
+  server.begin();
+  Serial.print("[Web] Dashboard at http://");
+  Serial.println(WiFi.localIP());
+}
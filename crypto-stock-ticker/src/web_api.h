@@ -0,0 +1,33 @@
+#ifndef WEB_API_H
+#define WEB_API_H
+
+#include "asset_registry.h"
+
+// Web dashboard and JSON API on port 80:
+//   /              dashboard, served gzipped from LittleFS (/index.html.gz)
+//   /api/snapshot  every asset with indicators and history (chunked JSON)
+//   /api/portfolio portfolio totals and holdings (chunked JSON)
+//   /api/events    server-sent events, one "asset" event per asset that
+//                  changed in the last fetch, and "portfolio" with the totals
+//
+// JSON is written with a fixed-buffer writer straight into the response
+// buffer, so serving a snapshot doesn't allocate per asset.
+
+#define WEB_DASHBOARD_PATH "/index.html.gz"
+#define WEB_ASSET_JSON_MAX 1800     // one asset record, history included
+#define WEB_MAX_SNAPSHOTS 2         // concurrent chunked (snapshot/portfolio) responses
+
+// Start the server (after WiFi is up and the registry is loaded)
+void webBegin();
+
+// Flag an asset as changed; call after writing its new price
+void webMarkDirty(int slot);
+
+// Push the changed assets to SSE clients and clear the flags (call from loop)
+void webPublishChanges();
+
+// Write one asset as a JSON object into buf. Returns the length, or 0 if it
+// didn't fit. Caller holds the registry lock.
+size_t webAssetJson(char *buf, size_t len, const Asset &asset);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef SHIM_ADAFRUIT_SSD1306_H
+#define SHIM_ADAFRUIT_SSD1306_H
+
+// The part of the Adafruit_SSD1306 / Adafruit_GFX interface the screens use.
+// Nothing is rasterised: text goes to a fixed transcript the tests can read
+// back, lines are counted, and clearDisplay() resets both. Like the real
+// driver it never allocates once constructed, so a frame drawn through it
+// allocates only what the screen code itself does.
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+#define SSD1306_SWITCHCAPVCC 0x02
+
+class Adafruit_SSD1306 {
+public:
+  Adafruit_SSD1306(int16_t w, int16_t h, TwoWire *wire = &Wire, int8_t rst = -1) : w(w), h(h) {
+    clearDisplay();
+  }
+
+  bool begin(uint8_t vcs = SSD1306_SWITCHCAPVCC, uint8_t addr = 0x3C) { return true; }
+  uint8_t *getBuffer() { return buffer; }
+  int16_t width() const { return w; }
+  int16_t height() const { return h; }
+
+  void clearDisplay() {
+    memset(buffer, 0, sizeof(buffer));
+    transcript[0] = '\0';
+    transcriptLen = 0;
+    lines = 0;
+  }
+
+  void setTextSize(uint8_t size) { textSize = size; }
+  void setTextColor(uint16_t color) {}
+  void cp437(bool enabled = true) {}
+  void setCursor(int16_t x, int16_t y) {
+    cursorX = x;
+    cursorY = y;
+    append('|');
+  }
+
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+    lines++;
+  }
+
+  size_t print(char c) { return append(c); }
+  size_t print(const char *text) {
+    size_t n = 0;
+    while(*text) n += append(*text++);
+    return n;
+  }
+  size_t print(const __FlashStringHelper *text) { return print((const char *)text); }
+  size_t println(const char *text = "") { return print(text) + append('\n'); }
+  size_t println(const __FlashStringHelper *text) { return println((const char *)text); }
+
+  // Everything printed since clearDisplay(), with '|' at each setCursor()
+  char transcript[512];
+  size_t transcriptLen = 0;
+  int lines = 0;
+  int16_t cursorX = 0;
+  int16_t cursorY = 0;
+  uint8_t textSize = 1;
+
+private:
+  size_t append(char c) {
+    if(transcriptLen + 1 >= sizeof(transcript)) return 0;
+    transcript[transcriptLen++] = c;
+    transcript[transcriptLen] = '\0';
+    return 1;
+  }
+
+  int16_t w;
+  int16_t h;
+  uint8_t buffer[128 * 64 / 8];
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+// Just enough of the Arduino core and FreeRTOS for the host tests
+// (the native environment). Serial goes to stdout; there is one task and no
+// other core, so locks and critical sections are no-ops.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+
+using std::min;
+using std::max;
+
+inline unsigned long micros() {
+  static const auto start = std::chrono::steady_clock::now();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+inline unsigned long millis() {
+  return micros() / 1000;
+}
+
+#if !defined(__APPLE__) && !(defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 38)))
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+  size_t len = strlen(src);
+  if(size > 0) {
+    size_t n = len < size - 1 ? len : size - 1;
+    memcpy(dst, src, n);
+    dst[n] = '\0';
+  }
+  return len;
+}
+#endif
+
+// Flash strings are plain strings on the host
+class __FlashStringHelper;
+#define F(text) ((const __FlashStringHelper *)(text))
+
+// Local time from the host clock; set TZ to pin it down
+inline bool getLocalTime(struct tm *info, uint32_t ms = 5000) {
+  time_t now = time(nullptr);
+  return localtime_r(&now, info) != nullptr;
+}
+
+class HardwareSerial {
+public:
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n;
+  }
+  size_t print(const char *text) { return fputs(text, stdout) < 0 ? 0 : strlen(text); }
+  size_t println(const char *text = "") { return print(text) + print("\n"); }
+};
+
+inline HardwareSerial Serial;
+
+typedef void *TaskHandle_t;
+typedef void *SemaphoreHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef struct { int unused; } portMUX_TYPE;
+
+#define pdTRUE 1
+#define portMAX_DELAY 0xffffffffu
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {
+  static int task;
+  return &task;
+}
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {
+  static int mutex;
+  return &mutex;
+}
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+#endif
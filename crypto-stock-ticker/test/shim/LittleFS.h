@@ -0,0 +1,77 @@
+#ifndef SHIM_LITTLEFS_H
+#define SHIM_LITTLEFS_H
+
+// In-memory LittleFS for the host tests: files are strings keyed by path.
+// Enough for the loaders, which read a whole JSON file through ArduinoJson.
+
+#include <Arduino.h>
+#include <map>
+#include <string>
+
+inline std::map<std::string, std::string> shimFiles;
+
+class File {
+public:
+  File() : data(nullptr), pos(0) {}
+  explicit File(std::string *data) : data(data), pos(0) {}
+
+  explicit operator bool() const { return data != nullptr; }
+  size_t size() const { return data ? data->size() : 0; }
+  int available() const { return data ? (int)(data->size() - pos) : 0; }
+  void close() { data = nullptr; }
+
+  size_t read(uint8_t *buf, size_t len) {
+    return readBytes((char *)buf, len);
+  }
+
+  int read() {
+    if(!data || pos >= data->size()) return -1;
+    return (uint8_t)(*data)[pos++];
+  }
+
+  size_t readBytes(char *buf, size_t len) {
+    size_t n = min(len, (size_t)available());
+    if(n > 0) memcpy(buf, data->data() + pos, n);
+    pos += n;
+    return n;
+  }
+
+  size_t write(const uint8_t *buf, size_t len) {
+    if(!data) return 0;
+    data->append((const char *)buf, len);
+    return len;
+  }
+
+private:
+  std::string *data;
+  size_t pos;
+};
+
+class LittleFSShim {
+public:
+  File open(const char *path, const char *mode = "r") {
+    if(mode[0] == 'r') {
+      auto it = shimFiles.find(path);
+      return it == shimFiles.end() ? File() : File(&it->second);
+    }
+    std::string &data = shimFiles[path];
+    if(mode[0] == 'w') data.clear();
+    return File(&data);
+  }
+  bool begin(bool formatOnFail = false) { return true; }
+  bool mkdir(const char *path) { return true; }
+  bool exists(const char *path) { return shimFiles.count(path) > 0; }
+  bool remove(const char *path) { return shimFiles.erase(path) > 0; }
+
+  bool rename(const char *from, const char *to) {
+    auto it = shimFiles.find(from);
+    if(it == shimFiles.end()) return false;
+    shimFiles[to] = std::move(it->second);
+    shimFiles.erase(from);
+    return true;
+  }
+};
+
+inline LittleFSShim LittleFS;
+
+#endif
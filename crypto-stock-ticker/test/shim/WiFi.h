@@ -0,0 +1,25 @@
+#ifndef SHIM_WIFI_H
+#define SHIM_WIFI_H
+
+// A station that stays connected at the RSSI the test sets
+
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiShim {
+public:
+  wl_status_t status() { return connected ? WL_CONNECTED : WL_DISCONNECTED; }
+  int8_t RSSI() { return rssi; }
+
+  bool connected = true;
+  int8_t rssi = -58;
+};
+
+inline WiFiShim WiFi;
+
+#endif
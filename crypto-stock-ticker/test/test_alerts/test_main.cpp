@@ -0,0 +1,154 @@
+// Host tests and a timing benchmark for alert rule evaluation:
+// pio test -e native -f test_alerts -v
+#include <unity.h>
+#include <chrono>
+#include "asset_registry.cpp"
+#include "alerts.cpp"
+
+static int bitcoin;
+
+static void resetRules() {
+  ruleCount = 0;
+  for(int i = 0; i < MAX_ASSETS; i++) ruleHeads[i] = -1;
+  memset(&alertStats, 0, sizeof(alertStats));
+  AlertEvent event;
+  while(alertsPopDisplay(event)) {}
+  while(alertsPopNotify(event)) {}
+}
+
+// One sample a minute, the newest at `now`, climbing by `step` per sample
+static void fillHistory(Asset &asset, uint32_t now, Fixed last, Fixed step) {
+  PriceHistory &history = registryHistory(asset);
+  memset(&history, 0, sizeof(history));
+  for(int i = 0; i < HISTORY_SIZE; i++) {
+    history.prices[i] = last - fixedMulDiv(step, HISTORY_SIZE - 1 - i, 1);
+    history.times[i] = now - (HISTORY_SIZE - 1 - i) * 60;
+  }
+  history.filled = true;
+  asset.price = last;
+}
+
+static void setPrice(int slot, int64_t units, unsigned long nowMs) {
+  assets[slot].price = Fixed::fromInt(units);
+  alertsEvaluate(slot, nowMs);
+}
+
+static int pendingEvents() {
+  int count = 0;
+  AlertEvent event;
+  while(alertsPopNotify(event)) count++;
+  return count;
+}
+
+void setUp() {
+  registryClear();
+  bitcoin = registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin");
+  for(int i = 1; i < MAX_ASSETS; i++) {
+    char id[16];
+    snprintf(id, sizeof(id), "coin-%d", i);
+    registryAdd(ASSET_CRYPTO, id, id, id);
+  }
+  resetRules();
+}
+
+void tearDown() {}
+
+void test_condition_holding_at_boot_does_not_fire() {
+  addRule(bitcoin, ALERT_ABOVE, Fixed::fromInt(100000), Fixed::fromInt(500), 0, 0);
+  setPrice(bitcoin, 101000, 1000);
+  setPrice(bitcoin, 102000, 2000);
+  TEST_ASSERT_EQUAL(0, pendingEvents());
+}
+
+void test_fires_once_then_rearms_past_hysteresis() {
+  addRule(bitcoin, ALERT_ABOVE, Fixed::fromInt(100000), Fixed::fromInt(500), 0, 0);
+  setPrice(bitcoin, 99000, 1000);
+  setPrice(bitcoin, 100100, 2000);
+  TEST_ASSERT_EQUAL(1, pendingEvents());
+
+  setPrice(bitcoin, 99800, 3000);       // inside the hysteresis band: still disarmed
+  setPrice(bitcoin, 100200, 4000);
+  TEST_ASSERT_EQUAL(0, pendingEvents());
+
+  setPrice(bitcoin, 99400, 5000);       // back past it: rearmed
+  setPrice(bitcoin, 100000, 6000);
+  TEST_ASSERT_EQUAL(1, pendingEvents());
+}
+
+void test_cooldown_suppresses_repeat() {
+  addRule(bitcoin, ALERT_BELOW, Fixed::fromInt(90000), Fixed::fromRaw(0), 0, 600);
+  setPrice(bitcoin, 91000, 0);
+  setPrice(bitcoin, 89000, 1000);
+  setPrice(bitcoin, 91000, 2000);
+  setPrice(bitcoin, 89000, 3000);
+  TEST_ASSERT_EQUAL(1, pendingEvents());
+  TEST_ASSERT_EQUAL(1, alertStats.suppressed);
+
+  setPrice(bitcoin, 91000, 700000);
+  setPrice(bitcoin, 89000, 701000);
+  TEST_ASSERT_EQUAL(1, pendingEvents());
+}
+
+void test_move_over_window() {
+  uint32_t now = 1700000000;
+  fillHistory(assets[bitcoin], now, Fixed::fromInt(100000), Fixed::fromInt(0));
+  addRule(bitcoin, ALERT_MOVE, Fixed::fromInt(3), Fixed::fromDouble(0.5), 900, 0);
+  alertsEvaluate(bitcoin, 1000);
+  TEST_ASSERT_EQUAL(0, pendingEvents());
+
+  // Newest sample 4% above the one 15 minutes back
+  fillHistory(assets[bitcoin], now + 60, Fixed::fromInt(104000), Fixed::fromDouble(4000.0 / 15));
+  alertsEvaluate(bitcoin, 2000);
+  AlertEvent event;
+  TEST_ASSERT_TRUE(alertsPopNotify(event));
+  TEST_ASSERT_EQUAL(ALERT_MOVE, event.type);
+  TEST_ASSERT_INT64_WITHIN(1000, Fixed::fromInt(4).raw, event.value.raw);
+}
+
+// Worst case for one fetch tick: the whole rule table on the asset that
+// updated, a third of it MOVE rules that scan the history ring
+void test_benchmark_full_table_one_asset() {
+  uint32_t now = 1700000000;
+  fillHistory(assets[bitcoin], now, Fixed::fromInt(100000), Fixed::fromInt(10));
+  for(int i = 0; i < MAX_ALERT_RULES; i++) {
+    if(i % 3 == 0) addRule(bitcoin, ALERT_ABOVE, Fixed::fromInt(100000 + i * 10), Fixed::fromInt(50), 0, 60);
+    else if(i % 3 == 1) addRule(bitcoin, ALERT_BELOW, Fixed::fromInt(100000 - i * 10), Fixed::fromInt(50), 0, 60);
+    else addRule(bitcoin, ALERT_MOVE, Fixed::fromDouble(0.1 + i * 0.01), Fixed::fromDouble(0.05), 60 * (1 + i % 25), 60);
+  }
+  TEST_ASSERT_EQUAL(MAX_ALERT_RULES, ruleCount);
+
+  const int ticks = 20000;
+  uint32_t seed = 1;
+  auto start = std::chrono::steady_clock::now();
+  for(int tick = 0; tick < ticks; tick++) {
+    seed = seed * 1664525u + 1013904223u;
+    assets[bitcoin].price = Fixed::fromInt(97000 + (int)(seed >> 16) % 6000);
+    alertsBeginTick();
+    alertsEvaluate(bitcoin, tick * 1000UL);
+    alertsEndTick();
+    pendingEvents();
+    AlertEvent event;
+    while(alertsPopDisplay(event)) {}
+  }
+  double elapsedNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)ticks * MAX_ALERT_RULES, alertStats.evaluations);
+  TEST_ASSERT_GREATER_THAN(0, alertStats.fired);
+
+  char message[120];
+  snprintf(message, sizeof(message), "%d rules/tick: %.0f ns per rule, %.1f us per tick, max tick %lu us (budget %d us)",
+           MAX_ALERT_RULES, elapsedNs / ((double)ticks * MAX_ALERT_RULES), elapsedNs / ticks / 1000,
+           (unsigned long)alertStats.maxTickUs, ALERT_EVAL_BUDGET_US);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_LESS_THAN(ALERT_EVAL_BUDGET_US, elapsedNs / ticks / 1000);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_condition_holding_at_boot_does_not_fire);
+  RUN_TEST(test_fires_once_then_rearms_past_hysteresis);
+  RUN_TEST(test_cooldown_suppresses_repeat);
+  RUN_TEST(test_move_over_window);
+  RUN_TEST(test_benchmark_full_table_one_asset);
+  return UNITY_END();
+}
@@ -0,0 +1,263 @@
+// Heap check of the pure per-fetch and per-frame paths, using the same
+// malloc hook as the alloc-check firmware: pio test -e native-alloc
+// Under the plain native environment (no hook) the tests are ignored.
+#include <unity.h>
+#include "alloc_check.cpp"
+#include "asset_registry.cpp"
+#include "indicators.cpp"
+#include "alerts.cpp"
+#include "portfolio.cpp"
+#include "screens.cpp"
+
+// Each site runs past its warmup, so every allocation after that is counted
+#define RUNS (ALLOC_CHECK_WARMUP + 3)
+
+// Steady-state frames per screen, with the prices moving between them
+#define FRAMES (ALLOC_CHECK_WARMUP + 20)
+
+// The screens draw into the shim's Adafruit_SSD1306. Display currency, tape
+// and display task are stood in for here: fx.cpp and tape.cpp need the
+// network or a task, and the submit only has to be seen.
+Adafruit_SSD1306 display(DISPLAY_WIDTH, DISPLAY_PAGES * 8);
+TapeStats tapeStats;
+
+Currency fxDisplay() { return CCY_USD; }
+Fixed fxToDisplay(Fixed usd) { return usd; }
+char fxGlyph(Currency currency) { return '$'; }
+
+static uint32_t submits = 0;
+static uint8_t submittedPages = 0;
+
+void displaySubmit(const uint8_t *frame, uint8_t pageMask) {
+  TEST_ASSERT_EQUAL_PTR(display.getBuffer(), frame);
+  submits++;
+  submittedPages = pageMask;
+}
+
+void setUp() {
+  memset(&allocCheckStats, 0, sizeof(allocCheckStats));
+}
+
+void tearDown() {}
+
+#ifdef ALLOC_CHECK
+
+// Called through a pointer so the compiler can't drop the malloc/free pair
+static void *(*volatile allocate)(size_t) = malloc;
+
+void test_hook_counts_allocations() {
+  static AllocSite site("deliberate");
+  for(int i = 0; i < RUNS; i++) {
+    AllocScope check(site);
+    free(allocate(16));
+  }
+  TEST_ASSERT_EQUAL_UINT32(RUNS - ALLOC_CHECK_WARMUP, allocCheckStats.scopes);
+  TEST_ASSERT_EQUAL_UINT32(RUNS - ALLOC_CHECK_WARMUP, allocCheckStats.failures);
+  memset(&allocCheckStats, 0, sizeof(allocCheckStats));
+}
+
+void test_formatting_does_not_allocate() {
+  static AllocSite site("formatting");
+  char buf[32];
+  for(int i = 0; i < RUNS; i++) {
+    AllocScope check(site);
+    fixedFormat(buf, sizeof(buf), Fixed::fromDouble(-1234.5678), 2, true);
+    fixedFormatCompact(buf, sizeof(buf), Fixed::fromInt(1934567890123LL));
+    snprintf(buf, sizeof(buf), "%s %lu", "BTC", (unsigned long)i);
+  }
+  TEST_ASSERT_EQUAL_UINT32(RUNS - ALLOC_CHECK_WARMUP, allocCheckStats.scopes);
+  TEST_ASSERT_EQUAL_UINT32(0, allocCheckStats.failures);
+}
+
+// What a fetch does per asset after parsing: registry lookup, history ring
+// and indicators, portfolio totals, alert rules and their description
+void test_price_update_does_not_allocate() {
+  registryClear();
+  int slot = registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin");
+  portfolioClear();
+  portfolioAdd(slot, Fixed::fromDouble(0.25), Fixed::fromInt(40000));
+  ruleCount = 0;
+  for(int i = 0; i < MAX_ASSETS; i++) ruleHeads[i] = -1;
+  addRule(slot, ALERT_ABOVE, Fixed::fromInt(100000), Fixed::fromInt(500), 0, 0);
+  addRule(slot, ALERT_MOVE, Fixed::fromInt(1), Fixed::fromRaw(0), 60, 0);
+
+  static AllocSite site("priceUpdate");
+  Asset &asset = assets[slot];
+  PriceHistory &history = registryHistory(asset);
+  for(int i = 0; i < RUNS * 20; i++) {
+    AllocScope check(site);
+    Fixed price = Fixed::fromInt(99000 + (i % 7) * 500);
+    TEST_ASSERT_EQUAL(slot, registryFind("bitcoin"));
+
+    IndicatorWindow window;
+    window.slot = history.index;
+    window.evicting = history.filled;
+    window.evictedPrice = history.prices[history.index];
+    window.evictedNext = history.prices[(history.index + 1) % HISTORY_SIZE];
+    indicatorsUpdate(asset.indicators, window, price, Fixed::fromInt(20000000 + i * 1000));
+    history.prices[history.index] = price;
+    history.times[history.index] = 1700000000 + i * 60;
+    history.index = (history.index + 1) % HISTORY_SIZE;
+    if(history.index == 0) history.filled = true;
+    asset.price = price;
+
+    portfolioOnPrice(slot, price, Fixed::fromDouble(1.5));
+    alertsEvaluate(slot, i * 60000UL);
+    AlertEvent event;
+    char text[48];
+    while(alertsPopDisplay(event)) alertsDescribe(event, text, sizeof(text));
+    while(alertsPopNotify(event)) {}
+  }
+  TEST_ASSERT_GREATER_THAN(0, alertStats.fired);
+  TEST_ASSERT_EQUAL_UINT32(RUNS * 20 - ALLOC_CHECK_WARMUP, allocCheckStats.scopes);
+  TEST_ASSERT_EQUAL_UINT32(0, allocCheckStats.failures);
+}
+
+// Feeds a full history ring and warm indicators, as after a few minutes of fetches
+static int addPricedAsset(AssetKind kind, const char *id, const char *symbol, int64_t price, double change) {
+  int slot = registryAdd(kind, id, symbol, id);
+  Asset &asset = assets[slot];
+  PriceHistory &history = registryHistory(asset);
+  for(int i = 0; i < HISTORY_SIZE; i++) {
+    Fixed sample = Fixed::fromInt(price + (i % 5) * price / 500);
+    IndicatorWindow window;
+    window.slot = history.index;
+    window.evicting = false;
+    indicatorsUpdate(asset.indicators, window, sample, Fixed::fromInt(1000000));
+    history.prices[history.index] = sample;
+    history.times[history.index] = 1700000000 + i * 60;
+    history.index = (history.index + 1) % HISTORY_SIZE;
+  }
+  history.filled = true;
+  asset.price = Fixed::fromInt(price);
+  asset.change24h = Fixed::fromDouble(change);
+  asset.high24h = Fixed::fromInt(price + price / 50);
+  asset.low24h = Fixed::fromInt(price - price / 50);
+  asset.volume24h = Fixed::fromInt(price * 250000);
+  asset.marketCap = Fixed::fromInt(price * 19000000);
+  asset.dataValid = true;
+  return slot;
+}
+
+static int bitcoin;
+static int solana;
+static int apple;
+static int loading;
+
+static void setUpScreens() {
+  registryClear();
+  bitcoin = addPricedAsset(ASSET_CRYPTO, "bitcoin", "BTC", 97000, 2.5);
+  solana = addPricedAsset(ASSET_CRYPTO, "solana", "SOL", 0, 0);
+  apple = addPricedAsset(ASSET_STOCK, "AAPL", "AAPL", 190, -1.25);
+  loading = registryAdd(ASSET_CRYPTO, "ethereum", "ETH", "Ethereum");
+  // Under a dollar, to take the small-price branch
+  assets[solana].price = Fixed::fromDouble(0.4321);
+
+  portfolioClear();
+  portfolioAdd(bitcoin, Fixed::fromDouble(0.25), Fixed::fromInt(40000));
+  portfolioAdd(apple, Fixed::fromInt(10), Fixed::fromDouble(150.5));
+  portfolioAdd(solana, Fixed::fromInt(1000), Fixed::fromDouble(0.5));
+  portfolioOnPrice(bitcoin, assets[bitcoin].price, Fixed::fromInt(1000));
+  portfolioOnPrice(apple, assets[apple].price, Fixed::fromInt(-2));
+  portfolioOnPrice(solana, assets[solana].price, Fixed::fromDouble(0.01));
+
+  tapeStats.assetsShown = 3;
+  submits = 0;
+  memset(&allocCheckStats, 0, sizeof(allocCheckStats));
+}
+
+// A new price between frames, the way a fetch lands between two redraws
+static void movePrices(int frame) {
+  assets[bitcoin].price = Fixed::fromInt(97000 + (frame % 9) * 125);
+  assets[bitcoin].change24h = Fixed::fromDouble(frame % 2 ? 2.5 : -0.75);
+  portfolioOnPrice(bitcoin, assets[bitcoin].price, Fixed::fromInt(frame * 10));
+}
+
+// Each screen's own AllocSite does the checking; these count its runs
+static void expectCheckedRuns(uint32_t runs) {
+  TEST_ASSERT_EQUAL_UINT32(runs - ALLOC_CHECK_WARMUP, allocCheckStats.scopes);
+  TEST_ASSERT_EQUAL_UINT32(0, allocCheckStats.failures);
+  TEST_ASSERT_EQUAL_UINT32(runs, submits);
+}
+
+void test_asset_screen_does_not_allocate() {
+  setUpScreens();
+  int shown[] = {bitcoin, solana, apple, loading};
+  for(int frame = 0; frame < FRAMES; frame++) {
+    movePrices(frame);
+    for(int slot : shown) drawAsset(assets[slot]);
+  }
+  expectCheckedRuns(FRAMES * 4);
+
+  drawAsset(assets[bitcoin]);
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "CRYPTO"));
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "BTC"));
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "MCap:"));
+  TEST_ASSERT_TRUE(display.lines > 1);        // divider plus the sparkline
+  drawAsset(assets[loading]);
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "Loading data..."));
+}
+
+void test_portfolio_screen_does_not_allocate() {
+  setUpScreens();
+  for(int frame = 0; frame < FRAMES; frame++) {
+    movePrices(frame);
+    drawPortfolio();
+  }
+  expectCheckedRuns(FRAMES);
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "PORTFOLIO"));
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "P&L "));
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "BTC "));
+}
+
+void test_tape_frame_does_not_allocate() {
+  setUpScreens();
+  for(int frame = 0; frame < FRAMES; frame++) {
+    movePrices(frame);
+    drawTapeFrame();
+  }
+  expectCheckedRuns(FRAMES);
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "Down 1"));
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "3 of 4 shown"));
+  // The tape's own pages are left to the tape task
+  TEST_ASSERT_EQUAL_HEX8(DISPLAY_ALL_PAGES & ~(((1 << TAPE_PAGES) - 1) << TAPE_FIRST_PAGE), submittedPages);
+}
+
+void test_alert_screen_does_not_allocate() {
+  setUpScreens();
+  AlertEvent event;
+  memset(&event, 0, sizeof(event));
+  event.slot = bitcoin;
+  event.type = ALERT_ABOVE;
+  event.value = Fixed::fromInt(100000);
+  for(int frame = 0; frame < FRAMES; frame++) {
+    event.price = Fixed::fromInt(100000 + frame * 250);
+    drawAlert(event);
+  }
+  expectCheckedRuns(FRAMES);
+  TEST_ASSERT_NOT_NULL(strstr(display.transcript, "PRICE ALERT"));
+}
+
+#else
+
+void test_needs_native_alloc() {
+  TEST_IGNORE_MESSAGE("malloc hook not linked; run with -e native-alloc");
+}
+
+#endif
+
+int main() {
+  UNITY_BEGIN();
+#ifdef ALLOC_CHECK
+  RUN_TEST(test_hook_counts_allocations);
+  RUN_TEST(test_formatting_does_not_allocate);
+  RUN_TEST(test_price_update_does_not_allocate);
+  RUN_TEST(test_asset_screen_does_not_allocate);
+  RUN_TEST(test_portfolio_screen_does_not_allocate);
+  RUN_TEST(test_tape_frame_does_not_allocate);
+  RUN_TEST(test_alert_screen_does_not_allocate);
+#else
+  RUN_TEST(test_needs_native_alloc);
+#endif
+  return UNITY_END();
+}
@@ -0,0 +1,126 @@
+// Host tests for fixed_point.h: pio test -e native -f test_fixed_point
+#include <unity.h>
+#include "fixed_point.h"
+
+static char buf[32];
+
+static const char *format(Fixed value, int decimals, bool showPlus = false) {
+  fixedFormat(buf, sizeof(buf), value, decimals, showPlus);
+  return buf;
+}
+
+static const char *compact(Fixed value) {
+  fixedFormatCompact(buf, sizeof(buf), value);
+  return buf;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_from_double() {
+  TEST_ASSERT_EQUAL_INT64(1234567, Fixed::fromDouble(1.2345674).raw);
+  TEST_ASSERT_EQUAL_INT64(1234568, Fixed::fromDouble(1.2345675).raw);
+  TEST_ASSERT_EQUAL_INT64(-2500000, Fixed::fromDouble(-2.5).raw);
+  TEST_ASSERT_EQUAL_INT64(0, Fixed::fromDouble(NAN).raw);
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, Fixed::fromDouble(1e300).raw);
+  TEST_ASSERT_EQUAL_INT64(-INT64_MAX, Fixed::fromDouble(-1e300).raw);
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, Fixed::fromDouble(INFINITY).raw);
+}
+
+void test_from_int_saturates() {
+  TEST_ASSERT_EQUAL_INT64(42 * FIXED_SCALE, Fixed::fromInt(42).raw);
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX / FIXED_SCALE, Fixed::fromInt(INT64_MAX).toInt());
+  TEST_ASSERT_EQUAL_INT64(-(INT64_MAX / FIXED_SCALE), Fixed::fromInt(INT64_MIN).toInt());
+  TEST_ASSERT_EQUAL_INT64(-1, Fixed::fromDouble(-1.9).toInt());
+}
+
+void test_format() {
+  TEST_ASSERT_EQUAL_STRING("100000.12", format(Fixed::fromDouble(100000.12), 2));
+  TEST_ASSERT_EQUAL_STRING("-0.00", format(Fixed::fromDouble(-0.004), 2));
+  TEST_ASSERT_EQUAL_STRING("+2.35", format(Fixed::fromDouble(2.345), 2, true));
+  TEST_ASSERT_EQUAL_STRING("0.0000", format(Fixed::fromDouble(0.00001234), 4));
+  TEST_ASSERT_EQUAL_STRING("0.000123", format(Fixed::fromDouble(0.00012345), 6));
+  TEST_ASSERT_EQUAL_STRING("98765", format(Fixed::fromInt(98765), 0));
+  TEST_ASSERT_EQUAL_STRING("1000.0", format(Fixed::fromDouble(999.95), 1));
+  TEST_ASSERT_EQUAL_STRING("9223372036854.775807", format(Fixed::fromRaw(INT64_MAX), 6));
+  TEST_ASSERT_EQUAL_STRING("-9223372036854.775808", format(Fixed::fromRaw(INT64_MIN), 6));
+}
+
+void test_format_truncates_to_buffer() {
+  TEST_ASSERT_EQUAL_UINT32(3, fixedFormat(buf, 4, Fixed::fromInt(98765), 0));
+  TEST_ASSERT_EQUAL_STRING("987", buf);
+  TEST_ASSERT_EQUAL_UINT32(0, fixedFormat(buf, 1, Fixed::fromInt(5), 0));
+  TEST_ASSERT_EQUAL_STRING("", buf);
+}
+
+void test_mul() {
+  TEST_ASSERT_EQUAL_INT64(3375000, fixedMul(Fixed::fromDouble(1.5), Fixed::fromDouble(2.25)).raw);
+  TEST_ASSERT_EQUAL_INT64(-1500000, fixedMul(Fixed::fromDouble(-0.5), Fixed::fromInt(3)).raw);
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(1840000000000LL).raw,
+                          fixedMul(Fixed::fromDouble(0.92), Fixed::fromInt(2000000000000LL)).raw);
+  // 0.000001 * 0.5 rounds half away from zero
+  TEST_ASSERT_EQUAL_INT64(1, fixedMul(Fixed::fromRaw(1), Fixed::fromDouble(0.5)).raw);
+  TEST_ASSERT_EQUAL_INT64(-1, fixedMul(Fixed::fromRaw(-1), Fixed::fromDouble(0.5)).raw);
+}
+
+void test_mul_overflow_saturates() {
+  Fixed big = Fixed::fromInt(5000000000000LL);
+  TEST_ASSERT_EQUAL_INT64(INT64_MAX, fixedMul(big, Fixed::fromInt(2)).raw);
+  TEST_ASSERT_EQUAL_INT64(-INT64_MAX, fixedMul(-big, Fixed::fromInt(2)).raw);
+}
+
+void test_div() {
+  TEST_ASSERT_EQUAL_INT64(333333, fixedDiv(Fixed::fromInt(1), Fixed::fromInt(3)).raw);
+  TEST_ASSERT_EQUAL_INT64(666667, fixedDiv(Fixed::fromInt(2), Fixed::fromInt(3)).raw);
+  TEST_ASSERT_EQUAL_INT64(-666667, fixedDiv(Fixed::fromInt(-2), Fixed::fromInt(3)).raw);
+  TEST_ASSERT_EQUAL_INT64(0, fixedDiv(Fixed::fromInt(7), Fixed::fromInt(0)).raw);
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(2000000000000LL).raw,
+                          fixedDiv(Fixed::fromInt(1000000000000LL), Fixed::fromDouble(0.5)).raw);
+}
+
+void test_mul_div_and_percent() {
+  TEST_ASSERT_EQUAL_INT64(2000000, fixedMulDiv(Fixed::fromInt(10), 2, 10).raw);
+  TEST_ASSERT_EQUAL_INT64(-2000000, fixedMulDiv(Fixed::fromInt(10), -2, 10).raw);
+  TEST_ASSERT_EQUAL_INT64(0, fixedMulDiv(Fixed::fromInt(10), 2, 0).raw);
+  TEST_ASSERT_EQUAL_INT64(2500000, fixedPercentChange(Fixed::fromInt(200), Fixed::fromInt(205)).raw);
+  Fixed change = fixedPercentChange(Fixed::fromDouble(100000.00), Fixed::fromDouble(99000.01));
+  TEST_ASSERT_EQUAL_STRING("-0.99999", format(change, 5));
+  TEST_ASSERT_EQUAL_STRING("-1.0000", format(change, 4));
+}
+
+void test_compact() {
+  TEST_ASSERT_EQUAL_STRING("1.9T", compact(Fixed::fromInt(1934567890123LL)));
+  TEST_ASSERT_EQUAL_STRING("25.3B", compact(Fixed::fromInt(25345000000LL)));
+  TEST_ASSERT_EQUAL_STRING("1.3M", compact(Fixed::fromInt(1250000)));
+  TEST_ASSERT_EQUAL_STRING("-1.5K", compact(Fixed::fromInt(-1500)));
+  TEST_ASSERT_EQUAL_STRING("0", compact(Fixed::fromInt(0)));
+}
+
+void test_compact_suffix_boundaries() {
+  TEST_ASSERT_EQUAL_STRING("999", compact(Fixed::fromDouble(999.9)));
+  TEST_ASSERT_EQUAL_STRING("1.0K", compact(Fixed::fromInt(1000)));
+  TEST_ASSERT_EQUAL_STRING("999.9K", compact(Fixed::fromRaw(999949999999LL)));
+  TEST_ASSERT_EQUAL_STRING("1.0M", compact(Fixed::fromRaw(999950000000LL)));
+  TEST_ASSERT_EQUAL_STRING("1.0M", compact(Fixed::fromInt(1000000)));
+  TEST_ASSERT_EQUAL_STRING("-1.0M", compact(Fixed::fromInt(-999950)));
+  TEST_ASSERT_EQUAL_STRING("999.9M", compact(Fixed::fromInt(999949999)));
+  TEST_ASSERT_EQUAL_STRING("1.0B", compact(Fixed::fromInt(999950000)));
+  TEST_ASSERT_EQUAL_STRING("999.9B", compact(Fixed::fromInt(999949999999LL)));
+  TEST_ASSERT_EQUAL_STRING("1.0T", compact(Fixed::fromInt(999950000000LL)));
+  TEST_ASSERT_EQUAL_STRING("9.2T", compact(Fixed::fromRaw(INT64_MAX)));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_from_double);
+  RUN_TEST(test_from_int_saturates);
+  RUN_TEST(test_format);
+  RUN_TEST(test_format_truncates_to_buffer);
+  RUN_TEST(test_mul);
+  RUN_TEST(test_mul_overflow_saturates);
+  RUN_TEST(test_div);
+  RUN_TEST(test_mul_div_and_percent);
+  RUN_TEST(test_compact);
+  RUN_TEST(test_compact_suffix_boundaries);
+  return UNITY_END();
+}
@@ -0,0 +1,97 @@
+// Host tests for the on-flash history log: pio test -e native -f test_history_log
+#include <unity.h>
+#include "asset_registry.cpp"
+#include "history_log.cpp"
+
+static void addSample(Asset &asset, uint32_t time, Fixed price) {
+  PriceHistory &history = registryHistory(asset);
+  history.prices[history.index] = price;
+  history.times[history.index] = time;
+  history.index = (history.index + 1) % HISTORY_SIZE;
+  if(history.index == 0) history.filled = true;
+  historyLogAppend(asset, time, price);
+}
+
+static std::string pathOf(const Asset &asset) {
+  char path[40];
+  logPath(asset, "bin", path, sizeof(path));
+  return path;
+}
+
+// Forget the RAM side, as a reboot would, and read the asset back from flash
+static int reboot(Asset &asset) {
+  memset(&registryHistory(asset), 0, sizeof(PriceHistory));
+  return historyLogRestore(asset);
+}
+
+void setUp() {
+  shimFiles.clear();
+  registryClear();
+  historyLogBegin();
+}
+
+void tearDown() {}
+
+void test_round_trip() {
+  Asset &bitcoin = assets[registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin")];
+  for(int i = 0; i < 12; i++) addSample(bitcoin, 1700000000 + i * 60, Fixed::fromInt(100000 + i * 7));
+  historyLogFlush(bitcoin);
+
+  TEST_ASSERT_EQUAL(12, reboot(bitcoin));
+  const PriceHistory &history = registryHistory(bitcoin);
+  TEST_ASSERT_EQUAL(12, history.index);
+  TEST_ASSERT_EQUAL_UINT32(1700000000 + 11 * 60, history.times[11]);
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(100000 + 11 * 7).raw, history.prices[11].raw);
+}
+
+void test_file_named_by_id_hash() {
+  Asset &bitcoin = assets[registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin")];
+  char expected[40];
+  snprintf(expected, sizeof(expected), "/hist/%08lx.bin", (unsigned long)fnv1a32("bitcoin"));
+  std::string path = pathOf(bitcoin);
+  TEST_ASSERT_EQUAL_STRING(expected, path.c_str());
+}
+
+// Two coins listed under one ticker symbol must not share (and interleave) a log
+void test_shared_symbol_keeps_separate_logs() {
+  Asset &first = assets[registryAdd(ASSET_CRYPTO, "usd-coin", "USDC", "USD Coin")];
+  Asset &bridged = assets[registryAdd(ASSET_CRYPTO, "bridged-usdc", "USDC", "Bridged USDC")];
+  TEST_ASSERT_TRUE(pathOf(first) != pathOf(bridged));
+
+  for(int i = 0; i < 10; i++) {
+    addSample(first, 1700000000 + i * 60, Fixed::fromDouble(1.0001));
+    addSample(bridged, 1700000000 + i * 60 + 5, Fixed::fromDouble(0.9990));
+  }
+  historyLogFlush(first);
+  historyLogFlush(bridged);
+
+  TEST_ASSERT_EQUAL(10, reboot(first));
+  TEST_ASSERT_EQUAL(10, reboot(bridged));
+  for(int i = 0; i < 10; i++) {
+    TEST_ASSERT_EQUAL_INT64(Fixed::fromDouble(1.0001).raw, registryHistory(first).prices[i].raw);
+    TEST_ASSERT_EQUAL_INT64(Fixed::fromDouble(0.9990).raw, registryHistory(bridged).prices[i].raw);
+  }
+}
+
+// A log from the symbol-named layout is taken over once, then lives under the hash
+void test_symbol_named_log_is_adopted() {
+  Asset &bitcoin = assets[registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin")];
+  for(int i = 0; i < 5; i++) addSample(bitcoin, 1700000000 + i * 60, Fixed::fromInt(50000 + i));
+  historyLogFlush(bitcoin);
+  shimFiles["/hist/BTC.bin"] = shimFiles[pathOf(bitcoin)];
+  shimFiles.erase(pathOf(bitcoin));
+
+  TEST_ASSERT_EQUAL(5, reboot(bitcoin));
+  TEST_ASSERT_FALSE(LittleFS.exists("/hist/BTC.bin"));
+  TEST_ASSERT_TRUE(LittleFS.exists(pathOf(bitcoin).c_str()));
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(50004).raw, registryHistory(bitcoin).prices[4].raw);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_file_named_by_id_hash);
+  RUN_TEST(test_shared_symbol_keeps_separate_logs);
+  RUN_TEST(test_symbol_named_log_is_adopted);
+  return UNITY_END();
+}
@@ -0,0 +1,203 @@
+// Host tests for the streaming indicators against a straightforward
+// floating-point reference that recomputes each window from scratch:
+// pio test -e native -f test_indicators
+#include <unity.h>
+#include <math.h>
+#include "indicators.cpp"
+
+#define SERIES_LENGTH 500
+
+static double prices[SERIES_LENGTH];
+static double volumes[SERIES_LENGTH];
+
+// The caller's side of the contract: a HISTORY_SIZE price ring whose evicted
+// slot is handed to indicatorsUpdate before being overwritten
+struct Ring {
+  Fixed prices[INDICATOR_WINDOW];
+  int index;
+  bool filled;
+};
+
+static void push(IndicatorState &state, Ring &ring, Fixed price, Fixed volume) {
+  IndicatorWindow window;
+  window.slot = ring.index;
+  window.evicting = ring.filled;
+  window.evictedPrice = ring.prices[ring.index];
+  window.evictedNext = ring.prices[(ring.index + 1) % INDICATOR_WINDOW];
+  indicatorsUpdate(state, window, price, volume);
+  ring.prices[ring.index] = price;
+  ring.index = (ring.index + 1) % INDICATOR_WINDOW;
+  if(ring.index == 0) ring.filled = true;
+}
+
+// Deterministic random walk: +/-1% per step in cents, and a rolling 24h
+// volume that mostly rises but sometimes falls (trades leaving the window)
+static void makeSeries() {
+  uint32_t seed = 12345;
+  double price = 100000.0;
+  double volume = 2e10;
+  for(int i = 0; i < SERIES_LENGTH; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    price *= 1.0 + ((int)(seed >> 16) % 2001 - 1000) / 100000.0;
+    price = round(price * 100) / 100;
+    seed = seed * 1664525u + 1013904223u;
+    volume += ((int)(seed >> 16) % 1000 - 200) * 1e5;
+    prices[i] = price;
+    volumes[i] = round(volume);
+  }
+}
+
+void setUp() {
+  makeSeries();
+}
+
+void tearDown() {}
+
+void test_matches_reference() {
+  IndicatorState state;
+  indicatorsReset(state);
+  Ring ring = {};
+
+  double emaFast = 0, emaSlow = 0, avgGain = 0, avgLoss = 0;
+  double maxEmaError = 0, maxRsiError = 0, maxVolatilityError = 0, maxVwapError = 0;
+
+  for(int i = 0; i < SERIES_LENGTH; i++) {
+    push(state, ring, Fixed::fromDouble(prices[i]), Fixed::fromDouble(volumes[i]));
+
+    if(i == 0) {
+      emaFast = emaSlow = prices[0];
+    } else {
+      emaFast += (prices[i] - emaFast) * 2 / (EMA_FAST_PERIOD + 1);
+      emaSlow += (prices[i] - emaSlow) * 2 / (EMA_SLOW_PERIOD + 1);
+      double diff = prices[i] - prices[i - 1];
+      double gain = diff > 0 ? diff : 0;
+      double loss = diff < 0 ? -diff : 0;
+      if(i <= RSI_PERIOD) {
+        avgGain += gain;
+        avgLoss += loss;
+        if(i == RSI_PERIOD) {
+          avgGain /= RSI_PERIOD;
+          avgLoss /= RSI_PERIOD;
+        }
+      } else {
+        avgGain = (avgGain * (RSI_PERIOD - 1) + gain) / RSI_PERIOD;
+        avgLoss = (avgLoss * (RSI_PERIOD - 1) + loss) / RSI_PERIOD;
+      }
+    }
+    maxEmaError = fmax(maxEmaError, fabs(state.emaFast.toDouble() - emaFast));
+    maxEmaError = fmax(maxEmaError, fabs(state.emaSlow.toDouble() - emaSlow));
+    TEST_ASSERT_EQUAL(i >= EMA_SLOW_PERIOD - 1, indicatorsEmaReady(state));
+
+    TEST_ASSERT_EQUAL(i >= RSI_PERIOD, indicatorsRsiReady(state));
+    if(i >= RSI_PERIOD) {
+      double rsi = 100 * avgGain / (avgGain + avgLoss);
+      maxRsiError = fmax(maxRsiError, fabs(state.rsi.toDouble() - rsi));
+    }
+
+    // Window: the last INDICATOR_WINDOW prices, and the returns between them
+    int first = i + 1 > INDICATOR_WINDOW ? i + 1 - INDICATOR_WINDOW : 0;
+    int returns = i - first;
+    if(returns >= 2) {
+      double sum = 0, sumSq = 0;
+      for(int k = first + 1; k <= i; k++) {
+        double ppm = (prices[k] - prices[k - 1]) / prices[k - 1] * 1e6;
+        sum += ppm;
+        sumSq += ppm * ppm;
+      }
+      double mean = sum / returns;
+      double percent = sqrt(sumSq / returns - mean * mean) / 1e4;
+      maxVolatilityError = fmax(maxVolatilityError, fabs(state.volatility.toDouble() - percent));
+    }
+
+    // VWAP weighted by the volume traded since the previous sample
+    double weighted = 0, weights = 0;
+    for(int k = first > 0 ? first : 1; k <= i; k++) {
+      double traded = volumes[k] - volumes[k - 1];
+      if(traded <= 0) continue;
+      weighted += prices[k] * traded;
+      weights += traded;
+    }
+    TEST_ASSERT_EQUAL(weights > 0, indicatorsVwapReady(state));
+    if(weights > 0) maxVwapError = fmax(maxVwapError, fabs(state.vwap.toDouble() - weighted / weights));
+  }
+
+  // Prices are ~100000 with 6 decimals; errors are rounding and the ppm
+  // quantisation of the VWAP weights
+  TEST_ASSERT_DOUBLE_WITHIN(0.0001, 0, maxEmaError);
+  TEST_ASSERT_DOUBLE_WITHIN(0.0001, 0, maxRsiError);
+  TEST_ASSERT_DOUBLE_WITHIN(0.001, 0, maxVolatilityError);
+  TEST_ASSERT_DOUBLE_WITHIN(0.5, 0, maxVwapError);
+}
+
+// A flat 24h volume means nothing traded: VWAP has no data rather than
+// degenerating into a simple average
+void test_vwap_ignores_flat_volume() {
+  IndicatorState state;
+  indicatorsReset(state);
+  Ring ring = {};
+  for(int i = 0; i < 10; i++) push(state, ring, Fixed::fromInt(100 + i), Fixed::fromInt(5000000));
+  TEST_ASSERT_FALSE(indicatorsVwapReady(state));
+}
+
+// Nine samples at 100 with 1000 traded each, then one at 200 with 9000
+// traded: VWAP is 150, where the simple average would be 110
+void test_vwap_weights_by_traded_volume() {
+  IndicatorState state;
+  indicatorsReset(state);
+  Ring ring = {};
+  int64_t volume = 1000000;
+  push(state, ring, Fixed::fromInt(100), Fixed::fromInt(volume));
+  for(int i = 0; i < 9; i++) {
+    volume += 1000;
+    push(state, ring, Fixed::fromInt(100), Fixed::fromInt(volume));
+  }
+  volume += 9000;
+  push(state, ring, Fixed::fromInt(200), Fixed::fromInt(volume));
+  TEST_ASSERT_TRUE(indicatorsVwapReady(state));
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(150).raw, state.vwap.raw);
+}
+
+// Restored history replays with no volume; the first live sample only sets
+// the baseline instead of counting the whole 24h volume as one trade
+void test_vwap_after_replay() {
+  IndicatorState state;
+  indicatorsReset(state);
+  Ring ring = {};
+  for(int i = 0; i < 5; i++) push(state, ring, Fixed::fromInt(100), Fixed::fromRaw(0));
+  push(state, ring, Fixed::fromInt(300), Fixed::fromInt(1000000));
+  TEST_ASSERT_FALSE(indicatorsVwapReady(state));
+  push(state, ring, Fixed::fromInt(120), Fixed::fromInt(1002000));
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(120).raw, state.vwap.raw);
+}
+
+// A falling 24h volume counts as nothing traded
+void test_vwap_clamps_negative_delta() {
+  IndicatorState state;
+  indicatorsReset(state);
+  Ring ring = {};
+  push(state, ring, Fixed::fromInt(100), Fixed::fromInt(1000000));
+  push(state, ring, Fixed::fromInt(110), Fixed::fromInt(1001000));
+  push(state, ring, Fixed::fromInt(500), Fixed::fromInt(990000));
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(110).raw, state.vwap.raw);
+}
+
+void test_flat_prices() {
+  IndicatorState state;
+  indicatorsReset(state);
+  Ring ring = {};
+  for(int i = 0; i < 40; i++) push(state, ring, Fixed::fromInt(42), Fixed::fromRaw(0));
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(42).raw, state.emaSlow.raw);
+  TEST_ASSERT_EQUAL_INT64(Fixed::fromInt(50).raw, state.rsi.raw);
+  TEST_ASSERT_EQUAL_INT64(0, state.volatility.raw);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_matches_reference);
+  RUN_TEST(test_vwap_ignores_flat_volume);
+  RUN_TEST(test_vwap_weights_by_traded_volume);
+  RUN_TEST(test_vwap_after_replay);
+  RUN_TEST(test_vwap_clamps_negative_delta);
+  RUN_TEST(test_flat_prices);
+  return UNITY_END();
+}
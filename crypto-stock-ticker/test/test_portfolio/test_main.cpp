@@ -0,0 +1,151 @@
+// Host tests for the portfolio P&L math: pio test -e native -f test_portfolio
+#include <unity.h>
+#include "asset_registry.cpp"
+#include "portfolio.cpp"
+
+static int bitcoin;
+static int apple;
+
+static void expectFixed(const char *expected, Fixed value) {
+  char buf[32];
+  fixedFormat(buf, sizeof(buf), value, 2);
+  TEST_ASSERT_EQUAL_STRING(expected, buf);
+}
+
+void setUp() {
+  registryClear();
+  bitcoin = registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin");
+  apple = registryAdd(ASSET_STOCK, "AAPL", "AAPL", "Apple");
+  portfolioClear();
+}
+
+void tearDown() {}
+
+void test_cleared_portfolio_has_no_holdings() {
+  for(int slot = 0; slot < MAX_ASSETS; slot++) TEST_ASSERT_EQUAL(-1, portfolioFind(slot));
+  portfolioOnPrice(bitcoin, Fixed::fromInt(50000), Fixed::fromInt(1));
+  TEST_ASSERT_EQUAL(0, portfolio.holdings);
+  TEST_ASSERT_EQUAL_INT64(0, portfolio.value.raw);
+  TEST_ASSERT_EQUAL_INT64(0, portfolioTotalPnlPercent().raw);
+  TEST_ASSERT_EQUAL_INT64(0, portfolioDayPercent().raw);
+}
+
+void test_value_day_change_and_pnl() {
+  // 0.25 BTC bought at 40000, now 44000 after +10% on the day
+  portfolioAdd(bitcoin, Fixed::fromDouble(0.25), Fixed::fromInt(40000));
+  portfolioOnPrice(bitcoin, Fixed::fromInt(44000), Fixed::fromInt(10));
+  expectFixed("11000.00", portfolio.value);
+  expectFixed("1000.00", portfolio.dayChange);
+  expectFixed("10000.00", portfolio.cost);
+  expectFixed("1000.00", portfolioTotalPnl());
+  expectFixed("10.00", portfolioTotalPnlPercent());
+  expectFixed("10.00", portfolioDayPercent());
+  expectFixed("100.00", portfolioAllocation(holdings[portfolioFind(bitcoin)]));
+
+  // A second update replaces the holding's contribution rather than adding to it
+  portfolioOnPrice(bitcoin, Fixed::fromInt(36000), Fixed::fromInt(-10));
+  expectFixed("9000.00", portfolio.value);
+  expectFixed("-1000.00", portfolio.dayChange);
+  expectFixed("-10.00", portfolioTotalPnlPercent());
+}
+
+void test_unpriced_holdings_stay_out_of_pnl() {
+  portfolioAdd(bitcoin, Fixed::fromInt(1), Fixed::fromInt(40000));
+  portfolioAdd(apple, Fixed::fromInt(10), Fixed::fromInt(150));
+  portfolioOnPrice(apple, Fixed::fromInt(165), Fixed::fromInt(0));
+  expectFixed("41500.00", portfolio.cost);
+  expectFixed("1500.00", portfolio.pricedCost);
+  expectFixed("150.00", portfolioTotalPnl());
+  expectFixed("10.00", portfolioTotalPnlPercent());
+  TEST_ASSERT_EQUAL(1, portfolio.priced);
+
+  portfolioOnPrice(bitcoin, Fixed::fromInt(40000), Fixed::fromInt(0));
+  expectFixed("150.00", portfolioTotalPnl());
+  expectFixed("41500.00", portfolio.pricedCost);
+  TEST_ASSERT_EQUAL(2, portfolio.priced);
+}
+
+void test_same_asset_merges() {
+  int first = portfolioAdd(apple, Fixed::fromInt(10), Fixed::fromInt(100));
+  int second = portfolioAdd(apple, Fixed::fromInt(10), Fixed::fromInt(200));
+  TEST_ASSERT_EQUAL(first, second);
+  TEST_ASSERT_EQUAL(1, portfolio.holdings);
+  portfolioOnPrice(apple, Fixed::fromInt(150), Fixed::fromInt(0));
+  expectFixed("3000.00", portfolio.value);
+  expectFixed("0.00", portfolioTotalPnl());
+}
+
+void test_allocation() {
+  portfolioAdd(bitcoin, Fixed::fromInt(1), Fixed::fromInt(1));
+  portfolioAdd(apple, Fixed::fromInt(1), Fixed::fromInt(1));
+  portfolioOnPrice(bitcoin, Fixed::fromInt(300), Fixed::fromInt(0));
+  portfolioOnPrice(apple, Fixed::fromInt(100), Fixed::fromInt(0));
+  expectFixed("75.00", portfolioAllocation(holdings[portfolioFind(bitcoin)]));
+  expectFixed("25.00", portfolioAllocation(holdings[portfolioFind(apple)]));
+}
+
+// A -100% change has no previous price; the day change counts as zero
+void test_total_loss_day_change() {
+  portfolioAdd(apple, Fixed::fromInt(10), Fixed::fromInt(100));
+  portfolioOnPrice(apple, Fixed::fromInt(1), Fixed::fromInt(-100));
+  expectFixed("0.00", portfolio.dayChange);
+}
+
+void test_table_full() {
+  registryClear();
+  portfolioClear();
+  for(int i = 0; i < MAX_HOLDINGS + 1; i++) {
+    char id[16];
+    snprintf(id, sizeof(id), "coin-%d", i);
+    int slot = registryAdd(ASSET_CRYPTO, id, id, id);
+    int index = portfolioAdd(slot, Fixed::fromInt(1), Fixed::fromInt(1));
+    TEST_ASSERT_EQUAL(i < MAX_HOLDINGS ? i : -1, index);
+  }
+  TEST_ASSERT_EQUAL(MAX_HOLDINGS, portfolio.holdings);
+}
+
+// The O(1) running totals must always equal a full re-sum
+void test_running_totals_match_resum() {
+  registryClear();
+  portfolioClear();
+  uint32_t seed = 7;
+  auto next = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+  for(int i = 0; i < 40; i++) {
+    char id[16];
+    snprintf(id, sizeof(id), "asset-%d", i);
+    int slot = registryAdd(i < 20 ? ASSET_CRYPTO : ASSET_STOCK, id, id, id);
+    if(i % 2 == 0) portfolioAdd(slot, Fixed::fromRaw(next() % 100000000 + 1), Fixed::fromInt(next() % 100000));
+  }
+
+  for(int step = 0; step < 100000; step++) {
+    int slot = next() % 40;
+    Fixed price = Fixed::fromRaw((int64_t)next() * 10000 + 1);
+    Fixed change = Fixed::fromRaw((int64_t)(next() % 40000000) - 20000000);
+    portfolioOnPrice(slot, price, change);
+    if(step % 997 != 0) continue;
+
+    int64_t value = 0, dayChange = 0, pricedCost = 0;
+    for(int i = 0; i < portfolio.holdings; i++) {
+      if(!holdings[i].priced) continue;
+      value += holdings[i].value.raw;
+      dayChange += holdings[i].dayChange.raw;
+      pricedCost += holdings[i].costBasis.raw;
+    }
+    TEST_ASSERT_EQUAL_INT64(value, portfolio.value.raw);
+    TEST_ASSERT_EQUAL_INT64(dayChange, portfolio.dayChange.raw);
+    TEST_ASSERT_EQUAL_INT64(pricedCost, portfolio.pricedCost.raw);
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_cleared_portfolio_has_no_holdings);
+  RUN_TEST(test_value_day_change_and_pnl);
+  RUN_TEST(test_unpriced_holdings_stay_out_of_pnl);
+  RUN_TEST(test_same_asset_merges);
+  RUN_TEST(test_allocation);
+  RUN_TEST(test_total_loss_day_change);
+  RUN_TEST(test_table_full);
+  RUN_TEST(test_running_totals_match_resum);
+  return UNITY_END();
+}
@@ -0,0 +1,70 @@
+// Host tests for the watchlist registry: pio test -e native -f test_registry
+#include <unity.h>
+#include "asset_registry.cpp"
+
+void setUp() {
+  registryClear();
+}
+
+void tearDown() {}
+
+void test_find_after_add() {
+  int bitcoin = registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin");
+  int apple = registryAdd(ASSET_STOCK, "AAPL", "AAPL", "Apple");
+  TEST_ASSERT_EQUAL(0, bitcoin);
+  TEST_ASSERT_EQUAL(1, apple);
+  TEST_ASSERT_EQUAL(bitcoin, registryFind("bitcoin"));
+  TEST_ASSERT_EQUAL(apple, registryFind("AAPL"));
+  TEST_ASSERT_EQUAL(-1, registryFind("ethereum"));
+  TEST_ASSERT_EQUAL(1, cryptoCount);
+  TEST_ASSERT_EQUAL(1, stockCount);
+}
+
+void test_duplicate_and_empty_ids_rejected() {
+  TEST_ASSERT_EQUAL(0, registryAdd(ASSET_CRYPTO, "bitcoin", "BTC", "Bitcoin"));
+  TEST_ASSERT_EQUAL(-1, registryAdd(ASSET_CRYPTO, "bitcoin", "BTC2", "Bitcoin again"));
+  TEST_ASSERT_EQUAL(-1, registryAdd(ASSET_CRYPTO, "", "X", "Empty"));
+  TEST_ASSERT_EQUAL(-1, registryAdd(ASSET_CRYPTO, nullptr, "X", "Null"));
+  TEST_ASSERT_EQUAL(1, assetCount);
+}
+
+// The longest id that fits is kept whole and found again; one more character
+// is refused instead of being cut to a prefix no response would ever match
+void test_long_ids() {
+  char id[ASSET_ID_LEN + 1];
+  memset(id, 'a', ASSET_ID_LEN - 1);
+  id[ASSET_ID_LEN - 1] = '\0';
+  int slot = registryAdd(ASSET_CRYPTO, id, "LONG", "Long");
+  TEST_ASSERT_EQUAL(0, slot);
+  TEST_ASSERT_EQUAL_STRING(id, assets[slot].id);
+  TEST_ASSERT_EQUAL(slot, registryFind(id));
+
+  id[ASSET_ID_LEN - 1] = 'b';
+  id[ASSET_ID_LEN] = '\0';
+  TEST_ASSERT_EQUAL(-1, registryAdd(ASSET_CRYPTO, id, "LONGER", "Longer"));
+  TEST_ASSERT_EQUAL(-1, registryFind(id));
+  TEST_ASSERT_EQUAL(1, assetCount);
+  TEST_ASSERT_EQUAL(1, cryptoCount);
+}
+
+void test_full_registry() {
+  for(int i = 0; i < MAX_ASSETS + 1; i++) {
+    char id[16];
+    snprintf(id, sizeof(id), "coin-%d", i);
+    TEST_ASSERT_EQUAL(i < MAX_ASSETS ? i : -1, registryAdd(ASSET_CRYPTO, id, id, id));
+  }
+  for(int i = 0; i < MAX_ASSETS; i++) {
+    char id[16];
+    snprintf(id, sizeof(id), "coin-%d", i);
+    TEST_ASSERT_EQUAL(i, registryFind(id));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_find_after_add);
+  RUN_TEST(test_duplicate_and_empty_ids_rejected);
+  RUN_TEST(test_long_ids);
+  RUN_TEST(test_full_registry);
+  return UNITY_END();
+}
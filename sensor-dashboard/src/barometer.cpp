@@ -0,0 +1,291 @@
+#include "barometer.h"
+#include <Wire.h>
+#include "i2c_bus.h"
+#include "sampler.h"
+
+MetricRing baroPressure;
+BarometerStats barometerStats;
+
+static const uint8_t REG_CALIBRATION = 0x88;  // 24 bytes: dig_T1..dig_P9
+static const uint8_t REG_CHIP_ID = 0xD0;
+static const uint8_t REG_STATUS = 0xF3;       // bit 3: measuring
+static const uint8_t REG_CTRL_MEAS = 0xF4;    // osrs_t, osrs_p, mode
+static const uint8_t REG_CONFIG = 0xF5;       // t_sb, filter
+static const uint8_t REG_DATA = 0xF7;         // press_msb..temp_xlsb
+static const uint8_t CHIP_ID = 0x58;
+static const uint8_t MODE_FORCED = 0x01;
+
+struct Calibration {
+  uint16_t t1;
+  int16_t t2, t3;
+  uint16_t p1;
+  int16_t p2, p3, p4, p5, p6, p7, p8, p9;
+};
+
+static Adafruit_BMP280 bmp;
+// Kept through deep sleep, so the sleep logger finds the sensor once
+RTC_DATA_ATTR static Calibration calib;
+RTC_DATA_ATTR static uint8_t address = 0;
+static bool available = false;
+static bool haveReading = false;
+static int32_t latestPressure = 0;
+static int32_t latestTemperature = 0;
+
+static bool readRegisters(uint8_t reg, uint8_t *buf, uint8_t len) {
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  if(Wire.endTransmission(false) != 0) return false;
+  if(Wire.requestFrom(address, len) != len) return false;
+  for(int i = 0; i < len; i++) buf[i] = Wire.read();
+  return true;
+}
+
+static bool writeRegister(uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+static bool readCalibration() {
+  uint8_t b[24];
+  i2cBusLock(I2C_BAROMETER);
+  bool ok = readRegisters(REG_CALIBRATION, b, sizeof(b));
+  i2cBusUnlock(I2C_BAROMETER);
+  if(!ok) return false;
+
+  // Little-endian words
+  uint16_t w[12];
+  for(int i = 0; i < 12; i++) w[i] = b[2 * i] | (b[2 * i + 1] << 8);
+  calib.t1 = w[0];
+  calib.t2 = (int16_t)w[1];
+  calib.t3 = (int16_t)w[2];
+  calib.p1 = w[3];
+  calib.p2 = (int16_t)w[4];
+  calib.p3 = (int16_t)w[5];
+  calib.p4 = (int16_t)w[6];
+  calib.p5 = (int16_t)w[7];
+  calib.p6 = (int16_t)w[8];
+  calib.p7 = (int16_t)w[9];
+  calib.p8 = (int16_t)w[10];
+  calib.p9 = (int16_t)w[11];
+  return calib.p1 != 0;
+}
+
+// Compensation from the BMP280 datasheet (section 8.2), integer versions.
+// Temperature in hundredths of a degree C; tFine carries it into the pressure.
+static int32_t compensateTemperature(int32_t adc, int32_t &tFine) {
+  int32_t var1 = (((adc >> 3) - ((int32_t)calib.t1 << 1)) * calib.t2) >> 11;
+  int32_t delta = (adc >> 4) - calib.t1;
+  int32_t var2 = (((delta * delta) >> 12) * calib.t3) >> 14;
+  tFine = var1 + var2;
+  return (tFine * 5 + 128) >> 8;
+}
+
+// Pressure in Pa as Q24.8
+static uint32_t compensatePressure(int32_t adc, int32_t tFine) {
+  int64_t var1 = (int64_t)tFine - 128000;
+  int64_t var2 = var1 * var1 * calib.p6;
+  var2 += (var1 * calib.p5) << 17;
+  var2 += (int64_t)calib.p4 << 35;
+  var1 = ((var1 * var1 * calib.p3) >> 8) + ((var1 * calib.p2) << 12);
+  var1 = ((((int64_t)1 << 47) + var1) * calib.p1) >> 33;
+  if(var1 == 0) return 0;
+  int64_t p = 1048576 - adc;
+  p = (((p << 31) - var2) * 3125) / var1;
+  var1 = ((int64_t)calib.p9 * (p >> 13) * (p >> 13)) >> 25;
+  var2 = ((int64_t)calib.p8 * p) >> 19;
+  return (uint32_t)(((p + var1 + var2) >> 8) + ((int64_t)calib.p7 << 4));
+}
+
+static void decode(const uint8_t *b, int32_t &pressure, int32_t &temperature) {
+  int32_t adcP = ((int32_t)b[0] << 12) | (b[1] << 4) | (b[2] >> 4);
+  int32_t adcT = ((int32_t)b[3] << 12) | (b[4] << 4) | (b[5] >> 4);
+  int32_t tFine;
+  temperature = compensateTemperature(adcT, tFine);
+  pressure = compensatePressure(adcP, tFine) >> 8;
+}
+
+static void readSample() {
+  uint8_t b[6];
+  i2cBusLock(I2C_BAROMETER);
+  uint32_t start = micros();
+  bool ok = readRegisters(REG_DATA, b, sizeof(b));
+  uint32_t elapsed = micros() - start;
+  i2cBusUnlock(I2C_BAROMETER);
+
+  barometerStats.lastReadUs = elapsed;
+  if(elapsed > barometerStats.maxReadUs) barometerStats.maxReadUs = elapsed;
+  if(!ok) {
+    barometerStats.errors++;
+    return;
+  }
+
+  int32_t pressure, temperature;
+  decode(b, pressure, temperature);
+
+  samplerLock();
+  latestPressure = pressure;
+  latestTemperature = temperature;
+  haveReading = true;
+  metricPush(baroPressure, pressure);
+  samplerUnlock();
+  barometerStats.samples++;
+}
+
+static void barometerTask(void *param) {
+  TickType_t period = pdMS_TO_TICKS(barometerStats.periodMs);
+  if(period == 0) period = 1;
+  TickType_t wake = xTaskGetTickCount();
+  for(;;) {
+    vTaskDelayUntil(&wake, period);
+    readSample();
+  }
+}
+
+// Oversampling factor of a setting: skipped, x1, x2, x4, x8, x16
+static uint32_t oversampling(Adafruit_BMP280::sensor_sampling setting) {
+  return setting == Adafruit_BMP280::SAMPLING_NONE ? 0 : 1u << (setting - 1);
+}
+
+// Datasheet appendix B: max measurement time in microseconds
+static uint32_t measurementUs(const BarometerConfig &config) {
+  uint32_t t = oversampling(config.temperatureOversampling);
+  uint32_t p = oversampling(config.pressureOversampling);
+  return 1250 + 2300 * t + (p ? 2300 * p + 575 : 0);
+}
+
+// Appendix B typical time, when a forced measurement is usually done
+static uint32_t typicalUs(const BarometerConfig &config) {
+  uint32_t t = oversampling(config.temperatureOversampling);
+  uint32_t p = oversampling(config.pressureOversampling);
+  return 1000 + 2000 * t + (p ? 2000 * p + 500 : 0);
+}
+
+static uint32_t standbyUs(Adafruit_BMP280::standby_duration standby) {
+  static const uint32_t STANDBY_US[] = {500, 62500, 125000, 250000, 500000, 1000000, 2000000, 4000000};
+  return STANDBY_US[standby & 7];
+}
+
+bool barometerBegin(const BarometerConfig &config) {
+  metricReset(baroPressure);
+
+  const uint8_t candidates[] = {BARO_ADDRESS, BARO_ADDRESS ^ 1};
+  for(uint8_t candidate : candidates) {
+    i2cBusLock(I2C_BAROMETER);
+    bool found = bmp.begin(candidate);
+    if(found) {
+      bmp.setSampling(Adafruit_BMP280::MODE_NORMAL,
+                      config.temperatureOversampling, config.pressureOversampling,
+                      config.filter, config.standby);
+    }
+    i2cBusUnlock(I2C_BAROMETER);
+    if(found) {
+      address = candidate;
+      break;
+    }
+  }
+  if(address == 0 || !readCalibration()) {
+    Serial.println("[Baro] No BMP280 found");
+    return false;
+  }
+
+  // Read once per measurement cycle, rounded up to the tick
+  barometerStats.measureUs = measurementUs(config);
+  barometerStats.periodMs = (barometerStats.measureUs + standbyUs(config.standby) + 999) / 1000;
+  available = true;
+
+  uint32_t rate = barometerRateDeciHz();
+  Serial.printf("[Baro] BMP280 at 0x%02X, P x%lu T x%lu, IIR %d: %lu.%02lu ms per measurement, reading at %lu.%lu Hz\n",
+                address, (unsigned long)oversampling(config.pressureOversampling),
+                (unsigned long)oversampling(config.temperatureOversampling),
+                config.filter == Adafruit_BMP280::FILTER_OFF ? 0 : 1 << config.filter,
+                (unsigned long)(barometerStats.measureUs / 1000), (unsigned long)(barometerStats.measureUs % 1000 / 10),
+                (unsigned long)(rate / 10), (unsigned long)(rate % 10));
+
+  xTaskCreatePinnedToCore(barometerTask, "barometer", 2048, nullptr, 2, nullptr, 1);
+  return true;
+}
+
+bool barometerAvailable() {
+  return available;
+}
+
+bool barometerLatest(int32_t &pressurePa, int32_t &temperatureCenti) {
+  pressurePa = latestPressure;
+  temperatureCenti = latestTemperature;
+  return haveReading;
+}
+
+uint32_t barometerRateDeciHz() {
+  return barometerStats.periodMs ? 10000 / barometerStats.periodMs : 0;
+}
+
+// Forced mode, for the sleep logger: one measurement per call, no task
+static uint32_t forcedStartedAt = 0;
+static uint32_t forcedTypicalUs = 0;
+
+// Probe both addresses by chip ID, read the calibration and set the filter
+// (only accepted in sleep mode, which forced mode returns to)
+static bool findForced(const BarometerConfig &config) {
+  const uint8_t candidates[] = {BARO_ADDRESS, BARO_ADDRESS ^ 1};
+  for(uint8_t candidate : candidates) {
+    address = candidate;
+    uint8_t id = 0;
+    i2cBusLock(I2C_BAROMETER);
+    bool ok = readRegisters(REG_CHIP_ID, &id, 1) && id == CHIP_ID &&
+              writeRegister(REG_CTRL_MEAS, 0) && writeRegister(REG_CONFIG, config.filter << 2);
+    i2cBusUnlock(I2C_BAROMETER);
+    if(ok && readCalibration()) return true;
+  }
+  address = 0;
+  return false;
+}
+
+bool barometerStartForced(const BarometerConfig &config) {
+  if(address == 0 && !findForced(config)) return false;
+
+  uint8_t ctrl = (config.temperatureOversampling << 5) | (config.pressureOversampling << 2) | MODE_FORCED;
+  i2cBusLock(I2C_BAROMETER);
+  bool ok = writeRegister(REG_CTRL_MEAS, ctrl);
+  i2cBusUnlock(I2C_BAROMETER);
+  forcedStartedAt = micros();
+  if(!ok) {
+    barometerStats.errors++;
+    address = 0;                      // probe again next time
+    return false;
+  }
+  barometerStats.measureUs = measurementUs(config);
+  forcedTypicalUs = typicalUs(config);
+  available = true;
+  return true;
+}
+
+bool barometerReadForced(int32_t &pressurePa, int32_t &temperatureCenti) {
+  if(!available) return false;
+
+  // Wait out the typical conversion time, then poll until done (or the max)
+  uint32_t elapsed = micros() - forcedStartedAt;
+  if(elapsed < forcedTypicalUs) delayMicroseconds(forcedTypicalUs - elapsed);
+  uint8_t b[6];
+  i2cBusLock(I2C_BAROMETER);
+  uint8_t status = 0;
+  while(readRegisters(REG_STATUS, &status, 1) && (status & 0x08) &&
+        micros() - forcedStartedAt < barometerStats.measureUs) {
+    delayMicroseconds(100);
+  }
+  uint32_t start = micros();
+  bool ok = readRegisters(REG_DATA, b, sizeof(b));
+  uint32_t read = micros() - start;
+  i2cBusUnlock(I2C_BAROMETER);
+
+  barometerStats.lastReadUs = read;
+  if(read > barometerStats.maxReadUs) barometerStats.maxReadUs = read;
+  if(!ok) {
+    barometerStats.errors++;
+    return false;
+  }
+  decode(b, pressurePa, temperatureCenti);
+  barometerStats.samples++;
+  return true;
+}
@@ -0,0 +1,56 @@
+#ifndef BAROMETER_H
+#define BAROMETER_H
+
+#include <Arduino.h>
+#include <Adafruit_BMP280.h>
+#include "metric_ring.h"
+
+// BMP280 pressure/temperature pipeline on the shared I2C bus.
+//
+// The sensor runs in normal mode, measuring continuously with the configured
+// oversampling and on-chip IIR filter. A task wakes once per measurement
+// cycle and burst-reads all six data registers in one transaction (the chip
+// shadows them, so pressure and temperature always come from the same
+// measurement), then compensates with the factory calibration in integer
+// maths. The Adafruit library sets the sensor up; its readPressure() would
+// re-read the temperature in a separate transaction on every call.
+
+#define BARO_ADDRESS 0x76             // SDO low; 0x77 is tried as well
+
+struct BarometerConfig {
+  Adafruit_BMP280::sensor_sampling pressureOversampling;
+  Adafruit_BMP280::sensor_sampling temperatureOversampling;
+  Adafruit_BMP280::sensor_filter filter;
+  Adafruit_BMP280::standby_duration standby;
+};
+
+struct BarometerStats {
+  uint32_t samples;
+  uint32_t errors;                    // failed bus reads
+  uint32_t measureUs;                 // datasheet max measurement time for the config
+  uint32_t periodMs;                  // read period: measurement + standby
+  uint32_t lastReadUs;                // bus time of one burst read
+  uint32_t maxReadUs;
+};
+
+// Pressure at the read rate (Pa), read under samplerLock
+extern MetricRing baroPressure;
+extern BarometerStats barometerStats;
+
+// Find and configure the sensor and start reading. False if there is none.
+bool barometerBegin(const BarometerConfig &config);
+bool barometerAvailable();
+
+// Latest reading: Pa and hundredths of a degree C. False before the first.
+bool barometerLatest(int32_t &pressurePa, int32_t &temperatureCenti);
+
+// Reads per second the config allows, in tenths of a Hz
+uint32_t barometerRateDeciHz();
+
+// One measurement in forced mode, without the task (the sleep logger): start
+// it, do other work, then collect it. The sensor sleeps in between. The first
+// call finds the sensor; its address and calibration survive deep sleep.
+bool barometerStartForced(const BarometerConfig &config);
+bool barometerReadForced(int32_t &pressurePa, int32_t &temperatureCenti);
+
+#endif
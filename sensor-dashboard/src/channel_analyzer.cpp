@@ -0,0 +1,118 @@
+#include "channel_analyzer.h"
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <math.h>
+
+// Share of a 22 MHz channel that overlaps one 5 MHz * d away: (22 - 5d) / 22
+static const float OVERLAP[CHANNEL_SPREAD + 1] = {1.0f, 0.773f, 0.545f, 0.318f, 0.091f};
+
+static ChannelStats stats;
+static portMUX_TYPE statsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// The scan being added up (loop task only)
+static float scanPower[CHANNEL_COUNT];
+static uint8_t scanNetworks[CHANNEL_COUNT];
+static uint8_t ownBssid[6];
+static uint8_t ownChannel = 0;
+static uint8_t firstAllowed = 1;
+static uint8_t lastAllowed = CHANNEL_DEFAULT_LAST;
+static uint32_t addUs = 0;
+
+void channelScanStart() {
+  memset(scanPower, 0, sizeof(scanPower));
+  memset(scanNetworks, 0, sizeof(scanNetworks));
+  addUs = 0;
+  ownChannel = 0;
+  if(WiFi.status() == WL_CONNECTED) {
+    uint8_t *bssid = WiFi.BSSID();
+    if(bssid) memcpy(ownBssid, bssid, sizeof(ownBssid));
+    ownChannel = WiFi.channel();
+  }
+
+  firstAllowed = 1;
+  lastAllowed = CHANNEL_DEFAULT_LAST;
+  wifi_country_t country;
+  if(esp_wifi_get_country(&country) == ESP_OK && country.nchan > 0 && country.schan >= 1 &&
+     country.schan <= CHANNEL_COUNT) {
+    firstAllowed = country.schan;
+    int last = country.schan + country.nchan - 1;
+    lastAllowed = last > CHANNEL_COUNT ? CHANNEL_COUNT : last;
+  }
+}
+
+void channelScanAdd(int8_t rssi, uint8_t channel, const uint8_t *bssid) {
+  if(channel < 1 || channel > CHANNEL_COUNT) return;
+  if(ownChannel && bssid && memcmp(bssid, ownBssid, sizeof(ownBssid)) == 0) return;
+  uint32_t start = micros();
+
+  float mw = powf(10.0f, rssi / 10.0f);
+  int index = channel - 1;
+  scanNetworks[index]++;
+  int first = index - CHANNEL_SPREAD < 0 ? 0 : index - CHANNEL_SPREAD;
+  int last = index + CHANNEL_SPREAD >= CHANNEL_COUNT ? CHANNEL_COUNT - 1 : index + CHANNEL_SPREAD;
+  for(int i = first; i <= last; i++) scanPower[i] += mw * OVERLAP[abs(i - index)];
+
+  addUs += micros() - start;
+}
+
+int32_t channelScoreDeciDbm(float power) {
+  if(power <= 0) return CHANNEL_FLOOR_DBM * 10;
+  int32_t deciDbm = lroundf(100.0f * log10f(power));
+  return deciDbm < CHANNEL_FLOOR_DBM * 10 ? CHANNEL_FLOOR_DBM * 10 : deciDbm;
+}
+
+// Quietest allowed channel, keeping the previous one unless another beats
+// it clearly (or it is no longer allowed)
+static uint8_t recommend(const ChannelStats &s) {
+  int best = s.firstAllowed - 1;
+  for(int i = best + 1; i < s.lastAllowed; i++) {
+    if(s.channels[i].power < s.channels[best].power) best = i;
+  }
+  if(s.recommended < s.firstAllowed || s.recommended > s.lastAllowed) return best + 1;
+
+  int32_t bestScore = channelScoreDeciDbm(s.channels[best].power);
+  int32_t previousScore = channelScoreDeciDbm(s.channels[s.recommended - 1].power);
+  return previousScore - bestScore >= CHANNEL_HYSTERESIS_DB * 10 ? best + 1 : s.recommended;
+}
+
+void channelScanDone() {
+  uint32_t start = micros();
+
+  // Work on a copy so readers never see a half-updated set
+  ChannelStats next;
+  portENTER_CRITICAL(&statsMux);
+  next = stats;
+  portEXIT_CRITICAL(&statsMux);
+
+  for(int i = 0; i < CHANNEL_COUNT; i++) {
+    ChannelScore &score = next.channels[i];
+    score.lastPower = scanPower[i];
+    score.lastNetworks = scanNetworks[i];
+    if(next.scans == 0) {
+      score.power = scanPower[i];
+      score.networks = scanNetworks[i];
+    } else {
+      score.power += (scanPower[i] - score.power) / CHANNEL_SMOOTHING;
+      score.networks += (scanNetworks[i] - score.networks) / CHANNEL_SMOOTHING;
+    }
+  }
+  next.scans++;
+  next.current = ownChannel;
+  next.firstAllowed = firstAllowed;
+  next.lastAllowed = lastAllowed;
+  next.recommended = recommend(next);
+
+  uint32_t elapsed = micros() - start + addUs;
+  next.lastUpdateUs = elapsed;
+  if(elapsed > next.maxUpdateUs) next.maxUpdateUs = elapsed;
+
+  portENTER_CRITICAL(&statsMux);
+  stats = next;
+  portEXIT_CRITICAL(&statsMux);
+}
+
+void channelStatsGet(ChannelStats &out) {
+  portENTER_CRITICAL(&statsMux);
+  out = stats;
+  portEXIT_CRITICAL(&statsMux);
+}
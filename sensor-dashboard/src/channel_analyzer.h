@@ -0,0 +1,62 @@
+#ifndef CHANNEL_ANALYZER_H
+#define CHANNEL_ANALYZER_H
+
+#include <Arduino.h>
+
+// 2.4 GHz channel congestion from the background scans.
+//
+// Every network a scan finds adds its received power (mW, from RSSI) to its
+// own channel and, scaled by spectral overlap, to the channels within four
+// either side: 2.4 GHz channels are 5 MHz apart but 22 MHz wide, so a network
+// on channel 6 is 77% as loud on 5 and 7 and still 9% on 2 and 10. A
+// channel's score is that sum in dBm: the interference an AP moved there
+// would hear. Scores are averaged over scans (an exponential moving average
+// over about CHANNEL_SMOOTHING scans) so one scan that caught a passing
+// hotspot doesn't move the recommendation, and the recommended channel only
+// changes when another is quieter by CHANNEL_HYSTERESIS_DB. Only channels
+// the Wi-Fi country setting allows are recommended (1-11, legal everywhere,
+// when it can't be read); 12 and 13 are still scored, since networks there
+// reach into the allowed ones.
+//
+// The work per network is a fixed CHANNEL_SPREAD * 2 + 1 additions and per
+// scan a pass over CHANNEL_COUNT channels, into fixed arrays; nothing grows
+// with the number of scans. The AP we're associated with is left out, since
+// it's the one to be moved.
+
+#define CHANNEL_COUNT 13              // 1-13 (14 is Japan-only 802.11b)
+#define CHANNEL_SPREAD 4              // neighbours either side a network reaches
+#define CHANNEL_SMOOTHING 8           // scans in the moving average (4 minutes at 30 s)
+#define CHANNEL_HYSTERESIS_DB 3       // a new recommendation must be this much quieter
+#define CHANNEL_FLOOR_DBM -100        // score of a channel with nothing on it
+#define CHANNEL_DEFAULT_LAST 11       // highest channel to recommend without a country
+
+struct ChannelScore {
+  float power;                        // overlap-weighted mW, averaged over scans
+  float networks;                     // networks on the channel itself, averaged
+  float lastPower;                    // last scan only
+  uint8_t lastNetworks;
+};
+
+struct ChannelStats {
+  ChannelScore channels[CHANNEL_COUNT];   // [0] is channel 1
+  uint8_t recommended;                // 0 until the first scan
+  uint8_t current;                    // our AP's channel, 0 when not associated
+  uint8_t firstAllowed;               // channels the country allows, 0 until the first scan
+  uint8_t lastAllowed;
+  uint32_t scans;
+  uint32_t lastUpdateUs;              // cost of folding in the last scan
+  uint32_t maxUpdateUs;
+};
+
+// Feed one scan: start, add each network, done
+void channelScanStart();
+void channelScanAdd(int8_t rssi, uint8_t channel, const uint8_t *bssid);
+void channelScanDone();
+
+// Consistent copy for other tasks
+void channelStatsGet(ChannelStats &out);
+
+// Score in tenths of a dBm, CHANNEL_FLOOR_DBM for nothing
+int32_t channelScoreDeciDbm(float power);
+
+#endif
@@ -0,0 +1,32 @@
+#include "i2c_bus.h"
+#include <Wire.h>
+
+I2cBusStats i2cBusStats;
+
+static SemaphoreHandle_t bus = nullptr;
+static uint32_t lockedAt = 0;
+
+void i2cBusBegin(int sda, int scl) {
+  bus = xSemaphoreCreateMutex();
+  Wire.begin(sda, scl);
+  Wire.setClock(I2C_CLOCK);
+}
+
+void i2cBusLock(I2cUser user) {
+  uint32_t start = micros();
+  xSemaphoreTake(bus, portMAX_DELAY);
+  lockedAt = micros();
+  uint32_t waited = lockedAt - start;
+  if(waited > i2cBusStats.maxWaitUs[user]) i2cBusStats.maxWaitUs[user] = waited;
+}
+
+void i2cBusUnlock(I2cUser user) {
+  i2cBusStats.busyUs[user] += micros() - lockedAt;
+  xSemaphoreGive(bus);
+}
+
+uint32_t i2cBusBusyUs() {
+  uint32_t total = 0;
+  for(int i = 0; i < I2C_USER_COUNT; i++) total += i2cBusStats.busyUs[i];
+  return total;
+}
@@ -0,0 +1,38 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+
+// Shared I2C bus (SDA 4 / SCL 15): the OLED and the BMP280.
+//
+// Each device takes the bus for one self-contained exchange (a sensor burst
+// read, one 128-byte page of a display flush) so transactions never
+// interleave mid-exchange. A frame takes eight of them, and the barometer
+// task (higher priority) gets the bus as soon as the page in flight is done.
+// The time the bus is held is accumulated per user, which gives its
+// utilisation.
+
+#define I2C_CLOCK 400000              // both devices support fast mode
+
+enum I2cUser : uint8_t {
+  I2C_DISPLAY,
+  I2C_BAROMETER,
+  I2C_USER_COUNT
+};
+
+struct I2cBusStats {
+  uint32_t busyUs[I2C_USER_COUNT];    // total time held, wraps after ~71 minutes
+  uint32_t maxWaitUs[I2C_USER_COUNT]; // longest wait to get the bus
+};
+
+extern I2cBusStats i2cBusStats;
+
+void i2cBusBegin(int sda, int scl);
+
+void i2cBusLock(I2cUser user);
+void i2cBusUnlock(I2cUser user);
+
+// Total held time of all users (for utilisation over an interval)
+uint32_t i2cBusBusyUs();
+
+#endif
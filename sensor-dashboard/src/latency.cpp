@@ -0,0 +1,106 @@
+#include "latency.h"
+
+#define CALIBRATION_RECORDS 1000
+
+static const char *PROBE_NAMES[LATENCY_PROBES] = {"loop", "delay late", "sampler late"};
+
+static LatencyHistogram histograms[LATENCY_PROBES];
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t cpuMhz = 240;
+static uint32_t recordCycles = 0;     // measured cost of one latencySince()
+static unsigned long startedAt = 0;
+
+// Values below 2^LATENCY_SUB_BITS have a bucket each; above, each power of
+// two is split into 2^LATENCY_SUB_BITS equal steps
+static uint16_t bucketOf(uint32_t cycles) {
+  if(cycles < (1u << LATENCY_SUB_BITS)) return cycles;
+  int msb = 31 - __builtin_clz(cycles);
+  uint32_t sub = (cycles >> (msb - LATENCY_SUB_BITS)) & ((1u << LATENCY_SUB_BITS) - 1);
+  return ((msb - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS) + sub;
+}
+
+// Largest value that lands in a bucket
+static uint32_t bucketUpper(uint16_t bucket) {
+  if(bucket < (1u << LATENCY_SUB_BITS)) return bucket;
+  int group = bucket >> LATENCY_SUB_BITS;
+  uint32_t sub = bucket & ((1u << LATENCY_SUB_BITS) - 1);
+  uint32_t lower = ((1u << LATENCY_SUB_BITS) + sub) << (group - 1);
+  return lower + ((1u << (group - 1)) - 1);
+}
+
+static uint32_t percentile(const LatencyHistogram &h, uint32_t permille) {
+  if(h.count == 0) return 0;
+  uint32_t rank = (uint32_t)(((uint64_t)h.count * permille + 999) / 1000);
+  uint32_t seen = 0;
+  for(uint16_t b = 0; b < LATENCY_BUCKETS; b++) {
+    seen += h.counts[b];
+    if(seen >= rank) {
+      uint32_t upper = bucketUpper(b);
+      return upper < h.maxCycles ? upper : h.maxCycles;
+    }
+  }
+  return h.maxCycles;
+}
+
+void latencyBegin() {
+  cpuMhz = getCpuFrequencyMhz();
+
+  // Time the probe itself on a throwaway histogram
+  uint32_t start = latencyNow();
+  for(int i = 0; i < CALIBRATION_RECORDS; i++) latencySince(LATENCY_LOOP, latencyNow());
+  recordCycles = (latencyNow() - start) / CALIBRATION_RECORDS;
+  portENTER_CRITICAL(&mux);
+  memset(&histograms[LATENCY_LOOP], 0, sizeof(LatencyHistogram));
+  portEXIT_CRITICAL(&mux);
+  startedAt = millis();
+}
+
+void latencyRecord(LatencyProbe probe, uint32_t cycles) {
+  LatencyHistogram &h = histograms[probe];
+  uint16_t bucket = bucketOf(cycles);
+  portENTER_CRITICAL(&mux);
+  h.counts[bucket]++;
+  h.count++;
+  h.sumCycles += cycles;
+  if(cycles > h.maxCycles) h.maxCycles = cycles;
+  portEXIT_CRITICAL(&mux);
+}
+
+uint32_t latencyCyclesFromMs(uint32_t ms) {
+  return ms * cpuMhz * 1000;          // wraps beyond 17.9 s at 240 MHz
+}
+
+void latencySummary(LatencyProbe probe, LatencySummary &out, LatencyHistogram &h) {
+  // Only the copy holds the lock; the bucket walks run on the snapshot
+  portENTER_CRITICAL(&mux);
+  h = histograms[probe];
+  portEXIT_CRITICAL(&mux);
+  out.count = h.count;
+  out.p50Us = percentile(h, 500) / cpuMhz;
+  out.p99Us = percentile(h, 990) / cpuMhz;
+  out.maxUs = h.maxCycles / cpuMhz;
+  out.sumUs = h.sumCycles / cpuMhz;
+}
+
+const char *latencyName(LatencyProbe probe) {
+  return probe < LATENCY_PROBES ? PROBE_NAMES[probe] : "?";
+}
+
+void latencyPrint(Print &out) {
+  uint64_t records = 0;
+  LatencyHistogram scratch;
+  for(int i = 0; i < LATENCY_PROBES; i++) {
+    LatencySummary s;
+    latencySummary((LatencyProbe)i, s, scratch);
+    records += s.count;
+    out.printf("[Latency] %-12s p50 %7lu us  p99 %7lu us  max %7lu us  (%lu)\n", latencyName((LatencyProbe)i),
+               (unsigned long)s.p50Us, (unsigned long)s.p99Us, (unsigned long)s.maxUs, (unsigned long)s.count);
+  }
+
+  // Share of the CPU spent recording: records per second times their cost
+  unsigned long elapsedMs = millis() - startedAt;
+  if(elapsedMs == 0) return;
+  uint64_t milliPercent = records * recordCycles * 100000 / ((uint64_t)elapsedMs * cpuMhz * 1000);
+  out.printf("[Latency] %lu cycles per record, %lu.%03lu%% of one core\n", (unsigned long)recordCycles,
+             (unsigned long)(milliPercent / 1000), (unsigned long)(milliPercent % 1000));
+}
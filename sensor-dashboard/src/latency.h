@@ -0,0 +1,79 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <Arduino.h>
+
+// Latency histograms from the CPU cycle counter.
+//
+// Each probe counts durations into log-spaced buckets: one bucket per power
+// of two of cycles, split into 2^LATENCY_SUB_BITS linear steps, so every
+// bucket is within 12.5% of its value from one cycle up to the counter's
+// 17.9 s wrap at 240 MHz, in under 1 KB per probe. A percentile is the upper
+// edge of the bucket it falls in (capped at the largest value seen), so
+// p50/p99 read at most 12.5% high. Recording is a count-leading-zeros and an
+// increment under a spinlock; latencyBegin() measures the cost so the serial
+// log can show the overhead. A summary copies the probe's histogram out under
+// the same lock and finds the percentiles in the copy, so a recording task
+// never waits behind a bucket scan. The copy is about 1 KB and the caller
+// provides it: loopTask keeps it on its 8 KB stack, the metrics task (4 KB
+// stack, already holding the scrape's stat snapshots) in a static.
+//
+// The cycle counter belongs to the core reading it: a probe's start and end
+// must be taken by the same pinned task (loopTask and the sampler both run
+// on core 1).
+
+#define LATENCY_SUB_BITS 3
+#define LATENCY_BUCKETS ((32 - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+enum LatencyProbe : uint8_t {
+  LATENCY_LOOP,                       // loop() iteration, excluding its delay()
+  LATENCY_LOOP_DELAY,                 // how late loop()'s delay() returns
+  LATENCY_SAMPLER_WAKE,               // how late the fixed-rate sampler wakes
+  LATENCY_PROBES
+};
+
+struct LatencyHistogram {
+  uint32_t counts[LATENCY_BUCKETS];
+  uint32_t count;
+  uint32_t maxCycles;
+  uint64_t sumCycles;
+};
+
+struct LatencySummary {
+  uint32_t count;
+  uint32_t p50Us;
+  uint32_t p99Us;
+  uint32_t maxUs;
+  uint64_t sumUs;
+};
+
+static inline uint32_t latencyNow() {
+  return ESP.getCycleCount();
+}
+
+// Calibrate the record cost (call once from setup)
+void latencyBegin();
+
+void latencyRecord(LatencyProbe probe, uint32_t cycles);
+
+// Record the cycles since `start` (a latencyNow() value)
+static inline void latencySince(LatencyProbe probe, uint32_t start) {
+  latencyRecord(probe, latencyNow() - start);
+}
+
+// Record how far past `due` (a latencyNow() value) the event ran; early counts as 0
+static inline void latencyLate(LatencyProbe probe, uint32_t due) {
+  int32_t late = (int32_t)(latencyNow() - due);
+  latencyRecord(probe, late > 0 ? late : 0);
+}
+
+uint32_t latencyCyclesFromMs(uint32_t ms);
+
+// `scratch` receives the copy of the probe's histogram the percentiles are read from
+void latencySummary(LatencyProbe probe, LatencySummary &out, LatencyHistogram &scratch);
+const char *latencyName(LatencyProbe probe);
+
+// p50/p99/max per probe and the recording overhead
+void latencyPrint(Print &out);
+
+#endif
@@ -3,6 +3,19 @@
 #include <Adafruit_GFX.h>
 #include <Adafruit_SSD1306.h>
 #include <WiFi.h>
+#include "wifi_scan.h"
+#include "channel_analyzer.h"
+#include "sampler.h"
+#include "task_stats.h"
+#include "i2c_bus.h"
+#include "barometer.h"
+#include "metric_log.h"
+#include "metrics_server.h"
+#include "telemetry.h"
+#include "render.h"
+#include "latency.h"
+#include "sleep_logger.h"
+#include "secrets.h"
 
 // OLED Display configuration for Heltec WiFi Kit 32
 #define SCREEN_WIDTH 128
@@ -12,34 +25,76 @@
 #define OLED_RST 16     // Heltec uses GPIO 16 for RST
 #define SCREEN_ADDRESS 0x3C
 
-Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RST);
+// Keep the bus at 400 kHz between frames too (the library drops it to 100 kHz), for the BMP280
+Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire, OLED_RST, I2C_CLOCK, I2C_CLOCK);
+
+// BMP280: pressure x4 / temperature x1 oversampling, IIR filter x4, 0.5 ms standby (~71 reads/s)
+const BarometerConfig BARO_CONFIG = {
+  Adafruit_BMP280::SAMPLING_X4,
+  Adafruit_BMP280::SAMPLING_X1,
+  Adafruit_BMP280::FILTER_X4,
+  Adafruit_BMP280::STANDBY_MS_1
+};
 
 // Dashboard display modes
 enum DisplayMode {
   MODE_OVERVIEW,
   MODE_WIFI_DETAILS,
+  MODE_CHANNELS,
   MODE_MEMORY,
   MODE_TEMPERATURE,
-  MODE_SYSTEM_INFO
+  MODE_PRESSURE,
+  MODE_SYSTEM_INFO,
+  MODE_TASKS,
+  MODE_TIMING,
+  MODE_HISTORY,
+  MODE_COUNT
 };
 
 DisplayMode currentMode = MODE_OVERVIEW;
 unsigned long lastModeChange = 0;
 const unsigned long MODE_DURATION = 5000; // 5 seconds per mode
+const unsigned long SCAN_PERIOD = 30000;  // background WiFi scan every 30 seconds
+const unsigned long SAMPLE_PERIOD = 1000; // metric sampling every second
+const unsigned long TASK_LOG_PERIOD = 60000; // per-task table on serial every minute
+const unsigned long LOOP_DELAY = 100;     // pause at the end of each loop() iteration
+
+const unsigned long LOG_PERIOD = 60000;   // one row of the flash log per minute
+const unsigned long HISTORY_SPAN = 24UL * 60 * 60 * 1000;  // history graph covers a day of uptime
+const unsigned long TELEMETRY_SAMPLE_PERIOD = 10000;   // one MQTT telemetry sample every 10 seconds
+const unsigned long TELEMETRY_PUBLISH_PERIOD = 60000;  // sent as one message a minute
 
-// Temperature reading (ESP32 internal sensor)
-#ifdef __cplusplus
-extern "C" {
+#ifdef SLEEP_LOGGER
+#ifndef MQTT_HOST
+#error "The sleep logger uploads over MQTT: set MQTT_HOST in secrets.h"
 #endif
-uint8_t temprature_sens_read();
-#ifdef __cplusplus
-}
+// Battery logging mode (the esp32dev-logger environment): one sample a minute
+// in deep sleep, uploaded SLEEP_LOG_BATCH at a time
+const unsigned long SLEEP_SAMPLE_PERIOD = 60000;
+
+// One forced measurement per wake at x1/x1 (5.5 ms typical); no IIR filter across minutes
+const BarometerConfig SLEEP_BARO_CONFIG = {
+  Adafruit_BMP280::SAMPLING_X1,
+  Adafruit_BMP280::SAMPLING_X1,
+  Adafruit_BMP280::FILTER_OFF,
+  Adafruit_BMP280::STANDBY_MS_1
+};
 #endif
-uint8_t temprature_sens_read();
 
-// Function to get ESP32 internal temperature
-float getInternalTemperature() {
-  return (temprature_sens_read() - 32) / 1.8;
+unsigned long lastTaskLog = 0;
+bool wifiConnected = false;
+
+// History graph: one point per column, refreshed when the page comes up or the log grows
+LogPoint historyPoints[SCREEN_WIDTH];
+LogChannel historyChannel = LOG_RSSI;
+uint32_t historyRowsSeen = 0;
+
+// Age of cached data, e.g. "12s" or "3m"
+void formatAge(char *buf, size_t len, unsigned long ms) {
+  unsigned long seconds = ms / 1000;
+  if(seconds < 60) snprintf(buf, len, "%lus", seconds);
+  else if(seconds < 3600) snprintf(buf, len, "%lum", seconds / 60);
+  else snprintf(buf, len, "%luh", seconds / 3600);
 }
 
 // Function to get WiFi signal quality percentage
@@ -53,24 +108,38 @@ int getWiFiQuality(int rssi) {
 }
 
 void setup() {
+#ifdef SLEEP_LOGGER
+  // Sample, upload when a batch is waiting, deep sleep: never returns
+  const SleepLoggerConfig sleepConfig = {
+    WIFI_SSID, WIFI_PASSWORD, MQTT_HOST, MQTT_PORT, MQTT_USER, MQTT_PASSWORD,
+    OLED_SDA, OLED_SCL, SCREEN_ADDRESS, &SLEEP_BARO_CONFIG, SLEEP_SAMPLE_PERIOD
+  };
+  sleepLoggerRun(sleepConfig);
+#endif
+
   Serial.begin(115200);
   delay(1000);
   
   Serial.println("\n\n=================================");
   Serial.println("ESP32 Sensor Dashboard Starting...");
   Serial.println("=================================");
+  latencyBegin();
 
   // Initialize I2C with Heltec WiFi Kit 32 pins
-  Wire.begin(OLED_SDA, OLED_SCL);
+  i2cBusBegin(OLED_SDA, OLED_SCL);
   Serial.println("I2C initialized");
 
   // Initialize OLED display
-  if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
+  i2cBusLock(I2C_DISPLAY);
+  bool displayFound = display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS);
+  i2cBusUnlock(I2C_DISPLAY);
+  if(!displayFound) {
     Serial.println(F("SSD1306 allocation failed"));
     for(;;);
   }
 
   Serial.println("Display initialized successfully!");
+  renderBegin(display, SCREEN_ADDRESS);
 
   display.clearDisplay();
   display.setTextSize(1);
@@ -78,19 +147,76 @@ void setup() {
   display.setCursor(0, 0);
   display.println(F("ESP32 Dashboard"));
   display.println(F("Initializing..."));
-  display.display();
+  renderFlush();
 
   delay(2000);
 
-  // Start WiFi in station mode (but don't connect to any network)
+  // Join the network in the background (scans keep running while connected)
   WiFi.mode(WIFI_STA);
-  WiFi.disconnect();
-  delay(100);
+  WiFi.setAutoReconnect(true);
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+  metricsServerBegin();
+  scanBegin(SCAN_PERIOD);
+  samplerBegin(SAMPLE_PERIOD);
+  
+  // External BMP280 on the same bus (optional; publishes under the sampler lock)
+  barometerBegin(BARO_CONFIG);
+  
+  // Week of metric history on flash (send 'x' on serial to export it as CSV)
+  metricLogBegin(LOG_PERIOD);
+
+#ifdef MQTT_HOST
+  // Batched telemetry to the broker, buffered through outages (needs the log's boot number)
+  const TelemetryConfig telemetryConfig = {
+    MQTT_HOST, MQTT_PORT, MQTT_USER, MQTT_PASSWORD,
+    TELEMETRY_SAMPLE_PERIOD, TELEMETRY_PUBLISH_PERIOD
+  };
+  telemetryBegin(telemetryConfig);
+#endif
 
   Serial.println("Sensor Dashboard Ready!");
 }
 
+// Each screen reads its inputs in display units first; the frame is only
+// drawn when they changed (see render.h)
+
+struct OverviewInputs {
+  uint32_t cpuMhz;
+  int32_t heapKb;
+  int32_t temp;                       // tenths of a degree
+  int32_t pressure;                   // tenths of a hPa
+  bool havePressure;
+  bool scanValid;
+  int networks;
+  char scanAge[8];
+  char uptime[20];
+};
+
 void drawOverview() {
+  OverviewInputs in;
+  memset(&in, 0, sizeof(in));
+  samplerLock();
+  in.heapKb = metricLatest(metrics[METRIC_FREE_HEAP]) / 1024;
+  in.temp = metricLatest(metrics[METRIC_TEMPERATURE]);
+  in.havePressure = metricCount(metrics[METRIC_PRESSURE]) > 0;
+  in.pressure = in.havePressure ? (metricLatest(metrics[METRIC_PRESSURE]) + 5) / 10 : 0;
+  samplerUnlock();
+  in.cpuMhz = getCpuFrequencyMhz();
+  in.scanValid = scanResults.valid;
+  if(in.scanValid) {
+    in.networks = scanResults.found;
+    formatAge(in.scanAge, sizeof(in.scanAge), scanAgeMs());
+  }
+  unsigned long uptime = millis() / 1000;
+  if(uptime > 3600) {
+    snprintf(in.uptime, sizeof(in.uptime), "%luh %lum", uptime / 3600, (uptime % 3600) / 60);
+  } else if(uptime > 60) {
+    snprintf(in.uptime, sizeof(in.uptime), "%lum %lus", uptime / 60, uptime % 60);
+  } else {
+    snprintf(in.uptime, sizeof(in.uptime), "%lu seconds", uptime);
+  }
+  if(!renderChanged(MODE_OVERVIEW, &in, sizeof(in))) return;
+  
   display.clearDisplay();
   display.setTextSize(1);
   display.setCursor(0, 0);
@@ -100,131 +226,278 @@ void drawOverview() {
   
   // CPU Frequency
   display.print(F("CPU: "));
-  display.print(getCpuFrequencyMhz());
+  display.print(in.cpuMhz);
   display.println(F(" MHz"));
   
   // Free Heap Memory
   display.print(F("Heap: "));
-  display.print(ESP.getFreeHeap() / 1024);
+  display.print(in.heapKb);
   display.println(F(" KB"));
   
   // Temperature
-  float temp = getInternalTemperature();
   display.print(F("Temp: "));
-  display.print(temp, 1);
+  display.print(in.temp / 10.0f, 1);
   display.println(F(" C"));
   
-  // WiFi Networks
-  int networks = WiFi.scanNetworks();
+  // Pressure (external BMP280)
+  if(in.havePressure) {
+    display.print(F("Press: "));
+    display.print(in.pressure / 10.0f, 1);
+    display.println(F(" hPa"));
+  }
+  
+  // WiFi Networks (from the last background scan)
   display.print(F("WiFi: "));
-  display.print(networks);
-  display.println(F(" networks"));
+  if(in.scanValid) {
+    display.print(in.networks);
+    display.print(F(" nets ("));
+    display.print(in.scanAge);
+    display.println(F(")"));
+  } else {
+    display.println(F("scanning..."));
+  }
   
   // Uptime
-  unsigned long uptime = millis() / 1000;
   display.print(F("Uptime: "));
-  if(uptime > 3600) {
-    display.print(uptime / 3600);
-    display.print(F("h "));
-    display.print((uptime % 3600) / 60);
-    display.print(F("m"));
-  } else if(uptime > 60) {
-    display.print(uptime / 60);
-    display.print(F("m "));
-    display.print(uptime % 60);
-    display.print(F("s"));
-  } else {
-    display.print(uptime);
-    display.print(F(" seconds"));
-  }
+  display.print(in.uptime);
   
-  display.display();
+  renderFlush();
 }
 
+struct WiFiInputs {
+  bool scanValid;
+  int found;
+  int count;                          // shown, up to 3
+  char scanAge[8];
+  char ssid[3][16];
+  int8_t rssi[3];
+};
+
 void drawWiFiDetails() {
+  WiFiInputs in;
+  memset(&in, 0, sizeof(in));
+  in.scanValid = scanResults.valid;
+  if(in.scanValid) {
+    in.found = scanResults.found;
+    formatAge(in.scanAge, sizeof(in.scanAge), scanAgeMs());
+    
+    // Top 3 strongest networks
+    in.count = min(scanResults.count, 3);
+    for(int i = 0; i < in.count; i++) {
+      const ScanNetwork &network = scanResults.networks[i];
+      if(network.ssid[0] == '\0') {
+        strlcpy(in.ssid[i], "(hidden)", sizeof(in.ssid[i]));
+      } else if(strlen(network.ssid) > 14) {
+        snprintf(in.ssid[i], sizeof(in.ssid[i]), "%.13s~", network.ssid);
+      } else {
+        strlcpy(in.ssid[i], network.ssid, sizeof(in.ssid[i]));
+      }
+      in.rssi[i] = network.rssi;
+    }
+  }
+  if(!renderChanged(MODE_WIFI_DETAILS, &in, sizeof(in))) return;
+  
   display.clearDisplay();
   display.setTextSize(1);
   display.setCursor(0, 0);
   
   display.println(F("=== WiFi SCAN ==="));
   
-  int networks = WiFi.scanNetworks();
-  
-  if(networks == 0) {
+  if(!in.scanValid) {
+    display.println(F("Scanning..."));
+  } else if(in.found == 0) {
     display.println(F("No networks found"));
   } else {
     display.print(F("Found: "));
-    display.print(networks);
-    display.println(F(" networks"));
+    display.print(in.found);
+    display.print(F(" ("));
+    display.print(in.scanAge);
+    display.println(F(" ago)"));
     display.println();
     
-    // Show top 3 strongest networks
-    int count = min(networks, 3);
-    for(int i = 0; i < count; i++) {
-      String ssid = WiFi.SSID(i);
-      if(ssid.length() > 14) {
-        ssid = ssid.substring(0, 13) + "~";
-      }
-      display.print(ssid);
-      
-      int rssi = WiFi.RSSI(i);
+    for(int i = 0; i < in.count; i++) {
+      display.print(in.ssid[i]);
       display.print(F(" "));
-      display.print(rssi);
+      display.print(in.rssi[i]);
       display.println(F("dB"));
     }
   }
   
-  display.display();
+  renderFlush();
 }
 
-void drawMemoryDetails() {
+#define CHANNEL_BAR_TOP 10           // bar area y 10..53, labels below
+#define CHANNEL_BAR_HEIGHT 44
+#define CHANNEL_BAR_PITCH 9
+
+struct ChannelInputs {
+  uint32_t scans;
+  uint8_t recommended;
+  uint8_t current;
+  int16_t bestDbm;
+  uint8_t bars[CHANNEL_COUNT];        // pixels, CHANNEL_FLOOR_DBM to -40 dBm
+};
+
+void drawChannels() {
+  ChannelStats stats;
+  channelStatsGet(stats);
+  
+  ChannelInputs in;
+  memset(&in, 0, sizeof(in));
+  in.scans = stats.scans;
+  if(in.scans > 0) {
+    in.recommended = stats.recommended;
+    in.current = stats.current;
+    in.bestDbm = channelScoreDeciDbm(stats.channels[stats.recommended - 1].power) / 10;
+    for(int i = 0; i < CHANNEL_COUNT; i++) {
+      int32_t above = channelScoreDeciDbm(stats.channels[i].power) - CHANNEL_FLOOR_DBM * 10;
+      in.bars[i] = constrain(above * CHANNEL_BAR_HEIGHT / ((CHANNEL_FLOOR_DBM + 40) * -10), 0, CHANNEL_BAR_HEIGHT);
+    }
+  }
+  if(!renderChanged(MODE_CHANNELS, &in, sizeof(in))) return;
+  
   display.clearDisplay();
   display.setTextSize(1);
   display.setCursor(0, 0);
   
-  display.println(F("==== MEMORY ===="));
-  display.println();
+  if(in.scans == 0) {
+    display.println(F("=== CHANNELS ==="));
+    display.println(F("Scanning..."));
+    renderFlush();
+    return;
+  }
+  
+  // Quietest channel, and ours when associated
+  display.printf("Best %u %ddBm", in.recommended, in.bestDbm);
+  if(in.current) display.printf(" now %u", in.current);
+  
+  // Congestion per channel, taller is busier
+  const int bottom = CHANNEL_BAR_TOP + CHANNEL_BAR_HEIGHT;
+  for(int i = 0; i < CHANNEL_COUNT; i++) {
+    int x = 2 + i * CHANNEL_BAR_PITCH;
+    if(in.bars[i] > 0) display.fillRect(x, bottom - in.bars[i], CHANNEL_BAR_PITCH - 2, in.bars[i], SSD1306_WHITE);
+    if(i + 1 == in.recommended) display.drawFastHLine(x - 1, bottom + 1, CHANNEL_BAR_PITCH, SSD1306_WHITE);
+  }
+  display.drawFastHLine(0, bottom, SCREEN_WIDTH, SSD1306_WHITE);
+  
+  // Labels under the non-overlapping channels
+  display.setCursor(2, 56);
+  display.print(F("1"));
+  display.setCursor(2 + 5 * CHANNEL_BAR_PITCH, 56);
+  display.print(F("6"));
+  display.setCursor(2 + 10 * CHANNEL_BAR_PITCH - 3, 56);
+  display.print(F("11"));
   
-  // Heap Memory
-  uint32_t freeHeap = ESP.getFreeHeap();
-  uint32_t heapSize = ESP.getHeapSize();
+  renderFlush();
+}
+
+struct MemoryInputs {
+  uint32_t totalKb;
+  uint32_t freeKb;
+  uint32_t usedKb;
+  uint32_t lowKb;                     // free heap range over the sample history
+  uint32_t highKb;
+  uint32_t lowestKb;                  // since boot
+  uint32_t blockKb;
+  int barWidth;
+};
+
+void drawMemoryDetails() {
+  samplerLock();
+  uint32_t freeHeap = metricLatest(metrics[METRIC_FREE_HEAP]);
+  uint32_t freeLow = metricMin(metrics[METRIC_FREE_HEAP]);
+  uint32_t freeHigh = metricMax(metrics[METRIC_FREE_HEAP]);
+  uint32_t lowest = metricLatest(metrics[METRIC_MIN_FREE_HEAP]);
+  uint32_t largestBlock = metricLatest(metrics[METRIC_LARGEST_BLOCK]);
+  samplerUnlock();
   uint32_t usedHeap = heapSize - freeHeap;
   
+  MemoryInputs in;
+  memset(&in, 0, sizeof(in));
+  in.totalKb = heapSize / 1024;
+  in.freeKb = freeHeap / 1024;
+  in.usedKb = usedHeap / 1024;
+  in.lowKb = freeLow / 1024;
+  in.highKb = freeHigh / 1024;
+  in.lowestKb = lowest / 1024;
+  in.blockKb = largestBlock / 1024;
+  in.barWidth = map(usedHeap, 0, heapSize, 0, SCREEN_WIDTH);
+  if(!renderChanged(MODE_MEMORY, &in, sizeof(in))) return;
+  
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  
+  display.println(F("==== MEMORY ===="));
+  
   display.print(F("Total: "));
-  display.print(heapSize / 1024);
+  display.print(in.totalKb);
   display.println(F(" KB"));
   
   display.print(F("Free:  "));
-  display.print(freeHeap / 1024);
+  display.print(in.freeKb);
   display.println(F(" KB"));
   
   display.print(F("Used:  "));
-  display.print(usedHeap / 1024);
+  display.print(in.usedKb);
+  display.println(F(" KB"));
+  
+  // Free heap range over the sample history
+  display.print(F("Range: "));
+  display.print(in.lowKb);
+  display.print(F("-"));
+  display.print(in.highKb);
+  display.println(F(" KB"));
+  
+  // Lowest free heap since boot and largest allocatable block
+  display.print(F("Low "));
+  display.print(in.lowestKb);
+  display.print(F(" Block "));
+  display.print(in.blockKb);
   display.println(F(" KB"));
   
   // Memory usage bar
-  int barWidth = map(usedHeap, 0, heapSize, 0, SCREEN_WIDTH);
-  display.println();
   display.drawRect(0, 50, SCREEN_WIDTH, 10, SSD1306_WHITE);
-  display.fillRect(0, 50, barWidth, 10, SSD1306_WHITE);
+  display.fillRect(0, 50, in.barWidth, 10, SSD1306_WHITE);
   
-  display.display();
+  renderFlush();
 }
 
+// Tenths of a degree
+struct TemperatureInputs {
+  int32_t temp;
+  int32_t low;
+  int32_t high;
+  int32_t mean;
+};
+
 void drawTemperatureDetails() {
+  TemperatureInputs in;
+  samplerLock();
+  in.temp = metricLatest(metrics[METRIC_TEMPERATURE]);
+  in.low = metricMin(metrics[METRIC_TEMPERATURE]);
+  in.high = metricMax(metrics[METRIC_TEMPERATURE]);
+  in.mean = metricMean(metrics[METRIC_TEMPERATURE]);
+  samplerUnlock();
+  if(!renderChanged(MODE_TEMPERATURE, &in, sizeof(in))) return;
+  
   display.clearDisplay();
   display.setTextSize(1);
   display.setCursor(0, 0);
   
   display.println(F("== TEMPERATURE =="));
-  display.println();
   
-  float temp = getInternalTemperature();
+  // Range over the sample history
+  display.setCursor(0, 10);
+  display.print(F("Lo "));
+  display.print(in.low / 10.0f, 1);
+  display.print(F("  Hi "));
+  display.print(in.high / 10.0f, 1);
   
   // Large temperature display
   display.setTextSize(3);
   display.setCursor(10, 20);
-  display.print(temp, 1);
+  display.print(in.temp / 10.0f, 1);
   
   display.setTextSize(1);
   display.setCursor(95, 22);
@@ -234,18 +507,109 @@ void drawTemperatureDetails() {
   
   // Status
   display.setCursor(0, 50);
-  if(temp < 50) {
-    display.print(F("Status: NORMAL"));
-  } else if(temp < 70) {
-    display.print(F("Status: WARM"));
+  if(in.temp < 500) {
+    display.print(F("NORMAL"));
+  } else if(in.temp < 700) {
+    display.print(F("WARM"));
   } else {
-    display.print(F("Status: HOT!"));
+    display.print(F("HOT!"));
+  }
+  display.setCursor(64, 50);
+  display.print(F("Avg "));
+  display.print(in.mean / 10.0f, 1);
+  
+  renderFlush();
+}
+
+struct PressureInputs {
+  bool available;
+  int32_t pressure;                   // tenths of a hPa
+  int32_t low;
+  int32_t high;
+  int32_t sensorTemp;                 // tenths of a degree
+  int32_t noise;                      // +/- Pa
+  uint32_t rateHz;
+  int32_t bus;                        // tenths of a percent
+};
+
+void drawPressureDetails() {
+  PressureInputs in;
+  memset(&in, 0, sizeof(in));
+  in.available = barometerAvailable();
+  if(in.available) {
+    samplerLock();
+    in.pressure = (metricLatest(metrics[METRIC_PRESSURE]) + 5) / 10;
+    in.low = (metricMin(metrics[METRIC_PRESSURE]) + 5) / 10;
+    in.high = (metricMax(metrics[METRIC_PRESSURE]) + 5) / 10;
+    in.sensorTemp = metricLatest(metrics[METRIC_SENSOR_TEMPERATURE]);
+    in.bus = metricMean(metrics[METRIC_I2C_BUS]);
+    // Spread of the raw reads over the last ~2 seconds: sensor noise after the IIR filter
+    in.noise = (metricMax(baroPressure) - metricMin(baroPressure)) / 2;
+    samplerUnlock();
+    in.rateHz = barometerRateDeciHz() / 10;
   }
+  if(!renderChanged(MODE_PRESSURE, &in, sizeof(in))) return;
+  
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
   
-  display.display();
+  display.println(F("=== PRESSURE ==="));
+  
+  if(!in.available) {
+    display.println();
+    display.println(F("No BMP280 found"));
+    display.println(F("(SDA 4, SCL 15)"));
+    renderFlush();
+    return;
+  }
+  
+  // Large pressure display
+  display.setTextSize(2);
+  display.setCursor(0, 12);
+  display.print(in.pressure / 10.0f, 1);
+  display.setTextSize(1);
+  display.setCursor(98, 19);
+  display.print(F("hPa"));
+  
+  display.setCursor(0, 32);
+  display.print(F("Temp "));
+  display.print(in.sensorTemp / 10.0f, 1);
+  display.print(F(" C  +/-"));
+  display.print(in.noise);
+  display.println(F("Pa"));
+  
+  // Range over the sample history
+  display.print(F("Range "));
+  display.print(in.low / 10.0f, 1);
+  display.print(F("-"));
+  display.println(in.high / 10.0f, 1);
+  
+  // Achievable read rate and how busy the shared bus is
+  display.setCursor(0, 56);
+  display.print(in.rateHz);
+  display.print(F(" Hz  bus "));
+  display.print(in.bus / 10.0f, 1);
+  display.print(F("%"));
+  
+  renderFlush();
 }
 
+// Chip, cores, flash and SDK never change
+struct SystemInputs {
+  uint32_t cpuMhz;
+  bool connected;
+  uint32_t ip;
+};
+
 void drawSystemInfo() {
+  SystemInputs in;
+  memset(&in, 0, sizeof(in));
+  in.cpuMhz = getCpuFrequencyMhz();
+  in.connected = WiFi.status() == WL_CONNECTED;
+  in.ip = in.connected ? (uint32_t)WiFi.localIP() : 0;
+  if(!renderChanged(MODE_SYSTEM_INFO, &in, sizeof(in))) return;
+  
   display.clearDisplay();
   display.setTextSize(1);
   display.setCursor(0, 0);
@@ -262,7 +626,7 @@ void drawSystemInfo() {
   
   // CPU Frequency
   display.print(F("CPU: "));
-  display.print(getCpuFrequencyMhz());
+  display.print(in.cpuMhz);
   display.println(F(" MHz"));
   
   // Flash size
@@ -274,27 +638,316 @@ void drawSystemInfo() {
   display.print(F("SDK: "));
   display.println(ESP.getSdkVersion());
   
-  display.display();
+  // Address to scrape
+  display.print(F("IP: "));
+  if(in.connected) display.println(IPAddress(in.ip));
+  else display.println(F("connecting..."));
+  
+  renderFlush();
+}
+
+#define TASKS_SHOWN 6
+
+struct TaskRow {
+  char name[10];
+  uint16_t cpu;                       // tenths of a percent
+  uint32_t stackFree;
+  char state;
+};
+
+struct TasksInputs {
+  bool available;
+  bool hasCpu;
+  uint16_t idle[2];                   // percent
+  uint32_t windowS;
+  int shown;
+  TaskRow rows[TASKS_SHOWN];
+};
+
+void drawTaskStats() {
+  TasksInputs in;
+  memset(&in, 0, sizeof(in));
+  in.available = taskStatsAvailable();
+  in.hasCpu = taskStatsHasCpu();
+  if(in.available) {
+    samplerLock();
+    TaskStats stats = taskStats;
+    samplerUnlock();
+    
+    // Idle time per core over the window
+    in.idle[0] = (stats.coreIdle[0] + 5) / 10;
+    in.idle[1] = (stats.coreIdle[1] + 5) / 10;
+    in.windowS = stats.windowMs / 1000;
+    
+    // Busiest tasks (or tightest stacks without run-time stats): name,
+    // CPU % of one core or state, bytes of stack never used
+    for(int i = 0; i < stats.count && in.shown < TASKS_SHOWN; i++) {
+      const TaskUsage &task = stats.tasks[i];
+      if(task.idle) continue;
+      TaskRow &row = in.rows[in.shown++];
+      strlcpy(row.name, task.name, sizeof(row.name));
+      row.cpu = task.cpu;
+      row.stackFree = task.stackFree;
+      row.state = task.state;
+    }
+  }
+  if(!renderChanged(MODE_TASKS, &in, sizeof(in))) return;
+  
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  
+  display.println(F("===== TASKS ====="));
+  
+  if(!in.available) {
+    display.println(F("Task list off"));
+    renderFlush();
+    return;
+  }
+  
+  if(in.hasCpu) {
+    display.printf("Idle %u%% / %u%%  %lus\n", in.idle[0], in.idle[1], (unsigned long)in.windowS);
+  } else {
+    display.println(F("Stack free, tightest"));
+  }
+  for(int i = 0; i < in.shown; i++) {
+    const TaskRow &row = in.rows[i];
+    if(in.hasCpu) {
+      display.printf("%-9.9s%3u.%u%%%6lu\n", row.name, row.cpu / 10, row.cpu % 10,
+                     (unsigned long)row.stackFree);
+    } else {
+      display.printf("%-9.9s %c%10lu\n", row.name, row.state, (unsigned long)row.stackFree);
+    }
+  }
+  
+  renderFlush();
+}
+
+// Duration in at most 4 characters: "850u", "2.5m", "340m", "1.2s", "17s"
+void formatMicros(char *buf, size_t len, uint32_t us) {
+  if(us < 1000) snprintf(buf, len, "%luu", (unsigned long)us);
+  else if(us < 10000) snprintf(buf, len, "%lu.%lum", (unsigned long)(us / 1000), (unsigned long)(us / 100 % 10));
+  else if(us < 1000000) snprintf(buf, len, "%lum", (unsigned long)(us / 1000));
+  else if(us < 10000000) snprintf(buf, len, "%lu.%lus", (unsigned long)(us / 1000000), (unsigned long)(us / 100000 % 10));
+  else snprintf(buf, len, "%lus", (unsigned long)(us / 1000000));
+}
+
+struct TimingInputs {
+  char cells[LATENCY_PROBES][3][5];   // p50, p99, max
+};
+
+void drawTiming() {
+  static const char *LABELS[LATENCY_PROBES] = {"loop", "sleep", "wake"};
+  
+  TimingInputs in;
+  memset(&in, 0, sizeof(in));
+  LatencyHistogram scratch;
+  for(int i = 0; i < LATENCY_PROBES; i++) {
+    LatencySummary s;
+    latencySummary((LatencyProbe)i, s, scratch);
+    formatMicros(in.cells[i][0], sizeof(in.cells[i][0]), s.p50Us);
+    formatMicros(in.cells[i][1], sizeof(in.cells[i][1]), s.p99Us);
+    formatMicros(in.cells[i][2], sizeof(in.cells[i][2]), s.maxUs);
+  }
+  if(!renderChanged(MODE_TIMING, &in, sizeof(in))) return;
+  
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  
+  display.println(F("===== TIMING ====="));
+  display.println(F("       p50  p99  max"));
+  
+  // Loop iteration time, then how late loop()'s delay and the sampler wake up
+  for(int i = 0; i < LATENCY_PROBES; i++) {
+    display.printf("%-5s %4s %4s %4s\n", LABELS[i], in.cells[i][0], in.cells[i][1], in.cells[i][2]);
+  }
+  
+  renderFlush();
+}
+
+// Log value in display units, e.g. "183K", "45.2C", "1013.2", "-61dB"
+void formatLogValue(char *buf, size_t len, LogChannel channel, int32_t value) {
+  switch(channel) {
+    case LOG_FREE_HEAP: snprintf(buf, len, "%ldK", (long)(value / 1024)); break;
+    case LOG_TEMPERATURE: snprintf(buf, len, "%.1fC", value / 10.0f); break;
+    case LOG_PRESSURE: snprintf(buf, len, "%.1f", value / 100.0f); break;
+    case LOG_RSSI: snprintf(buf, len, "%lddB", (long)value); break;
+    default: snprintf(buf, len, "%ld", (long)value); break;
+  }
+}
+
+// Next channel for the history page (pressure only with a sensor)
+void nextHistoryChannel() {
+  do {
+    historyChannel = (LogChannel)((historyChannel + 1) % LOG_CHANNELS);
+  } while(historyChannel == LOG_PRESSURE && !barometerAvailable());
+  historyRowsSeen = 0;
+}
+
+// The graph itself is in historyPoints, which only changes with these
+struct HistoryInputs {
+  uint32_t rows;
+  LogChannel channel;
+};
+
+void drawHistory() {
+  static const char *NAMES[LOG_CHANNELS] = {"Heap", "Temp", "hPa", "RSSI"};
+  
+  // Decoding from flash is too slow for every frame: only when there are new rows
+  if(historyRowsSeen == 0 || metricLogStats.rowsWritten != historyRowsSeen) {
+    metricLogQuery(historyChannel, HISTORY_SPAN / 1000, historyPoints, SCREEN_WIDTH);
+    historyRowsSeen = metricLogStats.rowsWritten ? metricLogStats.rowsWritten : 1;
+  }
+  
+  HistoryInputs in;
+  memset(&in, 0, sizeof(in));
+  in.rows = historyRowsSeen;
+  in.channel = historyChannel;
+  if(!renderChanged(MODE_HISTORY, &in, sizeof(in))) return;
+  
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.print(NAMES[historyChannel]);
+  display.print(F(" 24h"));
+  
+  // Scale to the range shown
+  bool any = false;
+  int32_t low = 0;
+  int32_t high = 0;
+  for(int x = 0; x < SCREEN_WIDTH; x++) {
+    const LogPoint &point = historyPoints[x];
+    if(point.rows == 0) continue;
+    if(!any || point.min < low) low = point.min;
+    if(!any || point.max > high) high = point.max;
+    any = true;
+  }
+  if(!any) {
+    display.setCursor(0, 28);
+    display.println(F("No history yet"));
+    renderFlush();
+    return;
+  }
+  
+  char lowText[12];
+  char highText[12];
+  formatLogValue(lowText, sizeof(lowText), historyChannel, low);
+  formatLogValue(highText, sizeof(highText), historyChannel, high);
+  display.print(F(" "));
+  display.print(lowText);
+  display.print(F("-"));
+  display.print(highText);
+  
+  // One column per point, min to max (graph area y 10..63)
+  if(high == low) high = low + 1;
+  const int top = 10;
+  const int height = SCREEN_HEIGHT - top;
+  for(int x = 0; x < SCREEN_WIDTH; x++) {
+    const LogPoint &point = historyPoints[x];
+    if(point.rows == 0) continue;
+    int yMax = top + (int)((int64_t)(high - point.max) * (height - 1) / (high - low));
+    int yMin = top + (int)((int64_t)(high - point.min) * (height - 1) / (high - low));
+    display.drawFastVLine(x, yMax, yMin - yMax + 1, SSD1306_WHITE);
+  }
+  
+  renderFlush();
 }
 
 void loop() {
+  uint32_t loopStart = latencyNow();
+  
+  // Start or collect the background WiFi scan (never blocks)
+  scanUpdate();
+  
+  // Log the address to scrape whenever the connection comes up
+  if((WiFi.status() == WL_CONNECTED) != wifiConnected) {
+    wifiConnected = !wifiConnected;
+    if(wifiConnected) {
+      Serial.print("[WiFi] Connected, metrics at http://");
+      Serial.print(WiFi.localIP());
+      Serial.println("/metrics");
+    } else {
+      Serial.println("[WiFi] Disconnected");
+    }
+  }
+  
+  // Long-term history
+  metricLogUpdate(millis());
+  
+  // 'x' on serial dumps the flash log as CSV
+  if(Serial.available() && Serial.read() == 'x') {
+    metricLogExport(Serial);
+  }
+  
+  // Export the per-task table
+  if(millis() - lastTaskLog > TASK_LOG_PERIOD) {
+    lastTaskLog = millis();
+    taskStatsPrint(Serial, SAMPLE_PERIOD);
+    latencyPrint(Serial);
+    
+    samplerLock();
+    int32_t bus = metricMean(metrics[METRIC_I2C_BUS]);
+    samplerUnlock();
+    Serial.printf("[I2C] Bus %ld.%ld%% busy, longest wait: display %lu us, barometer %lu us\n",
+                  (long)(bus / 10), (long)(bus % 10),
+                  (unsigned long)i2cBusStats.maxWaitUs[I2C_DISPLAY],
+                  (unsigned long)i2cBusStats.maxWaitUs[I2C_BAROMETER]);
+    if(barometerAvailable()) {
+      Serial.printf("[Baro] %lu reads (%lu errors), %lu us on the bus each (max %lu us)\n",
+                    (unsigned long)barometerStats.samples, (unsigned long)barometerStats.errors,
+                    (unsigned long)barometerStats.lastReadUs, (unsigned long)barometerStats.maxReadUs);
+    }
+    ChannelStats channels;
+    channelStatsGet(channels);
+    if(channels.scans > 0) {
+      int32_t best = channelScoreDeciDbm(channels.channels[channels.recommended - 1].power);
+      Serial.printf("[Channels] Least congested: %u (%ld.%ld dBm) over %lu scans", channels.recommended,
+                    (long)(best / 10), (long)abs(best % 10), (unsigned long)channels.scans);
+      if(channels.current) {
+        int32_t now = channelScoreDeciDbm(channels.channels[channels.current - 1].power);
+        Serial.printf(", ours %u (%ld.%ld dBm)", channels.current, (long)(now / 10), (long)abs(now % 10));
+      }
+      Serial.printf(", %lu us per scan (max %lu us)\n", (unsigned long)channels.lastUpdateUs,
+                    (unsigned long)channels.maxUpdateUs);
+    }
+    metricLogPrintStats(Serial);
+    if(metricsServerStats.scrapes > 0) {
+      Serial.printf("[Metrics] %lu scrapes, last %lu us (max %lu us), %lu bytes, heap change %ld while formatting, %ld per request (worst %ld)\n",
+                    (unsigned long)metricsServerStats.scrapes, (unsigned long)metricsServerStats.lastUs,
+                    (unsigned long)metricsServerStats.maxUs, (unsigned long)metricsServerStats.lastBytes,
+                    (long)metricsServerStats.buildHeapDelta, (long)metricsServerStats.requestHeapDelta,
+                    (long)metricsServerStats.worstRequestHeapDelta);
+    }
+    if(telemetryStats.samples > 0) telemetryPrintStats(Serial);
+    renderPrintStats(Serial);
+  }
+  
   // Auto-cycle through display modes
   if(millis() - lastModeChange > MODE_DURATION) {
-    currentMode = (DisplayMode)((currentMode + 1) % 5);
+    currentMode = (DisplayMode)((currentMode + 1) % MODE_COUNT);
     lastModeChange = millis();
     
     // Print mode change to serial
     Serial.print("Mode: ");
+    if(currentMode == MODE_HISTORY) nextHistoryChannel();
     switch(currentMode) {
       case MODE_OVERVIEW: Serial.println("Overview"); break;
       case MODE_WIFI_DETAILS: Serial.println("WiFi Details"); break;
+      case MODE_CHANNELS: Serial.println("Channels"); break;
       case MODE_MEMORY: Serial.println("Memory"); break;
       case MODE_TEMPERATURE: Serial.println("Temperature"); break;
+      case MODE_PRESSURE: Serial.println("Pressure"); break;
       case MODE_SYSTEM_INFO: Serial.println("System Info"); break;
+      case MODE_TASKS: Serial.println("Tasks"); break;
+      case MODE_TIMING: Serial.println("Timing"); break;
+      case MODE_HISTORY: Serial.println("History"); break;
+      default: break;
     }
   }
   
-  // Display current mode
+  // Display current mode (drawn and sent only when something on it changed)
+  renderFrameStart();
   switch(currentMode) {
     case MODE_OVERVIEW:
       drawOverview();
@@ -304,6 +957,10 @@ void loop() {
       drawWiFiDetails();
       break;
       
+    case MODE_CHANNELS:
+      drawChannels();
+      break;
+      
     case MODE_MEMORY:
       drawMemoryDetails();
       break;
@@ -312,10 +969,33 @@ void loop() {
       drawTemperatureDetails();
       break;
       
+    case MODE_PRESSURE:
+      drawPressureDetails();
+      break;
+      
     case MODE_SYSTEM_INFO:
       drawSystemInfo();
       break;
+      
+    case MODE_TASKS:
+      drawTaskStats();
+      break;
+      
+    case MODE_TIMING:
+      drawTiming();
+      break;
+      
+    case MODE_HISTORY:
+      drawHistory();
+      break;
+      
+    default:
+      break;
   }
+  renderFrameEnd();
   
-  delay(100);
+  latencySince(LATENCY_LOOP, loopStart);
+  uint32_t wakeDue = latencyNow() + latencyCyclesFromMs(LOOP_DELAY);
+  delay(LOOP_DELAY);
+  latencyLate(LATENCY_LOOP_DELAY, wakeDue);
 }
@@ -0,0 +1,565 @@
+#include "metric_log.h"
+#include <LittleFS.h>
+#include "sampler.h"
+
+#define LOG_BLOCK_MAGIC 0xB1          // first byte of every block
+#define LOG_PENDING_MAGIC 0x4C4F4721  // RTC block is valid
+#define LOG_RAW_ROW_BYTES (4 + 4 * LOG_CHANNELS)   // uptime and values as plain words
+#define LOG_BLOCK_MAX_ROWS 255
+#define FLASH_SECTOR_BYTES 4096       // LittleFS block: one erase
+#define FLASH_ERASE_CYCLES 100000     // rated endurance of the ESP32 flash
+
+MetricLogStats metricLogStats;
+
+struct BlockHeader {
+  uint8_t magic;
+  uint8_t rows;
+  uint16_t boot;
+  uint32_t uptime;                    // of the first row
+  int32_t first[LOG_CHANNELS];        // first row as is
+};
+
+#define LOG_PAYLOAD_BITS ((LOG_BLOCK_BYTES - sizeof(BlockHeader)) * 8)
+
+// The block being filled. RTC_NOINIT keeps it through a crash or reset;
+// after a power cut the check fails and it is discarded.
+struct PendingBlock {
+  uint32_t magic;
+  uint32_t check;                     // FNV-1a of bits and data
+  uint16_t bits;                      // payload bits used
+  uint8_t data[LOG_BLOCK_BYTES];
+};
+
+RTC_NOINIT_ATTR static PendingBlock pending;
+
+// Prefix code for signed deltas: small ones are common
+struct Tier {
+  uint8_t prefix;
+  uint8_t prefixBits;
+  uint8_t valueBits;
+};
+
+static const Tier TIERS[] = {
+  {0x0, 1, 0},                        // 0: unchanged
+  {0x2, 2, 7},                        // 10 + 7 bits
+  {0x6, 3, 14},                       // 110 + 14 bits
+  {0xE, 4, 20},                       // 1110 + 20 bits
+  {0xF, 4, 32}                        // 1111 + the full word
+};
+
+static bool logAvailable = false;
+static unsigned long period = 60000;
+static unsigned long lastRow = 0;
+
+// Segment files are numbered firstSegment..lastSegment
+static bool haveSegments = false;
+static uint32_t firstSegment = 0;
+static uint32_t lastSegment = 0;
+static uint16_t lastSegmentBlocks = 0;
+static uint16_t segmentRows[LOG_MAX_SEGMENTS];      // by segment number % LOG_MAX_SEGMENTS
+static uint32_t flashRows = 0;
+
+// Filesystem space, for measuring what the log really takes
+static size_t usedAtBoot = 0;
+static size_t freedBytes = 0;                       // by segments rotated out this boot
+
+// Encoder state for the pending block
+static uint32_t lastUptime = 0;
+static int32_t lastDelta = 0;
+static int32_t lastValues[LOG_CHANNELS];
+
+// Scratch for reading blocks back (loop task only)
+static uint8_t readBuffer[LOG_BLOCK_BYTES];
+
+static uint32_t fnv1a(const uint8_t *data, size_t len, uint32_t hash = 2166136261u) {
+  for(size_t i = 0; i < len; i++) hash = (hash ^ data[i]) * 16777619u;
+  return hash;
+}
+
+static uint32_t pendingCheck() {
+  uint32_t hash = fnv1a((const uint8_t *)&pending.bits, sizeof(pending.bits));
+  return fnv1a(pending.data, sizeof(pending.data), hash);
+}
+
+static void sealPending() {
+  pending.magic = LOG_PENDING_MAGIC;
+  pending.check = pendingCheck();
+}
+
+static BlockHeader readHeader(const uint8_t *block) {
+  BlockHeader header;
+  memcpy(&header, block, sizeof(header));
+  return header;
+}
+
+static int pendingRows() {
+  return pending.magic == LOG_PENDING_MAGIC ? pending.data[1] : 0;
+}
+
+// ---- Bit packing ----
+
+static void putBits(uint8_t *buf, uint16_t &pos, uint32_t value, uint8_t bits) {
+  for(int i = bits - 1; i >= 0; i--) {
+    uint8_t mask = 0x80 >> (pos & 7);
+    if((value >> i) & 1) buf[pos >> 3] |= mask;
+    else buf[pos >> 3] &= ~mask;
+    pos++;
+  }
+}
+
+// Reads past the payload (a corrupt row count) return zeros
+static uint32_t getBits(const uint8_t *buf, uint16_t &pos, uint8_t bits) {
+  uint32_t value = 0;
+  for(uint8_t i = 0; i < bits; i++) {
+    uint32_t bit = pos < LOG_PAYLOAD_BITS ? (buf[pos >> 3] >> (7 - (pos & 7))) & 1 : 0;
+    value = (value << 1) | bit;
+    pos++;
+  }
+  return value;
+}
+
+static const Tier &tierFor(int32_t v) {
+  for(size_t i = 0; i + 1 < sizeof(TIERS) / sizeof(TIERS[0]); i++) {
+    const Tier &tier = TIERS[i];
+    if(tier.valueBits == 0 ? v == 0 : (v >= -(1 << (tier.valueBits - 1)) && v < (1 << (tier.valueBits - 1)))) return tier;
+  }
+  return TIERS[sizeof(TIERS) / sizeof(TIERS[0]) - 1];
+}
+
+static uint8_t signedBits(int32_t v) {
+  const Tier &tier = tierFor(v);
+  return tier.prefixBits + tier.valueBits;
+}
+
+static void putSigned(uint8_t *buf, uint16_t &pos, int32_t v) {
+  const Tier &tier = tierFor(v);
+  putBits(buf, pos, tier.prefix, tier.prefixBits);
+  if(tier.valueBits) putBits(buf, pos, (uint32_t)v & (tier.valueBits == 32 ? 0xFFFFFFFFu : (1u << tier.valueBits) - 1), tier.valueBits);
+}
+
+static int32_t getSigned(const uint8_t *buf, uint16_t &pos) {
+  uint8_t ones = 0;
+  while(ones < 4 && getBits(buf, pos, 1)) ones++;
+  uint8_t bits = TIERS[ones].valueBits;
+  if(bits == 0) return 0;
+  uint32_t raw = getBits(buf, pos, bits);
+  if(bits == 32) return (int32_t)raw;
+  // Sign-extend
+  return (int32_t)(raw << (32 - bits)) >> (32 - bits);
+}
+
+// Differences wrap like the counters they describe
+static int32_t wrapDelta(int32_t a, int32_t b) {
+  return (int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+// ---- Decoding ----
+
+typedef void (*RowVisitor)(const LogRow &row, uint32_t index, void *ctx);
+
+// Visit the rows of a block from index `skip` on; `index` counts rows across blocks
+static void decodeBlock(const uint8_t *block, uint32_t &index, uint32_t skip, RowVisitor visit, void *ctx) {
+  BlockHeader header = readHeader(block);
+  if(header.magic != LOG_BLOCK_MAGIC) return;
+  if(index + header.rows <= skip) {
+    index += header.rows;
+    return;
+  }
+
+  const uint8_t *payload = block + sizeof(BlockHeader);
+  uint16_t pos = 0;
+  LogRow row;
+  row.boot = header.boot;
+  row.uptime = header.uptime;
+  memcpy(row.values, header.first, sizeof(row.values));
+  int32_t delta = 0;
+
+  for(int r = 0; r < header.rows; r++) {
+    if(r > 0) {
+      delta += getSigned(payload, pos);
+      row.uptime += delta;
+      for(int c = 0; c < LOG_CHANNELS; c++) {
+        row.values[c] = (int32_t)((uint32_t)row.values[c] + (uint32_t)getSigned(payload, pos));
+      }
+    }
+    if(index >= skip) visit(row, index, ctx);
+    index++;
+  }
+}
+
+static void segmentPath(uint32_t segment, char *out, size_t len) {
+  snprintf(out, len, LOG_DIR "/%08lu.bin", (unsigned long)segment);
+}
+
+// Rows from the oldest on, skipping the first `skip` without decoding where possible
+static void forEachRow(uint32_t skip, RowVisitor visit, void *ctx) {
+  uint32_t index = 0;
+  if(haveSegments) {
+    for(uint32_t segment = firstSegment; segment <= lastSegment; segment++) {
+      uint16_t rows = segmentRows[segment % LOG_MAX_SEGMENTS];
+      if(index + rows <= skip) {
+        index += rows;
+        continue;
+      }
+      char path[32];
+      segmentPath(segment, path, sizeof(path));
+      File f = LittleFS.open(path, "r");
+      if(!f) continue;
+      while(f.read(readBuffer, LOG_BLOCK_BYTES) == LOG_BLOCK_BYTES) {
+        decodeBlock(readBuffer, index, skip, visit, ctx);
+      }
+      f.close();
+    }
+  }
+  if(pendingRows() > 0) decodeBlock(pending.data, index, skip, visit, ctx);
+}
+
+// ---- Writing ----
+
+static void removeSegment(uint32_t segment) {
+  char path[32];
+  segmentPath(segment, path, sizeof(path));
+  size_t before = LittleFS.usedBytes();
+  LittleFS.remove(path);
+  size_t after = LittleFS.usedBytes();
+  if(before > after) freedBytes += before - after;
+}
+
+static void newSegment() {
+  if(haveSegments) {
+    lastSegment++;
+  } else {
+    firstSegment = lastSegment = 0;
+    haveSegments = true;
+  }
+
+  // Rotate: the oldest segments go first
+  while(lastSegment - firstSegment + 1 > LOG_MAX_SEGMENTS) {
+    removeSegment(firstSegment);
+    flashRows -= segmentRows[firstSegment % LOG_MAX_SEGMENTS];
+    firstSegment++;
+    metricLogStats.segmentsRotated++;
+  }
+  segmentRows[lastSegment % LOG_MAX_SEGMENTS] = 0;
+  lastSegmentBlocks = 0;
+}
+
+// A block that can't be written is dropped: its rows are counted, not kept
+static bool writeBlock(const uint8_t *block) {
+  BlockHeader header = readHeader(block);
+  if(!logAvailable) {
+    metricLogStats.droppedRows += header.rows;
+    return false;
+  }
+
+  if(!haveSegments || lastSegmentBlocks >= LOG_SEGMENT_BLOCKS) newSegment();
+  char path[32];
+  segmentPath(lastSegment, path, sizeof(path));
+  File f = LittleFS.open(path, "a");
+  size_t written = f ? f.write(block, LOG_BLOCK_BYTES) : 0;
+  if(f) f.close();
+
+  if(written != LOG_BLOCK_BYTES) {
+    // Never append after a torn block: readers stop at the first short one
+    lastSegmentBlocks = LOG_SEGMENT_BLOCKS;
+    metricLogStats.writeFailures++;
+    metricLogStats.droppedRows += header.rows;
+    Serial.printf("[Log] Write to %s failed\n", path);
+    return false;
+  }
+  lastSegmentBlocks++;
+  segmentRows[lastSegment % LOG_MAX_SEGMENTS] += header.rows;
+  flashRows += header.rows;
+  metricLogStats.blocksWritten++;
+  return true;
+}
+
+static void startBlock(const LogRow &row) {
+  memset(pending.data, 0, sizeof(pending.data));
+  BlockHeader header;
+  header.magic = LOG_BLOCK_MAGIC;
+  header.rows = 1;
+  header.boot = row.boot;
+  header.uptime = row.uptime;
+  memcpy(header.first, row.values, sizeof(header.first));
+  memcpy(pending.data, &header, sizeof(header));
+  pending.bits = 0;
+
+  lastUptime = row.uptime;
+  lastDelta = 0;
+  memcpy(lastValues, row.values, sizeof(lastValues));
+  metricLogStats.rowBits += sizeof(BlockHeader) * 8;
+}
+
+static void appendRow(const LogRow &row) {
+  int rows = pendingRows();
+  if(rows == 0) {
+    startBlock(row);
+  } else {
+    int32_t delta = (int32_t)(row.uptime - lastUptime);
+    uint16_t need = signedBits(delta - lastDelta);
+    for(int c = 0; c < LOG_CHANNELS; c++) need += signedBits(wrapDelta(row.values[c], lastValues[c]));
+
+    if(rows >= LOG_BLOCK_MAX_ROWS || pending.bits + need > LOG_PAYLOAD_BITS) {
+      // Block full: write it and start the next with this row
+      writeBlock(pending.data);
+      startBlock(row);
+    } else {
+      uint8_t *payload = pending.data + sizeof(BlockHeader);
+      putSigned(payload, pending.bits, delta - lastDelta);
+      for(int c = 0; c < LOG_CHANNELS; c++) {
+        putSigned(payload, pending.bits, wrapDelta(row.values[c], lastValues[c]));
+      }
+      pending.data[1] = rows + 1;
+      lastUptime = row.uptime;
+      lastDelta = delta;
+      memcpy(lastValues, row.values, sizeof(lastValues));
+      metricLogStats.rowBits += need;
+    }
+  }
+  sealPending();
+  metricLogStats.rowsWritten++;
+  metricLogStats.rows = flashRows + pendingRows();
+}
+
+// ---- Startup ----
+
+// Count the rows of a segment from its block headers; returns the newest boot seen
+static uint16_t indexSegment(uint32_t segment, bool last, uint16_t boot) {
+  char path[32];
+  segmentPath(segment, path, sizeof(path));
+  File f = LittleFS.open(path, "r");
+  uint16_t rows = 0;
+  if(f) {
+    size_t size = f.size();
+    int blocks = size / LOG_BLOCK_BYTES;
+    for(int b = 0; b < blocks; b++) {
+      BlockHeader header;
+      f.seek(b * LOG_BLOCK_BYTES);
+      if(f.read((uint8_t *)&header, sizeof(header)) != sizeof(header)) break;
+      if(header.magic != LOG_BLOCK_MAGIC) continue;
+      rows += header.rows;
+      boot = header.boot;
+    }
+    if(last) lastSegmentBlocks = size % LOG_BLOCK_BYTES ? LOG_SEGMENT_BLOCKS : blocks;
+    f.close();
+  }
+  segmentRows[segment % LOG_MAX_SEGMENTS] = rows;
+  flashRows += rows;
+  return boot;
+}
+
+bool metricLogBegin(unsigned long periodMs) {
+  period = periodMs;
+  lastRow = millis();
+
+  bool recovered = pending.magic == LOG_PENDING_MAGIC && pending.check == pendingCheck() &&
+                   readHeader(pending.data).magic == LOG_BLOCK_MAGIC;
+  if(!recovered) {
+    pending.magic = 0;
+    pending.data[1] = 0;
+  }
+
+  logAvailable = LittleFS.begin(true);
+  if(!logAvailable) {
+    Serial.println("[Log] LittleFS mount failed, metrics will not be logged");
+    // The recovered rows are lost too; later blocks are counted as they fill
+    if(recovered) writeBlock(pending.data);
+    pending.magic = 0;
+    pending.data[1] = 0;
+    return false;
+  }
+  if(!LittleFS.exists(LOG_DIR)) LittleFS.mkdir(LOG_DIR);
+
+  // Find the segment range
+  File dir = LittleFS.open(LOG_DIR);
+  for(File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    const char *name = strrchr(f.name(), '/');
+    uint32_t segment = strtoul(name ? name + 1 : f.name(), nullptr, 10);
+    if(!haveSegments || segment < firstSegment) firstSegment = segment;
+    if(!haveSegments || segment > lastSegment) lastSegment = segment;
+    haveSegments = true;
+  }
+  dir.close();
+
+  // LOG_MAX_SEGMENTS was lowered since the last boot
+  while(haveSegments && lastSegment - firstSegment + 1 > LOG_MAX_SEGMENTS) {
+    char path[32];
+    segmentPath(firstSegment++, path, sizeof(path));
+    LittleFS.remove(path);
+  }
+  usedAtBoot = LittleFS.usedBytes();
+
+  int boot = -1;
+  if(haveSegments) {
+    for(uint32_t segment = firstSegment; segment <= lastSegment; segment++) {
+      boot = indexSegment(segment, segment == lastSegment, boot < 0 ? 0 : boot);
+    }
+  }
+
+  // Rows the last boot hadn't written yet
+  if(recovered) {
+    BlockHeader header = readHeader(pending.data);
+    if((int)header.boot > boot) boot = header.boot;
+    if(header.rows > 0 && writeBlock(pending.data)) metricLogStats.recoveredRows = header.rows;
+    pending.magic = 0;
+    pending.data[1] = 0;
+  }
+
+  metricLogStats.boot = (uint16_t)(boot + 1);
+  metricLogStats.rows = flashRows;
+  Serial.printf("[Log] %lu rows in %lu segments, boot %u", (unsigned long)flashRows,
+                haveSegments ? (unsigned long)(lastSegment - firstSegment + 1) : 0UL, metricLogStats.boot);
+  if(metricLogStats.recoveredRows) Serial.printf(", %u rows recovered from RTC memory", metricLogStats.recoveredRows);
+  Serial.println();
+  return true;
+}
+
+void metricLogUpdate(unsigned long nowMs) {
+  if(nowMs - lastRow < period) return;
+  lastRow += period;
+  if(nowMs - lastRow >= period) lastRow = nowMs;     // fell behind: don't burst
+
+  LogRow row;
+  row.boot = metricLogStats.boot;
+  row.uptime = nowMs / 1000;
+
+  samplerLock();
+  row.values[LOG_FREE_HEAP] = metricMin(metrics[METRIC_FREE_HEAP]);
+  row.values[LOG_TEMPERATURE] = metricMean(metrics[METRIC_TEMPERATURE]);
+  row.values[LOG_PRESSURE] = metricMean(metrics[METRIC_PRESSURE]);
+  row.values[LOG_RSSI] = metricMean(metrics[METRIC_RSSI]);
+  samplerUnlock();
+
+  appendRow(row);
+}
+
+// ---- Queries ----
+
+struct QueryState {
+  LogChannel channel;
+  LogPoint *points;
+  int count;
+  uint32_t span;                      // seconds of logged time
+  uint32_t bootGap;                   // seconds put between boots
+  uint32_t newest;                    // time of the newest row (first pass)
+  uint32_t found;
+  // Timeline in logged seconds from the first row visited
+  bool started;
+  uint16_t boot;
+  uint32_t uptime;
+  uint32_t time;
+};
+
+// Move the timeline on to `row`: by uptime within a boot; the time between
+// boots is unknown, so they are joined one period apart
+static uint32_t advance(QueryState &q, const LogRow &row) {
+  if(q.started) {
+    bool sameBoot = row.boot == q.boot && row.uptime >= q.uptime;
+    q.time += sameBoot ? row.uptime - q.uptime : q.bootGap;
+  }
+  q.started = true;
+  q.boot = row.boot;
+  q.uptime = row.uptime;
+  return q.time;
+}
+
+static void findNewest(const LogRow &row, uint32_t index, void *ctx) {
+  QueryState &q = *(QueryState *)ctx;
+  q.newest = advance(q, row);
+}
+
+static void addToPoint(const LogRow &row, uint32_t index, void *ctx) {
+  QueryState &q = *(QueryState *)ctx;
+  uint32_t age = q.newest - advance(q, row);
+  if(age >= q.span) return;
+  int bucket = q.count - 1 - (int)((uint64_t)age * q.count / q.span);
+  LogPoint &point = q.points[bucket];
+  int32_t value = row.values[q.channel];
+  if(point.rows == 0 || value < point.min) point.min = value;
+  if(point.rows == 0 || value > point.max) point.max = value;
+  point.rows++;
+  q.found++;
+}
+
+uint32_t metricLogQuery(LogChannel channel, uint32_t spanSeconds, LogPoint *points, int count) {
+  memset(points, 0, count * sizeof(LogPoint));
+  if(spanSeconds == 0 || count <= 0 || channel >= LOG_CHANNELS) return 0;
+
+  // Rows are at least a period apart, so only the newest few can be in the span
+  uint32_t bootGap = period / 1000 ? period / 1000 : 1;
+  uint32_t total = flashRows + pendingRows();
+  uint32_t candidates = spanSeconds / bootGap + 1;
+  uint32_t first = total > candidates ? total - candidates : 0;
+
+  QueryState q;
+  memset(&q, 0, sizeof(q));
+  q.channel = channel;
+  q.points = points;
+  q.count = count;
+  q.span = spanSeconds;
+  q.bootGap = bootGap;
+  forEachRow(first, findNewest, &q);
+  if(!q.started) return 0;
+
+  q.started = false;
+  q.time = 0;
+  forEachRow(first, addToPoint, &q);
+  return q.found;
+}
+
+static void printRow(const LogRow &row, uint32_t index, void *ctx) {
+  Print &out = *(Print *)ctx;
+  out.printf("%u,%lu,%ld,%ld,%ld,%ld\n", row.boot, (unsigned long)row.uptime,
+             (long)row.values[LOG_FREE_HEAP], (long)row.values[LOG_TEMPERATURE],
+             (long)row.values[LOG_PRESSURE], (long)row.values[LOG_RSSI]);
+}
+
+void metricLogExport(Print &out) {
+  out.println("boot,uptime_s,free_heap,temperature_dC,pressure_pa,rssi_dbm");
+  forEachRow(0, printRow, &out);
+}
+
+void metricLogPrintStats(Print &out) {
+  const MetricLogStats &s = metricLogStats;
+  out.printf("[Log] %lu rows, %lu blocks written this boot, %lu segments rotated, %lu write failures, %lu rows dropped%s\n",
+             (unsigned long)s.rows, (unsigned long)s.blocksWritten, (unsigned long)s.segmentsRotated,
+             (unsigned long)s.writeFailures, (unsigned long)s.droppedRows, logAvailable ? "" : " (no filesystem)");
+  if(s.rowsWritten == 0) return;
+
+  // Encoded size of the rows appended this boot, header included
+  float encodedBytes = s.rowBits / 8.0f / s.rowsWritten;
+  int rowsPerBlock = (int)(LOG_BLOCK_BYTES / encodedBytes);
+  if(rowsPerBlock < 1) rowsPerBlock = 1;
+  out.printf("[Log] %.1f B/row encoded (%d B raw, %.1fx), %d rows per block\n",
+             encodedBytes, LOG_RAW_ROW_BYTES, LOG_RAW_ROW_BYTES / encodedBytes, rowsPerBlock);
+  if(!logAvailable) return;
+
+  // Measured: filesystem space taken since boot. LittleFS allocates whole
+  // blocks, so this is coarse until a few segments are written, and it
+  // includes any other file that grew.
+  long grownBytes = (long)LittleFS.usedBytes() - (long)usedAtBoot + (long)freedBytes;
+  uint32_t flushedRows = s.rowsWritten - pendingRows() - s.droppedRows;
+  if(flushedRows > 0) {
+    out.printf("[Log] Measured: LittleFS used %+ld KB for %lu rows on flash this boot (%.1f B/row)\n",
+               grownBytes / 1024, (unsigned long)flushedRows, (float)grownBytes / flushedRows);
+  }
+
+  // Estimated, not measured: appending to a file whose last 4 KB block is
+  // partly full makes LittleFS copy that block into a freshly erased one,
+  // so each block append costs a sector erase and reprograms the segment so
+  // far (LOG_SEGMENT_BLOCKS fill one sector). Metadata commits aren't counted.
+  float programmedPerAppend = LOG_BLOCK_BYTES * (LOG_SEGMENT_BLOCKS + 1) / 2.0f;
+  float programmedPerRow = programmedPerAppend / rowsPerBlock;
+  float rowsPerDay = 86400000.0f / period;
+  float appendsPerDay = rowsPerDay / rowsPerBlock;
+  float sectors = LittleFS.totalBytes() / FLASH_SECTOR_BYTES;
+  float cyclesPerDay = sectors > 0 ? appendsPerDay / sectors : 0;
+
+  out.printf("[Log] Estimated: %.0f B/row programmed, write amplification %.0f\n",
+             programmedPerRow, programmedPerRow / encodedBytes);
+  out.printf("[Log] Estimated per day: %.0f rows, %.0f appends, %.1f KB programmed, %.0f sector erases, "
+             "%.4f erase cycles per sector (%.0f years to %d)\n",
+             rowsPerDay, appendsPerDay, appendsPerDay * programmedPerAppend / 1024, appendsPerDay,
+             cyclesPerDay, cyclesPerDay > 0 ? FLASH_ERASE_CYCLES / cyclesPerDay / 365 : 0.0f, FLASH_ERASE_CYCLES);
+}
@@ -0,0 +1,84 @@
+#ifndef METRIC_LOG_H
+#define METRIC_LOG_H
+
+#include <Arduino.h>
+
+// Long-term metric history on LittleFS, for looking back after a field failure.
+//
+// One row per period (free heap, temperature, pressure, RSSI) is appended to a
+// LOG_BLOCK_BYTES block. The block header holds the first row as is; later rows
+// are bit-packed deltas (values) and delta-of-deltas (timestamps), so a steady
+// value costs one bit; test_metric_log's synthetic week of readings encodes at
+// 2.9 bytes a row. Only full blocks are
+// written, as one append to the current segment file; segments rotate, oldest
+// deleted first, once there are LOG_MAX_SEGMENTS.
+//
+// The block being filled lives in RTC memory, so rows since the last write
+// survive a crash or watchdog reset and are written at the next boot. A power
+// cut loses at most one block. Without a filesystem (or when a write fails)
+// full blocks are dropped and their rows counted in droppedRows.
+//
+// Rows carry seconds since boot and a boot number (there's no wall clock).
+// Queries measure their span in logged time: uptime within a boot, with
+// consecutive boots joined one period apart since the time between them is
+// unknown.
+
+#define LOG_DIR "/log"
+#define LOG_BLOCK_BYTES 256           // one flash append; ~88 rows at 2.9 B/row
+#define LOG_SEGMENT_BLOCKS 16         // blocks per segment file (4 KB)
+#define LOG_MAX_SEGMENTS 48           // 192 KB: about six weeks at one row a minute
+
+enum LogChannel : uint8_t {
+  LOG_FREE_HEAP,                      // bytes, lowest in the sampler window
+  LOG_TEMPERATURE,                    // tenths of a degree C, internal sensor mean
+  LOG_PRESSURE,                       // Pa mean, 0 without a BMP280
+  LOG_RSSI,                           // dBm mean
+  LOG_CHANNELS
+};
+
+struct LogRow {
+  uint16_t boot;
+  uint32_t uptime;                    // seconds
+  int32_t values[LOG_CHANNELS];
+};
+
+// One column of a downsampled graph
+struct LogPoint {
+  int32_t min;
+  int32_t max;
+  uint16_t rows;                      // 0: no data for this span
+};
+
+struct MetricLogStats {
+  uint32_t rows;                      // rows in the log, flash and RTC
+  uint32_t rowsWritten;               // this boot
+  uint32_t rowBits;                   // encoded size of the rows written this boot
+  uint32_t blocksWritten;             // this boot
+  uint32_t segmentsRotated;           // this boot
+  uint32_t writeFailures;
+  uint32_t droppedRows;               // this boot: no filesystem or a failed write
+  uint16_t recoveredRows;             // from RTC memory at boot
+  uint16_t boot;
+};
+
+extern MetricLogStats metricLogStats;
+
+// Mount LittleFS, index the segments and write any block left in RTC memory
+bool metricLogBegin(unsigned long periodMs);
+
+// Append a row when one is due (call from loop)
+void metricLogUpdate(unsigned long nowMs);
+
+// Downsample the last `spanSeconds` of logged time of a channel, up to the
+// newest row, into `count` points, oldest first. Spans without rows (missing
+// history, a stalled logger) leave empty points. Returns the rows found.
+uint32_t metricLogQuery(LogChannel channel, uint32_t spanSeconds, LogPoint *points, int count);
+
+// Every row as CSV
+void metricLogExport(Print &out);
+
+// Compression and filesystem growth (measured), write amplification and
+// flash wear (estimated)
+void metricLogPrintStats(Print &out);
+
+#endif
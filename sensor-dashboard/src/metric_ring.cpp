@@ -0,0 +1,75 @@
+#include "metric_ring.h"
+#include <string.h>
+
+static uint32_t queueFront(const MonotonicQueue &q) {
+  return q.seq[q.head];
+}
+
+static uint32_t queueBack(const MonotonicQueue &q) {
+  return q.seq[(q.head + q.size - 1) % METRIC_HISTORY];
+}
+
+static void queuePopFront(MonotonicQueue &q) {
+  q.head = (q.head + 1) % METRIC_HISTORY;
+  q.size--;
+}
+
+static void queuePushBack(MonotonicQueue &q, uint32_t seq) {
+  q.seq[(q.head + q.size) % METRIC_HISTORY] = seq;
+  q.size++;
+}
+
+static int32_t valueOf(const MetricRing &ring, uint32_t seq) {
+  return ring.values[seq % METRIC_HISTORY];
+}
+
+// Append seq to a queue whose front is the window minimum (sign = 1) or maximum (sign = -1)
+static void queueAdd(MetricRing &ring, MonotonicQueue &q, uint32_t seq, int sign) {
+  // Samples that left the window
+  while(q.size > 0 && seq - queueFront(q) >= METRIC_HISTORY) queuePopFront(q);
+
+  // Samples the new one beats can never be the extreme again
+  int64_t value = (int64_t)valueOf(ring, seq) * sign;
+  while(q.size > 0 && (int64_t)valueOf(ring, queueBack(q)) * sign >= value) q.size--;
+  queuePushBack(q, seq);
+}
+
+void metricReset(MetricRing &ring) {
+  memset(&ring, 0, sizeof(ring));
+}
+
+void metricPush(MetricRing &ring, int32_t value) {
+  uint32_t seq = ring.pushed++;
+  int slot = seq % METRIC_HISTORY;
+  if(seq >= METRIC_HISTORY) ring.sum -= ring.values[slot];
+  ring.values[slot] = value;
+  ring.sum += value;
+
+  queueAdd(ring, ring.minQueue, seq, 1);
+  queueAdd(ring, ring.maxQueue, seq, -1);
+}
+
+int metricCount(const MetricRing &ring) {
+  return ring.pushed < METRIC_HISTORY ? (int)ring.pushed : METRIC_HISTORY;
+}
+
+int32_t metricAt(const MetricRing &ring, int age) {
+  return valueOf(ring, ring.pushed - 1 - age);
+}
+
+int32_t metricLatest(const MetricRing &ring) {
+  return ring.pushed ? metricAt(ring, 0) : 0;
+}
+
+int32_t metricMin(const MetricRing &ring) {
+  return ring.minQueue.size ? valueOf(ring, queueFront(ring.minQueue)) : 0;
+}
+
+int32_t metricMax(const MetricRing &ring) {
+  return ring.maxQueue.size ? valueOf(ring, queueFront(ring.maxQueue)) : 0;
+}
+
+int32_t metricMean(const MetricRing &ring) {
+  int count = metricCount(ring);
+  return count ? (int32_t)(ring.sum / count) : 0;
+}
@@ -0,0 +1,45 @@
+#ifndef METRIC_RING_H
+#define METRIC_RING_H
+
+#include <stdint.h>
+
+// Fixed-size history of one metric with O(1) window statistics.
+//
+// The last METRIC_HISTORY samples are kept in a ring. The mean comes from a
+// running sum (add the new sample, subtract the evicted one). Min and max use
+// monotonic queues: each holds the samples that can still become the window
+// extreme, in order, so the extreme is always at the front. Every sample is
+// queued and dropped at most once, so a push is amortized O(1) and a query
+// is O(1).
+
+#define METRIC_HISTORY 120            // samples per metric (2 minutes at 1 Hz)
+
+struct MonotonicQueue {
+  uint32_t seq[METRIC_HISTORY];       // sample sequence numbers, front = window extreme
+  uint16_t head;
+  uint16_t size;
+};
+
+struct MetricRing {
+  int32_t values[METRIC_HISTORY];
+  uint32_t pushed;                    // samples ever pushed; the next one gets this sequence number
+  int64_t sum;                        // of the samples in the window
+  MonotonicQueue minQueue;            // increasing values
+  MonotonicQueue maxQueue;            // decreasing values
+};
+
+void metricReset(MetricRing &ring);
+void metricPush(MetricRing &ring, int32_t value);
+
+// Samples in the window (0 until the first push)
+int metricCount(const MetricRing &ring);
+
+// Sample by age: 0 = newest. age must be < metricCount.
+int32_t metricAt(const MetricRing &ring, int age);
+
+int32_t metricLatest(const MetricRing &ring);
+int32_t metricMin(const MetricRing &ring);
+int32_t metricMax(const MetricRing &ring);
+int32_t metricMean(const MetricRing &ring);
+
+#endif
@@ -0,0 +1,382 @@
+#include "metrics_server.h"
+#include <WiFi.h>
+#include <lwip/sockets.h>
+#include "sampler.h"
+#include "barometer.h"
+#include "wifi_scan.h"
+#include "telemetry.h"
+#include "channel_analyzer.h"
+#include "latency.h"
+#include "metric_log.h"
+
+#define HEADER_RESERVE 160            // room in front of the body for the status line and headers
+
+MetricsServerStats metricsServerStats;
+
+static int listenFd = -1;
+
+// Only the server task touches these
+static char response[METRICS_BUFFER_BYTES];
+static char request[METRICS_REQUEST_BYTES];
+
+// Appends to a fixed buffer; sets overflow instead of writing past the end
+struct Writer {
+  char *buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+};
+
+static void put(Writer &w, const char *s) {
+  size_t n = strlen(s);
+  if(w.len + n > w.cap) {
+    w.overflow = true;
+    return;
+  }
+  memcpy(w.buf + w.len, s, n);
+  w.len += n;
+}
+
+// Decimal with a fixed number of fraction digits: putFixed(w, 452, 1) -> "45.2"
+static void putFixed(Writer &w, int64_t value, uint8_t decimals) {
+  char digits[24];
+  int n = 0;
+  bool negative = value < 0;
+  uint64_t v = negative ? -(uint64_t)value : (uint64_t)value;
+  do {
+    digits[n++] = '0' + v % 10;
+    v /= 10;
+  } while(v > 0 || n <= decimals);
+
+  char out[26];
+  int len = 0;
+  if(negative) out[len++] = '-';
+  while(n > 0) {
+    if(n == decimals) out[len++] = '.';
+    out[len++] = digits[--n];
+  }
+  out[len] = '\0';
+  put(w, out);
+}
+
+static void putInt(Writer &w, int64_t value) {
+  putFixed(w, value, 0);
+}
+
+static void family(Writer &w, const char *name, const char *type, const char *unit, const char *help) {
+  put(w, "# TYPE ");
+  put(w, name);
+  put(w, " ");
+  put(w, type);
+  put(w, "\n");
+  if(unit) {
+    put(w, "# UNIT ");
+    put(w, name);
+    put(w, " ");
+    put(w, unit);
+    put(w, "\n");
+  }
+  put(w, "# HELP ");
+  put(w, name);
+  put(w, " ");
+  put(w, help);
+  put(w, "\n");
+}
+
+// name + suffix + labels, then the value scaled down by 10^decimals
+static void sample(Writer &w, const char *name, const char *suffix, int64_t value, uint8_t decimals = 0, const char *labels = nullptr) {
+  put(w, name);
+  if(suffix) put(w, suffix);
+  if(labels) put(w, labels);
+  put(w, " ");
+  putFixed(w, value, decimals);
+  put(w, "\n");
+}
+
+static void gauge(Writer &w, const char *name, const char *unit, const char *help, int64_t value, uint8_t decimals = 0) {
+  family(w, name, "gauge", unit, help);
+  sample(w, name, nullptr, value, decimals);
+}
+
+static void counter(Writer &w, const char *name, const char *help, uint64_t value) {
+  family(w, name, "counter", nullptr, help);
+  sample(w, name, "_total", value);
+}
+
+// Histogram copy for latencySummary(): static, the metrics task has a 4 KB stack
+static LatencyHistogram latencyScratch;
+
+// Summary with p50/p99 from the cycle-counter histogram, plus a _max gauge
+static void latencyFamily(Writer &w, LatencyProbe probe, const char *name, const char *maxName, const char *help) {
+  LatencySummary s;
+  latencySummary(probe, s, latencyScratch);
+  family(w, name, "summary", "seconds", help);
+  sample(w, name, nullptr, s.p50Us, 6, "{quantile=\"0.5\"}");
+  sample(w, name, nullptr, s.p99Us, 6, "{quantile=\"0.99\"}");
+  sample(w, name, "_count", s.count);
+  sample(w, name, "_sum", s.sumUs, 6);
+  gauge(w, maxName, "seconds", "Largest value since boot.", s.maxUs, 6);
+}
+
+static void buildBody(Writer &w) {
+  // Snapshot everything first so the formatting below holds no locks
+  samplerLock();
+  int32_t freeHeap = metricLatest(metrics[METRIC_FREE_HEAP]);
+  int32_t minFreeHeap = metricLatest(metrics[METRIC_MIN_FREE_HEAP]);
+  int32_t largestBlock = metricLatest(metrics[METRIC_LARGEST_BLOCK]);
+  int32_t temperature = metricLatest(metrics[METRIC_TEMPERATURE]);
+  int32_t rssi = metricLatest(metrics[METRIC_RSSI]);
+  int32_t bus = metricLatest(metrics[METRIC_I2C_BUS]);
+  bool havePressure = metricCount(metrics[METRIC_PRESSURE]) > 0;
+  int32_t pressure = metricLatest(metrics[METRIC_PRESSURE]);
+  samplerUnlock();
+
+  MetricsServerStats scrape = metricsServerStats;
+  TelemetryStats mqtt = telemetryStats;
+  ChannelStats channels;
+  channelStatsGet(channels);
+
+  gauge(w, "dashboard_heap_free_bytes", "bytes", "Free heap.", freeHeap);
+  gauge(w, "dashboard_heap_min_free_bytes", "bytes", "Lowest free heap since boot.", minFreeHeap);
+  gauge(w, "dashboard_heap_largest_block_bytes", "bytes", "Largest allocatable heap block.", largestBlock);
+  gauge(w, "dashboard_heap_size_bytes", "bytes", "Total heap.", heapSize);
+  gauge(w, "dashboard_temperature_celsius", "celsius", "Internal chip temperature.", temperature, 1);
+  if(havePressure) gauge(w, "dashboard_pressure_pascals", "pascals", "BMP280 pressure.", pressure);
+  gauge(w, "dashboard_i2c_busy_ratio", "ratio", "Share of time the I2C bus was held.", bus, 3);
+  gauge(w, "dashboard_wifi_connected", nullptr, "1 when associated with the access point.", WiFi.status() == WL_CONNECTED);
+  gauge(w, "dashboard_wifi_rssi_dbm", "dbm", "RSSI of the access point, or the strongest scanned network.", rssi);
+  gauge(w, "dashboard_uptime_seconds", "seconds", "Time since boot.", millis(), 3);
+
+  counter(w, "dashboard_scans", "Completed WiFi scans.", scanResults.scans);
+  counter(w, "dashboard_scan_failures", "Failed WiFi scans.", scanResults.failures);
+  gauge(w, "dashboard_scan_networks", nullptr, "Networks found by the last scan.", scanResults.found);
+  gauge(w, "dashboard_scan_duration_seconds", "seconds", "Duration of the last scan.", scanResults.durationMs, 3);
+  if(channels.scans > 0) {
+    family(w, "dashboard_wifi_channel_interference_dbm", "gauge", "dbm", "Overlap-weighted power of the networks heard on each 2.4 GHz channel, averaged over scans.");
+    for(int i = 0; i < CHANNEL_COUNT; i++) {
+      char labels[20];
+      snprintf(labels, sizeof(labels), "{channel=\"%d\"}", i + 1);
+      sample(w, "dashboard_wifi_channel_interference_dbm", nullptr, channelScoreDeciDbm(channels.channels[i].power), 1, labels);
+    }
+    gauge(w, "dashboard_wifi_channel_recommended", nullptr, "Least congested 2.4 GHz channel the country allows.", channels.recommended);
+  }
+
+  counter(w, "dashboard_log_dropped_rows", "History log rows lost to a missing filesystem or a failed flash write.",
+          metricLogStats.droppedRows);
+
+  latencyFamily(w, LATENCY_LOOP, "dashboard_loop_duration_seconds", "dashboard_loop_duration_max_seconds",
+                "Main loop iteration time, excluding its delay().");
+  latencyFamily(w, LATENCY_LOOP_DELAY, "dashboard_loop_delay_lateness_seconds", "dashboard_loop_delay_lateness_max_seconds",
+                "How late the main loop's delay() returns.");
+  latencyFamily(w, LATENCY_SAMPLER_WAKE, "dashboard_sampler_wake_lateness_seconds", "dashboard_sampler_wake_lateness_max_seconds",
+                "How late the fixed-rate sampler task wakes.");
+
+  if(mqtt.samples > 0) {
+    gauge(w, "dashboard_mqtt_connected", nullptr, "1 while connected to the MQTT broker.", mqtt.connected);
+    family(w, "dashboard_mqtt_queued_samples", "gauge", nullptr, "Telemetry samples waiting to be published.");
+    sample(w, "dashboard_mqtt_queued_samples", nullptr, mqtt.ramQueued, 0, "{store=\"ram\"}");
+    sample(w, "dashboard_mqtt_queued_samples", nullptr, mqtt.flashQueued, 0, "{store=\"flash\"}");
+    counter(w, "dashboard_mqtt_published_samples", "Telemetry samples acknowledged by the broker.", mqtt.published);
+    counter(w, "dashboard_mqtt_dropped_samples", "Telemetry samples lost to a full backlog.", mqtt.dropped);
+    counter(w, "dashboard_mqtt_payload_bytes", "Payload bytes of acknowledged messages.", mqtt.payloadBytes);
+    family(w, "dashboard_mqtt_publish_duration_seconds", "summary", "seconds", "Publish to PUBACK.");
+    sample(w, "dashboard_mqtt_publish_duration_seconds", "_count", mqtt.messages);
+    sample(w, "dashboard_mqtt_publish_duration_seconds", "_sum", mqtt.totalPublishUs, 6);
+    counter(w, "dashboard_mqtt_publish_failures", "Publishes without a PUBACK.", mqtt.failures);
+  }
+
+  // This endpoint's own cost, as of the previous scrape
+  family(w, "dashboard_scrape_duration_seconds", "summary", "seconds", "Time to serve a scrape, accept to close.");
+  sample(w, "dashboard_scrape_duration_seconds", "_count", scrape.scrapes);
+  sample(w, "dashboard_scrape_duration_seconds", "_sum", scrape.totalUs, 6);
+  gauge(w, "dashboard_scrape_duration_max_seconds", "seconds", "Slowest scrape.", scrape.maxUs, 6);
+  gauge(w, "dashboard_scrape_response_bytes", "bytes", "Size of the last response.", scrape.lastBytes);
+  family(w, "dashboard_scrape_heap_delta_bytes", "gauge", "bytes", "Free heap change during the last scrape.");
+  sample(w, "dashboard_scrape_heap_delta_bytes", nullptr, scrape.buildHeapDelta, 0, "{stage=\"build\"}");
+  sample(w, "dashboard_scrape_heap_delta_bytes", nullptr, scrape.requestHeapDelta, 0, "{stage=\"request\"}");
+  counter(w, "dashboard_scrape_errors", "Scrapes that timed out or failed to send.", scrape.errors);
+
+  put(w, "# EOF\n");
+}
+
+static bool sendAll(int client, const char *data, size_t len) {
+  while(len > 0) {
+    int n = send(client, data, len, 0);
+    if(n <= 0) return false;
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Status line and headers into `out`, which must hold HEADER_RESERVE bytes
+static size_t buildHeader(char *out, const char *status, const char *type, size_t length) {
+  Writer w = {out, HEADER_RESERVE, 0, false};
+  put(w, "HTTP/1.1 ");
+  put(w, status);
+  put(w, "\r\n");
+  if(type) {
+    put(w, "Content-Type: ");
+    put(w, type);
+    put(w, "\r\n");
+  }
+  put(w, "Content-Length: ");
+  putInt(w, length);
+  put(w, "\r\nConnection: close\r\n\r\n");
+  return w.len;
+}
+
+// Read until the end of the headers, the buffer fills or the client stalls.
+// True once at least the request line is in.
+static bool readRequest(int client) {
+  size_t got = 0;
+  request[0] = '\0';
+  while(got < sizeof(request) - 1) {
+    int n = recv(client, request + got, sizeof(request) - 1 - got, 0);
+    if(n <= 0) break;
+    got += n;
+    request[got] = '\0';
+    if(strstr(request, "\r\n\r\n")) break;
+  }
+  return strstr(request, "\r\n") != nullptr;
+}
+
+// Channel analysis as JSON, for tooling that plans AP channels
+static void buildChannels(Writer &w) {
+  ChannelStats stats;
+  channelStatsGet(stats);
+  put(w, "{\"scans\":");
+  putInt(w, stats.scans);
+  put(w, ",\"recommended\":");
+  putInt(w, stats.recommended);
+  put(w, ",\"current\":");
+  putInt(w, stats.current);
+  put(w, ",\"allowed\":[");
+  putInt(w, stats.firstAllowed);
+  put(w, ",");
+  putInt(w, stats.lastAllowed);
+  put(w, "]");
+  put(w, ",\"channels\":[");
+  for(int i = 0; i < CHANNEL_COUNT; i++) {
+    const ChannelScore &score = stats.channels[i];
+    put(w, i ? ",{\"channel\":" : "{\"channel\":");
+    putInt(w, i + 1);
+    put(w, ",\"score_dbm\":");
+    putFixed(w, channelScoreDeciDbm(score.power), 1);
+    put(w, ",\"last_dbm\":");
+    putFixed(w, channelScoreDeciDbm(score.lastPower), 1);
+    put(w, ",\"networks\":");
+    putFixed(w, lroundf(score.networks * 10), 1);
+    put(w, ",\"last_networks\":");
+    putInt(w, score.lastNetworks);
+    put(w, "}");
+  }
+  put(w, "]}\n");
+}
+
+// "GET <path>", optionally with a query string
+static bool requestFor(const char *path) {
+  size_t n = strlen(path);
+  return strncmp(request, "GET ", 4) == 0 && strncmp(request + 4, path, n) == 0 &&
+         (request[4 + n] == ' ' || request[4 + n] == '?');
+}
+
+static void serveClient(int client) {
+  uint32_t start = micros();
+  int32_t heapAtAccept = ESP.getFreeHeap();
+
+  struct timeval timeout = {METRICS_TIMEOUT_MS / 1000, (METRICS_TIMEOUT_MS % 1000) * 1000};
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+  bool ok = readRequest(client);
+  bool isMetrics = ok && requestFor("/metrics");
+  bool isChannels = ok && requestFor("/channels");
+
+  if(isMetrics || isChannels) {
+    Writer body = {response + HEADER_RESERVE, sizeof(response) - HEADER_RESERVE, 0, false};
+    if(isMetrics) {
+      int32_t heapBefore = ESP.getFreeHeap();
+      buildBody(body);
+      metricsServerStats.buildHeapDelta = (int32_t)ESP.getFreeHeap() - heapBefore;
+    } else {
+      buildChannels(body);
+    }
+
+    if(body.overflow) {
+      // METRICS_BUFFER_BYTES is too small for the metric set
+      char header[HEADER_RESERVE];
+      size_t len = buildHeader(header, "500 Internal Server Error", nullptr, 0);
+      sendAll(client, header, len);
+      ok = false;
+    } else {
+      // Headers go right in front of the body so the response leaves in one send
+      char header[HEADER_RESERVE];
+      const char *type = isMetrics ? "application/openmetrics-text; version=1.0.0; charset=utf-8" : "application/json";
+      size_t headerLen = buildHeader(header, "200 OK", type, body.len);
+      char *begin = response + HEADER_RESERVE - headerLen;
+      memcpy(begin, header, headerLen);
+      ok = sendAll(client, begin, headerLen + body.len);
+      if(isMetrics) metricsServerStats.lastBytes = headerLen + body.len;
+    }
+  } else if(ok) {
+    char header[HEADER_RESERVE];
+    size_t len = buildHeader(header, "404 Not Found", nullptr, 0);
+    sendAll(client, header, len);
+    metricsServerStats.notFound++;
+  }
+  close(client);
+
+  uint32_t elapsed = micros() - start;
+  if(!ok) {
+    metricsServerStats.errors++;
+    return;
+  }
+  if(!isMetrics) return;
+
+  int32_t heapDelta = (int32_t)ESP.getFreeHeap() - heapAtAccept;
+  metricsServerStats.scrapes++;
+  metricsServerStats.lastUs = elapsed;
+  metricsServerStats.totalUs += elapsed;
+  if(elapsed > metricsServerStats.maxUs) metricsServerStats.maxUs = elapsed;
+  metricsServerStats.requestHeapDelta = heapDelta;
+  if(heapDelta < metricsServerStats.worstRequestHeapDelta) metricsServerStats.worstRequestHeapDelta = heapDelta;
+}
+
+static void serverTask(void *param) {
+  for(;;) {
+    int client = accept(listenFd, nullptr, nullptr);
+    if(client < 0) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+    serveClient(client);
+  }
+}
+
+bool metricsServerBegin() {
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if(listenFd < 0) {
+    Serial.println("[Metrics] Socket failed");
+    return false;
+  }
+  int reuse = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(METRICS_PORT);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if(bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 4) < 0) {
+    Serial.println("[Metrics] Bind failed");
+    close(listenFd);
+    listenFd = -1;
+    return false;
+  }
+
+  // Core 0 with the network stack, away from the display and sampling on core 1
+  xTaskCreatePinnedToCore(serverTask, "metrics", 4096, nullptr, 1, nullptr, 0);
+  Serial.printf("[Metrics] Serving /metrics and /channels on port %d\n", METRICS_PORT);
+  return true;
+}
@@ -0,0 +1,39 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <Arduino.h>
+
+// Prometheus scrape endpoint: GET /metrics in OpenMetrics text format.
+//
+// A small task serves one connection at a time on a plain lwIP socket (no
+// WiFiClient or web server objects). The response is formatted straight into
+// a static buffer with integer-only formatting, so a scrape allocates nothing
+// in our code; lwIP's own socket and packet buffers are all that touch the
+// heap. Each scrape's latency and net heap change are measured and exported
+// alongside the dashboard metrics. GET /channels returns the Wi-Fi channel
+// analysis (channel_analyzer.h) as JSON from the same buffer.
+
+#define METRICS_PORT 80
+#define METRICS_BUFFER_BYTES 12288    // whole response, headers included (~8 KB today)
+#define METRICS_REQUEST_BYTES 512     // request line and headers (the rest is ignored)
+#define METRICS_TIMEOUT_MS 2000       // slow or idle clients are dropped
+
+struct MetricsServerStats {
+  uint32_t scrapes;
+  uint32_t notFound;                  // requests for other paths
+  uint32_t errors;                    // timeouts, overflow, failed sends
+  uint32_t lastUs;                    // accept to close
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint32_t lastBytes;                 // response size
+  int32_t buildHeapDelta;             // free heap change while formatting (expected 0)
+  int32_t requestHeapDelta;           // free heap change accept to close (lwIP included)
+  int32_t worstRequestHeapDelta;
+};
+
+extern MetricsServerStats metricsServerStats;
+
+// Start listening (after WiFi.mode(); serves once an IP is assigned)
+bool metricsServerBegin();
+
+#endif
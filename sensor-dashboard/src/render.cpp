@@ -0,0 +1,137 @@
+#include "render.h"
+#include "i2c_bus.h"
+#include <Wire.h>
+
+RenderStats renderStats;
+
+static Adafruit_SSD1306 *panel = nullptr;
+static uint8_t panelAddress = 0;
+
+// What the last composed frame showed
+static int lastScreen = -1;
+static uint8_t lastInputs[RENDER_INPUT_BYTES];
+static size_t lastSize = 0;
+
+// What the panel shows
+static uint8_t shown[RENDER_BUFFER_BYTES];
+static bool shownValid = false;
+
+static uint32_t frameStart = 0;
+static uint32_t frameFlushUs = 0;
+static bool frameComposed = false;
+
+// Counters at the last renderPrintStats()
+static RenderStats reported;
+static unsigned long reportedAt = 0;
+
+void renderBegin(Adafruit_SSD1306 &display, uint8_t address) {
+  panel = &display;
+  panelAddress = address;
+  reportedAt = millis();
+}
+
+void renderFrameStart() {
+  frameStart = micros();
+  frameFlushUs = 0;
+  frameComposed = false;
+}
+
+void renderFrameEnd() {
+  uint32_t elapsed = micros() - frameStart;
+  renderStats.frames++;
+  renderStats.frameUs += elapsed;
+  if(frameComposed) renderStats.composeUs += elapsed - frameFlushUs;
+}
+
+bool renderChanged(uint8_t screen, const void *inputs, size_t size) {
+  bool same = screen == lastScreen && size == lastSize && size <= sizeof(lastInputs) &&
+              memcmp(inputs, lastInputs, size) == 0;
+  if(same) return false;
+  // Too big to keep: composed every frame, as before
+  lastScreen = size <= sizeof(lastInputs) ? screen : -1;
+  lastSize = size;
+  if(lastScreen >= 0) memcpy(lastInputs, inputs, size);
+  frameComposed = true;
+  renderStats.composed++;
+  return true;
+}
+
+// One 8-pixel-high row of the panel: its own address window, then the pixels
+// in transfers that fit the Wire buffer with the data control byte
+static void sendPage(const uint8_t *pixels, uint8_t page, uint8_t width) {
+  Wire.beginTransmission(panelAddress);
+  Wire.write(0x00);                   // command stream
+  Wire.write(SSD1306_PAGEADDR);
+  Wire.write(page);
+  Wire.write(page);
+  Wire.write(SSD1306_COLUMNADDR);
+  Wire.write(0);
+  Wire.write(width - 1);
+  Wire.endTransmission();
+  for(uint8_t column = 0; column < width; column += RENDER_PAGE_CHUNK) {
+    uint8_t count = width - column < RENDER_PAGE_CHUNK ? width - column : RENDER_PAGE_CHUNK;
+    Wire.beginTransmission(panelAddress);
+    Wire.write(0x40);                 // data stream
+    Wire.write(pixels + column, count);
+    Wire.endTransmission();
+  }
+}
+
+void renderFlush() {
+  if(!panel) return;
+  const uint8_t *buffer = panel->getBuffer();
+  size_t bytes = panel->width() * ((panel->height() + 7) / 8);
+  if(bytes > sizeof(shown)) bytes = sizeof(shown);
+  if(shownValid && memcmp(buffer, shown, bytes) == 0) return;
+
+  // The bus is released after every page, so a barometer read waits for
+  // at most one page (~3 ms at 400 kHz) rather than the whole frame
+  uint32_t start = micros();
+  uint8_t width = panel->width();
+  for(size_t offset = 0, page = 0; offset < bytes; offset += width, page++) {
+    i2cBusLock(I2C_DISPLAY);
+    sendPage(buffer + offset, page, width);
+    i2cBusUnlock(I2C_DISPLAY);
+  }
+  uint32_t elapsed = micros() - start;
+
+  memcpy(shown, buffer, bytes);
+  shownValid = true;
+  frameFlushUs += elapsed;
+  renderStats.flushed++;
+  renderStats.flushUs += elapsed;
+}
+
+void renderPrintStats(Print &out) {
+  RenderStats now = renderStats;
+  unsigned long nowMs = millis();
+  unsigned long elapsedMs = nowMs - reportedAt;
+  uint32_t frames = now.frames - reported.frames;
+  uint32_t composed = now.composed - reported.composed;
+  uint32_t flushed = now.flushed - reported.flushed;
+  uint64_t frameUs = now.frameUs - reported.frameUs;
+  uint64_t composeUs = now.composeUs - reported.composeUs;
+  uint64_t flushUs = now.flushUs - reported.flushUs;
+  reported = now;
+  reportedAt = nowMs;
+  if(elapsedMs == 0 || frames == 0) return;
+
+  // Redrawing and sending every frame would have cost one average compose and flush each
+  uint64_t perFrameUs = (composed ? composeUs / composed : 0) + (flushed ? flushUs / flushed : 0);
+  uint64_t everyFrameUs = perFrameUs * frames;
+  int64_t savedUs = (int64_t)everyFrameUs - (int64_t)frameUs;
+
+  uint32_t perMinute = 60000;
+  out.printf("[Render] %lu frames/min: %lu composed, %lu flushed; I2C %lu KB/min (every frame: %lu KB/min)\n",
+             (unsigned long)((uint64_t)frames * perMinute / elapsedMs),
+             (unsigned long)((uint64_t)composed * perMinute / elapsedMs),
+             (unsigned long)((uint64_t)flushed * perMinute / elapsedMs),
+             (unsigned long)((uint64_t)flushed * RENDER_FLUSH_BYTES * perMinute / elapsedMs / 1024),
+             (unsigned long)((uint64_t)frames * RENDER_FLUSH_BYTES * perMinute / elapsedMs / 1024));
+  out.printf("[Render] Frame time %lu ms/min (every frame: %lu ms/min, %ld ms/min saved); compose %lu us, flush %lu us\n",
+             (unsigned long)(frameUs * perMinute / elapsedMs / 1000),
+             (unsigned long)(everyFrameUs * perMinute / elapsedMs / 1000),
+             (long)(savedUs * (int64_t)perMinute / (int64_t)elapsedMs / 1000),
+             (unsigned long)(composed ? composeUs / composed : 0),
+             (unsigned long)(flushed ? flushUs / flushed : 0));
+}
@@ -0,0 +1,52 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+
+// Change-driven frames for the OLED.
+//
+// Each screen reads what it shows into an inputs struct, already in display
+// units (KB, tenths of a degree, the formatted uptime), and passes it to
+// renderChanged(). A frame is composed only when those bytes differ from the
+// last composed frame's or the screen changed; a composed frame is flushed
+// only when its pixels differ from what the panel already shows. A static
+// page costs one flush, a page of 1 Hz values about one a second.
+//
+// loop() wraps each frame in renderFrameStart()/renderFrameEnd() so the time
+// and I2C traffic saved can be compared with flushing every frame.
+
+#define RENDER_INPUT_BYTES 192        // largest inputs struct (the Tasks page)
+#define RENDER_BUFFER_BYTES (128 * 64 / 8)   // the panel's framebuffer
+#define RENDER_PAGE_CHUNK 64          // pixel bytes per transfer (ESP32 Wire buffer: 128)
+#define RENDER_FLUSH_BYTES 1120       // on the wire per flush: 8 pages of an 8-byte address
+                                      // window and two 66-byte pixel transfers
+
+struct RenderStats {
+  uint32_t frames;                    // loop iterations that drew the current screen
+  uint32_t composed;                  // inputs changed: frame drawn
+  uint32_t flushed;                   // pixels changed: frame sent
+  uint64_t frameUs;                   // all frames: reading inputs, drawing, flushing
+  uint64_t composeUs;                 // composed frames, excluding the flush
+  uint64_t flushUs;
+};
+
+extern RenderStats renderStats;
+
+void renderBegin(Adafruit_SSD1306 &display, uint8_t address);
+
+// Time one frame of loop()
+void renderFrameStart();
+void renderFrameEnd();
+
+// True when the frame should be composed: new screen or inputs changed
+bool renderChanged(uint8_t screen, const void *inputs, size_t size);
+
+// Send the framebuffer unless the panel already shows it, one page at a time
+// (takes the I2C bus per page, so sensor reads interleave between pages)
+void renderFlush();
+
+// Frames, flushes, I2C bytes and time saved per minute since the last call
+void renderPrintStats(Print &out);
+
+#endif
@@ -0,0 +1,115 @@
+#include "sampler.h"
+#include <WiFi.h>
+#include "wifi_scan.h"
+#include "task_stats.h"
+#include "barometer.h"
+#include "i2c_bus.h"
+#include "latency.h"
+
+extern "C" uint8_t temprature_sens_read();
+
+MetricRing metrics[METRIC_COUNT];
+SamplerStats samplerStats;
+uint32_t heapSize = 0;
+
+static const char *METRIC_NAMES[METRIC_COUNT] = {
+  "free heap", "min free heap", "largest block", "temperature", "rssi",
+  "pressure", "sensor temperature", "i2c bus"
+};
+
+static SemaphoreHandle_t lock = nullptr;
+static TickType_t period = pdMS_TO_TICKS(1000);
+static uint32_t lastBusyUs = 0;
+static uint32_t lastSampleAt = 0;
+
+static int32_t readTemperature() {
+  // The sensor reports Fahrenheit
+  return ((int32_t)temprature_sens_read() - 32) * 50 / 9;
+}
+
+static int32_t readRssi() {
+  if(WiFi.status() == WL_CONNECTED) return WiFi.RSSI();
+  // Not associated: the strongest network of the last scan (a single byte, safe to read here)
+  return scanResults.count > 0 ? scanResults.networks[0].rssi : 0;
+}
+
+static void sample() {
+  unsigned long start = micros();
+  int32_t values[METRIC_COUNT];
+  values[METRIC_FREE_HEAP] = ESP.getFreeHeap();
+  values[METRIC_MIN_FREE_HEAP] = ESP.getMinFreeHeap();
+  values[METRIC_LARGEST_BLOCK] = ESP.getMaxAllocHeap();
+  values[METRIC_TEMPERATURE] = readTemperature();
+  values[METRIC_RSSI] = readRssi();
+
+  // Bus utilisation since the last sample
+  uint32_t busy = i2cBusBusyUs();
+  uint32_t interval = start - lastSampleAt;
+  values[METRIC_I2C_BUS] = interval ? (int32_t)((uint64_t)(busy - lastBusyUs) * 1000 / interval) : 0;
+  lastBusyUs = busy;
+  lastSampleAt = start;
+
+  samplerLock();
+  // The barometer publishes under the same lock; no sensor, no samples
+  int32_t pressure, sensorTemperature;
+  bool baro = barometerLatest(pressure, sensorTemperature);
+  values[METRIC_PRESSURE] = pressure;
+  values[METRIC_SENSOR_TEMPERATURE] = sensorTemperature / 10;
+  for(int i = 0; i < METRIC_COUNT; i++) {
+    if(!baro && (i == METRIC_PRESSURE || i == METRIC_SENSOR_TEMPERATURE)) continue;
+    metricPush(metrics[i], values[i]);
+  }
+  samplerUnlock();
+
+  uint32_t elapsed = micros() - start;
+  samplerStats.samples++;
+  samplerStats.lastSampleUs = elapsed;
+  if(elapsed > samplerStats.maxSampleUs) samplerStats.maxSampleUs = elapsed;
+
+  // Run-time stats ride on the same clock (timed separately)
+  taskStatsSample();
+}
+
+static void samplerTask(void *param) {
+  // Start on a tick boundary so the cycle count tracks the wake-up ticks
+  vTaskDelay(1);
+  TickType_t wake = xTaskGetTickCount();
+  uint32_t periodCycles = latencyCyclesFromMs(period * portTICK_PERIOD_MS);
+  uint32_t due = latencyNow();
+  for(;;) {
+    vTaskDelayUntil(&wake, period);
+    due += periodCycles;
+    latencyLate(LATENCY_SAMPLER_WAKE, due);
+    // Behind by more than a period (e.g. starved): skip ahead instead of bursting
+    TickType_t now = xTaskGetTickCount();
+    if(now - wake >= period) {
+      samplerStats.overruns++;
+      wake = now;
+      due = latencyNow();
+    }
+    sample();
+  }
+}
+
+void samplerBegin(unsigned long periodMs) {
+  period = pdMS_TO_TICKS(periodMs);
+  heapSize = ESP.getHeapSize();
+  lock = xSemaphoreCreateMutex();
+  for(int i = 0; i < METRIC_COUNT; i++) metricReset(metrics[i]);
+  lastSampleAt = micros();
+  lastBusyUs = i2cBusBusyUs();
+  sample();                           // screens have data from the first frame
+  xTaskCreatePinnedToCore(samplerTask, "sampler", 2048, nullptr, 1, nullptr, 1);
+}
+
+void samplerLock() {
+  xSemaphoreTake(lock, portMAX_DELAY);
+}
+
+void samplerUnlock() {
+  xSemaphoreGive(lock);
+}
+
+const char *metricName(Metric metric) {
+  return metric < METRIC_COUNT ? METRIC_NAMES[metric] : "?";
+}
@@ -0,0 +1,46 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <Arduino.h>
+#include "metric_ring.h"
+
+// Fixed-rate background sampling of the system metrics.
+//
+// A task reads every metric each sample period and pushes it into that
+// metric's ring, so screens show trends and spikes between redraws and
+// never touch the hardware themselves. Lock around reads that must be
+// consistent with each other (samplerLock / samplerUnlock).
+
+enum Metric : uint8_t {
+  METRIC_FREE_HEAP,                   // bytes
+  METRIC_MIN_FREE_HEAP,               // bytes, lowest since boot
+  METRIC_LARGEST_BLOCK,               // bytes, largest allocatable block
+  METRIC_TEMPERATURE,                 // tenths of a degree C (internal sensor)
+  METRIC_RSSI,                        // dBm: the connected AP, or the strongest scanned one
+  METRIC_PRESSURE,                    // Pa (BMP280; empty without the sensor)
+  METRIC_SENSOR_TEMPERATURE,          // tenths of a degree C (BMP280)
+  METRIC_I2C_BUS,                     // tenths of a percent of the time the bus was held
+  METRIC_COUNT
+};
+
+struct SamplerStats {
+  uint32_t samples;
+  uint32_t lastSampleUs;              // time to read all metrics
+  uint32_t maxSampleUs;
+  uint32_t overruns;                  // periods missed because sampling fell behind
+};
+
+extern MetricRing metrics[METRIC_COUNT];
+extern SamplerStats samplerStats;
+extern uint32_t heapSize;             // total heap, read once at start
+
+// Take the first sample and start the sampling task
+void samplerBegin(unsigned long periodMs);
+
+void samplerLock();
+void samplerUnlock();
+
+// Metric name and unit for logs
+const char *metricName(Metric metric);
+
+#endif
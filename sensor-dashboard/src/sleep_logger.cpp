@@ -0,0 +1,304 @@
+#include "sleep_logger.h"
+#include <Wire.h>
+#include <WiFi.h>
+#include <MQTT.h>
+#include <sys/time.h>
+#include <esp_sleep.h>
+#include "i2c_bus.h"
+
+#define LOGGER_MAGIC 0x534C4F47       // RTC state is valid
+#define SSD1306_DISPLAY_OFF 0xAE
+
+extern "C" uint8_t temprature_sens_read();
+
+// Everything that has to outlive deep sleep
+struct LoggerState {
+  uint32_t magic;
+  uint16_t boot;
+  uint16_t head;                      // oldest queued sample
+  uint16_t count;
+  uint16_t retryIn;                   // wakes until an upload is tried again
+  int64_t startUs;                    // RTC time of the first wake
+  int64_t dueUs;                      // when the next wake is scheduled
+  uint8_t bssid[6];                   // last AP joined, to connect without a scan
+  uint8_t channel;                    // 0: scan
+  SleepLoggerStats stats;
+  SleepSample samples[SLEEP_LOG_SAMPLES];
+};
+
+RTC_NOINIT_ATTR static LoggerState state;
+
+static SleepLoggerConfig config;
+static char clientId[24];
+static char topic[64];
+
+// The RTC clock keeps counting through deep sleep (esp_timer restarts at 0)
+static int64_t rtcNowUs() {
+  struct timeval tv;
+  gettimeofday(&tv, nullptr);
+  return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int16_t readTemperature() {
+  // The sensor reports Fahrenheit
+  return ((int32_t)temprature_sens_read() - 32) * 50 / 9;
+}
+
+static bool stateValid() {
+  return state.magic == LOGGER_MAGIC && state.head < SLEEP_LOG_SAMPLES && state.count <= SLEEP_LOG_SAMPLES;
+}
+
+static SleepSample &sampleAt(uint16_t index) {
+  return state.samples[(state.head + index) % SLEEP_LOG_SAMPLES];
+}
+
+static void powerUp(int64_t now) {
+  memset(&state, 0, sizeof(state));
+  state.magic = LOGGER_MAGIC;
+  state.boot = esp_random();
+  state.startUs = now;
+  state.dueUs = now;
+
+  // The panel keeps whatever it last showed unless told otherwise
+  Wire.beginTransmission(config.displayAddress);
+  Wire.write(0x00);                   // command stream
+  Wire.write(SSD1306_DISPLAY_OFF);
+  Wire.endTransmission();
+
+  Serial.begin(115200);
+  Serial.printf("[Sleep] Logging every %lu s, uploading every %d samples as %s to %s:%u\n",
+                config.samplePeriodMs / 1000, SLEEP_LOG_BATCH, clientId, config.host, config.port);
+  Serial.flush();
+}
+
+static void takeSample(int64_t due) {
+  // Start the conversion first and read the chip sensor while it runs
+  bool baro = barometerStartForced(*config.barometer);
+  SleepSample s;
+  memset(&s, 0, sizeof(s));
+  s.time = (uint32_t)((due - state.startUs + 500000) / 1000000);
+  s.temperature = readTemperature();
+  int32_t temperatureCenti;
+  s.hasPressure = baro && barometerReadForced(s.pressure, temperatureCenti);
+
+  if(state.count == SLEEP_LOG_SAMPLES) {
+    state.head = (state.head + 1) % SLEEP_LOG_SAMPLES;
+    state.count--;
+    state.stats.dropped++;
+  }
+  s.wakeUs = (uint32_t)(rtcNowUs() - due);
+  sampleAt(state.count) = s;
+  state.count++;
+  state.stats.wakes++;
+  state.stats.wakeToSampleUs += s.wakeUs;
+}
+
+// ---- Upload ----
+
+static void appendf(char *payload, size_t &len, const char *format, long value) {
+  if(len < SLEEP_LOG_PAYLOAD_BYTES) len += snprintf(payload + len, SLEEP_LOG_PAYLOAD_BYTES - len, format, value);
+}
+
+// One delta-coded series: "name":[first,d1,d2,...]
+static void appendSeries(char *payload, size_t &len, const char *name, uint16_t count,
+                         int32_t (*field)(const SleepSample &)) {
+  if(len < SLEEP_LOG_PAYLOAD_BYTES) len += snprintf(payload + len, SLEEP_LOG_PAYLOAD_BYTES - len, ",\"%s\":[", name);
+  int32_t previous = 0;
+  for(uint16_t i = 0; i < count; i++) {
+    int32_t value = field(sampleAt(i));
+    appendf(payload, len, i ? ",%ld" : "%ld", (long)(value - previous));
+    previous = value;
+  }
+  appendf(payload, len, "]", 0);
+}
+
+static int32_t fieldTime(const SleepSample &s) { return s.time; }
+static int32_t fieldTemperature(const SleepSample &s) { return s.temperature; }
+static int32_t fieldPressure(const SleepSample &s) { return s.pressure; }
+static int32_t fieldWake(const SleepSample &s) { return s.wakeUs; }
+static int32_t fieldAwake(const SleepSample &s) { return s.awakeUs; }
+
+// The oldest samples up to the batch size, stopping where "press" comes or goes
+static uint16_t batchSize(uint16_t waiting) {
+  uint16_t count = waiting < SLEEP_LOG_BATCH ? waiting : SLEEP_LOG_BATCH;
+  for(uint16_t i = 1; i < count; i++) {
+    if(sampleAt(i).hasPressure != sampleAt(0).hasPressure) return i;
+  }
+  return count;
+}
+
+// Returns the payload length, 0 if it didn't fit
+static size_t buildPayload(char *payload, uint16_t count) {
+  size_t len = 0;
+  appendf(payload, len, "{\"boot\":%ld", state.boot);
+  appendSeries(payload, len, "t", count, fieldTime);
+  appendSeries(payload, len, "temp", count, fieldTemperature);
+  if(sampleAt(0).hasPressure) appendSeries(payload, len, "press", count, fieldPressure);
+  appendSeries(payload, len, "wake_us", count, fieldWake);
+  appendSeries(payload, len, "awake_us", count, fieldAwake);
+  appendf(payload, len, "}", 0);
+  return len < SLEEP_LOG_PAYLOAD_BYTES ? len : 0;
+}
+
+static bool waitForWifi(unsigned long timeoutMs) {
+  unsigned long start = millis();
+  while(WiFi.status() != WL_CONNECTED) {
+    if(millis() - start >= timeoutMs) return false;
+    delay(10);
+  }
+  return true;
+}
+
+static bool connectWifi() {
+  WiFi.persistent(false);             // no flash write per upload
+  WiFi.mode(WIFI_STA);
+
+  // Straight to the last AP on its channel; scan only if that fails
+  if(state.channel != 0) {
+    WiFi.begin(config.ssid, config.wifiPassword, state.channel, state.bssid);
+    if(waitForWifi(SLEEP_LOG_CONNECT_MS / 2)) return true;
+    WiFi.disconnect();
+    state.channel = 0;
+  }
+  WiFi.begin(config.ssid, config.wifiPassword);
+  if(!waitForWifi(SLEEP_LOG_CONNECT_MS)) return false;
+  state.channel = WiFi.channel();
+  memcpy(state.bssid, WiFi.BSSID(), sizeof(state.bssid));
+  return true;
+}
+
+// Publish everything but this wake's sample. False if any is left behind.
+static bool upload() {
+  Serial.begin(115200);
+  unsigned long start = millis();
+  if(!connectWifi()) {
+    Serial.printf("[Sleep] Wi-Fi not connected after %lu ms, %u samples queued\n", millis() - start,
+                  (unsigned)state.count);
+    return false;
+  }
+  unsigned long wifiMs = millis() - start;
+
+  WiFiClient net;
+  MQTTClient client(SLEEP_LOG_PAYLOAD_BYTES + 128);
+  client.begin(config.host, config.port, net);
+  client.setOptions(10, true, SLEEP_LOG_TIMEOUT_MS);      // keep-alive s, clean session, timeout ms
+  bool credentials = config.user && config.user[0];
+  if(!client.connect(clientId, credentials ? config.user : nullptr, credentials ? config.password : nullptr)) {
+    Serial.printf("[Sleep] Connecting to %s:%u failed (error %d, return code %d)\n", config.host, config.port,
+                  (int)client.lastError(), (int)client.returnCode());
+    return false;
+  }
+
+  char payload[SLEEP_LOG_PAYLOAD_BYTES];
+  uint32_t sent = 0;
+  uint32_t messages = 0;
+  while(state.count > 1) {
+    uint16_t count = batchSize(state.count - 1);
+    size_t len = buildPayload(payload, count);
+    if(len == 0) {
+      // Can't happen at today's batch size; don't wedge the queue if it does
+      Serial.printf("[Sleep] %u samples don't fit in %d bytes, dropped\n", count, SLEEP_LOG_PAYLOAD_BYTES);
+      state.stats.dropped += count;
+    } else if(client.publish(topic, payload, len, false, 1)) {
+      // QoS 1: returned once the broker's PUBACK arrived
+      sent += count;
+      messages++;
+    } else {
+      break;
+    }
+    state.head = (state.head + count) % SLEEP_LOG_SAMPLES;
+    state.count -= count;
+  }
+  client.disconnect();
+  state.stats.uploads += messages;
+  state.stats.published += sent;
+  Serial.printf("[Sleep] %lu samples in %lu messages, Wi-Fi %lu ms, total %lu ms, %u left\n", (unsigned long)sent,
+                (unsigned long)messages, wifiMs, millis() - start, (unsigned)(state.count - 1));
+  return state.count <= 1;
+}
+
+static void printStats() {
+  const SleepLoggerStats &s = state.stats;
+  if(s.wakes == 0) return;
+  Serial.printf("[Sleep] %lu wakes: wake to sample avg %lu us", (unsigned long)s.wakes,
+                (unsigned long)(s.wakeToSampleUs / s.wakes));
+  if(s.sampleWakes > 0) {
+    Serial.printf(", sample wake to sleep avg %lu us (max %lu us)", (unsigned long)(s.sampleAwakeUs / s.sampleWakes),
+                  (unsigned long)s.maxSampleAwakeUs);
+  }
+  if(s.uploadWakes > 0) {
+    Serial.printf(", upload wake avg %lu ms (max %lu ms)", (unsigned long)(s.uploadAwakeUs / s.uploadWakes / 1000),
+                  (unsigned long)(s.maxUploadAwakeUs / 1000));
+  }
+  // Awake time per sample, uploads shared out
+  uint64_t awakeUs = s.sampleAwakeUs + s.uploadAwakeUs;
+  uint32_t wakes = s.sampleWakes + s.uploadWakes;
+  if(wakes > 0) Serial.printf("; %lu us awake per sample", (unsigned long)(awakeUs / wakes));
+  Serial.printf("\n[Sleep] %lu published, %lu failed uploads, %lu dropped, %lu slots missed\n",
+                (unsigned long)s.published, (unsigned long)s.failures, (unsigned long)s.dropped,
+                (unsigned long)s.missed);
+  Serial.flush();
+}
+
+// ---- Sleep ----
+
+static void sleepUntilNext(int64_t due, bool uploaded) {
+  if(uploaded) WiFi.mode(WIFI_OFF);   // the radio has to be stopped before deep sleep
+  int64_t period = (int64_t)config.samplePeriodMs * 1000;
+  int64_t now = rtcNowUs();
+  uint32_t awake = (uint32_t)(now - due);
+  sampleAt(state.count - 1).awakeUs = awake;
+  SleepLoggerStats &s = state.stats;
+  if(uploaded) {
+    s.uploadWakes++;
+    s.uploadAwakeUs += awake;
+    if(awake > s.maxUploadAwakeUs) s.maxUploadAwakeUs = awake;
+  } else {
+    s.sampleWakes++;
+    s.sampleAwakeUs += awake;
+    if(awake > s.maxSampleAwakeUs) s.maxSampleAwakeUs = awake;
+  }
+
+  int64_t next = due + period;
+  while(next - now < SLEEP_LOG_MIN_SLEEP_US) {
+    next += period;
+    s.missed++;
+  }
+  state.dueUs = next;
+  esp_sleep_enable_timer_wakeup(next - now);
+  esp_deep_sleep_start();
+}
+
+void sleepLoggerRun(const SleepLoggerConfig &cfg) {
+  int64_t now = rtcNowUs();
+  config = cfg;
+  setCpuFrequencyMhz(SLEEP_LOG_CPU_MHZ);
+  i2cBusBegin(config.sda, config.scl);
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(clientId, sizeof(clientId), "dashboard-%06lx", (unsigned long)((mac >> 24) & 0xFFFFFF));
+  snprintf(topic, sizeof(topic), "sensor-dashboard/%s/log", clientId);
+
+  if(!stateValid()) {
+    powerUp(now);
+  } else if(esp_sleep_get_wakeup_cause() != ESP_SLEEP_WAKEUP_TIMER || now < state.dueUs) {
+    // Reset while logging: keep the queue and restart the schedule from now.
+    // If the clock went back with it, shift the start so times carry on.
+    if(now < state.dueUs) state.startUs += now - state.dueUs;
+    state.dueUs = now;
+  }
+  int64_t due = state.dueUs;
+  takeSample(due);
+
+  bool uploaded = false;
+  if(state.retryIn > 0) {
+    state.retryIn--;
+  } else if(state.count > SLEEP_LOG_BATCH) {
+    uploaded = true;
+    if(!upload()) {
+      state.stats.failures++;
+      state.retryIn = SLEEP_LOG_BATCH;
+    }
+    printStats();
+  }
+  sleepUntilNext(due, uploaded);
+}
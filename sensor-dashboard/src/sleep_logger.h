@@ -0,0 +1,81 @@
+#ifndef SLEEP_LOGGER_H
+#define SLEEP_LOGGER_H
+
+#include <Arduino.h>
+#include "barometer.h"
+
+// Battery logging mode: deep sleep between samples.
+//
+// Built with -DSLEEP_LOGGER (the esp32dev-logger environment), setup() hands
+// over to sleepLoggerRun() and the dashboard never starts. Each timer wake
+// takes one sample (chip temperature and a forced BMP280 measurement),
+// appends it to a ring in RTC slow memory and goes straight back to deep
+// sleep: no display, flash writes, serial output or radio, at 80 MHz. Only
+// once SLEEP_LOG_BATCH earlier samples are waiting does a wake bring up Wi-Fi
+// and publish them over MQTT, in the telemetry format (see telemetry.h):
+//
+//   {"boot":40172,"t":[0,60,60],"temp":[452,0,1],"press":[101325,2,-1],
+//    "wake_us":[61230,-85,12],"awake_us":[68140,-91,2103420]}
+//
+// "boot" is random per power-up and "t" is seconds since then. The wake that
+// uploads keeps its own sample for the next batch, so every sample published
+// has its full cost: "wake_us" from the scheduled wake to the sample being
+// stored (the boot included) and "awake_us" from the scheduled wake to deep
+// sleep. Wakes are scheduled on the RTC clock a fixed period apart, however
+// long each one stayed up.
+//
+// If an upload fails the samples stay queued and the next attempt waits for
+// another SLEEP_LOG_BATCH; a full ring overwrites the oldest. The ring is
+// RTC_NOINIT, so a reset keeps it and a power cut clears it.
+
+#define SLEEP_LOG_SAMPLES 192         // RTC ring (3.8 KB of 8 KB): over 3 hours of failed uploads at 1/min
+#define SLEEP_LOG_BATCH 30            // upload once this many are waiting, and per message
+#define SLEEP_LOG_PAYLOAD_BYTES 1024  // a full batch is 550-750 bytes
+#define SLEEP_LOG_CPU_MHZ 80          // lowest clock Wi-Fi runs at
+#define SLEEP_LOG_CONNECT_MS 8000     // Wi-Fi join, then the upload waits for the next batch
+#define SLEEP_LOG_TIMEOUT_MS 2000     // MQTT connect and PUBACK
+#define SLEEP_LOG_MIN_SLEEP_US 5000   // a wake that ran into the next slot skips it
+
+struct SleepLoggerConfig {
+  const char *ssid;
+  const char *wifiPassword;
+  const char *host;                   // MQTT broker
+  uint16_t port;
+  const char *user;                   // empty: no credentials
+  const char *password;
+  int sda;
+  int scl;
+  uint8_t displayAddress;             // turned off on power-up
+  const BarometerConfig *barometer;
+  unsigned long samplePeriodMs;
+};
+
+struct SleepSample {
+  uint32_t time;                      // seconds since power-up (scheduled wake)
+  int32_t pressure;                   // Pa
+  uint32_t wakeUs;                    // scheduled wake to sample stored
+  uint32_t awakeUs;                   // scheduled wake to deep sleep, set just before sleeping
+  int16_t temperature;                // tenths of a degree C (chip sensor)
+  uint8_t hasPressure;
+};
+
+struct SleepLoggerStats {
+  uint32_t wakes;                     // since power-up
+  uint32_t missed;                    // slots skipped by wakes that overran
+  uint32_t uploads;                   // messages acknowledged
+  uint32_t published;                 // samples acknowledged
+  uint32_t failures;                  // upload wakes that left samples behind
+  uint32_t dropped;                   // overwritten in a full ring
+  uint32_t sampleWakes;               // wakes without an upload
+  uint64_t sampleAwakeUs;
+  uint32_t maxSampleAwakeUs;
+  uint32_t uploadWakes;
+  uint64_t uploadAwakeUs;
+  uint32_t maxUploadAwakeUs;
+  uint64_t wakeToSampleUs;            // all wakes
+};
+
+// Sample, upload if a batch is waiting, deep sleep. Never returns.
+void sleepLoggerRun(const SleepLoggerConfig &config);
+
+#endif
@@ -0,0 +1,227 @@
+#include "task_stats.h"
+#include "sampler.h"
+#include <esp_idf_version.h>
+
+TaskStats taskStats;
+
+#if configUSE_TRACE_FACILITY
+
+#define TASK_CPU configGENERATE_RUN_TIME_STATS
+
+#if ESP_IDF_VERSION_MAJOR >= 5
+#define idleTaskHandle(core) xTaskGetIdleTaskHandleForCore(core)
+#else
+#define idleTaskHandle(core) xTaskGetIdleTaskHandleForCPU(core)
+#endif
+
+static TaskStatus_t status[TASK_MAX];
+static TaskUsage usage[TASK_MAX];     // static: the sampler task has a small stack
+
+#if TASK_CPU
+
+// IDF 5 can make the counters 64-bit
+#ifdef configRUN_TIME_COUNTER_TYPE
+typedef configRUN_TIME_COUNTER_TYPE RunTimeCounter;
+#else
+typedef uint32_t RunTimeCounter;
+#endif
+
+// Counters are kept mod 2^32: deltas stay exact while the window is shorter
+// than the counter's wrap (71 minutes at the 1 MHz ESP-IDF clock)
+struct TrackedTask {
+  TaskHandle_t handle;
+  uint32_t runTime[TASK_WINDOW];      // counter at each of the last samples
+  bool seen;
+};
+
+static TrackedTask tracked[TASK_MAX];
+static uint32_t totalTime[TASK_WINDOW];
+static unsigned long sampleMs[TASK_WINDOW];
+static uint32_t snapshots = 0;
+
+static TrackedTask *track(TaskHandle_t handle) {
+  TrackedTask *free = nullptr;
+  for(int i = 0; i < TASK_MAX; i++) {
+    if(tracked[i].handle == handle) return &tracked[i];
+    if(tracked[i].handle == nullptr && free == nullptr) free = &tracked[i];
+  }
+  if(free == nullptr) return nullptr;
+  // A new task's counter started at zero when it was created
+  free->handle = handle;
+  memset(free->runTime, 0, sizeof(free->runTime));
+  return free;
+}
+
+#else
+
+typedef uint32_t RunTimeCounter;      // unused: uxTaskGetSystemState leaves it 0
+
+#endif
+
+static char stateLetter(eTaskState state) {
+  switch(state) {
+    case eRunning: return 'X';
+    case eReady: return 'R';
+    case eBlocked: return 'B';
+    case eSuspended: return 'S';
+    default: return 'D';
+  }
+}
+
+// Busiest first with CPU figures, otherwise the tightest stack first
+static bool ranksBefore(const TaskUsage &a, const TaskUsage &b) {
+  if(TASK_CPU) return a.cpu > b.cpu;
+  return a.stackFree < b.stackFree;
+}
+
+bool taskStatsAvailable() {
+  return true;
+}
+
+bool taskStatsHasCpu() {
+  return TASK_CPU;
+}
+
+void taskStatsSample() {
+  unsigned long start = micros();
+
+  RunTimeCounter total = 0;
+  UBaseType_t count = uxTaskGetSystemState(status, TASK_MAX, &total);
+  if(count == 0) {
+    // More tasks than slots: the call fills nothing
+    taskStats.dropped = uxTaskGetNumberOfTasks() - TASK_MAX;
+    return;
+  }
+
+  TaskHandle_t idle[2] = {idleTaskHandle(0), portNUM_PROCESSORS > 1 ? idleTaskHandle(1) : nullptr};
+  uint16_t coreIdle[2] = {0, 0};
+  uint32_t windowMs = 0;
+  int used = 0;
+
+#if TASK_CPU
+  // The slot written now holds the oldest sample of the window
+  int slot = snapshots % TASK_WINDOW;
+  int oldest = snapshots < TASK_WINDOW ? 0 : slot;
+  uint32_t elapsed = snapshots ? (uint32_t)total - totalTime[oldest] : 0;
+  unsigned long nowMs = millis();
+  windowMs = snapshots ? nowMs - sampleMs[oldest] : 0;
+  totalTime[slot] = (uint32_t)total;
+  sampleMs[slot] = nowMs;
+
+  for(int i = 0; i < TASK_MAX; i++) tracked[i].seen = false;
+#endif
+
+  for(UBaseType_t i = 0; i < count; i++) {
+    const TaskStatus_t &task = status[i];
+    uint32_t cpu = 0;
+#if TASK_CPU
+    TrackedTask *entry = track(task.xHandle);
+    if(entry == nullptr) continue;
+    entry->seen = true;
+    // First snapshot: no history, every task starts the window at its current count
+    if(snapshots == 0) {
+      for(int s = 0; s < TASK_WINDOW; s++) entry->runTime[s] = (uint32_t)task.ulRunTimeCounter;
+    }
+
+    uint32_t counter = (uint32_t)task.ulRunTimeCounter;
+    uint32_t ran = counter - entry->runTime[oldest];
+    entry->runTime[slot] = counter;
+    cpu = elapsed ? (uint32_t)((uint64_t)ran * 1000 / elapsed) : 0;
+    if(cpu > 1000) cpu = 1000;
+#endif
+
+    TaskUsage &u = usage[used++];
+    strlcpy(u.name, task.pcTaskName, sizeof(u.name));
+    u.cpu = cpu;
+    u.stackFree = task.usStackHighWaterMark;     // StackType_t is a byte on ESP32
+    u.priority = task.uxCurrentPriority;
+    u.state = stateLetter(task.eCurrentState);
+    u.idle = task.xHandle == idle[0] || task.xHandle == idle[1];
+    if(task.xHandle == idle[0]) coreIdle[0] = cpu;
+    if(task.xHandle == idle[1]) coreIdle[1] = cpu;
+
+    // Insert sorted
+    for(int j = used - 1; j > 0 && ranksBefore(usage[j], usage[j - 1]); j--) {
+      TaskUsage swap = usage[j];
+      usage[j] = usage[j - 1];
+      usage[j - 1] = swap;
+    }
+  }
+
+#if TASK_CPU
+  // Deleted tasks free their slot
+  for(int i = 0; i < TASK_MAX; i++) {
+    if(!tracked[i].seen) tracked[i].handle = nullptr;
+  }
+  snapshots++;
+#endif
+
+  samplerLock();
+  memcpy(taskStats.tasks, usage, used * sizeof(TaskUsage));
+  taskStats.count = used;
+  taskStats.coreIdle[0] = coreIdle[0];
+  taskStats.coreIdle[1] = coreIdle[1];
+  taskStats.windowMs = windowMs;
+  taskStats.dropped = 0;
+  samplerUnlock();
+
+  uint32_t cost = micros() - start;
+  taskStats.lastCollectUs = cost;
+  if(cost > taskStats.maxCollectUs) taskStats.maxCollectUs = cost;
+}
+
+#else
+
+bool taskStatsAvailable() {
+  return false;
+}
+
+bool taskStatsHasCpu() {
+  return false;
+}
+
+void taskStatsSample() {
+}
+
+#endif
+
+uint32_t taskStatsOverhead(unsigned long periodMs) {
+  return periodMs ? taskStats.lastCollectUs * 10 / periodMs : 0;
+}
+
+void taskStatsPrint(Print &out, unsigned long periodMs) {
+  if(!taskStatsAvailable()) {
+    out.println("[Tasks] FreeRTOS trace facility is disabled");
+    return;
+  }
+
+  samplerLock();
+  TaskStats stats = taskStats;
+  samplerUnlock();
+
+  uint32_t overhead = taskStatsOverhead(periodMs);
+  if(taskStatsHasCpu()) {
+    out.printf("[Tasks] %lu ms window, idle core0 %u.%u%% core1 %u.%u%%",
+               (unsigned long)stats.windowMs,
+               stats.coreIdle[0] / 10, stats.coreIdle[0] % 10,
+               stats.coreIdle[1] / 10, stats.coreIdle[1] % 10);
+  } else {
+    out.print("[Tasks] No run-time stats, tightest stack first");
+  }
+  out.printf(", collection %lu us (%lu.%02lu%%, max %lu us)\n",
+             (unsigned long)stats.lastCollectUs,
+             (unsigned long)(overhead / 100), (unsigned long)(overhead % 100),
+             (unsigned long)stats.maxCollectUs);
+  for(int i = 0; i < stats.count; i++) {
+    const TaskUsage &task = stats.tasks[i];
+    if(taskStatsHasCpu()) {
+      out.printf("[Tasks]   %-16s %c %3u.%u%%  prio %2u  stack free %5lu\n",
+                 task.name, task.state, task.cpu / 10, task.cpu % 10, task.priority,
+                 (unsigned long)task.stackFree);
+    } else {
+      out.printf("[Tasks]   %-16s %c  prio %2u  stack free %5lu\n",
+                 task.name, task.state, task.priority, (unsigned long)task.stackFree);
+    }
+  }
+  if(stats.dropped) out.printf("[Tasks] %lu tasks not shown (TASK_MAX)\n", (unsigned long)stats.dropped);
+}
@@ -0,0 +1,61 @@
+#ifndef TASK_STATS_H
+#define TASK_STATS_H
+
+#include <Arduino.h>
+
+// Per-task stack headroom and state, plus CPU use where the core has
+// FreeRTOS run-time stats.
+//
+// The sampler calls taskStatsSample() once per sample period, which
+// snapshots every task with uxTaskGetSystemState() (configUSE_TRACE_FACILITY).
+// The stock arduino-esp32 build does not set configGENERATE_RUN_TIME_STATS,
+// so there the figures are each task's state, priority and bytes of stack
+// never used, tightest stack first. Built against an ESP-IDF config with
+// CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS (e.g. Arduino as an IDF component),
+// each task's CPU % is added: its run-time counter delta over the last
+// TASK_WINDOW samples divided by the elapsed time, so one task on one core
+// can reach 100% and each core's idle task gives that core's idle %. Tasks
+// are then sorted busiest first.
+
+#define TASK_MAX 24                   // tasks tracked; the Arduino core runs ~15
+#define TASK_WINDOW 10                // samples per window (10 s at 1 Hz)
+#define TASK_NAME_LEN 16
+
+struct TaskUsage {
+  char name[TASK_NAME_LEN];
+  uint16_t cpu;                       // tenths of a percent of one core over the window (0 without run-time stats)
+  uint32_t stackFree;                 // bytes of stack never used since the task started
+  uint8_t priority;
+  char state;                         // X running, R ready, B blocked, S suspended, D deleted
+  bool idle;                          // a core's idle task
+};
+
+struct TaskStats {
+  TaskUsage tasks[TASK_MAX];          // busiest first, or tightest stack first without CPU figures
+  int count;
+  uint16_t coreIdle[2];               // tenths of a percent, per core (run-time stats only)
+  uint32_t windowMs;                  // time covered by the CPU figures
+  uint32_t lastCollectUs;             // cost of the last taskStatsSample call
+  uint32_t maxCollectUs;
+  uint32_t dropped;                   // tasks beyond TASK_MAX, last sample
+};
+
+// Published after each sample; read under samplerLock
+extern TaskStats taskStats;
+
+// Task list (state, priority, stack) available
+bool taskStatsAvailable();
+
+// CPU figures available (run-time stats compiled into FreeRTOS)
+bool taskStatsHasCpu();
+
+// Snapshot counters and refresh taskStats (called from the sampler task)
+void taskStatsSample();
+
+// Collection cost as a share of the sample period, in hundredths of a percent
+uint32_t taskStatsOverhead(unsigned long periodMs);
+
+// Table of the current figures, one line per task
+void taskStatsPrint(Print &out, unsigned long periodMs);
+
+#endif
@@ -0,0 +1,393 @@
+#include "telemetry.h"
+#include <WiFi.h>
+#include <LittleFS.h>
+#include <MQTT.h>
+#include "sampler.h"
+#include "metric_log.h"
+
+#define RETRY_MIN_MS 2000             // reconnect backoff, doubling on each failure
+#define RETRY_MAX_MS 60000
+
+TelemetryStats telemetryStats;
+
+static TelemetryConfig config;
+static WiFiClient net;
+static MQTTClient client(TELEMETRY_PAYLOAD_BYTES + 128);
+static char clientId[24];
+static char topic[64];
+
+// Newest samples, oldest at ramHead
+static TelemetrySample ram[TELEMETRY_RAM_SAMPLES];
+static uint16_t ramHead = 0;
+static uint16_t ramCount = 0;
+
+// Older samples on flash: segment files firstSegment..lastSegment, the first
+// read up to readOffset
+static bool spillAvailable = false;
+static bool haveSegments = false;
+static uint32_t firstSegment = 0;
+static uint32_t lastSegment = 0;
+static uint16_t segmentSamples[TELEMETRY_MAX_SEGMENTS];   // by segment number % TELEMETRY_MAX_SEGMENTS
+static uint16_t readOffset = 0;
+static bool lastSegmentFull = false;
+
+// The message being sent (task only)
+static TelemetrySample batch[TELEMETRY_BATCH];
+static char payload[TELEMETRY_PAYLOAD_BYTES];
+
+static unsigned long lastSample = 0;
+static unsigned long lastPublish = 0;
+static unsigned long lastAttempt = 0;
+static unsigned long retryMs = RETRY_MIN_MS;
+
+static void segmentPath(uint32_t segment, char *out, size_t len) {
+  snprintf(out, len, TELEMETRY_DIR "/%08lu.bin", (unsigned long)segment);
+}
+
+static uint32_t queued() {
+  return ramCount + telemetryStats.flashQueued;
+}
+
+// ---- Flash backlog ----
+
+static void removeFirstSegment() {
+  char path[32];
+  segmentPath(firstSegment, path, sizeof(path));
+  LittleFS.remove(path);
+  telemetryStats.flashQueued -= segmentSamples[firstSegment % TELEMETRY_MAX_SEGMENTS] - readOffset;
+  readOffset = 0;
+  if(firstSegment == lastSegment) {
+    haveSegments = false;
+  } else {
+    firstSegment++;
+  }
+}
+
+static void newSegment() {
+  if(haveSegments) {
+    lastSegment++;
+  } else {
+    firstSegment = lastSegment = lastSegment + 1;    // numbers aren't reused
+    haveSegments = true;
+  }
+
+  // Full backlog: the oldest samples go
+  while(lastSegment - firstSegment + 1 > TELEMETRY_MAX_SEGMENTS) {
+    telemetryStats.dropped += segmentSamples[firstSegment % TELEMETRY_MAX_SEGMENTS] - readOffset;
+    removeFirstSegment();
+  }
+  segmentSamples[lastSegment % TELEMETRY_MAX_SEGMENTS] = 0;
+  lastSegmentFull = false;
+}
+
+static bool appendToSegment(const TelemetrySample *samples, uint16_t count) {
+  if(!haveSegments || lastSegmentFull ||
+     segmentSamples[lastSegment % TELEMETRY_MAX_SEGMENTS] >= TELEMETRY_SEGMENT_SAMPLES) newSegment();
+  char path[32];
+  segmentPath(lastSegment, path, sizeof(path));
+  File f = LittleFS.open(path, "a");
+  size_t bytes = count * sizeof(TelemetrySample);
+  size_t written = f ? f.write((const uint8_t *)samples, bytes) : 0;
+  if(f) f.close();
+
+  if(written != bytes) {
+    // Never append after a torn sample: start a new file next time
+    lastSegmentFull = true;
+    Serial.printf("[MQTT] Write to %s failed\n", path);
+    return false;
+  }
+  segmentSamples[lastSegment % TELEMETRY_MAX_SEGMENTS] += count;
+  telemetryStats.flashQueued += count;
+  return true;
+}
+
+// Move the oldest RAM samples to flash, filling up segments
+static void spill() {
+  uint16_t count = ramCount < TELEMETRY_SPILL_SAMPLES ? ramCount : TELEMETRY_SPILL_SAMPLES;
+  while(count > 0) {
+    uint16_t room = TELEMETRY_SEGMENT_SAMPLES;
+    if(haveSegments && !lastSegmentFull) room -= segmentSamples[lastSegment % TELEMETRY_MAX_SEGMENTS];
+    if(room == 0) room = TELEMETRY_SEGMENT_SAMPLES;
+    // Contiguous in the ring and within one segment
+    uint16_t n = count;
+    if(n > room) n = room;
+    if(n > TELEMETRY_RAM_SAMPLES - ramHead) n = TELEMETRY_RAM_SAMPLES - ramHead;
+
+    if(spillAvailable && appendToSegment(&ram[ramHead], n)) {
+      telemetryStats.spilled += n;
+    } else {
+      telemetryStats.dropped += n;
+    }
+    ramHead = (ramHead + n) % TELEMETRY_RAM_SAMPLES;
+    ramCount -= n;
+    count -= n;
+  }
+}
+
+static void indexSpill() {
+  spillAvailable = LittleFS.begin(true);
+  if(!spillAvailable) return;
+  if(!LittleFS.exists(TELEMETRY_DIR)) LittleFS.mkdir(TELEMETRY_DIR);
+
+  File dir = LittleFS.open(TELEMETRY_DIR);
+  for(File f = dir.openNextFile(); f; f = dir.openNextFile()) {
+    const char *name = strrchr(f.name(), '/');
+    uint32_t segment = strtoul(name ? name + 1 : f.name(), nullptr, 10);
+    if(!haveSegments || segment < firstSegment) firstSegment = segment;
+    if(!haveSegments || segment > lastSegment) lastSegment = segment;
+    haveSegments = true;
+  }
+  dir.close();
+
+  // TELEMETRY_MAX_SEGMENTS was lowered since the last boot
+  while(haveSegments && lastSegment - firstSegment + 1 > TELEMETRY_MAX_SEGMENTS) {
+    char path[32];
+    segmentPath(firstSegment++, path, sizeof(path));
+    LittleFS.remove(path);
+  }
+  if(!haveSegments) return;
+
+  for(uint32_t segment = firstSegment; segment <= lastSegment; segment++) {
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    uint16_t samples = f ? f.size() / sizeof(TelemetrySample) : 0;
+    if(f) f.close();
+    segmentSamples[segment % TELEMETRY_MAX_SEGMENTS] = samples;
+    telemetryStats.flashQueued += samples;
+  }
+  // The last boot may have been cut off mid-write
+  lastSegmentFull = true;
+}
+
+// ---- Queue ----
+
+static void takeSample() {
+  TelemetrySample s;
+  memset(&s, 0, sizeof(s));
+  s.boot = metricLogStats.boot;
+  s.uptime = millis() / 1000;
+  samplerLock();
+  s.freeHeap = metricLatest(metrics[METRIC_FREE_HEAP]);
+  s.temperature = metricLatest(metrics[METRIC_TEMPERATURE]);
+  s.rssi = metricLatest(metrics[METRIC_RSSI]);
+  s.hasPressure = metricCount(metrics[METRIC_PRESSURE]) > 0;
+  s.pressure = s.hasPressure ? metricLatest(metrics[METRIC_PRESSURE]) : 0;
+  samplerUnlock();
+
+  if(ramCount == TELEMETRY_RAM_SAMPLES) spill();
+  ram[(ramHead + ramCount) % TELEMETRY_RAM_SAMPLES] = s;
+  ramCount++;
+  telemetryStats.samples++;
+}
+
+// Copy the oldest samples into batch, stopping where the payload's shared
+// fields (boot, pressure present) change. Sets fromFlash for releaseBatch().
+static uint16_t peekBatch(bool &fromFlash) {
+  uint16_t count = 0;
+  // Empty files left by a failed write
+  while(telemetryStats.flashQueued > 0 && segmentSamples[firstSegment % TELEMETRY_MAX_SEGMENTS] == readOffset) {
+    removeFirstSegment();
+  }
+  fromFlash = telemetryStats.flashQueued > 0;
+  if(fromFlash) {
+    // One segment at a time
+    uint16_t available = segmentSamples[firstSegment % TELEMETRY_MAX_SEGMENTS] - readOffset;
+    char path[32];
+    segmentPath(firstSegment, path, sizeof(path));
+    File f = LittleFS.open(path, "r");
+    if(f && f.seek(readOffset * sizeof(TelemetrySample))) {
+      uint16_t want = available < TELEMETRY_BATCH ? available : TELEMETRY_BATCH;
+      count = f.read((uint8_t *)batch, want * sizeof(TelemetrySample)) / sizeof(TelemetrySample);
+    }
+    if(f) f.close();
+    if(count == 0) {
+      // Unreadable: skip the segment rather than retry it forever
+      Serial.printf("[MQTT] Read from %s failed, dropping %u samples\n", path, available);
+      telemetryStats.dropped += available;
+      removeFirstSegment();
+      return 0;
+    }
+  } else {
+    count = ramCount < TELEMETRY_BATCH ? ramCount : TELEMETRY_BATCH;
+    for(uint16_t i = 0; i < count; i++) batch[i] = ram[(ramHead + i) % TELEMETRY_RAM_SAMPLES];
+  }
+
+  for(uint16_t i = 1; i < count; i++) {
+    if(batch[i].boot != batch[0].boot || batch[i].hasPressure != batch[0].hasPressure) return i;
+  }
+  return count;
+}
+
+static void releaseBatch(uint16_t count, bool fromFlash) {
+  if(!fromFlash) {
+    ramHead = (ramHead + count) % TELEMETRY_RAM_SAMPLES;
+    ramCount -= count;
+    return;
+  }
+  readOffset += count;
+  telemetryStats.flashQueued -= count;
+  if(readOffset >= segmentSamples[firstSegment % TELEMETRY_MAX_SEGMENTS]) removeFirstSegment();
+}
+
+// ---- Payload ----
+
+static void appendf(size_t &len, const char *format, long value) {
+  if(len < sizeof(payload)) len += snprintf(payload + len, sizeof(payload) - len, format, value);
+}
+
+// One delta-coded series: "name":[first,d1,d2,...]
+static void appendSeries(size_t &len, const char *name, uint16_t count, int32_t (*field)(const TelemetrySample &)) {
+  if(len < sizeof(payload)) len += snprintf(payload + len, sizeof(payload) - len, ",\"%s\":[", name);
+  int32_t previous = 0;
+  for(uint16_t i = 0; i < count; i++) {
+    int32_t value = field(batch[i]);
+    appendf(len, i ? ",%ld" : "%ld", (long)(value - previous));
+    previous = value;
+  }
+  appendf(len, "]", 0);
+}
+
+static int32_t fieldUptime(const TelemetrySample &s) { return s.uptime; }
+static int32_t fieldHeap(const TelemetrySample &s) { return s.freeHeap; }
+static int32_t fieldTemperature(const TelemetrySample &s) { return s.temperature; }
+static int32_t fieldPressure(const TelemetrySample &s) { return s.pressure; }
+static int32_t fieldRssi(const TelemetrySample &s) { return s.rssi; }
+
+// Returns the payload length, 0 if it didn't fit
+static size_t buildPayload(uint16_t count) {
+  size_t len = 0;
+  appendf(len, "{\"boot\":%ld", batch[0].boot);
+  appendSeries(len, "t", count, fieldUptime);
+  appendSeries(len, "heap", count, fieldHeap);
+  appendSeries(len, "temp", count, fieldTemperature);
+  if(batch[0].hasPressure) appendSeries(len, "press", count, fieldPressure);
+  appendSeries(len, "rssi", count, fieldRssi);
+  appendf(len, "}", 0);
+  return len < sizeof(payload) ? len : 0;
+}
+
+// ---- Connection ----
+
+static void maintainConnection(unsigned long now) {
+  bool up = WiFi.status() == WL_CONNECTED && client.connected();
+  if(up != telemetryStats.connected) {
+    telemetryStats.connected = up;
+    if(!up) Serial.printf("[MQTT] Disconnected, %lu samples queued\n", (unsigned long)queued());
+  }
+  if(up || WiFi.status() != WL_CONNECTED) return;
+  if(lastAttempt != 0 && now - lastAttempt < retryMs) return;
+  lastAttempt = now;
+
+  bool credentials = config.user && config.user[0];
+  if(client.connect(clientId, credentials ? config.user : nullptr, credentials ? config.password : nullptr)) {
+    telemetryStats.connected = true;
+    telemetryStats.connects++;
+    retryMs = RETRY_MIN_MS;
+    Serial.printf("[MQTT] Connected to %s:%u as %s, %lu samples queued\n", config.host, config.port,
+                  clientId, (unsigned long)queued());
+  } else {
+    Serial.printf("[MQTT] Connecting to %s:%u failed (error %d, return code %d), retry in %lu s\n",
+                  config.host, config.port, (int)client.lastError(), (int)client.returnCode(), retryMs / 1000);
+    retryMs = retryMs * 2 > RETRY_MAX_MS ? RETRY_MAX_MS : retryMs * 2;
+  }
+}
+
+static void publishBatch(unsigned long now) {
+  lastPublish = now;
+  bool fromFlash;
+  uint16_t count = peekBatch(fromFlash);
+  if(count == 0) return;
+  size_t len = buildPayload(count);
+  if(len == 0) {
+    // Can't happen at today's batch size; don't wedge the queue if it does
+    Serial.printf("[MQTT] %u samples don't fit in %d bytes, dropped\n", count, TELEMETRY_PAYLOAD_BYTES);
+    telemetryStats.dropped += count;
+    releaseBatch(count, fromFlash);
+    return;
+  }
+
+  // QoS 1: returns once the broker's PUBACK arrives (or the timeout)
+  uint32_t start = micros();
+  bool acked = client.publish(topic, payload, len, false, 1);
+  uint32_t elapsed = micros() - start;
+  if(!acked) {
+    // Stays queued and goes again; the broker may see it twice
+    telemetryStats.failures++;
+    return;
+  }
+  releaseBatch(count, fromFlash);
+  telemetryStats.messages++;
+  telemetryStats.published += count;
+  telemetryStats.payloadBytes += len;
+  telemetryStats.lastPublishUs = elapsed;
+  telemetryStats.totalPublishUs += elapsed;
+  if(elapsed > telemetryStats.maxPublishUs) telemetryStats.maxPublishUs = elapsed;
+}
+
+// One pass of the task: sample when due, keep connected, publish when due
+static void telemetryStep(unsigned long now) {
+  if(now - lastSample >= config.samplePeriodMs) {
+    lastSample += config.samplePeriodMs;
+    if(now - lastSample >= config.samplePeriodMs) lastSample = now;   // fell behind: don't burst
+    takeSample();
+  }
+
+  maintainConnection(now);
+  if(telemetryStats.connected) {
+    client.loop();
+    // On schedule, or sooner (rate limited) while there's a backlog
+    uint32_t waiting = queued();
+    if(waiting > 0 && (now - lastPublish >= config.publishPeriodMs ||
+                       (waiting >= TELEMETRY_BATCH && now - lastPublish >= TELEMETRY_DRAIN_MS))) {
+      publishBatch(now);
+    }
+  }
+  telemetryStats.ramQueued = ramCount;
+}
+
+static void telemetryTask(void *param) {
+  for(;;) {
+    telemetryStep(millis());
+    vTaskDelay(pdMS_TO_TICKS(100));
+  }
+}
+
+bool telemetryBegin(const TelemetryConfig &cfg) {
+  config = cfg;
+  uint64_t mac = ESP.getEfuseMac();
+  snprintf(clientId, sizeof(clientId), "dashboard-%06lx", (unsigned long)((mac >> 24) & 0xFFFFFF));
+  snprintf(topic, sizeof(topic), "sensor-dashboard/%s/telemetry", clientId);
+
+  indexSpill();
+  if(telemetryStats.flashQueued > 0) {
+    Serial.printf("[MQTT] %lu samples waiting on flash from an earlier boot\n",
+                  (unsigned long)telemetryStats.flashQueued);
+  }
+
+  client.begin(config.host, config.port, net);
+  client.setOptions(30, true, TELEMETRY_TIMEOUT_MS);     // keep-alive s, clean session, timeout ms
+
+  lastSample = millis() - config.samplePeriodMs;          // first sample straight away
+  lastPublish = millis();
+  xTaskCreatePinnedToCore(telemetryTask, "mqtt", 4096, nullptr, 1, nullptr, 0);
+  Serial.printf("[MQTT] Publishing to %s on %s:%u\n", topic, config.host, config.port);
+  return true;
+}
+
+void telemetryPrintStats(Print &out) {
+  TelemetryStats s = telemetryStats;
+  out.printf("[MQTT] %s, %lu samples in %lu messages", s.connected ? "connected" : "offline",
+             (unsigned long)s.published, (unsigned long)s.messages);
+  if(s.published > 0) {
+    uint32_t bytesX10 = (uint32_t)(s.payloadBytes * 10 / s.published);
+    out.printf(", %lu.%lu bytes per sample", (unsigned long)(bytesX10 / 10), (unsigned long)(bytesX10 % 10));
+  }
+  if(s.messages > 0) {
+    out.printf(", publish to PUBACK %lu us (avg %lu us, max %lu us)", (unsigned long)s.lastPublishUs,
+               (unsigned long)(s.totalPublishUs / s.messages), (unsigned long)s.maxPublishUs);
+  }
+  out.printf("\n[MQTT] Queued %lu in RAM, %lu on flash; %lu spilled, %lu dropped, %lu unacknowledged, %lu connects\n",
+             (unsigned long)s.ramQueued, (unsigned long)s.flashQueued, (unsigned long)s.spilled,
+             (unsigned long)s.dropped, (unsigned long)s.failures, (unsigned long)s.connects);
+}
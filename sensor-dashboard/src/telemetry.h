@@ -0,0 +1,82 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+// Batched MQTT telemetry: free heap, temperature, pressure and RSSI.
+//
+// A task takes a sample every samplePeriodMs into a RAM queue and publishes
+// the queued samples every publishPeriodMs as one QoS 1 message, removing
+// them only once the broker has acknowledged it. Payloads are JSON with each
+// series delta-coded against the previous sample, so a steady value costs two
+// characters:
+//
+//   {"boot":3,"t":[12340,10,10],"heap":[183456,-12,0],"temp":[452,0,1],
+//    "press":[101325,1,0],"rssi":[-61,0,0]}
+//
+// Add up each array to decode. "t" is seconds since boot ("boot" is the flash
+// log's boot number; there's no wall clock), "temp" tenths of a degree C,
+// "press" Pa ("press" is left out without a BMP280). Redelivered messages
+// repeat the same boot and times, so consumers can drop duplicates.
+//
+// While Wi-Fi or the broker is down the queue fills; when the RAM ring is full
+// the oldest TELEMETRY_SPILL_SAMPLES are appended to flash at a time, up to
+// TELEMETRY_MAX_SEGMENTS files, beyond which the oldest are dropped. The
+// backlog survives a reboot and is sent oldest first, at most one message of
+// TELEMETRY_BATCH samples every TELEMETRY_DRAIN_MS.
+
+#define TELEMETRY_DIR "/mqtt"
+#define TELEMETRY_BATCH 30            // most samples per message
+#define TELEMETRY_RAM_SAMPLES 180     // 30 minutes offline at 10 s before touching flash (3.6 KB)
+#define TELEMETRY_SPILL_SAMPLES 60    // moved to flash in one append
+#define TELEMETRY_SEGMENT_SAMPLES 240 // per spill file (4.8 KB)
+#define TELEMETRY_MAX_SEGMENTS 24     // 16 hours at 10 s
+#define TELEMETRY_DRAIN_MS 500        // backlog rate limit: two messages a second
+#define TELEMETRY_PAYLOAD_BYTES 1024  // a full batch is about 550 bytes
+#define TELEMETRY_TIMEOUT_MS 2000     // connect and PUBACK
+
+struct TelemetryConfig {
+  const char *host;
+  uint16_t port;
+  const char *user;                   // empty: no credentials
+  const char *password;
+  unsigned long samplePeriodMs;
+  unsigned long publishPeriodMs;
+};
+
+struct TelemetrySample {
+  uint16_t boot;
+  int16_t temperature;                // tenths of a degree C
+  int8_t rssi;                        // dBm
+  uint8_t hasPressure;
+  uint32_t uptime;                    // seconds
+  int32_t freeHeap;
+  int32_t pressure;                   // Pa
+};
+
+struct TelemetryStats {
+  uint32_t samples;                   // taken this boot
+  uint32_t published;                 // samples acknowledged by the broker
+  uint32_t messages;
+  uint32_t failures;                  // publishes without a PUBACK (resent later)
+  uint32_t connects;
+  uint32_t spilled;                   // samples moved to flash
+  uint32_t dropped;                   // lost to a full backlog or a failed flash write
+  uint32_t ramQueued;
+  uint32_t flashQueued;
+  uint64_t payloadBytes;              // of acknowledged messages
+  uint32_t lastPublishUs;             // publish to PUBACK
+  uint32_t maxPublishUs;
+  uint64_t totalPublishUs;
+  bool connected;
+};
+
+extern TelemetryStats telemetryStats;
+
+// Pick up any backlog left on flash and start the task (after metricLogBegin)
+bool telemetryBegin(const TelemetryConfig &config);
+
+// Latency, bytes per sample and the backlog
+void telemetryPrintStats(Print &out);
+
+#endif
@@ -0,0 +1,85 @@
+#include "wifi_scan.h"
+#include <WiFi.h>
+#include "channel_analyzer.h"
+
+ScanResults scanResults;
+
+static unsigned long scanPeriod = 30000;
+static unsigned long scanStartedAt = 0;
+static bool running = false;
+static bool started = false;          // a scan has been started since boot
+
+static void startScan() {
+  // Async, no hidden networks: returns at once, results arrive in the driver
+  WiFi.scanNetworks(true, false);
+  scanStartedAt = millis();
+  running = true;
+  started = true;
+}
+
+// Copy the driver's records, keeping the strongest SCAN_MAX_NETWORKS in RSSI order.
+// Every network counts towards the channel scores, not just the ones kept.
+static void collect(int found) {
+  scanResults.count = 0;
+  channelScanStart();
+  for(int i = 0; i < found; i++) {
+    wifi_ap_record_t *ap = (wifi_ap_record_t *)WiFi.getScanInfoByIndex(i);
+    if(ap == nullptr) continue;
+    channelScanAdd(ap->rssi, ap->primary, ap->bssid);
+
+    int pos = scanResults.count < SCAN_MAX_NETWORKS ? scanResults.count++ : SCAN_MAX_NETWORKS;
+    while(pos > 0 && ap->rssi > scanResults.networks[pos - 1].rssi) {
+      if(pos < SCAN_MAX_NETWORKS) scanResults.networks[pos] = scanResults.networks[pos - 1];
+      pos--;
+    }
+    if(pos >= SCAN_MAX_NETWORKS) continue;
+
+    ScanNetwork &network = scanResults.networks[pos];
+    strlcpy(network.ssid, (const char *)ap->ssid, sizeof(network.ssid));
+    memcpy(network.bssid, ap->bssid, sizeof(network.bssid));
+    network.rssi = ap->rssi;
+    network.channel = ap->primary;
+    network.open = ap->authmode == WIFI_AUTH_OPEN;
+  }
+  channelScanDone();
+  scanResults.found = found;
+}
+
+void scanBegin(unsigned long periodMs) {
+  scanPeriod = periodMs;
+  memset(&scanResults, 0, sizeof(scanResults));
+  startScan();
+}
+
+void scanUpdate() {
+  if(!running) {
+    if(started && millis() - scanStartedAt >= scanPeriod) startScan();
+    return;
+  }
+
+  int found = WiFi.scanComplete();
+  if(found == WIFI_SCAN_RUNNING) return;
+
+  running = false;
+  if(found < 0) {
+    scanResults.failures++;
+    Serial.println("[Scan] Scan failed");
+    return;
+  }
+
+  collect(found);
+  WiFi.scanDelete();
+  scanResults.completedAt = millis();
+  scanResults.durationMs = scanResults.completedAt - scanStartedAt;
+  scanResults.scans++;
+  scanResults.valid = true;
+  Serial.printf("[Scan] %d networks in %lu ms\n", found, (unsigned long)scanResults.durationMs);
+}
+
+bool scanRunning() {
+  return running;
+}
+
+unsigned long scanAgeMs() {
+  return millis() - scanResults.completedAt;
+}
@@ -0,0 +1,49 @@
+#ifndef WIFI_SCAN_H
+#define WIFI_SCAN_H
+
+#include <Arduino.h>
+
+// Background Wi-Fi scanning.
+//
+// WiFi.scanNetworks() blocks for the whole active scan (several seconds),
+// which used to freeze the dashboard every time a screen showed the network
+// count. Scans now run asynchronously every scan period: scanUpdate() only
+// starts a scan when one is due and copies the results into a fixed array
+// when it has finished. Screens read the cached results, with their age.
+
+#define SCAN_MAX_NETWORKS 16          // strongest networks kept
+#define SCAN_SSID_LEN 33              // 32 characters + terminator
+
+struct ScanNetwork {
+  char ssid[SCAN_SSID_LEN];           // empty for hidden networks
+  uint8_t bssid[6];
+  int8_t rssi;
+  uint8_t channel;
+  bool open;                          // no encryption
+};
+
+struct ScanResults {
+  ScanNetwork networks[SCAN_MAX_NETWORKS];  // strongest first
+  int count;                          // networks stored
+  int found;                          // networks seen by the last scan (may exceed count)
+  unsigned long completedAt;          // millis() of the last finished scan
+  uint32_t durationMs;                // how long the last scan took
+  uint32_t scans;
+  uint32_t failures;
+  bool valid;                         // at least one scan has finished
+};
+
+extern ScanResults scanResults;
+
+// Start scanning every periodMs (first scan right away)
+void scanBegin(unsigned long periodMs);
+
+// Call from loop(): starts a scan when due and collects finished results. Never blocks.
+void scanUpdate();
+
+bool scanRunning();
+
+// Milliseconds since the cached results were taken
+unsigned long scanAgeMs();
+
+#endif
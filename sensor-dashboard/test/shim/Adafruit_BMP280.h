@@ -0,0 +1,19 @@
+#ifndef SHIM_ADAFRUIT_BMP280_H
+#define SHIM_ADAFRUIT_BMP280_H
+
+// The setting types barometer.h names; tests that need a reading define
+// barometerStartForced() and barometerReadForced() themselves
+
+#include <Arduino.h>
+
+class Adafruit_BMP280 {
+public:
+  enum sensor_sampling { SAMPLING_NONE, SAMPLING_X1, SAMPLING_X2, SAMPLING_X4, SAMPLING_X8, SAMPLING_X16 };
+  enum sensor_filter { FILTER_OFF, FILTER_X2, FILTER_X4, FILTER_X8, FILTER_X16 };
+  enum standby_duration {
+    STANDBY_MS_1, STANDBY_MS_63, STANDBY_MS_125, STANDBY_MS_250,
+    STANDBY_MS_500, STANDBY_MS_1000, STANDBY_MS_2000, STANDBY_MS_4000
+  };
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef SHIM_ARDUINO_H
+#define SHIM_ARDUINO_H
+
+// Just enough of the Arduino core and FreeRTOS for the host tests
+// (the native environment). Serial goes to stdout; there is one task and no
+// other core, so locks and critical sections are no-ops and created tasks
+// never run. RTC memory is ordinary memory. Time is simulated: it moves only
+// with delay() and vTaskDelay(), or when a test sets shimMicros; the cycle
+// counter is separate and moves only when a test sets shimCycles.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+
+inline uint64_t shimMicros = 0;
+inline uint32_t shimCycles = 0;
+
+inline unsigned long micros() {
+  return (unsigned long)shimMicros;
+}
+
+inline unsigned long millis() {
+  return (unsigned long)(shimMicros / 1000);
+}
+
+inline void delay(unsigned long ms) {
+  shimMicros += (uint64_t)ms * 1000;
+}
+
+class EspClass {
+public:
+  uint64_t getEfuseMac() { return 0x123456789abcULL; }
+  uint32_t getCycleCount() { return shimCycles; }
+};
+
+inline uint32_t shimCpuMhz = 240;
+
+inline uint32_t getCpuFrequencyMhz() {
+  return shimCpuMhz;
+}
+
+inline bool setCpuFrequencyMhz(uint32_t mhz) {
+  shimCpuMhz = mhz;
+  return true;
+}
+
+inline uint32_t esp_random() {
+  return 0x9c4e2b17;
+}
+
+inline EspClass ESP;
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *buf, size_t len) {
+    return fwrite(buf, 1, len, stdout);
+  }
+
+  int printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char buf[256];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if(n > 0) write((const uint8_t *)buf, min((size_t)n, sizeof(buf) - 1));
+    return n;
+  }
+  size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+  size_t println(const char *text = "") { return print(text) + print("\n"); }
+};
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud) {}
+  void flush() { fflush(stdout); }
+};
+
+inline HardwareSerial Serial;
+
+typedef void *TaskHandle_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef struct { int unused; } portMUX_TYPE;
+
+#define pdTRUE 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) (void)(mux)
+#define portEXIT_CRITICAL(mux) (void)(mux)
+
+inline void vTaskDelay(TickType_t ticks) {
+  delay(ticks);
+}
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*task)(void *), const char *name, uint32_t stack,
+                                          void *param, unsigned priority, TaskHandle_t *handle, int core) {
+  return pdTRUE;
+}
+
+#endif
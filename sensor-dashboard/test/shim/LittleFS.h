@@ -0,0 +1,113 @@
+#ifndef SHIM_LITTLEFS_H
+#define SHIM_LITTLEFS_H
+
+// In-memory LittleFS for the host tests: files are strings keyed by path,
+// and a directory lists the files under its path. usedBytes() counts whole
+// 4 KB blocks per file, as the real one allocates them. Set shimMountFails
+// to make begin() fail.
+
+#include <Arduino.h>
+#include <map>
+#include <set>
+#include <string>
+
+#define SHIM_BLOCK_BYTES 4096
+#define SHIM_TOTAL_BYTES (1408 * 1024)
+
+inline std::map<std::string, std::string> shimFiles;
+inline bool shimMountFails = false;
+
+class File {
+public:
+  File() : data(nullptr), pos(0), next(0) {}
+  File(std::string *data, const std::string &path, size_t pos) : data(data), path(path), pos(pos), next(0) {}
+  explicit File(const std::string &dir) : data(nullptr), path(dir), pos(0), next(0), directory(true) {}
+
+  explicit operator bool() const { return data != nullptr || directory; }
+  size_t size() const { return data ? data->size() : 0; }
+  int available() const { return data ? (int)(data->size() - pos) : 0; }
+  bool seek(size_t to) {
+    pos = min(to, size());
+    return true;
+  }
+  void close() {
+    data = nullptr;
+    directory = false;
+  }
+  const char *name() const { return path.c_str(); }
+
+  size_t read(uint8_t *buf, size_t len) {
+    size_t n = min(len, (size_t)available());
+    if(n > 0) memcpy(buf, data->data() + pos, n);
+    pos += n;
+    return n;
+  }
+
+  size_t write(const uint8_t *buf, size_t len) {
+    if(!data) return 0;
+    data->replace(pos, min(len, data->size() - pos), (const char *)buf, len);
+    pos += len;
+    return len;
+  }
+
+  // Files directly under this directory, in name order
+  File openNextFile() {
+    std::string prefix = path + "/";
+    size_t index = 0;
+    for(auto &entry : shimFiles) {
+      const std::string &name = entry.first;
+      if(name.compare(0, prefix.size(), prefix) != 0 || name.find('/', prefix.size()) != std::string::npos) continue;
+      if(index++ < next) continue;
+      next++;
+      return File(&entry.second, name, 0);
+    }
+    return File();
+  }
+
+private:
+  std::string *data;
+  std::string path;
+  size_t pos;
+  size_t next;
+  bool directory = false;
+};
+
+class LittleFSShim {
+public:
+  bool begin(bool formatOnFail = false) { return !shimMountFails; }
+
+  File open(const char *path, const char *mode = "r") {
+    if(mode[0] == 'r') {
+      if(dirs.count(path)) return File(std::string(path));
+      auto it = shimFiles.find(path);
+      return it == shimFiles.end() ? File() : File(&it->second, path, 0);
+    }
+    std::string &data = shimFiles[path];
+    if(mode[0] == 'w') data.clear();
+    return File(&data, path, mode[0] == 'a' ? data.size() : 0);
+  }
+  bool exists(const char *path) { return dirs.count(path) > 0 || shimFiles.count(path) > 0; }
+  bool mkdir(const char *path) { return dirs.insert(path).second; }
+  bool remove(const char *path) { return shimFiles.erase(path) > 0; }
+
+  size_t totalBytes() { return SHIM_TOTAL_BYTES; }
+  size_t usedBytes() {
+    size_t used = 0;
+    for(auto &entry : shimFiles) {
+      used += (entry.second.size() + SHIM_BLOCK_BYTES - 1) / SHIM_BLOCK_BYTES * SHIM_BLOCK_BYTES;
+    }
+    return used;
+  }
+
+  void reset() {
+    shimFiles.clear();
+    dirs.clear();
+  }
+
+private:
+  std::set<std::string> dirs;
+};
+
+inline LittleFSShim LittleFS;
+
+#endif
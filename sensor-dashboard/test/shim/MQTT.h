@@ -0,0 +1,60 @@
+#ifndef SHIM_MQTT_H
+#define SHIM_MQTT_H
+
+// A broker on the other end of 256dpi/MQTT's client: while shimBrokerUp,
+// connect() succeeds and a QoS 1 publish is acknowledged and recorded in
+// shimPublished. shimDropAcks makes the next publishes fail as a lost PUBACK
+// would, after the broker has seen them (recorded in shimUnacked).
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string>
+#include <vector>
+
+inline bool shimBrokerUp = true;
+inline int shimDropAcks = 0;
+inline std::vector<std::string> shimPublished;
+inline std::vector<std::string> shimUnacked;
+
+typedef enum { LWMQTT_SUCCESS = 0, LWMQTT_NETWORK_FAILED_CONNECT = -3 } lwmqtt_err_t;
+typedef enum { LWMQTT_CONNECTION_ACCEPTED = 0 } lwmqtt_return_code_t;
+
+class MQTTClient {
+public:
+  explicit MQTTClient(int bufferSize = 128) {}
+  void begin(const char *host, int port, WiFiClient &client) {}
+  void setOptions(int keepAlive, bool cleanSession, int timeout) {}
+
+  bool connect(const char *clientId, const char *user = nullptr, const char *password = nullptr, bool skip = false) {
+    up = shimBrokerUp;
+    return up;
+  }
+  bool connected() {
+    if(!shimBrokerUp) up = false;
+    return up;
+  }
+  bool loop() { return connected(); }
+  bool disconnect() {
+    up = false;
+    return true;
+  }
+
+  bool publish(const char *topic, const char *payload, int length, bool retained, int qos) {
+    if(!connected()) return false;
+    if(shimDropAcks > 0) {
+      shimDropAcks--;
+      shimUnacked.push_back(std::string(payload, length));
+      return false;
+    }
+    shimPublished.push_back(std::string(payload, length));
+    return true;
+  }
+
+  lwmqtt_err_t lastError() { return up ? LWMQTT_SUCCESS : LWMQTT_NETWORK_FAILED_CONNECT; }
+  lwmqtt_return_code_t returnCode() { return LWMQTT_CONNECTION_ACCEPTED; }
+
+private:
+  bool up = false;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef SHIM_WIFI_H
+#define SHIM_WIFI_H
+
+// Station status and the associated AP: tests set the shim variables.
+// begin() doesn't change the status; it counts joins and keeps the channel
+// asked for (0 when the station scans).
+
+#include <Arduino.h>
+
+enum wl_status_t {
+  WL_IDLE_STATUS = 0,
+  WL_CONNECTED = 3,
+  WL_DISCONNECTED = 6
+};
+
+enum wifi_mode_t {
+  WIFI_OFF = 0,
+  WIFI_STA = 1
+};
+
+inline wl_status_t shimWifiStatus = WL_CONNECTED;
+inline uint8_t shimBssid[6];
+inline uint8_t shimChannel = 1;
+inline wifi_mode_t shimWifiMode = WIFI_OFF;
+inline int shimWifiJoins = 0;
+inline int32_t shimJoinChannel = 0;
+
+class WiFiClass {
+public:
+  void persistent(bool persistent) {}
+  bool mode(wifi_mode_t mode) {
+    shimWifiMode = mode;
+    return true;
+  }
+  wl_status_t begin(const char *ssid, const char *password, int32_t channel = 0, const uint8_t *bssid = nullptr) {
+    shimWifiJoins++;
+    shimJoinChannel = channel;
+    return shimWifiStatus;
+  }
+  bool disconnect() { return true; }
+  wl_status_t status() { return shimWifiStatus; }
+  uint8_t *BSSID() { return shimBssid; }
+  int32_t channel() { return shimChannel; }
+};
+
+inline WiFiClass WiFi;
+
+class WiFiClient {};
+
+#endif
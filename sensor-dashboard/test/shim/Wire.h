@@ -0,0 +1,29 @@
+#ifndef SHIM_WIRE_H
+#define SHIM_WIRE_H
+
+// The I2C bus: every transmission is recorded in shimI2cWrites with its
+// address, and always acknowledged
+
+#include <Arduino.h>
+#include <vector>
+
+struct ShimI2cWrite {
+  uint8_t address;
+  std::vector<uint8_t> bytes;
+};
+
+inline std::vector<ShimI2cWrite> shimI2cWrites;
+
+class TwoWire {
+public:
+  void beginTransmission(uint8_t address) { shimI2cWrites.push_back({address, {}}); }
+  size_t write(uint8_t value) {
+    shimI2cWrites.back().bytes.push_back(value);
+    return 1;
+  }
+  uint8_t endTransmission(bool stop = true) { return 0; }
+};
+
+inline TwoWire Wire;
+
+#endif
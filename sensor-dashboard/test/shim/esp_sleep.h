@@ -0,0 +1,34 @@
+#ifndef SHIM_ESP_SLEEP_H
+#define SHIM_ESP_SLEEP_H
+
+// Deep sleep ends the wake: esp_deep_sleep_start() throws ShimDeepSleep for
+// the test to catch, with the timer wake-up it asked for in shimSleepUs.
+// Tests set shimWakeCause for the next wake (a power-up or reset reads as
+// ESP_SLEEP_WAKEUP_UNDEFINED).
+
+#include <Arduino.h>
+
+typedef enum {
+  ESP_SLEEP_WAKEUP_UNDEFINED = 0,
+  ESP_SLEEP_WAKEUP_TIMER = 4
+} esp_sleep_wakeup_cause_t;
+
+struct ShimDeepSleep {};
+
+inline esp_sleep_wakeup_cause_t shimWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+inline uint64_t shimSleepUs = 0;
+
+inline esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return shimWakeCause;
+}
+
+inline esp_err_t esp_sleep_enable_timer_wakeup(uint64_t us) {
+  shimSleepUs = us;
+  return ESP_OK;
+}
+
+[[noreturn]] inline void esp_deep_sleep_start() {
+  throw ShimDeepSleep();
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef SHIM_ESP_WIFI_H
+#define SHIM_ESP_WIFI_H
+
+// The country setting: tests set shimCountry, or shimCountryError to make
+// esp_wifi_get_country() fail as it does before Wi-Fi starts
+
+#include <Arduino.h>
+
+#define ESP_ERR_WIFI_NOT_INIT 0x3001
+
+typedef enum {
+  WIFI_COUNTRY_POLICY_AUTO,
+  WIFI_COUNTRY_POLICY_MANUAL
+} wifi_country_policy_t;
+
+typedef struct {
+  char cc[3];
+  uint8_t schan;
+  uint8_t nchan;
+  int8_t max_tx_power;
+  wifi_country_policy_t policy;
+} wifi_country_t;
+
+inline wifi_country_t shimCountry = {"01", 1, 11, 20, WIFI_COUNTRY_POLICY_AUTO};
+inline esp_err_t shimCountryError = ESP_OK;
+
+inline esp_err_t esp_wifi_get_country(wifi_country_t *country) {
+  if(shimCountryError != ESP_OK) return shimCountryError;
+  *country = shimCountry;
+  return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,190 @@
+// Host tests for the channel recommendation, replaying saved scan lists and
+// checking the country limit: pio test -e native -f test_channel_analyzer
+//
+// steady.csv is 40 scans of a stable neighbourhood. shift.csv is the same
+// place for scans 0-19 and busier on 6 (one more network, 4 dB louder) for
+// scans 20-39; in both halves a loud network on 13 shows up for the last ten.
+#include <unity.h>
+#include <string>
+#include <vector>
+#include "channel_analyzer.cpp"
+
+struct Network {
+  int scan;
+  uint8_t bssid[6];
+  uint8_t channel;
+  int8_t rssi;
+};
+
+static std::vector<Network> load(const char *name) {
+  std::string path = __FILE__;
+  path = path.substr(0, path.find_last_of('/') + 1) + name;
+  std::vector<Network> networks;
+  FILE *f = fopen(path.c_str(), "r");
+  TEST_ASSERT_NOT_NULL_MESSAGE(f, path.c_str());
+  char line[128];
+  fgets(line, sizeof(line), f);       // header
+  while(fgets(line, sizeof(line), f)) {
+    Network n;
+    unsigned b[6];
+    int channel, rssi;
+    if(sscanf(line, "%d,%*[^,],%x:%x:%x:%x:%x:%x,%d,%d", &n.scan, &b[0], &b[1], &b[2], &b[3], &b[4], &b[5],
+              &channel, &rssi) != 9) continue;
+    for(int i = 0; i < 6; i++) n.bssid[i] = b[i];
+    n.channel = channel;
+    n.rssi = rssi;
+    networks.push_back(n);
+  }
+  fclose(f);
+  return networks;
+}
+
+static void scan(const std::vector<Network> &networks, int index) {
+  channelScanStart();
+  for(const Network &n : networks) {
+    if(n.scan == index) channelScanAdd(n.rssi, n.channel, n.bssid);
+  }
+  channelScanDone();
+}
+
+// The recommendation after each scan
+static std::vector<int> replay(const std::vector<Network> &networks) {
+  std::vector<int> recommended;
+  for(int i = 0; i <= networks.back().scan; i++) {
+    scan(networks, i);
+    recommended.push_back(stats.recommended);
+  }
+  return recommended;
+}
+
+// One network on each of 1, 6 and 11 leaves 13 the quietest channel
+static void scanOneSixEleven() {
+  static const uint8_t bssid[6] = {2, 0, 0, 0, 0, 1};
+  channelScanStart();
+  channelScanAdd(-50, 1, bssid);
+  channelScanAdd(-50, 6, bssid);
+  channelScanAdd(-50, 11, bssid);
+  channelScanDone();
+}
+
+static const wifi_country_t WORLD = {"01", 1, 11, 20, WIFI_COUNTRY_POLICY_AUTO};
+static const wifi_country_t JAPAN = {"JP", 1, 14, 20, WIFI_COUNTRY_POLICY_AUTO};
+static const wifi_country_t EUROPE = {"EU", 1, 13, 20, WIFI_COUNTRY_POLICY_AUTO};
+
+void setUp() {
+  memset(&stats, 0, sizeof(stats));
+  shimWifiStatus = WL_DISCONNECTED;
+  shimCountry = WORLD;
+  shimCountryError = ESP_OK;
+}
+
+void tearDown() {}
+
+void test_steady_scans_keep_one_recommendation() {
+  std::vector<Network> networks = load("steady.csv");
+  std::vector<int> recommended = replay(networks);
+  TEST_ASSERT_EQUAL(40, recommended.size());
+  for(int channel : recommended) TEST_ASSERT_EQUAL(6, channel);
+  TEST_ASSERT_EQUAL_UINT32(40, stats.scans);
+
+  int lastScan = 0;
+  for(const Network &n : networks) lastScan += n.scan == 39;
+  int counted = 0;
+  for(int i = 0; i < CHANNEL_COUNT; i++) counted += stats.channels[i].lastNetworks;
+  TEST_ASSERT_EQUAL(lastScan, counted);
+}
+
+void test_shift_moves_once_after_smoothing() {
+  std::vector<int> recommended = replay(load("shift.csv"));
+  TEST_ASSERT_EQUAL(6, recommended.front());
+  TEST_ASSERT_EQUAL(1, recommended.back());
+  int changes = 0;
+  int changedAt = 0;
+  for(size_t i = 1; i < recommended.size(); i++) {
+    if(recommended[i] != recommended[i - 1]) {
+      changes++;
+      changedAt = i;
+    }
+  }
+  TEST_ASSERT_EQUAL(1, changes);
+  // Not on the first louder scan: the average and the 3 dB margin hold it
+  TEST_ASSERT_GREATER_THAN(20, changedAt);
+}
+
+void test_own_ap_left_out() {
+  std::vector<Network> networks = load("steady.csv");
+  const Network &own = networks.front();
+  shimWifiStatus = WL_CONNECTED;
+  memcpy(shimBssid, own.bssid, 6);
+  shimChannel = own.channel;
+
+  int onChannel = 0;
+  for(const Network &n : networks) onChannel += n.scan == 0 && n.channel == own.channel;
+  scan(networks, 0);
+  TEST_ASSERT_EQUAL(onChannel - 1, stats.channels[own.channel - 1].lastNetworks);
+  TEST_ASSERT_EQUAL(own.channel, stats.current);
+}
+
+void test_country_limits_candidates() {
+  scanOneSixEleven();
+  TEST_ASSERT_EQUAL(1, stats.firstAllowed);
+  TEST_ASSERT_EQUAL(11, stats.lastAllowed);
+  TEST_ASSERT_TRUE(stats.recommended >= 1 && stats.recommended <= 11);
+  TEST_ASSERT_TRUE(stats.channels[12].power < stats.channels[stats.recommended - 1].power);
+
+  memset(&stats, 0, sizeof(stats));
+  shimCountry = EUROPE;
+  scanOneSixEleven();
+  TEST_ASSERT_EQUAL(13, stats.recommended);
+
+  // 14 is past the channels scored
+  memset(&stats, 0, sizeof(stats));
+  shimCountry = JAPAN;
+  scanOneSixEleven();
+  TEST_ASSERT_EQUAL(13, stats.lastAllowed);
+  TEST_ASSERT_EQUAL(13, stats.recommended);
+}
+
+void test_unknown_country_defaults_to_one_to_eleven() {
+  shimCountryError = ESP_ERR_WIFI_NOT_INIT;
+  scanOneSixEleven();
+  TEST_ASSERT_EQUAL(1, stats.firstAllowed);
+  TEST_ASSERT_EQUAL(CHANNEL_DEFAULT_LAST, stats.lastAllowed);
+  TEST_ASSERT_TRUE(stats.recommended <= CHANNEL_DEFAULT_LAST);
+
+  memset(&stats, 0, sizeof(stats));
+  shimCountryError = ESP_OK;
+  shimCountry.nchan = 0;
+  scanOneSixEleven();
+  TEST_ASSERT_EQUAL(CHANNEL_DEFAULT_LAST, stats.lastAllowed);
+}
+
+// Hysteresis keeps a channel only while it is still allowed
+void test_disallowed_recommendation_moves_at_once() {
+  shimCountry = EUROPE;
+  scanOneSixEleven();
+  TEST_ASSERT_EQUAL(13, stats.recommended);
+  shimCountry = WORLD;
+  scanOneSixEleven();
+  TEST_ASSERT_TRUE(stats.recommended <= 11);
+}
+
+void test_replays_stay_in_country() {
+  shimCountry = {"US", 1, 11, 20, WIFI_COUNTRY_POLICY_MANUAL};
+  for(int channel : replay(load("shift.csv"))) TEST_ASSERT_TRUE(channel >= 1 && channel <= 11);
+  memset(&stats, 0, sizeof(stats));
+  shimCountry = {"XX", 3, 5, 20, WIFI_COUNTRY_POLICY_MANUAL};
+  for(int channel : replay(load("steady.csv"))) TEST_ASSERT_TRUE(channel >= 3 && channel <= 7);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_steady_scans_keep_one_recommendation);
+  RUN_TEST(test_shift_moves_once_after_smoothing);
+  RUN_TEST(test_own_ap_left_out);
+  RUN_TEST(test_country_limits_candidates);
+  RUN_TEST(test_unknown_country_defaults_to_one_to_eleven);
+  RUN_TEST(test_disallowed_recommendation_moves_at_once);
+  RUN_TEST(test_replays_stay_in_country);
+  return UNITY_END();
+}
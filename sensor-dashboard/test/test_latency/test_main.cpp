@@ -0,0 +1,151 @@
+// Host tests for the latency buckets, percentiles and the cycle-counter
+// probes: pio test -e native -f test_latency
+#include <unity.h>
+#include <algorithm>
+#include <vector>
+#include "latency.cpp"
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+// Spread over six decades of cycles, most of them in the middle like a loop
+// that usually takes a few hundred microseconds and now and then stalls
+static uint32_t loopCycles() {
+  uint32_t shift = (nextRandom() % 7 + nextRandom() % 7 + nextRandom() % 7) + 4;
+  return (nextRandom() % 1024 + 1024) << (shift - 4);
+}
+
+// Walks every value up to 100000, then steps of about 0.1% to 2^32 - 1
+static uint64_t nextValue(uint64_t v) {
+  return v < 100000 ? v + 1 : v + v / 997 + 1;
+}
+
+void setUp() {
+  seed = 1;
+  shimCycles = 0;
+  memset(histograms, 0, sizeof(histograms));
+}
+
+void tearDown() {}
+
+void test_bucket_count() {
+  TEST_ASSERT_EQUAL(240, LATENCY_BUCKETS);
+  TEST_ASSERT_EQUAL(0, bucketOf(0));
+  TEST_ASSERT_EQUAL(LATENCY_BUCKETS - 1, bucketOf(UINT32_MAX));
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, bucketUpper(LATENCY_BUCKETS - 1));
+}
+
+void test_buckets_are_ordered_and_contiguous() {
+  uint16_t previous = 0;
+  for(uint64_t v = 0; v <= UINT32_MAX; v = nextValue(v)) {
+    uint16_t bucket = bucketOf((uint32_t)v);
+    TEST_ASSERT_TRUE(bucket >= previous);
+    TEST_ASSERT_TRUE(bucket < LATENCY_BUCKETS);
+    previous = bucket;
+  }
+  // Each bucket starts one past the last one's upper edge
+  for(uint16_t b = 1; b < LATENCY_BUCKETS; b++) {
+    TEST_ASSERT_EQUAL(b - 1, bucketOf(bucketUpper(b - 1)));
+    TEST_ASSERT_EQUAL(b, bucketOf(bucketUpper(b - 1) + 1));
+  }
+}
+
+// The 12.5% the header and README quote
+void test_upper_edge_within_an_eighth() {
+  for(uint64_t v = 0; v <= UINT32_MAX; v = nextValue(v)) {
+    uint32_t upper = bucketUpper(bucketOf((uint32_t)v));
+    TEST_ASSERT_TRUE(upper >= v);
+    if(v < (1u << LATENCY_SUB_BITS)) TEST_ASSERT_EQUAL_UINT32(v, upper);
+    else TEST_ASSERT_TRUE(upper - v < v / 8 + 1);
+  }
+}
+
+void test_percentiles_against_sorted_values() {
+  std::vector<uint32_t> values;
+  for(int i = 0; i < 100000; i++) {
+    uint32_t cycles = loopCycles();
+    values.push_back(cycles);
+    latencyRecord(LATENCY_LOOP, cycles);
+  }
+  std::sort(values.begin(), values.end());
+
+  const LatencyHistogram &h = histograms[LATENCY_LOOP];
+  uint32_t p50 = values[50000 - 1];
+  uint32_t p99 = values[99000 - 1];
+  TEST_ASSERT_TRUE(percentile(h, 500) >= p50 && percentile(h, 500) - p50 <= p50 / 8);
+  TEST_ASSERT_TRUE(percentile(h, 990) >= p99 && percentile(h, 990) - p99 <= p99 / 8);
+  TEST_ASSERT_EQUAL_UINT32(values.back(), percentile(h, 1000));
+
+  uint64_t sum = 0;
+  for(uint32_t cycles : values) sum += cycles;
+  LatencySummary s;
+  LatencyHistogram scratch;
+  latencySummary(LATENCY_LOOP, s, scratch);
+  TEST_ASSERT_EQUAL_UINT32(100000, s.count);
+  TEST_ASSERT_EQUAL_UINT32(percentile(h, 500) / 240, s.p50Us);
+  TEST_ASSERT_EQUAL_UINT32(percentile(h, 990) / 240, s.p99Us);
+  TEST_ASSERT_EQUAL_UINT32(values.back() / 240, s.maxUs);
+  TEST_ASSERT_EQUAL_UINT64(sum / 240, s.sumUs);
+}
+
+// A percentile never reads above the largest value recorded
+void test_percentile_capped_at_max() {
+  latencyRecord(LATENCY_LOOP, 1000);
+  TEST_ASSERT_TRUE(bucketUpper(bucketOf(1000)) > 1000);
+  TEST_ASSERT_EQUAL_UINT32(1000, percentile(histograms[LATENCY_LOOP], 500));
+  TEST_ASSERT_EQUAL_UINT32(1000, percentile(histograms[LATENCY_LOOP], 990));
+}
+
+void test_empty_probe() {
+  LatencySummary s;
+  LatencyHistogram scratch;
+  latencySummary(LATENCY_SAMPLER_WAKE, s, scratch);
+  TEST_ASSERT_EQUAL_UINT32(0, s.count);
+  TEST_ASSERT_EQUAL_UINT32(0, s.p50Us);
+  TEST_ASSERT_EQUAL_UINT32(0, s.p99Us);
+  TEST_ASSERT_EQUAL_UINT32(0, s.maxUs);
+}
+
+void test_probes_across_counter_wrap() {
+  shimCycles = UINT32_MAX - 100;
+  uint32_t start = latencyNow();
+  shimCycles += 2400;
+  latencySince(LATENCY_LOOP, start);
+  TEST_ASSERT_EQUAL_UINT32(2400, histograms[LATENCY_LOOP].maxCycles);
+
+  // Late by 480 cycles, then early, which counts as on time
+  uint32_t due = shimCycles - 480;
+  latencyLate(LATENCY_LOOP_DELAY, due);
+  latencyLate(LATENCY_LOOP_DELAY, shimCycles + 1000000);
+  const LatencyHistogram &h = histograms[LATENCY_LOOP_DELAY];
+  TEST_ASSERT_EQUAL_UINT32(2, h.count);
+  TEST_ASSERT_EQUAL_UINT32(1, h.counts[0]);
+  TEST_ASSERT_EQUAL_UINT32(480, h.maxCycles);
+}
+
+// Calibration records into the loop probe and then clears it
+void test_begin_leaves_probes_empty() {
+  latencyRecord(LATENCY_SAMPLER_WAKE, 50);
+  latencyBegin();
+  TEST_ASSERT_EQUAL_UINT32(0, histograms[LATENCY_LOOP].count);
+  TEST_ASSERT_EQUAL_UINT32(0, histograms[LATENCY_LOOP].counts[0]);
+  TEST_ASSERT_EQUAL_UINT32(1, histograms[LATENCY_SAMPLER_WAKE].count);
+  TEST_ASSERT_EQUAL_UINT32(240 * 1000, latencyCyclesFromMs(1));
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_bucket_count);
+  RUN_TEST(test_buckets_are_ordered_and_contiguous);
+  RUN_TEST(test_upper_edge_within_an_eighth);
+  RUN_TEST(test_percentiles_against_sorted_values);
+  RUN_TEST(test_percentile_capped_at_max);
+  RUN_TEST(test_empty_probe);
+  RUN_TEST(test_probes_across_counter_wrap);
+  RUN_TEST(test_begin_leaves_probes_empty);
+  return UNITY_END();
+}
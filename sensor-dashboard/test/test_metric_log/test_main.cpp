@@ -0,0 +1,290 @@
+// Host tests for the flash log codec, recovery, drops and time-window queries
+// on an in-memory filesystem: pio test -e native -f test_metric_log
+#include <unity.h>
+#include <vector>
+#include "metric_ring.cpp"
+#include "metric_log.cpp"
+
+#define PERIOD_MS 60000UL
+
+// The sampler the log reads from; these tests append rows directly
+MetricRing metrics[METRIC_COUNT];
+void samplerLock() {}
+void samplerUnlock() {}
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+// A value that changes with probability `percent` by up to +/-`step`
+static int32_t drift(int32_t value, int percent, int step) {
+  if((int)(nextRandom() % 100) >= percent) return value;
+  return value + (int32_t)(nextRandom() % (2 * step + 1)) - step;
+}
+
+// One row a minute of a quiet board: the lowest free heap moves now and
+// then, temperature and pressure means creep, RSSI wobbles by a dB or two
+static LogRow typicalRow(LogRow row) {
+  row.uptime += PERIOD_MS / 1000;
+  row.values[LOG_FREE_HEAP] = drift(row.values[LOG_FREE_HEAP], 30, 400);
+  row.values[LOG_TEMPERATURE] = drift(row.values[LOG_TEMPERATURE], 50, 1);
+  row.values[LOG_PRESSURE] = drift(row.values[LOG_PRESSURE], 90, 6);
+  row.values[LOG_RSSI] = drift(row.values[LOG_RSSI], 40, 2);
+  return row;
+}
+
+static LogRow firstRow(uint16_t boot) {
+  LogRow row;
+  row.boot = boot;
+  row.uptime = PERIOD_MS / 1000;
+  row.values[LOG_FREE_HEAP] = 201344;
+  row.values[LOG_TEMPERATURE] = 452;
+  row.values[LOG_PRESSURE] = 101325;
+  row.values[LOG_RSSI] = -61;
+  return row;
+}
+
+static void collect(const LogRow &row, uint32_t index, void *ctx) {
+  ((std::vector<LogRow> *)ctx)->push_back(row);
+}
+
+static std::vector<LogRow> readAll() {
+  std::vector<LogRow> rows;
+  forEachRow(0, collect, &rows);
+  return rows;
+}
+
+static void assertRowsEqual(const LogRow &expected, const LogRow &actual) {
+  TEST_ASSERT_EQUAL_UINT16(expected.boot, actual.boot);
+  TEST_ASSERT_EQUAL_UINT32(expected.uptime, actual.uptime);
+  TEST_ASSERT_EQUAL_INT32_ARRAY(expected.values, actual.values, LOG_CHANNELS);
+}
+
+// A reset: RAM state goes, RTC memory and flash stay
+static void reboot() {
+  logAvailable = false;
+  haveSegments = false;
+  firstSegment = lastSegment = 0;
+  lastSegmentBlocks = 0;
+  memset(segmentRows, 0, sizeof(segmentRows));
+  flashRows = 0;
+  usedAtBoot = freedBytes = 0;
+  metricLogStats = MetricLogStats();
+  metricLogBegin(PERIOD_MS);
+}
+
+void setUp() {
+  seed = 1;
+  shimMountFails = false;
+  LittleFS.reset();
+  pending.magic = 0;
+  pending.data[1] = 0;
+  reboot();
+}
+
+void tearDown() {}
+
+void test_signed_codes_round_trip() {
+  static const int32_t values[] = {
+    0, 1, -1, 63, -64, 64, -65, 8191, -8192, 8192, -8193,
+    524287, -524288, 524288, -524289, INT32_MAX, INT32_MIN
+  };
+  static const uint8_t bits[] = {
+    1, 9, 9, 9, 9, 17, 17, 17, 17, 24, 24, 24, 24, 36, 36, 36, 36
+  };
+  uint8_t buf[64];
+  memset(buf, 0, sizeof(buf));
+  uint16_t pos = 0;
+  for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    uint16_t before = pos;
+    putSigned(buf, pos, values[i]);
+    TEST_ASSERT_EQUAL_UINT16(bits[i], pos - before);
+    TEST_ASSERT_EQUAL_UINT8(bits[i], signedBits(values[i]));
+  }
+  pos = 0;
+  for(size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) {
+    TEST_ASSERT_EQUAL_INT32(values[i], getSigned(buf, pos));
+  }
+}
+
+// Several segments of rows, including counter wrap and a jumpy clock
+void test_rows_round_trip() {
+  std::vector<LogRow> written;
+  LogRow row = firstRow(0);
+  for(int i = 0; i < 3000; i++) {
+    row = typicalRow(row);
+    if(i % 500 == 7) row.uptime += 3600;                // the logger stalled
+    if(i == 1000) row.values[LOG_FREE_HEAP] = INT32_MAX;
+    if(i == 1001) row.values[LOG_FREE_HEAP] = INT32_MIN;
+    appendRow(row);
+    written.push_back(row);
+  }
+  TEST_ASSERT_GREATER_THAN(1, lastSegment - firstSegment + 1);
+  TEST_ASSERT_EQUAL_UINT32(3000, metricLogStats.rows);
+
+  std::vector<LogRow> read = readAll();
+  TEST_ASSERT_EQUAL(written.size(), read.size());
+  for(size_t i = 0; i < written.size(); i++) assertRowsEqual(written[i], read[i]);
+}
+
+// The size the header and README quote comes from here
+void test_typical_row_size() {
+  LogRow row = firstRow(0);
+  for(int i = 0; i < 7 * 1440; i++) {
+    row = typicalRow(row);
+    appendRow(row);
+  }
+  float encoded = metricLogStats.rowBits / 8.0f / metricLogStats.rowsWritten;
+  float perBlock = (float)flashRows / metricLogStats.blocksWritten;
+  char message[96];
+  snprintf(message, sizeof(message), "A week of typical rows: %.2f B/row encoded, %.1f rows per block",
+           encoded, perBlock);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_FLOAT_WITHIN(0.2f, 2.9f, encoded);
+}
+
+void test_rotation_keeps_newest() {
+  std::vector<LogRow> written;
+  LogRow row = firstRow(0);
+  // Noisy rows fill blocks fast
+  for(int i = 0; i < 40000; i++) {
+    row.uptime += 60;
+    for(int c = 0; c < LOG_CHANNELS; c++) row.values[c] = (int32_t)nextRandom();
+    appendRow(row);
+    written.push_back(row);
+  }
+  TEST_ASSERT_GREATER_THAN(0, metricLogStats.segmentsRotated);
+  TEST_ASSERT_EQUAL_UINT32(LOG_MAX_SEGMENTS, lastSegment - firstSegment + 1);
+
+  std::vector<LogRow> read = readAll();
+  TEST_ASSERT_EQUAL_UINT32(metricLogStats.rows, read.size());
+  size_t offset = written.size() - read.size();
+  for(size_t i = 0; i < read.size(); i++) assertRowsEqual(written[offset + i], read[i]);
+  TEST_ASSERT_TRUE(metricLogStats.rowsWritten > metricLogStats.rows);
+}
+
+void test_reset_recovers_pending_block() {
+  std::vector<LogRow> written;
+  LogRow row = firstRow(0);
+  for(int i = 0; i < 200; i++) {
+    row = typicalRow(row);
+    appendRow(row);
+    written.push_back(row);
+  }
+  uint16_t waiting = pendingRows();
+  TEST_ASSERT_GREATER_THAN(0, waiting);
+
+  reboot();
+  TEST_ASSERT_EQUAL_UINT16(waiting, metricLogStats.recoveredRows);
+  TEST_ASSERT_EQUAL_UINT16(1, metricLogStats.boot);
+  std::vector<LogRow> read = readAll();
+  TEST_ASSERT_EQUAL(written.size(), read.size());
+  for(size_t i = 0; i < written.size(); i++) assertRowsEqual(written[i], read[i]);
+}
+
+void test_no_filesystem_counts_dropped_rows() {
+  LogRow row = firstRow(0);
+  for(int i = 0; i < 50; i++) {
+    row = typicalRow(row);
+    appendRow(row);
+  }
+  int waiting = pendingRows();
+
+  // The rows left in RTC memory are dropped with the first boot that can't mount
+  shimMountFails = true;
+  reboot();
+  TEST_ASSERT_EQUAL_UINT32(waiting, metricLogStats.droppedRows);
+
+  for(int i = 0; i < 1000; i++) {
+    row = typicalRow(row);
+    appendRow(row);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, metricLogStats.blocksWritten);
+  TEST_ASSERT_EQUAL_UINT32(waiting + 1000 - pendingRows(), metricLogStats.droppedRows);
+  TEST_ASSERT_EQUAL_UINT32(pendingRows(), metricLogStats.rows);
+}
+
+// Brute force over all rows with the same timeline rules
+static uint32_t expectedPoints(const std::vector<LogRow> &rows, uint32_t span, LogPoint *points, int count) {
+  std::vector<uint32_t> times;
+  for(size_t i = 0; i < rows.size(); i++) {
+    if(i == 0) times.push_back(0);
+    else if(rows[i].boot == rows[i - 1].boot && rows[i].uptime >= rows[i - 1].uptime)
+      times.push_back(times.back() + rows[i].uptime - rows[i - 1].uptime);
+    else times.push_back(times.back() + PERIOD_MS / 1000);
+  }
+  memset(points, 0, count * sizeof(LogPoint));
+  uint32_t found = 0;
+  for(size_t i = 0; i < rows.size(); i++) {
+    uint32_t age = times.back() - times[i];
+    if(age >= span) continue;
+    LogPoint &point = points[count - 1 - (int)((uint64_t)age * count / span)];
+    int32_t value = rows[i].values[LOG_PRESSURE];
+    if(point.rows == 0 || value < point.min) point.min = value;
+    if(point.rows == 0 || value > point.max) point.max = value;
+    point.rows++;
+    found++;
+  }
+  return found;
+}
+
+void test_query_window_is_time_not_rows() {
+  std::vector<LogRow> written;
+  // Two days on boot 0, a stall of six hours in the second, then a reboot
+  LogRow row = firstRow(0);
+  for(int i = 0; i < 2 * 1440; i++) {
+    row = typicalRow(row);
+    if(i == 2400) row.uptime += 6 * 3600;
+    appendRow(row);
+    written.push_back(row);
+  }
+  reboot();
+  row = firstRow(metricLogStats.boot);
+  for(int i = 0; i < 300; i++) {
+    row = typicalRow(row);
+    appendRow(row);
+    written.push_back(row);
+  }
+
+  const uint32_t day = 24 * 3600;
+  LogPoint points[128];
+  LogPoint expected[128];
+  uint32_t found = metricLogQuery(LOG_PRESSURE, day, points, 128);
+  TEST_ASSERT_EQUAL_UINT32(expectedPoints(written, day, expected, 128), found);
+  // A day of rows would be 1440; the stall leaves a quarter of the day empty
+  TEST_ASSERT_EQUAL_UINT32(1440 - 6 * 60, found);
+  for(int x = 0; x < 128; x++) {
+    TEST_ASSERT_EQUAL_UINT16(expected[x].rows, points[x].rows);
+    TEST_ASSERT_EQUAL_INT32(expected[x].min, points[x].min);
+    TEST_ASSERT_EQUAL_INT32(expected[x].max, points[x].max);
+  }
+  int empty = 0;
+  for(int x = 0; x < 128; x++) empty += points[x].rows == 0;
+  TEST_ASSERT_INT_WITHIN(2, 32, empty);
+
+  // An hour: the newest 60 rows, all from this boot
+  TEST_ASSERT_EQUAL_UINT32(60, metricLogQuery(LOG_PRESSURE, 3600, points, 128));
+  TEST_ASSERT_EQUAL_UINT16(1, points[127].rows);
+}
+
+void test_query_empty_log() {
+  LogPoint points[16];
+  TEST_ASSERT_EQUAL_UINT32(0, metricLogQuery(LOG_RSSI, 3600, points, 16));
+  for(int x = 0; x < 16; x++) TEST_ASSERT_EQUAL_UINT16(0, points[x].rows);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_signed_codes_round_trip);
+  RUN_TEST(test_rows_round_trip);
+  RUN_TEST(test_typical_row_size);
+  RUN_TEST(test_rotation_keeps_newest);
+  RUN_TEST(test_reset_recovers_pending_block);
+  RUN_TEST(test_no_filesystem_counts_dropped_rows);
+  RUN_TEST(test_query_window_is_time_not_rows);
+  RUN_TEST(test_query_empty_log);
+  return UNITY_END();
+}
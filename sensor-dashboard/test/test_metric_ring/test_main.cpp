@@ -0,0 +1,82 @@
+// Host tests for the O(1) window statistics against a brute-force rescan:
+// pio test -e native -f test_metric_ring
+#include <unity.h>
+#include "metric_ring.cpp"
+
+static MetricRing ring;
+
+void setUp() {
+  metricReset(ring);
+}
+
+void tearDown() {}
+
+void test_empty() {
+  TEST_ASSERT_EQUAL(0, metricCount(ring));
+  TEST_ASSERT_EQUAL(0, metricMean(ring));
+}
+
+void test_partial_window() {
+  metricPush(ring, 5);
+  metricPush(ring, -3);
+  metricPush(ring, 10);
+  TEST_ASSERT_EQUAL(3, metricCount(ring));
+  TEST_ASSERT_EQUAL(10, metricLatest(ring));
+  TEST_ASSERT_EQUAL(-3, metricAt(ring, 1));
+  TEST_ASSERT_EQUAL(5, metricAt(ring, 2));
+  TEST_ASSERT_EQUAL(-3, metricMin(ring));
+  TEST_ASSERT_EQUAL(10, metricMax(ring));
+  TEST_ASSERT_EQUAL(4, metricMean(ring));
+}
+
+// The extreme leaves the window exactly METRIC_HISTORY pushes later
+void test_extreme_expires() {
+  metricPush(ring, 1000);
+  for(int i = 0; i < METRIC_HISTORY - 1; i++) metricPush(ring, i % 10);
+  TEST_ASSERT_EQUAL(1000, metricMax(ring));
+  metricPush(ring, 3);
+  TEST_ASSERT_EQUAL(9, metricMax(ring));
+  TEST_ASSERT_EQUAL(METRIC_HISTORY, metricCount(ring));
+}
+
+// Random runs of small values, large values, plateaus and INT32 extremes,
+// checked after every push against a rescan of the last METRIC_HISTORY
+void test_matches_rescan() {
+  static int32_t all[20000];
+  uint32_t seed = 1;
+  for(int i = 0; i < 20000; i++) {
+    seed = seed * 1664525u + 1013904223u;
+    int32_t value;
+    if(i % 1000 < 300) value = (int32_t)(seed >> 24) - 128;
+    else if(i % 1000 < 600) value = (int32_t)seed;
+    else value = (i / 50) % 7;
+    if(i % 37 == 0) value = INT32_MIN;
+    if(i % 41 == 0) value = INT32_MAX;
+    all[i] = value;
+    metricPush(ring, value);
+
+    int count = i + 1 < METRIC_HISTORY ? i + 1 : METRIC_HISTORY;
+    int64_t sum = 0;
+    int32_t low = value, high = value;
+    for(int age = 0; age < count; age++) {
+      int32_t x = all[i - age];
+      TEST_ASSERT_EQUAL_INT32(x, metricAt(ring, age));
+      sum += x;
+      if(x < low) low = x;
+      if(x > high) high = x;
+    }
+    TEST_ASSERT_EQUAL(count, metricCount(ring));
+    TEST_ASSERT_EQUAL_INT32(low, metricMin(ring));
+    TEST_ASSERT_EQUAL_INT32(high, metricMax(ring));
+    TEST_ASSERT_EQUAL_INT32((int32_t)(sum / count), metricMean(ring));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty);
+  RUN_TEST(test_partial_window);
+  RUN_TEST(test_extreme_expires);
+  RUN_TEST(test_matches_rescan);
+  return UNITY_END();
+}
@@ -0,0 +1,253 @@
+// Host tests for the sleep logger's RTC ring, batching, retries and schedule
+// across simulated deep sleeps: pio test -e native -f test_sleep_logger
+#include <unity.h>
+#include <sys/time.h>
+#include <string>
+#include "sleep_logger.cpp"
+
+#define PERIOD_MS 60000UL
+#define BOOT_US 40000                 // timer wake to sleepLoggerRun()
+
+// The RTC clock runs on through deep sleep; here it is the simulated time
+extern "C" int gettimeofday(struct timeval *tv, void *tz) {
+  tv->tv_sec = shimMicros / 1000000;
+  tv->tv_usec = shimMicros % 1000000;
+  return 0;
+}
+
+extern "C" uint8_t temprature_sens_read() {
+  return 113;                         // 45 C
+}
+
+void i2cBusBegin(int sda, int scl) {}
+
+static bool sensorPresent = true;
+static int32_t sensorPressure = 101325;
+
+bool barometerStartForced(const BarometerConfig &config) {
+  return sensorPresent;
+}
+
+bool barometerReadForced(int32_t &pressurePa, int32_t &temperatureCenti) {
+  pressurePa = sensorPressure++;
+  temperatureCenti = 4500;
+  return true;
+}
+
+static const BarometerConfig barometer = {Adafruit_BMP280::SAMPLING_X1, Adafruit_BMP280::SAMPLING_X1,
+                                          Adafruit_BMP280::FILTER_OFF, Adafruit_BMP280::STANDBY_MS_1};
+static SleepLoggerConfig loggerConfig = {"ssid", "password", "broker", 1883, "", "", 4, 15, 0x3C,
+                                         &barometer, PERIOD_MS};
+
+// One wake from boot to deep sleep, then the sleep itself
+static void wake() {
+  shimMicros += BOOT_US;
+  bool slept = false;
+  try {
+    sleepLoggerRun(loggerConfig);
+  } catch(ShimDeepSleep &) {
+    slept = true;
+  }
+  TEST_ASSERT_TRUE(slept);
+  shimMicros += shimSleepUs;
+  shimWakeCause = ESP_SLEEP_WAKEUP_TIMER;
+}
+
+static void wakes(int count) {
+  for(int i = 0; i < count; i++) wake();
+}
+
+// Entries in one of a message's series
+static int seriesLength(const std::string &message, const char *name) {
+  std::string key = std::string("\"") + name + "\":[";
+  size_t start = message.find(key);
+  if(start == std::string::npos) return 0;
+  start += key.size();
+  size_t end = message.find(']', start);
+  int entries = 1;
+  for(size_t i = start; i < end; i++) entries += message[i] == ',';
+  return entries;
+}
+
+void setUp() {
+  memset(&state, 0x5A, sizeof(state));   // power-up garbage
+  shimMicros = 5000000;
+  shimWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+  shimWifiStatus = WL_CONNECTED;
+  shimWifiJoins = 0;
+  shimBrokerUp = true;
+  shimPublished.clear();
+  shimI2cWrites.clear();
+  sensorPresent = true;
+  loggerConfig.samplePeriodMs = PERIOD_MS;
+}
+
+void tearDown() {}
+
+void test_power_up_starts_empty() {
+  wake();
+  TEST_ASSERT_EQUAL_HEX32(LOGGER_MAGIC, state.magic);
+  TEST_ASSERT_EQUAL_UINT16(0, state.head);
+  TEST_ASSERT_EQUAL_UINT16(1, state.count);
+  TEST_ASSERT_EQUAL_UINT32(1, state.stats.wakes);
+  TEST_ASSERT_EQUAL_UINT32(0, state.stats.dropped);
+  TEST_ASSERT_EQUAL(80, getCpuFrequencyMhz());
+  TEST_ASSERT_EQUAL(0, shimWifiJoins);
+
+  // The panel is told to switch off
+  TEST_ASSERT_EQUAL(1, shimI2cWrites.size());
+  TEST_ASSERT_EQUAL_HEX8(0x3C, shimI2cWrites[0].address);
+  TEST_ASSERT_EQUAL_HEX8(SSD1306_DISPLAY_OFF, shimI2cWrites[0].bytes.back());
+}
+
+// Times count the schedule, not how long each wake took
+void test_samples_on_schedule() {
+  wakes(10);
+  TEST_ASSERT_EQUAL_UINT16(10, state.count);
+  for(uint16_t i = 0; i < 10; i++) {
+    const SleepSample &s = sampleAt(i);
+    TEST_ASSERT_EQUAL_UINT32(i * PERIOD_MS / 1000, s.time);
+    TEST_ASSERT_EQUAL_INT16(450, s.temperature);
+    TEST_ASSERT_EQUAL_UINT8(1, s.hasPressure);
+    TEST_ASSERT_TRUE(s.awakeUs >= s.wakeUs);
+  }
+  // After the first, each wake starts BOOT_US after it was due
+  TEST_ASSERT_EQUAL_UINT32(BOOT_US, sampleAt(1).wakeUs);
+  TEST_ASSERT_EQUAL_UINT32(0, state.stats.missed);
+  TEST_ASSERT_EQUAL_INT64(state.startUs + 10 * PERIOD_MS * 1000, state.dueUs);
+}
+
+// The wake that finds a full batch waiting publishes it and keeps its own sample
+void test_uploads_batch_and_keeps_own_sample() {
+  wakes(SLEEP_LOG_BATCH);
+  TEST_ASSERT_EQUAL(0, shimPublished.size());
+  wake();
+  TEST_ASSERT_EQUAL(1, shimPublished.size());
+  TEST_ASSERT_EQUAL(SLEEP_LOG_BATCH, seriesLength(shimPublished[0], "t"));
+  TEST_ASSERT_EQUAL(SLEEP_LOG_BATCH, seriesLength(shimPublished[0], "press"));
+  TEST_ASSERT_EQUAL(SLEEP_LOG_BATCH, seriesLength(shimPublished[0], "awake_us"));
+  TEST_ASSERT_TRUE(shimPublished[0].size() < SLEEP_LOG_PAYLOAD_BYTES);
+  TEST_ASSERT_EQUAL(0, shimPublished[0].find("{\"boot\":"));
+  TEST_ASSERT_TRUE(shimPublished[0].find("\"t\":[0,60,60,") != std::string::npos);
+
+  TEST_ASSERT_EQUAL_UINT16(1, state.count);
+  TEST_ASSERT_EQUAL_UINT32(SLEEP_LOG_BATCH * PERIOD_MS / 1000, sampleAt(0).time);
+  TEST_ASSERT_EQUAL_UINT32(1, state.stats.uploads);
+  TEST_ASSERT_EQUAL_UINT32(SLEEP_LOG_BATCH, state.stats.published);
+  TEST_ASSERT_EQUAL_UINT32(1, state.stats.uploadWakes);
+  TEST_ASSERT_EQUAL(WIFI_OFF, shimWifiMode);
+}
+
+// A failed upload keeps the queue and waits another batch before trying again
+void test_failed_upload_retries_after_a_batch() {
+  shimBrokerUp = false;
+  wakes(SLEEP_LOG_BATCH + 1);
+  TEST_ASSERT_EQUAL_UINT32(1, state.stats.failures);
+  TEST_ASSERT_EQUAL_UINT16(SLEEP_LOG_BATCH, state.retryIn);
+  TEST_ASSERT_EQUAL_UINT16(SLEEP_LOG_BATCH + 1, state.count);
+
+  shimBrokerUp = true;
+  int joins = shimWifiJoins;
+  wakes(SLEEP_LOG_BATCH);
+  TEST_ASSERT_EQUAL(joins, shimWifiJoins);
+  TEST_ASSERT_EQUAL(0, shimPublished.size());
+
+  // Everything but the new sample, oldest first, a batch per message
+  wake();
+  TEST_ASSERT_EQUAL(3, shimPublished.size());
+  TEST_ASSERT_EQUAL(SLEEP_LOG_BATCH, seriesLength(shimPublished[0], "t"));
+  TEST_ASSERT_EQUAL(SLEEP_LOG_BATCH, seriesLength(shimPublished[1], "t"));
+  TEST_ASSERT_EQUAL(1, seriesLength(shimPublished[2], "t"));
+  TEST_ASSERT_TRUE(shimPublished[0].find("\"t\":[0,") != std::string::npos);
+  TEST_ASSERT_EQUAL_UINT32(2 * SLEEP_LOG_BATCH + 1, state.stats.published);
+  TEST_ASSERT_EQUAL_UINT16(1, state.count);
+  TEST_ASSERT_EQUAL_UINT32(0, state.stats.dropped);
+}
+
+// A full ring overwrites the oldest and counts them
+void test_full_ring_drops_oldest() {
+  shimBrokerUp = false;
+  const int total = SLEEP_LOG_SAMPLES + 58;
+  wakes(total);
+  TEST_ASSERT_EQUAL_UINT16(SLEEP_LOG_SAMPLES, state.count);
+  TEST_ASSERT_EQUAL_UINT32(total - SLEEP_LOG_SAMPLES, state.stats.dropped);
+  for(uint16_t i = 0; i < SLEEP_LOG_SAMPLES; i++) {
+    TEST_ASSERT_EQUAL_UINT32((total - SLEEP_LOG_SAMPLES + i) * PERIOD_MS / 1000, sampleAt(i).time);
+  }
+
+  shimBrokerUp = true;
+  while(shimPublished.empty()) wake();
+  TEST_ASSERT_EQUAL_UINT32(SLEEP_LOG_SAMPLES - 1, state.stats.published);
+  TEST_ASSERT_EQUAL_UINT32(state.stats.wakes - SLEEP_LOG_SAMPLES, state.stats.dropped);
+  TEST_ASSERT_EQUAL_UINT32(state.stats.wakes, state.stats.published + state.stats.dropped + state.count);
+}
+
+// Messages split where the pressure reading comes or goes
+void test_batch_splits_on_missing_pressure() {
+  wakes(10);
+  sensorPresent = false;
+  wakes(SLEEP_LOG_BATCH - 10);
+  sensorPresent = true;
+  wake();
+  TEST_ASSERT_EQUAL(2, shimPublished.size());
+  TEST_ASSERT_EQUAL(10, seriesLength(shimPublished[0], "press"));
+  TEST_ASSERT_EQUAL(SLEEP_LOG_BATCH - 10, seriesLength(shimPublished[1], "t"));
+  TEST_ASSERT_TRUE(shimPublished[1].find("\"press\"") == std::string::npos);
+  TEST_ASSERT_EQUAL_UINT32(SLEEP_LOG_BATCH, state.stats.published);
+}
+
+// A reset keeps the ring; the schedule restarts and times carry on
+void test_reset_keeps_queue() {
+  wakes(10);
+  uint32_t boot = state.boot;
+  shimWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+  shimMicros = 2000000;               // and the clock went back with it
+  wake();
+  TEST_ASSERT_EQUAL_UINT32(boot, state.boot);
+  TEST_ASSERT_EQUAL_UINT16(11, state.count);
+  TEST_ASSERT_EQUAL_UINT32(10 * PERIOD_MS / 1000, sampleAt(10).time);
+  wake();
+  TEST_ASSERT_EQUAL_UINT32(11 * PERIOD_MS / 1000, sampleAt(11).time);
+}
+
+// RTC memory that doesn't hold a valid ring is a power cut: start over
+void test_power_cut_starts_over() {
+  wakes(10);
+  state.magic = 0;
+  shimWakeCause = ESP_SLEEP_WAKEUP_UNDEFINED;
+  wake();
+  TEST_ASSERT_EQUAL_UINT16(1, state.count);
+  TEST_ASSERT_EQUAL_UINT32(1, state.stats.wakes);
+  TEST_ASSERT_EQUAL_UINT32(0, sampleAt(0).time);
+
+  // Likewise a head or count past the ring
+  state.count = SLEEP_LOG_SAMPLES + 1;
+  wake();
+  TEST_ASSERT_EQUAL_UINT16(1, state.count);
+}
+
+// A wake that runs past the next slot skips it rather than waking at once
+void test_overrun_skips_slots() {
+  loggerConfig.samplePeriodMs = 5000;
+  shimWifiStatus = WL_DISCONNECTED;   // the upload waits out the Wi-Fi timeout
+  wakes(SLEEP_LOG_BATCH + 1);
+  TEST_ASSERT_EQUAL_UINT32(1, state.stats.failures);
+  TEST_ASSERT_TRUE(sampleAt(SLEEP_LOG_BATCH).awakeUs > SLEEP_LOG_CONNECT_MS * 1000);
+  TEST_ASSERT_EQUAL_UINT32(1, state.stats.missed);
+  wake();
+  TEST_ASSERT_EQUAL_UINT32(sampleAt(SLEEP_LOG_BATCH).time + 10, sampleAt(SLEEP_LOG_BATCH + 1).time);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_power_up_starts_empty);
+  RUN_TEST(test_samples_on_schedule);
+  RUN_TEST(test_uploads_batch_and_keeps_own_sample);
+  RUN_TEST(test_failed_upload_retries_after_a_batch);
+  RUN_TEST(test_full_ring_drops_oldest);
+  RUN_TEST(test_batch_splits_on_missing_pressure);
+  RUN_TEST(test_reset_keeps_queue);
+  RUN_TEST(test_power_cut_starts_over);
+  RUN_TEST(test_overrun_skips_slots);
+  return UNITY_END();
+}
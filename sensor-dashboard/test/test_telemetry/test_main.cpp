@@ -0,0 +1,279 @@
+// Host tests for the telemetry queue against a fake broker: batching, the
+// flash backlog through an outage and a reboot, and redelivery after a lost
+// PUBACK. pio test -e native -f test_telemetry
+//
+// The broker is test/shim/MQTT.h, not a real one: the QoS 1 round trip over
+// a network isn't exercised here.
+#include <unity.h>
+#include <vector>
+#include "metric_ring.cpp"
+#include "telemetry.cpp"
+
+#define SAMPLE_MS 10000UL
+#define PUBLISH_MS 60000UL
+
+MetricRing metrics[METRIC_COUNT];
+MetricLogStats metricLogStats;
+void samplerLock() {}
+void samplerUnlock() {}
+
+static const TelemetryConfig CONFIG = {"localhost", 1883, "", "", SAMPLE_MS, PUBLISH_MS};
+
+struct Sample {
+  long boot, t, heap, temp, press, rssi;
+  bool operator==(const Sample &o) const {
+    return boot == o.boot && t == o.t && heap == o.heap && temp == o.temp && press == o.press && rssi == o.rssi;
+  }
+};
+
+static std::vector<Sample> taken;
+static uint32_t seed = 1;
+static int32_t readings[METRIC_COUNT];
+
+static uint32_t nextRandom() {
+  seed = seed * 1664525u + 1013904223u;
+  return seed >> 8;
+}
+
+// A value that changes with probability `percent` by up to +/-`step`
+static int32_t drift(int32_t value, int percent, int step) {
+  if((int)(nextRandom() % 100) >= percent) return value;
+  return value + (int32_t)(nextRandom() % (2 * step + 1)) - step;
+}
+
+// The sampler's readings once a second, then one 100 ms pass of the task;
+// remembers each sample taken
+static void tick() {
+  if(millis() % 1000 == 0) {
+    readings[METRIC_FREE_HEAP] = drift(readings[METRIC_FREE_HEAP], 30, 400);
+    readings[METRIC_TEMPERATURE] = drift(readings[METRIC_TEMPERATURE], 10, 1);
+    readings[METRIC_PRESSURE] = drift(readings[METRIC_PRESSURE], 30, 3);
+    readings[METRIC_RSSI] = drift(readings[METRIC_RSSI], 10, 2);
+    static const Metric SAMPLED[] = {METRIC_FREE_HEAP, METRIC_TEMPERATURE, METRIC_PRESSURE, METRIC_RSSI};
+    for(Metric m : SAMPLED) metricPush(metrics[m], readings[m]);
+  }
+
+  uint32_t before = telemetryStats.samples;
+  telemetryStep(millis());
+  if(telemetryStats.samples != before) {
+    Sample s = {metricLogStats.boot, (long)(millis() / 1000), metricLatest(metrics[METRIC_FREE_HEAP]),
+                metricLatest(metrics[METRIC_TEMPERATURE]), metricLatest(metrics[METRIC_PRESSURE]),
+                metricLatest(metrics[METRIC_RSSI])};
+    taken.push_back(s);
+  }
+  delay(100);
+}
+
+static void run(unsigned long ms) {
+  for(unsigned long t = 0; t < ms; t += 100) tick();
+}
+
+// Values of one delta-coded series, e.g. "heap":[180000,12,-3]
+static std::vector<long> series(const std::string &payload, const char *name) {
+  std::vector<long> values;
+  std::string key = std::string("\"") + name + "\":[";
+  size_t at = payload.find(key);
+  if(at == std::string::npos) return values;
+  const char *p = payload.c_str() + at + key.size();
+  long sum = 0;
+  while(*p && *p != ']') {
+    char *end;
+    sum += strtol(p, &end, 10);
+    values.push_back(sum);
+    p = *end == ',' ? end + 1 : end;
+  }
+  return values;
+}
+
+static std::vector<Sample> decode(const std::vector<std::string> &messages) {
+  std::vector<Sample> samples;
+  for(const std::string &m : messages) {
+    long boot = strtol(m.c_str() + m.find("\"boot\":") + 7, nullptr, 10);
+    std::vector<long> t = series(m, "t"), heap = series(m, "heap"), temp = series(m, "temp");
+    std::vector<long> press = series(m, "press"), rssi = series(m, "rssi");
+    TEST_ASSERT_EQUAL(t.size(), heap.size());
+    TEST_ASSERT_EQUAL(t.size(), temp.size());
+    TEST_ASSERT_EQUAL(t.size(), press.size());
+    TEST_ASSERT_EQUAL(t.size(), rssi.size());
+    for(size_t i = 0; i < t.size(); i++) samples.push_back({boot, t[i], heap[i], temp[i], press[i], rssi[i]});
+  }
+  return samples;
+}
+
+// Everything published is a contiguous run of what was taken, in order
+static size_t assertRunOfTaken(const std::vector<Sample> &published) {
+  TEST_ASSERT_FALSE(published.empty());
+  size_t first = 0;
+  while(first < taken.size() && !(taken[first] == published[0])) first++;
+  TEST_ASSERT_TRUE_MESSAGE(first < taken.size(), "first published sample was never taken");
+  TEST_ASSERT_TRUE(first + published.size() <= taken.size());
+  for(size_t i = 0; i < published.size(); i++) TEST_ASSERT_TRUE(taken[first + i] == published[i]);
+  return first;
+}
+
+// A reset: RAM state goes, flash stays
+static void reboot() {
+  ramHead = ramCount = 0;
+  spillAvailable = haveSegments = lastSegmentFull = false;
+  firstSegment = lastSegment = 0;
+  memset(segmentSamples, 0, sizeof(segmentSamples));
+  readOffset = 0;
+  lastAttempt = 0;
+  retryMs = RETRY_MIN_MS;
+  telemetryStats = TelemetryStats();
+  metricLogStats.boot++;
+  telemetryBegin(CONFIG);
+}
+
+void setUp() {
+  seed = 1;
+  shimMicros = 1000000;
+  LittleFS.reset();
+  shimBrokerUp = true;
+  shimDropAcks = 0;
+  shimWifiStatus = WL_CONNECTED;
+  shimPublished.clear();
+  shimUnacked.clear();
+  taken.clear();
+  for(int m = 0; m < METRIC_COUNT; m++) metricReset(metrics[m]);
+  readings[METRIC_FREE_HEAP] = 180000;
+  readings[METRIC_TEMPERATURE] = 450;
+  readings[METRIC_PRESSURE] = 101325;
+  readings[METRIC_RSSI] = -60;
+  metricLogStats.boot = 6;
+  reboot();
+}
+
+void tearDown() {}
+
+void test_online_publishes_every_sample_once() {
+  run(3600000);
+  std::vector<Sample> published = decode(shimPublished);
+  TEST_ASSERT_EQUAL_size_t(0, assertRunOfTaken(published));
+  // The newest few wait for the next publish
+  TEST_ASSERT_UINT32_WITHIN(PUBLISH_MS / SAMPLE_MS, taken.size(), published.size());
+  TEST_ASSERT_EQUAL_UINT32(published.size(), telemetryStats.published);
+  TEST_ASSERT_EQUAL_UINT32(0, telemetryStats.spilled);
+  TEST_ASSERT_EQUAL_UINT32(0, telemetryStats.dropped);
+  // Once a minute, six samples each
+  TEST_ASSERT_UINT32_WITHIN(1, 60, shimPublished.size());
+}
+
+void test_outage_spills_to_flash_and_drains_in_order() {
+  run(600000);
+  shimBrokerUp = false;
+  run(8 * 3600000UL);
+  // RAM spills a batch at a time once full
+  TEST_ASSERT_GREATER_THAN(TELEMETRY_RAM_SAMPLES - TELEMETRY_SPILL_SAMPLES, ramCount);
+  TEST_ASSERT_GREATER_THAN(0, telemetryStats.flashQueued);
+  TEST_ASSERT_EQUAL_UINT32(0, telemetryStats.dropped);
+
+  shimBrokerUp = true;
+  unsigned long start = millis();
+  while(queued() > PUBLISH_MS / SAMPLE_MS) tick();
+  // Rate-limited drain: a batch per TELEMETRY_DRAIN_MS
+  unsigned long drainMs = millis() - start;
+  TEST_ASSERT_TRUE(drainMs >= (taken.size() / TELEMETRY_BATCH - 1) * TELEMETRY_DRAIN_MS);
+  run(PUBLISH_MS);
+
+  std::vector<Sample> published = decode(shimPublished);
+  TEST_ASSERT_EQUAL_size_t(0, assertRunOfTaken(published));
+  TEST_ASSERT_UINT32_WITHIN(PUBLISH_MS / SAMPLE_MS, taken.size(), published.size());
+  TEST_ASSERT_EQUAL_UINT32(0, telemetryStats.flashQueued);
+  TEST_ASSERT_EQUAL_size_t(0, shimFiles.size());
+}
+
+void test_reboot_keeps_the_flash_backlog() {
+  shimBrokerUp = false;
+  run(3 * 3600000UL);
+  uint32_t onFlash = telemetryStats.flashQueued;
+  uint32_t inRam = ramCount;
+  TEST_ASSERT_GREATER_THAN(0, onFlash);
+
+  reboot();
+  TEST_ASSERT_EQUAL_UINT32(onFlash, telemetryStats.flashQueued);
+  std::vector<Sample> flashed(taken.begin(), taken.begin() + onFlash);
+  std::vector<Sample> lost(taken.end() - inRam, taken.end());
+  taken.clear();
+
+  shimBrokerUp = true;
+  run(10 * 60000UL);
+  std::vector<Sample> published = decode(shimPublished);
+  // The flash backlog first, in order, then this boot's samples
+  TEST_ASSERT_TRUE(published.size() > onFlash);
+  for(size_t i = 0; i < onFlash; i++) TEST_ASSERT_TRUE(flashed[i] == published[i]);
+  std::vector<Sample> after(published.begin() + onFlash, published.end());
+  TEST_ASSERT_EQUAL_size_t(0, assertRunOfTaken(after));
+  for(const Sample &s : published) TEST_ASSERT_FALSE(s == lost[0]);
+}
+
+void test_long_outage_drops_the_oldest() {
+  shimBrokerUp = false;
+  run(20 * 3600000UL);
+  TEST_ASSERT_GREATER_THAN(0, telemetryStats.dropped);
+  // Whole segments go, so the newest may be part full
+  TEST_ASSERT_GREATER_THAN((TELEMETRY_MAX_SEGMENTS - 1) * TELEMETRY_SEGMENT_SAMPLES, telemetryStats.flashQueued);
+  TEST_ASSERT_LESS_OR_EQUAL(TELEMETRY_MAX_SEGMENTS * TELEMETRY_SEGMENT_SAMPLES, telemetryStats.flashQueued);
+  TEST_ASSERT_EQUAL_UINT32(taken.size(), telemetryStats.dropped + queued());
+
+  shimBrokerUp = true;
+  while(queued() > PUBLISH_MS / SAMPLE_MS) tick();
+  std::vector<Sample> published = decode(shimPublished);
+  // Everything after the dropped ones
+  TEST_ASSERT_EQUAL_size_t(telemetryStats.dropped, assertRunOfTaken(published));
+}
+
+void test_lost_puback_resends_the_same_batch() {
+  run(PUBLISH_MS - 100);
+  shimDropAcks = 1;
+  run(PUBLISH_MS);
+  TEST_ASSERT_EQUAL_UINT32(1, telemetryStats.failures);
+  TEST_ASSERT_EQUAL_size_t(1, shimUnacked.size());
+  run(2 * PUBLISH_MS);
+
+  // The broker saw the unacknowledged message, and then the same samples again
+  std::vector<Sample> unacked = decode(shimUnacked);
+  std::vector<Sample> published = decode(shimPublished);
+  TEST_ASSERT_EQUAL_size_t(0, assertRunOfTaken(published));
+  TEST_ASSERT_TRUE(published.size() >= unacked.size());
+  size_t start = 0;
+  while(start < published.size() && !(published[start] == unacked[0])) start++;
+  TEST_ASSERT_TRUE(start + unacked.size() <= published.size());
+  for(size_t i = 0; i < unacked.size(); i++) TEST_ASSERT_TRUE(unacked[i] == published[start + i]);
+}
+
+// Bytes per sample, as the README quotes them, against plain JSON
+void test_payload_is_compact() {
+  run(3600000);
+  double online = (double)telemetryStats.payloadBytes / telemetryStats.published;
+  uint64_t bytes = telemetryStats.payloadBytes;
+  uint32_t samples = telemetryStats.published;
+
+  shimBrokerUp = false;
+  run(2 * 3600000UL);
+  shimBrokerUp = true;
+  while(queued() > PUBLISH_MS / SAMPLE_MS) tick();
+  double backlog = (double)(telemetryStats.payloadBytes - bytes) / (telemetryStats.published - samples);
+
+  char plain[96];
+  const Sample &last = taken.back();
+  int plainBytes = snprintf(plain, sizeof(plain), "{\"boot\":%ld,\"t\":%ld,\"heap\":%ld,\"temp\":%ld,\"press\":%ld,\"rssi\":%ld}",
+                            last.boot, last.t, last.heap, last.temp, last.press, last.rssi);
+  char message[112];
+  snprintf(message, sizeof(message), "Bytes per sample: %.1f once a minute, %.1f draining a backlog, %d as plain JSON",
+           online, backlog, plainBytes);
+  TEST_MESSAGE(message);
+  TEST_ASSERT_TRUE(online < plainBytes / 2.0);
+  TEST_ASSERT_TRUE(backlog < online);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_online_publishes_every_sample_once);
+  RUN_TEST(test_outage_spills_to_flash_and_drains_in_order);
+  RUN_TEST(test_reboot_keeps_the_flash_backlog);
+  RUN_TEST(test_long_outage_drops_the_oldest);
+  RUN_TEST(test_lost_puback_resends_the_same_batch);
+  RUN_TEST(test_payload_is_compact);
+  return UNITY_END();
+}